@@ -259,12 +259,12 @@ void CmdSetTransform::redo(Scene& s, SceneRenderer& /*r*/, SelectionState& /*sel
 {
     if (nodeIdx < 0 || nodeIdx >= (int)s.nodes.size()) return;
     s.nodes[nodeIdx].localMatrix = after;
-    s.geometryDirty = true;
+    s.markTransformDirty(nodeIdx);
 }
 
 void CmdSetTransform::undo(Scene& s, SceneRenderer& /*r*/, SelectionState& /*sel*/)
 {
     if (nodeIdx < 0 || nodeIdx >= (int)s.nodes.size()) return;
     s.nodes[nodeIdx].localMatrix = before;
-    s.geometryDirty = true;
+    s.markTransformDirty(nodeIdx);
 }
@@ -235,7 +235,10 @@ void EditorUI::renderStats(SceneRenderer& renderer, Scene& scene, vex::GraphicsC
             ImGui::Text("Sample:      %u", sampleCount);
 
         float sps = renderer.getSamplesPerSec();
-        if (sps >= 1000.0f)
+        float rps = renderer.getRaysPerSec();
+        if (rps > 0.0f)
+            ImGui::Text("Rays/sec:    %.2f M", rps * 1e-6f);
+        else if (sps >= 1000.0f)
             ImGui::Text("Samples/sec: %.1f k", sps / 1000.0f);
         else if (sps > 0.0f)
             ImGui::Text("Samples/sec: %.1f", sps);
@@ -262,6 +265,31 @@ void EditorUI::renderStats(SceneRenderer& renderer, Scene& scene, vex::GraphicsC
             ImGui::Text("Light tris:  %zu", lightTris);
             ImGui::Text("Light area:  %.2f m\xc2\xb2", renderer.getTotalLightArea());
         }
+
+        // Worker utilization of the last sample: idle time is spent waiting
+        // on the slowest worker once no tiles are left to steal
+        const auto& workers = renderer.getCPUWorkerStats();
+        if (mode == RenderMode::CPURaytrace && !workers.empty())
+        {
+            float busy = 0.0f, total = 0.0f;
+            for (const auto& w : workers)
+            {
+                busy  += w.busyMs;
+                total += w.busyMs + w.idleMs;
+            }
+            ImGui::Text("Utilization: %.0f%% of %zu workers", total > 0.0f ? 100.0f * busy / total : 0.0f,
+                        workers.size());
+            if (ImGui::TreeNode("Workers"))
+            {
+                for (size_t i = 0; i < workers.size(); ++i)
+                {
+                    const auto& w = workers[i];
+                    ImGui::Text("%2zu: busy %6.2f ms  idle %6.2f ms  %u tiles  %u steals",
+                                i, w.busyMs, w.idleMs, w.tiles, w.steals);
+                }
+                ImGui::TreePop();
+            }
+        }
     }
 
     // --- Scene ---
@@ -341,7 +369,17 @@ void EditorUI::renderStats(SceneRenderer& renderer, Scene& scene, vex::GraphicsC
         float sahCost = renderer.getBVHSAHCost();
         if (sahCost > 0.0f)
             ImGui::Text("SAH cost: %.1f", sahCost);
+        float dupRatio = renderer.getBVHDuplicationRatio();
+        if (dupRatio > 1.0f)
+            ImGui::Text("Refs:     %.2fx (spatial splits)", dupRatio);
         ImGui::Text("Memory:   %.1f KB", static_cast<float>(bvhMem) / 1024.0f);
+        // Traversal layouts that differ from the binary build (wide / compressed)
+        size_t cpuMem = renderer.getCPUBVHMemoryBytes();
+        if (cpuMem > 0 && cpuMem != bvhMem)
+            ImGui::Text("CPU nodes: %.1f KB", static_cast<float>(cpuMem) / 1024.0f);
+        size_t gpuMem = renderer.getGPUBVHMemoryBytes();
+        if (gpuMem > 0 && gpuMem != bvhMem)
+            ImGui::Text("GPU nodes: %.1f KB", static_cast<float>(gpuMem) / 1024.0f);
     }
 
     // --- Viewport ---
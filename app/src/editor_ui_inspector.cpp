@@ -204,13 +204,13 @@ void EditorUI::renderInspector(Scene& scene, SceneRenderer& renderer)
                                      * glm::scale(glm::mat4(1.f), decompScale);
                 }
                 if (released && renderer.getRenderMode() != RenderMode::Rasterize)
-                    scene.geometryDirty = true;
+                    scene.markTransformDirty(m_selection->index);
 
                 if (ImGui::Button("Reset Transform"))
                 {
                     node.localMatrix = glm::mat4(1.f);
                     if (renderer.getRenderMode() != RenderMode::Rasterize)
-                        scene.geometryDirty = true;
+                        scene.markTransformDirty(m_selection->index);
                 }
                 ImGui::SameLine();
                 if (ImGui::Button("Duplicate"))
@@ -249,6 +249,8 @@ void EditorUI::renderInspector(Scene& scene, SceneRenderer& renderer)
                     ImGui::Text("  Min: (%.2f, %.2f, %.2f)", root.min.x, root.min.y, root.min.z);
                     ImGui::Text("  Max: (%.2f, %.2f, %.2f)", root.max.x, root.max.y, root.max.z);
                     ImGui::Text("SAH Cost: %.1f", renderer.getBVHSAHCost());
+                    if (renderer.getBVHDuplicationRatio() > 1.0f)
+                        ImGui::Text("Duplication: %.2fx refs", renderer.getBVHDuplicationRatio());
                     size_t mem = renderer.getBVHMemoryBytes();
                     if (mem < 1024)
                         ImGui::Text("Memory: %zu B", mem);
@@ -7,6 +7,70 @@
 #include <cmath>
 #include <iterator>
 
+// BVH build controls shared by every mode that traverses the CPU-built BVH.
+// Changes are applied through a geometry rebuild on the next frame.
+static void renderBVHBuildSettings(SceneRenderer& renderer, const char* id)
+{
+    ImGui::PushID(id);
+    vex::BVHBuildOptions opts = renderer.getBVHBuildOptions();
+    bool changed = ImGui::Checkbox("Spatial Splits (SBVH)", &opts.spatialSplits);
+    if (ImGui::IsItemHovered())
+        ImGui::SetTooltip("Split triangles that straddle a node boundary instead of\nletting child boxes overlap. Slower, single-threaded build;\nfaster traversal on long/diagonal triangles.");
+    ImGui::BeginDisabled(!opts.spatialSplits);
+    float budgetPct = opts.spatialSplitBudget * 100.0f;
+    if (ImGui::SliderFloat("Duplication Budget", &budgetPct, 0.0f, 100.0f, "%.0f%%"))
+    {
+        opts.spatialSplitBudget = budgetPct / 100.0f;
+        changed = true;
+    }
+    if (ImGui::IsItemHovered())
+        ImGui::SetTooltip("Maximum extra triangle references, relative to the triangle count.");
+    ImGui::EndDisabled();
+    int leafSize = static_cast<int>(opts.leafSize);
+    if (ImGui::SliderInt("Leaf Size", &leafSize, 1, 8))
+    {
+        opts.leafSize = static_cast<uint32_t>(leafSize);
+        changed = true;
+    }
+    if (ImGui::IsItemHovered())
+        ImGui::SetTooltip("Triangle count at which the SAH and LBVH builds\nstop splitting. The CPU tracer tests 4 triangles per\nSIMD step, so larger leaves give shallower trees\nat little leaf cost.");
+    int optimizePasses = static_cast<int>(opts.optimizePasses);
+    if (ImGui::SliderInt("Optimize Passes", &optimizePasses, 0, 16))
+    {
+        opts.optimizePasses = static_cast<uint32_t>(optimizePasses);
+        changed = true;
+    }
+    if (ImGui::IsItemHovered())
+        ImGui::SetTooltip("Passes after each final-quality build moving subtrees to\nlower-cost positions (reinsertion). 0 = off.");
+    float budgetMs = opts.optimizeBudgetMs;
+    if (ImGui::SliderFloat("Optimize Budget", &budgetMs, 0.0f, 5000.0f, budgetMs > 0.0f ? "%.0f ms" : "No limit"))
+    {
+        opts.optimizeBudgetMs = budgetMs;
+        changed = true;
+    }
+    if (ImGui::IsItemHovered())
+        ImGui::SetTooltip("Time limit for those passes. A build stopped by it is not\nwritten to the disk cache, since it is not reproducible.");
+    if (changed)
+        renderer.setBVHBuildOptions(opts);
+
+    bool diskCache = renderer.getGeometryDiskCache();
+    if (ImGui::Checkbox("Disk Cache", &diskCache))
+        renderer.setGeometryDiskCache(diskCache);
+    if (ImGui::IsItemHovered())
+        ImGui::SetTooltip("Save the built BVH and flattened triangles under %s and\nreload them when the same scene is opened with the same settings.",
+                          SceneRenderer::GEOMETRY_CACHE_DIR);
+
+    bool fastEdits = renderer.getFastEditRebuilds();
+    if (ImGui::Checkbox("Fast Rebuilds While Editing (LBVH)", &fastEdits))
+        renderer.setFastEditRebuilds(fastEdits);
+    if (ImGui::IsItemHovered())
+        ImGui::SetTooltip("Rebuild with the Morton-code LBVH after an edit, then swap in\na SAH tree built in the background once editing stops.");
+
+    float ratio = renderer.getBVHDuplicationRatio();
+    ImGui::TextDisabled("SAH %.1f, %.2fx refs", renderer.getBVHSAHCost(), ratio);
+    ImGui::PopID();
+}
+
 void EditorUI::renderSettings(SceneRenderer& renderer)
 {
     ImGui::Begin("Settings");
@@ -99,16 +163,25 @@ void EditorUI::renderSettings(SceneRenderer& renderer)
         {
             uint32_t samples = renderer.getRaytraceSampleCount();
             uint32_t maxSamp = renderer.getMaxSamples();
-            if (maxSamp > 0 && samples >= maxSamp)
+            // With adaptive sampling, samples counts passes: the per-pixel
+            // count of every tile that has not converged yet
+            const bool adaptive = renderer.getCPURTSettings().adaptiveSampling;
+            const float converged = adaptive ? renderer.getCPUConvergedTileFraction() : 0.0f;
+            if ((maxSamp > 0 && samples >= maxSamp) || converged >= 1.0f)
             {
                 ImGui::PushStyleColor(ImGuiCol_Text, ImVec4(0.4f, 1.0f, 0.4f, 1.0f));
-                ImGui::Text("Samples: %u / %u  (converged)", samples, maxSamp);
+                if (maxSamp > 0)
+                    ImGui::Text("Samples: %u / %u  (converged)", samples, maxSamp);
+                else
+                    ImGui::Text("Samples: %u  (converged)", samples);
                 ImGui::PopStyleColor();
             }
             else if (maxSamp > 0)
                 ImGui::Text("Samples: %u / %u", samples, maxSamp);
             else
                 ImGui::Text("Samples: %u", samples);
+            if (adaptive)
+                ImGui::TextDisabled("Converged tiles: %.0f%%", converged * 100.0f);
         }
         {
             int v = static_cast<int>(renderer.getMaxSamples());
@@ -141,15 +214,53 @@ void EditorUI::renderSettings(SceneRenderer& renderer)
             ImGui::Checkbox("Next Event Estimation", &renderer.getCPURTSettings().enableNEE);
             ImGui::Checkbox("Russian Roulette", &renderer.getCPURTSettings().enableRR);
             ImGui::Checkbox("Anti-Aliasing", &renderer.getCPURTSettings().enableAA);
+
+            const char* samplerItems[] = { "PCG (Default)", "Sobol (Owen)", "Blue Noise (IGN)" };
+            ImGui::Combo("Sampler##cpu", &renderer.getCPURTSettings().samplerType, samplerItems, 3);
+            if (ImGui::IsItemHovered())
+                ImGui::SetTooltip("PCG: pseudo-random\nSobol: Owen-scrambled low-discrepancy, faster convergence\nBlue Noise: Sobol shifted per pixel, error spread as blue noise");
             ImGui::Checkbox("Firefly Clamping", &renderer.getCPURTSettings().enableFireflyClamping);
             if (renderer.getCPURTSettings().enableFireflyClamping)
                 ImGui::SliderFloat("Clamp Threshold##cpu", &renderer.getCPURTSettings().fireflyClampThreshold, 1.0f, 100.0f, "%.1f");
 
+            ImGui::Checkbox("Light BVH##cpu", &renderer.getCPURTSettings().lightBVH);
+            if (ImGui::IsItemHovered())
+                ImGui::SetTooltip("Pick emissive triangles by their estimated contribution at the\nshading point (power, distance, orientation). Much faster\nconvergence in scenes with many small emitters.");
+
+            ImGui::Checkbox("Solid Angle Light Sampling##cpu", &renderer.getCPURTSettings().sphericalLights);
+            if (ImGui::IsItemHovered())
+                ImGui::SetTooltip("Sample directions inside the solid angle of the chosen emissive\ntriangle instead of points on its area. Much less noise from\nlarge, close emitters such as ceiling panels.");
+
+            ImGui::Checkbox("Path Guiding##cpu", &renderer.getCPURTSettings().pathGuiding);
+            if (ImGui::IsItemHovered())
+                ImGui::SetTooltip("Learn where light arrives from over the passes and send half of\nthe bounces that way. Helps interiors lit through openings or by\nbounced light; learning restarts whenever accumulation does.");
+            ImGui::BeginDisabled(!renderer.getCPURTSettings().pathGuiding);
+            ImGui::SliderInt("Guide Memory##cpu", &renderer.getCPURTSettings().pathGuideMemoryMB, 4, 1024, "%d MB",
+                             ImGuiSliderFlags_Logarithmic);
+            ImGui::EndDisabled();
+
             bool lumCDF = renderer.getUseLuminanceCDF();
             if (ImGui::Checkbox("Luminance CDF", &lumCDF))
                 renderer.setUseLuminanceCDF(lumCDF);
             if (ImGui::IsItemHovered())
-                ImGui::SetTooltip("Weight emissive triangle sampling by luminance x area\ninstead of area alone. Improves convergence for scenes\nwith bright emitters of varying color/intensity.");
+                ImGui::SetTooltip("Weight emissive triangle sampling by luminance x area\ninstead of area alone. Improves convergence for scenes\nwith bright emitters of varying color/intensity.\nThe light BVH always weights by luminance.");
+
+            ImGui::Checkbox("Adaptive Sampling", &renderer.getCPURTSettings().adaptiveSampling);
+            if (ImGui::IsItemHovered())
+                ImGui::SetTooltip("16x16 tiles whose estimated error drops below the threshold\nstop receiving samples; later passes go to the noisy ones.");
+            ImGui::BeginDisabled(!renderer.getCPURTSettings().adaptiveSampling);
+            ImGui::SliderFloat("Error Threshold##cpu", &renderer.getCPURTSettings().adaptiveThreshold, 0.001f, 0.1f, "%.3f",
+                               ImGuiSliderFlags_Logarithmic);
+            ImGui::SliderInt("Min Samples##cpu", &renderer.getCPURTSettings().adaptiveMinSamples, 2, 256);
+            ImGui::Checkbox("Show Sample Counts", &renderer.getCPURTSettings().showSampleCounts);
+            if (ImGui::IsItemHovered())
+                ImGui::SetTooltip("Per-pixel sample counts, blue (few) to red (every pass).");
+            ImGui::EndDisabled();
+
+            ImGui::SliderFloat("Frame Budget##cpu", &renderer.getCPURTSettings().frameBudgetMs, 0.0f, 50.0f,
+                               renderer.getCPURTSettings().frameBudgetMs > 0.0f ? "%.1f ms" : "Off");
+            if (ImGui::IsItemHovered())
+                ImGui::SetTooltip("Trace for this long each frame, continuing a pass across frames,\ninstead of sampling in the background. Off = background sampling.");
 
         }
 
@@ -184,6 +295,45 @@ void EditorUI::renderSettings(SceneRenderer& renderer)
             ImGui::EndDisabled();
         }
 
+        // ── Acceleration Structure ────────────────────────────────────────────
+        if (ImGui::CollapsingHeader("Acceleration Structure##cpu"))
+        {
+            renderBVHBuildSettings(renderer, "cpu");
+
+            const char* widthItems[] = { "Auto", "Binary", "BVH4 (SSE)", "BVH8 (AVX2)" };
+            const int widthValues[]  = { 0, 2, 4, 8 };
+            int& bvhWidth = renderer.getCPURTSettings().bvhWidth;
+            int widthIdx = static_cast<int>(std::find(std::begin(widthValues), std::end(widthValues), bvhWidth)
+                                            - std::begin(widthValues));
+            if (widthIdx >= static_cast<int>(std::size(widthValues))) widthIdx = 0;
+            if (ImGui::Combo("Traversal", &widthIdx, widthItems, static_cast<int>(std::size(widthItems))))
+                bvhWidth = widthValues[widthIdx];
+            if (ImGui::IsItemHovered())
+                ImGui::SetTooltip("Wide BVH nodes test 4 or 8 child boxes per SIMD step.\nAuto picks the widest the CPU supports.");
+            ImGui::SameLine();
+            ImGui::TextDisabled("(active: %u-wide)", renderer.getCPUBVHWidth());
+
+            ImGui::Checkbox("Compressed Nodes", &renderer.getCPURTSettings().compressedBVH);
+            if (ImGui::IsItemHovered())
+                ImGui::SetTooltip("4-wide nodes with child boxes quantized to 8 bits.\nLess memory and bandwidth, a little decode work per node.\nOverrides the traversal width.");
+            ImGui::Checkbox("Instanced (BLAS + TLAS)", &renderer.getCPURTSettings().instancedBVH);
+            if (ImGui::IsItemHovered())
+                ImGui::SetTooltip("One BVH per unique submesh plus a small top-level BVH over instances.\nMoving a node only rebuilds the top level, and duplicated\nobjects share their triangles. Traversal is binary.");
+            ImGui::Checkbox("Packet Primary Rays", &renderer.getCPURTSettings().packetTracing);
+            if (ImGui::IsItemHovered())
+                ImGui::SetTooltip("Camera rays of each 4x4 pixel tile walk the binary BVH together.\nBounces stay single-ray. Not used with the instanced BVH.");
+            ImGui::Checkbox("Wavefront Mode", &renderer.getCPURTSettings().wavefront);
+            if (ImGui::IsItemHovered())
+                ImGui::SetTooltip("Paths advance one bounce at a time in large batches: rays are\ntraced as streams sorted by direction and hits shaded grouped\nby material. Same image; replaces packet primary rays.");
+            ImGui::TextDisabled("Nodes: %.1f KB (binary %.1f KB)",
+                                static_cast<float>(renderer.getCPUBVHMemoryBytes()) / 1024.0f,
+                                static_cast<float>(renderer.getBVHMemoryBytes()) / 1024.0f);
+            if (renderer.getCPUInstanceCount() > 0)
+                ImGui::TextDisabled("%u meshes, %u instances, triangles %.1f KB",
+                                    renderer.getCPUMeshCount(), renderer.getCPUInstanceCount(),
+                                    static_cast<float>(renderer.getCPUTriangleMemoryBytes()) / 1024.0f);
+        }
+
         // ── Diagnostics ───────────────────────────────────────────────────────
         if (ImGui::CollapsingHeader("Diagnostics##cpu"))
         {
@@ -293,6 +443,21 @@ void EditorUI::renderSettings(SceneRenderer& renderer)
             ImGui::EndDisabled();
         }
 
+#ifdef VEX_BACKEND_OPENGL
+        // ── Acceleration Structure ────────────────────────────────────────────
+        if (ImGui::CollapsingHeader("Acceleration Structure##gpu"))
+        {
+            renderBVHBuildSettings(renderer, "gpu");
+
+            ImGui::Checkbox("Compressed Nodes", &renderer.getGPURTSettings().compressedBVH);
+            if (ImGui::IsItemHovered())
+                ImGui::SetTooltip("Upload 4-wide nodes with child boxes quantized to 8 bits\ninstead of full-precision binary nodes.");
+            ImGui::TextDisabled("Uploaded: %.1f KB (binary %.1f KB)",
+                                static_cast<float>(renderer.getGPUBVHMemoryBytes()) / 1024.0f,
+                                static_cast<float>(renderer.getBVHMemoryBytes()) / 1024.0f);
+        }
+#endif
+
         // ── Diagnostics ───────────────────────────────────────────────────────
         if (ImGui::CollapsingHeader("Diagnostics##gpu"))
         {
@@ -399,6 +564,9 @@ void EditorUI::renderSettings(SceneRenderer& renderer)
             ImGui::EndDisabled();
         }
 
+        if (ImGui::CollapsingHeader("Acceleration Structure##compute"))
+            renderBVHBuildSettings(renderer, "compute");
+
         if (ImGui::CollapsingHeader("Diagnostics##compute"))
         {
             float& rayEps = renderer.getGPURTSettings().rayEps;
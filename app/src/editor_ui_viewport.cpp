@@ -195,7 +195,7 @@ bool EditorUI::drawGizmo(Scene& scene, ImDrawList* dl, ImVec2 vpOrigin, ImVec2 v
             node.localMatrix = glm::inverse(scene.getWorldMatrix(node.parentIndex)) * newWorld;
         else
             node.localMatrix = newWorld;
-        scene.geometryDirty = true;
+        scene.markTransformDirty(m_selection->index);
     };
 
     float aspect = vpSize.x / vpSize.y;
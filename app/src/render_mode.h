@@ -38,6 +38,7 @@ struct VKRTSettings
     float exposure              = 0.f;
     float gamma                 = 2.2f;
     bool  enableACES            = true;
+    bool  compressedBVH         = false; // GL compute: upload 8-bit quantized 4-wide BVH nodes
 
     bool operator==(const VKRTSettings& o) const
     {
@@ -72,6 +73,21 @@ struct CPURTSettings
     bool  enableACES            = true;
     float rayEps                = 1e-4f;
     bool  enableRR              = true;
+    bool  lightBVH              = true;  // NEE picks emissive triangles by estimated contribution, not by power alone
+    bool  sphericalLights       = true;  // NEE samples emissive triangles by solid angle instead of area
+    bool  pathGuiding           = false; // bounces learn incident light over the passes (SD-tree) and sample it
+    int   pathGuideMemoryMB     = 64;    // cap on the guide's trees
+    int   samplerType           = 0;    // 0 = PCG, 1 = Owen-scrambled Sobol, 2 = blue-noise-shifted Sobol
+    int   bvhWidth              = 0;    // 0 = auto (widest SIMD width), 2 / 4 / 8
+    bool  compressedBVH         = false; // 8-bit quantized 4-wide nodes (overrides bvhWidth)
+    bool  instancedBVH          = false; // per-mesh BLAS + TLAS over instances (overrides both)
+    bool  packetTracing         = true;  // primary rays traced in 4x4-pixel packets
+    bool  wavefront             = false; // bounce-by-bounce queues over ray streams instead of per-path tracing
+    bool  adaptiveSampling      = false; // converged 16x16 tiles stop receiving samples
+    float adaptiveThreshold     = 0.01f; // per-tile relative error below which a tile is converged
+    int   adaptiveMinSamples    = 16;    // samples before a tile may converge
+    bool  showSampleCounts      = false; // display per-pixel sample counts instead of the image
+    float frameBudgetMs         = 0.0f;  // > 0: trace on the UI thread for this long per frame instead of in the background
 };
 
 // ---- Rasterizer settings ----
@@ -130,6 +146,8 @@ struct SharedRenderData
     bool*             showDenoisedResult  = nullptr;
     int*              drawCalls           = nullptr; // write-back into SceneRenderer::m_drawCalls
     uint32_t          maxSamples          = 0;
+    bool              cpuShowSampleCounts = false;   // CPU RT: sample-count heatmap instead of the image
+    float             cpuFrameBudgetMs    = 0.0f;    // CPU RT: per-frame tracing budget, 0 = background sampling
     int               debugMode           = 0;       // cast of DebugMode enum
     int               selectedNodeIdx     = -1;
     int               selectedSubmesh     = -1;
@@ -189,6 +207,7 @@ struct FrameChanges
     // VK env data (pointers into SceneRenderer's m_vkEnvMap* vectors; valid this frame)
     const std::vector<float>* vkEnvMapData = nullptr; // nullptr = no HDR map
     const std::vector<float>* vkEnvCdfData = nullptr;
+    const std::vector<vex::AliasTable::Entry>* vkEnvAliasData = nullptr; // row marginal, then per-row conditionals
     int vkEnvMapW = 0;
     int vkEnvMapH = 0;
 #endif
@@ -209,8 +228,12 @@ public:
                         const FrameChanges& changes)             = 0;
 
     virtual void     onGeometryRebuilt()       {}
+    // Triangles moved in place (same count and order, see lastRefitTriangles());
+    // modes that can patch their buffers override this instead of re-uploading.
+    virtual void     onGeometryRefit()         { onGeometryRebuilt(); }
     virtual void     resetAccumulation()       {}
     virtual uint32_t getSampleCount()   const { return 0; }
     virtual float    getSamplesPerSec() const { return 0.f; }
+    virtual float    getRaysPerSec()    const { return 0.f; } // 0 = show samples/sec instead
     virtual bool     reloadShader()           { return false; }
 };
@@ -40,10 +40,17 @@ bool CPURaytraceMode::init(const RenderModeInitData& init)
 void CPURaytraceMode::activate()
 {
     m_samplesPerSec = 0.0f;
+    m_lastSampleCount = 0;
     if (m_cpuRaytracer)
         m_cpuRaytracer->reset();
 }
 
+void CPURaytraceMode::deactivate()
+{
+    if (m_cpuRaytracer)
+        m_cpuRaytracer->cancelSample();
+}
+
 void CPURaytraceMode::render(Scene& scene, const SharedRenderData& shared, const FrameChanges& changes)
 {
     if (!m_cpuRaytracer)
@@ -113,39 +120,84 @@ void CPURaytraceMode::render(Scene& scene, const SharedRenderData& shared, const
         m_cpuRaytracer->setDoF(scene.camera.aperture, scene.camera.focusDistance, right, up);
     }
 
+    // The workers sample in the background between frames; each frame shows
+    // the last pass they completed instead of waiting for one. With a frame
+    // budget they trace on this thread instead, resuming a pass across frames.
     bool showDenoised = shared.showDenoisedResult && *shared.showDenoisedResult;
-    if (!showDenoised &&
-        (shared.maxSamples == 0 || m_cpuRaytracer->getSampleCount() < shared.maxSamples))
+    const bool budgeted = shared.cpuFrameBudgetMs > 0.0f;
+    bool sliced = false;
+    if (showDenoised)
+        m_cpuRaytracer->cancelSample();
+    else if (!budgeted)
+        m_cpuRaytracer->traceSampleAsync(shared.maxSamples);
+    else if (!m_cpuRaytracer->isConverged() &&
+             (shared.maxSamples == 0 || m_cpuRaytracer->getSampleCount() < shared.maxSamples))
+    {
+        m_cpuRaytracer->traceSampleBudget(shared.cpuFrameBudgetMs);
+        sliced = true;
+    }
+
+    // After a reset the previous image stays up until the first new pass lands
+    const uint32_t sampleCount = m_cpuRaytracer->getSampleCount();
+    if (sampleCount < m_lastSampleCount)
+        m_lastSampleCount = 0;
+    const bool fresh = sampleCount > m_lastSampleCount;
+    if (fresh)
     {
         auto now = std::chrono::steady_clock::now();
-        if (m_cpuRaytracer->getSampleCount() == 0) {
-            m_samplesPerSec = 0.0f;
-        } else {
+        if (m_lastSampleCount > 0)
+        {
             float dt = std::chrono::duration<float>(now - m_lastSampleTime).count();
             if (dt > 1e-6f) {
-                float instant = 1.0f / dt;
+                float instant = static_cast<float>(sampleCount - m_lastSampleCount) / dt;
                 m_samplesPerSec = m_samplesPerSec < 1e-6f
                     ? instant : m_samplesPerSec * 0.9f + instant * 0.1f;
             }
         }
         m_lastSampleTime = now;
-        m_cpuRaytracer->traceSample();
+        m_lastSampleCount = sampleCount;
+    }
 
-        // Upload linear HDR result to RGBA32F texture; tone mapping applied in shader
-        if (raytraceTex)
-        {
+    // Rays per wall-clock second while a frame budget is set
+    const uint64_t rays = m_cpuRaytracer->getRaysTraced();
+    if (!budgeted || rays < m_lastRayCount)
+    {
+        m_raysPerSec = budgeted ? m_raysPerSec : 0.0f;
+        m_lastRayCount = rays;
+        m_lastRayTime = std::chrono::steady_clock::now();
+    }
+    else if (rays > m_lastRayCount)
+    {
+        auto now = std::chrono::steady_clock::now();
+        float dt = std::chrono::duration<float>(now - m_lastRayTime).count();
+        if (dt > 1e-6f) {
+            float instant = static_cast<float>(rays - m_lastRayCount) / dt;
+            m_raysPerSec = m_raysPerSec < 1e-6f
+                ? instant : m_raysPerSec * 0.9f + instant * 0.1f;
+        }
+        m_lastRayTime = now;
+        m_lastRayCount = rays;
+    }
+
+    // Upload linear HDR result to RGBA32F texture; tone mapping applied in shader.
+    // The sample-count view replaces it until toggled off (also once converged).
+    if (!showDenoised && raytraceTex && (fresh || sliced || shared.cpuShowSampleCounts != m_showingSampleCounts))
+    {
+        m_showingSampleCounts = shared.cpuShowSampleCounts;
+        if (m_showingSampleCounts)
+            m_cpuRaytracer->getSampleCountHeatmap(m_cpuHDRScratch);
+        else
             m_cpuRaytracer->getLinearHDR(m_cpuHDRScratch);
-            uint32_t n = w * h;
-            m_cpuRGBAScratch.resize(n * 4);
-            for (uint32_t i = 0; i < n; ++i)
-            {
-                m_cpuRGBAScratch[i * 4 + 0] = m_cpuHDRScratch[i * 3 + 0];
-                m_cpuRGBAScratch[i * 4 + 1] = m_cpuHDRScratch[i * 3 + 1];
-                m_cpuRGBAScratch[i * 4 + 2] = m_cpuHDRScratch[i * 3 + 2];
-                m_cpuRGBAScratch[i * 4 + 3] = 1.0f;
-            }
-            raytraceTex->setData(m_cpuRGBAScratch.data(), w, h, 4);
+        uint32_t n = w * h;
+        m_cpuRGBAScratch.resize(n * 4);
+        for (uint32_t i = 0; i < n; ++i)
+        {
+            m_cpuRGBAScratch[i * 4 + 0] = m_cpuHDRScratch[i * 3 + 0];
+            m_cpuRGBAScratch[i * 4 + 1] = m_cpuHDRScratch[i * 3 + 1];
+            m_cpuRGBAScratch[i * 4 + 2] = m_cpuHDRScratch[i * 3 + 2];
+            m_cpuRGBAScratch[i * 4 + 3] = 1.0f;
         }
+        raytraceTex->setData(m_cpuRGBAScratch.data(), w, h, 4);
     }
 
 #ifdef VEX_BACKEND_OPENGL
@@ -16,10 +16,11 @@ public:
     bool init(const RenderModeInitData& init) override;
     void shutdown() override {}
     void activate() override;
-    void deactivate() override {}
+    void deactivate() override;
     void render(Scene& scene, const SharedRenderData& shared, const FrameChanges& changes) override;
 
     float    getSamplesPerSec() const override { return m_samplesPerSec; }
+    float    getRaysPerSec()    const override { return m_raysPerSec; }
     uint32_t getSampleCount()   const override { return m_cpuRaytracer ? m_cpuRaytracer->getSampleCount() : 0; }
     void     resetAccumulation()      override { if (m_cpuRaytracer) m_cpuRaytracer->reset(); }
 
@@ -38,5 +39,10 @@ private:
     std::vector<float>                     m_cpuHDRScratch;   // RGB scratch from getLinearHDR
     std::vector<float>                     m_cpuRGBAScratch;  // RGBA32F scratch for texture upload
     float                                  m_samplesPerSec  = 0.0f;
+    bool                                   m_showingSampleCounts = false; // last upload was the heatmap
+    uint32_t                               m_lastSampleCount = 0;  // getSampleCount() when last seen
     std::chrono::steady_clock::time_point  m_lastSampleTime = {};
+    float                                  m_raysPerSec     = 0.0f;  // only while a frame budget is set
+    uint64_t                               m_lastRayCount   = 0;
+    std::chrono::steady_clock::time_point  m_lastRayTime    = {};
 };
@@ -63,6 +63,15 @@ void GPURaytraceMode::activate()
 
 void GPURaytraceMode::onGeometryRebuilt() { activate(); }
 
+void GPURaytraceMode::onGeometryRefit()
+{
+    // lastRefitTriangles() only covers the latest refit; a second one before
+    // the next render falls back to a full upload
+    if (m_refitPending)
+        m_geomDirty = true;
+    m_refitPending = true;
+}
+
 uint32_t GPURaytraceMode::getSampleCount() const
 {
     return m_raytracer ? m_raytracer->getSampleCount() : 0;
@@ -89,13 +98,30 @@ void GPURaytraceMode::render(Scene& scene, const SharedRenderData& shared, const
 
     m_raytracer->resize(w, h);
 
+    // Switching the BVH layout needs a re-upload of the node buffer
+    if (m_settings.compressedBVH != m_raytracer->getCompressedBVH())
+    {
+        m_raytracer->setCompressedBVH(m_settings.compressedBVH);
+        m_raytracer->reset();
+        m_geomDirty = true;
+    }
+
     // Upload geometry if dirty
     if (m_geomDirty && m_geomCache)
     {
         m_raytracer->uploadGeometry(m_geomCache->triangles(), m_geomCache->bvh(),
                                     m_geomCache->lightIndices(), m_geomCache->lightCDF(),
                                     m_geomCache->totalLightArea(), m_geomCache->textures());
-        m_geomDirty = false;
+        m_geomDirty    = false;
+        m_refitPending = false;
+    }
+    else if (m_refitPending && m_geomCache)
+    {
+        m_raytracer->updateGeometry(m_geomCache->triangles(), m_geomCache->bvh(),
+                                    m_geomCache->lastRefitTriangles(),
+                                    m_geomCache->lightIndices(), m_geomCache->lightCDF(),
+                                    m_geomCache->totalLightArea());
+        m_refitPending = false;
     }
 
     // Environment
@@ -35,6 +35,9 @@ public:
     const VKRTSettings& getSettings() const { return m_settings; }
 
     void onGeometryRebuilt() override;
+#ifdef VEX_BACKEND_OPENGL
+    void onGeometryRefit() override;
+#endif
 
 #ifdef VEX_BACKEND_VULKAN
     const vex::GpuPassTimings* getGpuPassTimings() const
@@ -71,6 +74,7 @@ private:
     std::unique_ptr<vex::GpuTimer> m_gpuTimer;
 #endif
     bool     m_geomDirty   = false;
+    bool     m_refitPending = false; // GL: patch the SSBOs from lastRefitTriangles() on the next render
     uint32_t m_sampleCount = 0;   // incremented per frame on VK; unused on GL (GL raytracer tracks it)
     uint32_t m_rtTexW      = 0;
     uint32_t m_rtTexH      = 0;
@@ -12,6 +12,15 @@ glm::mat4 Scene::getWorldMatrix(int nodeIdx) const
     return getWorldMatrix(node.parentIndex) * node.localMatrix;
 }
 
+// ── markTransformDirty ───────────────────────────────────────────────────────
+
+void Scene::markTransformDirty(int nodeIdx)
+{
+    if (nodeIdx < 0 || nodeIdx >= (int)nodes.size()) return;
+    if (std::find(transformDirtyNodes.begin(), transformDirtyNodes.end(), nodeIdx) == transformDirtyNodes.end())
+        transformDirtyNodes.push_back(nodeIdx);
+}
+
 // ── Index fixup helpers ───────────────────────────────────────────────────────
 
 void fixRefsAfterRemove(Scene& scene, int removedIdx)
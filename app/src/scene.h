@@ -121,6 +121,11 @@ struct Scene
     bool geometryDirty = false;
     bool materialDirty = false;
 
+    // Nodes whose localMatrix changed since the last frame. Cheaper than
+    // geometryDirty: the raytrace geometry is refit instead of rebuilt.
+    std::vector<int> transformDirtyNodes;
+    void markTransformDirty(int nodeIdx);
+
     // Pixel cache populated by SceneImporter during import.
     // Consumed (then cleared) by SceneGeometryCache::rebuild() to avoid a
     // second stbi_load per texture. See scene_importer.h for write paths.
@@ -22,6 +22,7 @@
 #include <chrono>
 #include <cstdio>
 #include <cstring>
+#include <filesystem>
 #include <thread>
 #include <unordered_map>
 #include <vector>
@@ -49,15 +50,166 @@ static std::vector<uint8_t> downsampleNearest(
     return out;
 }
 
+// World-space positions, normals and the derived per-triangle frame (geometric
+// normal, area, tangent). Shared by rebuild() and refitTransforms() so a refit
+// produces exactly the data a full flatten would.
+static void bakeTriangleGeometry(const vex::Vertex& v0, const vex::Vertex& v1, const vex::Vertex& v2,
+                                 const glm::mat4& worldMat, const glm::mat3& normalMat,
+                                 vex::CPURaytracer::Triangle& tri)
+{
+    glm::vec3 p0 = glm::vec3(worldMat * glm::vec4(v0.position, 1.0f));
+    glm::vec3 p1 = glm::vec3(worldMat * glm::vec4(v1.position, 1.0f));
+    glm::vec3 p2 = glm::vec3(worldMat * glm::vec4(v2.position, 1.0f));
+
+    glm::vec3 edge1 = p1 - p0;
+    glm::vec3 edge2 = p2 - p0;
+    glm::vec3 cr    = glm::cross(edge1, edge2);
+    float len       = glm::length(cr);
+    glm::vec3 geoN  = (len > GEOMETRY_EPSILON) ? (cr / len) : glm::vec3(0, 1, 0);
+
+    glm::vec2 dUV1 = v1.uv - v0.uv;
+    glm::vec2 dUV2 = v2.uv - v0.uv;
+    float det = dUV1.x * dUV2.y - dUV2.x * dUV1.y;
+    glm::vec3 tangent(1, 0, 0);
+    float bitangentSign = 1.0f;
+    if (std::abs(det) > GEOMETRY_EPSILON)
+    {
+        float f = 1.0f / det;
+        tangent = glm::normalize(f * (dUV2.y * edge1 - dUV1.y * edge2));
+        glm::vec3 B = f * (-dUV2.x * edge1 + dUV1.x * edge2);
+        bitangentSign = (glm::dot(glm::cross(geoN, tangent), B) < 0.0f) ? -1.0f : 1.0f;
+    }
+
+    tri.v0 = p0; tri.v1 = p1; tri.v2 = p2;
+    tri.n0 = glm::normalize(normalMat * v0.normal);
+    tri.n1 = glm::normalize(normalMat * v1.normal);
+    tri.n2 = glm::normalize(normalMat * v2.normal);
+    tri.geometricNormal = geoN;
+    tri.area            = len * 0.5f;
+    tri.tangent         = tangent;
+    tri.bitangentSign   = bitangentSign;
+}
+
+// Per-submesh material values (texture indices are resolved by the caller)
+static void bakeTriangleMaterial(const vex::Vertex& v0, const vex::MeshData& md,
+                                 vex::CPURaytracer::Triangle& tri)
+{
+    tri.color            = v0.color * md.baseColor;
+    tri.emissive         = md.emissiveColor * md.emissiveStrength;
+    tri.emissiveStrength = md.emissiveStrength;
+    tri.alphaClip    = md.alphaClip;
+    tri.materialType = md.materialType;
+    tri.ior          = md.ior;
+    tri.roughness    = md.roughness;
+    tri.metallic     = md.metallic;
+}
+
+// Submeshes that may share one CPU BLAS: identical material...
+static bool sameMaterial(const vex::MeshData& a, const vex::MeshData& b)
+{
+    return a.baseColor == b.baseColor
+        && a.emissiveColor == b.emissiveColor
+        && a.emissiveStrength == b.emissiveStrength
+        && a.alphaClip == b.alphaClip
+        && a.materialType == b.materialType
+        && a.ior == b.ior
+        && a.roughness == b.roughness
+        && a.metallic == b.metallic
+        && a.diffuseTexturePath == b.diffuseTexturePath
+        && a.emissiveTexturePath == b.emissiveTexturePath
+        && a.normalTexturePath == b.normalTexturePath
+        && a.roughnessTexturePath == b.roughnessTexturePath
+        && a.metallicTexturePath == b.metallicTexturePath
+        && a.alphaTexturePath == b.alphaTexturePath;
+}
+
+// ...and identical vertex and index data (duplicated nodes copy their meshData)
+static bool sameGeometry(const vex::MeshData& a, const vex::MeshData& b)
+{
+    return a.vertices.size() == b.vertices.size()
+        && a.indices.size() == b.indices.size()
+        && std::memcmp(a.vertices.data(), b.vertices.data(), a.vertices.size() * sizeof(vex::Vertex)) == 0
+        && std::memcmp(a.indices.data(), b.indices.data(), a.indices.size() * sizeof(uint32_t)) == 0;
+}
+
+static constexpr uint64_t FNV_OFFSET_BASIS = 14695981039346656037ull;
+
+// FNV-1a, continued from h
+static uint64_t hashBytes(uint64_t h, const void* data, size_t bytes)
+{
+    const auto* p = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < bytes; ++i)
+    {
+        h ^= p[i];
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+template <typename T>
+static uint64_t hashValue(uint64_t h, const T& value)
+{
+    return hashBytes(h, &value, sizeof(T));
+}
+
+// FNV-1a over the vertex and index bytes; buckets candidates for sameGeometry()
+static uint64_t geometryHash(const vex::MeshData& md)
+{
+    uint64_t h = hashBytes(FNV_OFFSET_BASIS, md.vertices.data(), md.vertices.size() * sizeof(vex::Vertex));
+    return hashBytes(h, md.indices.data(), md.indices.size() * sizeof(uint32_t));
+}
+
+// Everything a submesh contributes to the flattened triangles besides its
+// transform and texture indices: geometry plus the material values baked in
+static uint64_t submeshContentHash(uint64_t h, const vex::MeshData& md)
+{
+    h = hashValue(h, geometryHash(md));
+    h = hashValue(h, md.baseColor);
+    h = hashValue(h, md.emissiveColor);
+    h = hashValue(h, md.emissiveStrength);
+    h = hashValue(h, md.alphaClip);
+    h = hashValue(h, md.materialType);
+    h = hashValue(h, md.ior);
+    h = hashValue(h, md.roughness);
+    return hashValue(h, md.metallic);
+}
+
+#ifdef VEX_BACKEND_VULKAN
+// Writes the transform-dependent slots of one 52-float VK shading record:
+// normals ([0..2].xyz), area ([6].w), geometric normal ([7].xyz), tangent
+// frame ([9]) and world-space vertices ([10..12]).
+static void packShadingGeometry(const vex::CPURaytracer::Triangle& tri, float* sh)
+{
+    sh[ 0]=tri.n0.x; sh[ 1]=tri.n0.y; sh[ 2]=tri.n0.z;
+    sh[ 4]=tri.n1.x; sh[ 5]=tri.n1.y; sh[ 6]=tri.n1.z;
+    sh[ 8]=tri.n2.x; sh[ 9]=tri.n2.y; sh[10]=tri.n2.z;
+    sh[27]=tri.area;
+    sh[28]=tri.geometricNormal.x; sh[29]=tri.geometricNormal.y; sh[30]=tri.geometricNormal.z;
+    sh[36]=tri.tangent.x; sh[37]=tri.tangent.y; sh[38]=tri.tangent.z; sh[39]=tri.bitangentSign;
+    sh[40]=tri.v0.x; sh[41]=tri.v0.y; sh[42]=tri.v0.z; sh[43]=0.0f;
+    sh[44]=tri.v1.x; sh[45]=tri.v1.y; sh[46]=tri.v1.z; sh[47]=0.0f;
+    sh[48]=tri.v2.x; sh[49]=tri.v2.y; sh[50]=tri.v2.z; sh[51]=0.0f;
+}
+#endif
+
 // ---------------------------------------------------------------------------
 // SceneGeometryCache::rebuild
 // ---------------------------------------------------------------------------
 
+SceneGeometryCache::~SceneGeometryCache()
+{
+    // BVH::build cannot be interrupted; wait for an in-flight upgrade
+    if (m_sahUpgrade && m_sahUpgrade->worker.joinable())
+        m_sahUpgrade->worker.join();
+}
+
 void SceneGeometryCache::rebuild(const Scene& scene, vex::CPURaytracer& cpuRT,
-                                  bool luminanceCDF, ProgressFn progress)
+                                  bool luminanceCDF, ProgressFn progress, bool fastBuild)
 {
     m_luminanceCDF = luminanceCDF;
     m_blasTlasReady = false;
+    m_fastBuild = fastBuild;
+    ++m_geometryGeneration;
 
     auto t_total = std::chrono::steady_clock::now();
 
@@ -216,14 +368,71 @@ void SceneGeometryCache::rebuild(const Scene& scene, vex::CPURaytracer& cpuRT,
         }  // end for(si)
     }  // end for(ni)
 
+    // -----------------------------------------------------------------------
+    // Persistent disk cache: the key covers every input of the flatten and the
+    // BVH build, so a hit stands in for both
+    // -----------------------------------------------------------------------
+    const bool useDiskCache = !m_diskCacheDir.empty() && !fastBuild;
+    const vex::BVHBuildOptions buildOptions = cpuRT.getBVHBuildOptions();
+    uint64_t    diskKey = 0;
+    std::string diskPath;
+    bool        diskHit = false;
+    if (useDiskCache)
+    {
+        auto t_disk = std::chrono::steady_clock::now();
+        uint64_t h = FNV_OFFSET_BASIS;
+        for (const SubmeshTask& task : tasks)
+        {
+            h = submeshContentHash(h, scene.nodes[task.nodeIdx].submeshes[task.smIdx].meshData);
+            h = hashValue(h, task.worldMat);
+            const int texIndices[6] = { task.texIdx, task.emissiveTexIdx, task.normalTexIdx,
+                                        task.roughnessTexIdx, task.metallicTexIdx, task.alphaTexIdx };
+            h = hashValue(h, texIndices);
+        }
+        h = hashValue(h, buildOptions.builder);
+        h = hashValue(h, buildOptions.spatialSplits);
+        h = hashValue(h, buildOptions.spatialSplitBudget);
+        h = hashValue(h, buildOptions.spatialSplitAlpha);
+        h = hashValue(h, buildOptions.leafSize);
+        diskKey = hashValue(h, buildOptions.optimizePasses);
+
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016llx.vgc", static_cast<unsigned long long>(diskKey));
+        diskPath = (std::filesystem::path(m_diskCacheDir) / name).string();
+        diskHit  = cpuRT.loadGeometryCache(diskPath, diskKey, textures);
+
+        float ms = std::chrono::duration<float, std::milli>(
+            std::chrono::steady_clock::now() - t_disk).count();
+        char buf[256];
+        std::snprintf(buf, sizeof(buf), "  Geometry disk cache %s: %s  (%.0f ms hash + load)",
+                      diskHit ? "hit" : "miss", diskPath.c_str(), ms);
+        vex::Log::info(buf);
+    }
+
+    // BVH-order source mapping is rebuilt from the submesh layout on a hit too
+    std::vector<std::pair<int,int>> flatSrc(static_cast<size_t>(globalTriOffset));
+    std::vector<int>                flatSrcIdx(static_cast<size_t>(globalTriOffset));
+    for (const SubmeshTask& task : tasks)
+    {
+        for (int t = 0; t < task.triCount; ++t)
+        {
+            flatSrc[task.triOffset + t]    = {task.nodeIdx, task.smIdx};
+            flatSrcIdx[task.triOffset + t] = t;
+        }
+    }
+
     // -----------------------------------------------------------------------
     // Parallel triangle flatten (Improvements 1 + 2)
     // -----------------------------------------------------------------------
 
+#ifdef VEX_BACKEND_VULKAN
+    const bool flatten = true; // the flatten workers also pack the VK shading SSBO
+#else
+    const bool flatten = !diskHit;
+#endif
+
     // Pre-allocate output arrays; workers write to exclusive slices.
-    std::vector<vex::CPURaytracer::Triangle> flatTris(static_cast<size_t>(globalTriOffset));
-    std::vector<std::pair<int,int>>          flatSrc(static_cast<size_t>(globalTriOffset));
-    std::vector<int>                         flatSrcIdx(static_cast<size_t>(globalTriOffset));
+    std::vector<vex::CPURaytracer::Triangle> flatTris(flatten ? static_cast<size_t>(globalTriOffset) : 0);
 
 #ifdef VEX_BACKEND_VULKAN
     static constexpr size_t FLOATS_PER_TRI = 52;
@@ -237,6 +446,7 @@ void SceneGeometryCache::rebuild(const Scene& scene, vex::CPURaytracer& cpuRT,
     // slice of the output arrays (flatTris[task.triOffset .. +task.triCount]),
     // so no locks are needed. taskLights is also indexed by taskIdx — NOT by
     // thread id — so the post-join merge preserves submesh order.
+    if (flatten)
     {
         std::atomic<int> nextTask{0};
         const int numThreads = std::max(1, (int)std::thread::hardware_concurrency());
@@ -271,60 +481,21 @@ void SceneGeometryCache::rebuild(const Scene& scene, vex::CPURaytracer& cpuRT,
                         const auto& v1 = verts[indices[j + 1]];
                         const auto& v2 = verts[indices[j + 2]];
 
-                        glm::vec3 p0 = glm::vec3(task.worldMat * glm::vec4(v0.position, 1.0f));
-                        glm::vec3 p1 = glm::vec3(task.worldMat * glm::vec4(v1.position, 1.0f));
-                        glm::vec3 p2 = glm::vec3(task.worldMat * glm::vec4(v2.position, 1.0f));
-
-                        glm::vec3 edge1 = p1 - p0;
-                        glm::vec3 edge2 = p2 - p0;
-                        glm::vec3 cr    = glm::cross(edge1, edge2);
-                        float len       = glm::length(cr);
-                        glm::vec3 geoN  = (len > GEOMETRY_EPSILON) ? (cr / len) : glm::vec3(0, 1, 0);
-                        float area      = len * 0.5f;
-
-                        glm::vec2 dUV1 = v1.uv - v0.uv;
-                        glm::vec2 dUV2 = v2.uv - v0.uv;
-                        float det = dUV1.x * dUV2.y - dUV2.x * dUV1.y;
-                        glm::vec3 tangent(1, 0, 0);
-                        float bitangentSign = 1.0f;
-                        if (std::abs(det) > GEOMETRY_EPSILON)
-                        {
-                            float f = 1.0f / det;
-                            tangent = glm::normalize(f * (dUV2.y * edge1 - dUV1.y * edge2));
-                            glm::vec3 B = f * (-dUV2.x * edge1 + dUV1.x * edge2);
-                            bitangentSign = (glm::dot(glm::cross(geoN, tangent), B) < 0.0f) ? -1.0f : 1.0f;
-                        }
-
                         vex::CPURaytracer::Triangle tri;
-                        tri.v0 = p0; tri.v1 = p1; tri.v2 = p2;
-                        tri.n0 = glm::normalize(task.normalMat * v0.normal);
-                        tri.n1 = glm::normalize(task.normalMat * v1.normal);
-                        tri.n2 = glm::normalize(task.normalMat * v2.normal);
+                        bakeTriangleGeometry(v0, v1, v2, task.worldMat, task.normalMat, tri);
+                        bakeTriangleMaterial(v0, md, tri);
                         tri.uv0 = v0.uv; tri.uv1 = v1.uv; tri.uv2 = v2.uv;
-                        tri.color            = v0.color * md.baseColor;
-                        tri.emissive         = md.emissiveColor * md.emissiveStrength;
-                        tri.emissiveStrength = md.emissiveStrength;
-                        tri.geometricNormal  = geoN;
-                        tri.area             = area;
                         tri.textureIndex          = task.texIdx;
                         tri.emissiveTextureIndex  = task.emissiveTexIdx;
                         tri.normalMapTextureIndex = task.normalTexIdx;
                         tri.roughnessTextureIndex = task.roughnessTexIdx;
                         tri.metallicTextureIndex  = task.metallicTexIdx;
                         tri.alphaTextureIndex     = task.alphaTexIdx;
-                        tri.alphaClip    = md.alphaClip;
-                        tri.materialType = md.materialType;
-                        tri.ior          = md.ior;
-                        tri.roughness    = md.roughness;
-                        tri.metallic     = md.metallic;
-                        tri.tangent      = tangent;
-                        tri.bitangentSign = bitangentSign;
-
-                        flatTris[outIdx]   = tri;
-                        flatSrc[outIdx]    = {task.nodeIdx, task.smIdx};
-                        flatSrcIdx[outIdx] = localTri;
+
+                        flatTris[outIdx] = tri;
 
 #ifdef VEX_BACKEND_VULKAN
+                        const float area = tri.area;
                         float* sh = &flatShading[static_cast<size_t>(outIdx) * FLOATS_PER_TRI];
                         // [0] n0.xyz + roughnessTexIdx
                         sh[ 0]=tri.n0.x; sh[ 1]=tri.n0.y; sh[ 2]=tri.n0.z; sh[ 3]=iBF(task.roughnessTexIdx);
@@ -345,7 +516,8 @@ void SceneGeometryCache::rebuild(const Scene& scene, vex::CPURaytracer& cpuRT,
                         sh[26]=md.emissiveColor.z*md.emissiveStrength;
                         sh[27]=area;
                         // [7] geoNormal.xyz + normalMapTexIdx
-                        sh[28]=geoN.x; sh[29]=geoN.y; sh[30]=geoN.z; sh[31]=iBF(task.normalTexIdx);
+                        sh[28]=tri.geometricNormal.x; sh[29]=tri.geometricNormal.y;
+                        sh[30]=tri.geometricNormal.z; sh[31]=iBF(task.normalTexIdx);
                         // [8] alphaEnc + materialType + ior + emissiveTexIdx
                         // alphaEnc encodes alpha clip: -1=no clip, -2=use diffuse.a, >=0=alpha tex idx
                         { int alphaEnc = md.alphaClip
@@ -354,14 +526,8 @@ void SceneGeometryCache::rebuild(const Scene& scene, vex::CPURaytracer& cpuRT,
                           sh[32]=iBF(alphaEnc); }
                         sh[33]=static_cast<float>(md.materialType);
                         sh[34]=md.ior; sh[35]=iBF(task.emissiveTexIdx);
-                        // [9] tangent.xyz + bitangentSign
-                        sh[36]=tangent.x; sh[37]=tangent.y; sh[38]=tangent.z; sh[39]=bitangentSign;
-                        // [10] v0.xyz + pad
-                        sh[40]=p0.x; sh[41]=p0.y; sh[42]=p0.z; sh[43]=0.0f;
-                        // [11] v1.xyz + pad
-                        sh[44]=p1.x; sh[45]=p1.y; sh[46]=p1.z; sh[47]=0.0f;
-                        // [12] v2.xyz + pad
-                        sh[48]=p2.x; sh[49]=p2.y; sh[50]=p2.z; sh[51]=0.0f;
+                        // [9] tangent.xyz + bitangentSign, [10..12] v0/v1/v2.xyz + pad
+                        packShadingGeometry(tri, sh);
 
                         if (smEmissive)
                         {
@@ -380,6 +546,7 @@ void SceneGeometryCache::rebuild(const Scene& scene, vex::CPURaytracer& cpuRT,
         for (auto& w : workers) w.join();
     }
 
+    if (flatten)
     {
         float t_flatten_ms = std::chrono::duration<float, std::milli>(
             std::chrono::steady_clock::now() - t_flatten).count();
@@ -397,18 +564,59 @@ void SceneGeometryCache::rebuild(const Scene& scene, vex::CPURaytracer& cpuRT,
     if (progress) progress("Building BVH...", 0.45f);
     m_rtTextures = textures;  // copy before move
 
+    if (!diskHit)
     {
         auto t_cpu_bvh = std::chrono::steady_clock::now();
+        // Edit-time rebuilds take the Morton builder; startSAHUpgrade() follows up
+        if (fastBuild)
+        {
+            vex::BVHBuildOptions fast = buildOptions;
+            fast.builder          = vex::BVHBuilder::LBVH;
+            fast.optimizePasses   = 0;
+            fast.optimizeBudgetMs = 0.0f;
+            cpuRT.setBVHBuildOptions(fast);
+        }
         cpuRT.setGeometry(std::move(flatTris), std::move(textures));
+        if (fastBuild)
+            cpuRT.setBVHBuildOptions(buildOptions);
         {
             float ms = std::chrono::duration<float, std::milli>(
                 std::chrono::steady_clock::now() - t_cpu_bvh).count();
             char buf[128];
+            const char* stage = fastBuild ? "LBVH build"
+                : buildOptions.optimizePasses > 0 ? "BVH build + optimize" : "BVH build";
             std::snprintf(buf, sizeof(buf),
-                "  CPURaytracer::setGeometry (BVH build + reorder): %.0f ms", ms);
+                "  CPURaytracer::setGeometry (%s + reorder): %.0f ms", stage, ms);
             vex::Log::info(buf);
         }
 
+        // A tree the optimize deadline cut short is not what the key
+        // describes: another run of the same build would differ
+        if (useDiskCache && cpuRT.getBVH().optimizeStoppedEarly())
+        {
+            vex::Log::info("  Geometry disk cache not written: BVH optimize stopped at its time budget");
+        }
+        else if (useDiskCache)
+        {
+            auto t_save = std::chrono::steady_clock::now();
+            if (cpuRT.saveGeometryCache(diskPath, diskKey))
+            {
+                pruneDiskCache();
+                float ms = std::chrono::duration<float, std::milli>(
+                    std::chrono::steady_clock::now() - t_save).count();
+                char buf[256];
+                std::snprintf(buf, sizeof(buf), "  Geometry disk cache written: %s  (%.0f ms)",
+                              diskPath.c_str(), ms);
+                vex::Log::info(buf);
+            }
+            else
+            {
+                vex::Log::warn("  Geometry disk cache could not be written: " + diskPath);
+            }
+        }
+    }
+
+    {
         auto t_rt_bvh = std::chrono::steady_clock::now();
         m_rtBVH = cpuRT.getBVH();
 
@@ -427,24 +635,7 @@ void SceneGeometryCache::rebuild(const Scene& scene, vex::CPURaytracer& cpuRT,
         }
 
         // Build CPU RT light CDF from BVH-ordered m_rtTriangles.
-        m_rtLightIndices.clear();
-        m_rtLightCDF.clear();
-        m_rtTotalLightArea = 0.0f;
-        for (uint32_t i = 0; i < static_cast<uint32_t>(m_rtTriangles.size()); ++i)
-        {
-            if (glm::length(m_rtTriangles[i].emissive) > 0.001f)
-            {
-                m_rtLightIndices.push_back(i);
-                const auto& em = m_rtTriangles[i].emissive;
-                float w = m_luminanceCDF
-                    ? (0.2126f * em.r + 0.7152f * em.g + 0.0722f * em.b) * m_rtTriangles[i].area
-                    : m_rtTriangles[i].area;
-                m_rtTotalLightArea += w;
-                m_rtLightCDF.push_back(m_rtTotalLightArea);
-            }
-        }
-        if (m_rtTotalLightArea > 0.0f)
-            for (float& c : m_rtLightCDF) c /= m_rtTotalLightArea;
+        buildRTLightCDF();
 
         {
             float t_rt_bvh_ms = std::chrono::duration<float, std::milli>(
@@ -455,12 +646,26 @@ void SceneGeometryCache::rebuild(const Scene& scene, vex::CPURaytracer& cpuRT,
             vex::Log::info(rtbuf);
         }
 
-        char sahBuf[32];
-        std::snprintf(sahBuf, sizeof(sahBuf), "%.1f", cpuRT.getBVHSAHCost());
+        char sahBuf[64];
+        if (m_rtBVH.duplicationRatio() > 1.0f)
+            std::snprintf(sahBuf, sizeof(sahBuf), "%.1f (spatial splits, %.2fx refs)",
+                          cpuRT.getBVHSAHCost(), m_rtBVH.duplicationRatio());
+        else
+            std::snprintf(sahBuf, sizeof(sahBuf), "%.1f", cpuRT.getBVHSAHCost());
         std::string emissiveStr = m_rtLightIndices.empty() ? ""
             : ", " + std::to_string(m_rtLightIndices.size()) + " emissive";
         vex::Log::info("  CPU BVH: " + std::to_string(cpuRT.getBVHNodeCount()) + " nodes, "
-                      + std::to_string(m_rtTriangles.size()) + " triangles, SAH " + sahBuf + emissiveStr);
+                      + std::to_string(m_rtBVH.primitiveCount()) + " triangles, SAH " + sahBuf + emissiveStr);
+
+        const auto omm = cpuRT.getOpacityMicromapStats();
+        if (omm.triangles > 0)
+        {
+            uint64_t micro = uint64_t(omm.opaque) + omm.transparent + omm.mixed;
+            char ommBuf[128];
+            std::snprintf(ommBuf, sizeof(ommBuf), "  Opacity micromaps: %u alpha-clipped triangles, %.0f%% of micro-triangles skip the texture",
+                          omm.triangles, micro ? 100.0 * double(micro - omm.mixed) / double(micro) : 0.0);
+            vex::Log::info(ommBuf);
+        }
     }
 
 #ifdef VEX_BACKEND_VULKAN
@@ -526,9 +731,174 @@ void SceneGeometryCache::rebuild(const Scene& scene, vex::CPURaytracer& cpuRT,
     }
 
     m_texturePathToIndex = std::move(textureMap);
+
+    // The flat build above still feeds the GPU modes and the shared BVH
+    if (m_cpuInstancing)
+        setupCPUInstances(scene, cpuRT);
+
     m_ready = true;
 }
 
+// ---------------------------------------------------------------------------
+// SceneGeometryCache: two-level CPU geometry
+// ---------------------------------------------------------------------------
+
+void SceneGeometryCache::bakeObjectSpaceMesh(const vex::MeshData& md,
+                                             std::vector<vex::CPURaytracer::Triangle>& out) const
+{
+    auto texIdx = [this](const std::string& path) -> int
+    {
+        auto it = m_texturePathToIndex.find(path);
+        return (it != m_texturePathToIndex.end()) ? it->second : -1;
+    };
+    const int diffuseTex   = texIdx(md.diffuseTexturePath);
+    const int emissiveTex  = texIdx(md.emissiveTexturePath);
+    const int normalTex    = texIdx(md.normalTexturePath);
+    const int roughnessTex = texIdx(md.roughnessTexturePath);
+    const int metallicTex  = texIdx(md.metallicTexturePath);
+    const int alphaTex     = texIdx(md.alphaTexturePath);
+
+    const glm::mat4 identity(1.0f);
+    const glm::mat3 identityN(1.0f);
+    out.clear();
+    out.reserve(md.indices.size() / 3);
+    for (size_t j = 0; j + 2 < md.indices.size(); j += 3)
+    {
+        const auto& v0 = md.vertices[md.indices[j + 0]];
+        const auto& v1 = md.vertices[md.indices[j + 1]];
+        const auto& v2 = md.vertices[md.indices[j + 2]];
+
+        vex::CPURaytracer::Triangle tri;
+        bakeTriangleGeometry(v0, v1, v2, identity, identityN, tri);
+        bakeTriangleMaterial(v0, md, tri);
+        tri.uv0 = v0.uv; tri.uv1 = v1.uv; tri.uv2 = v2.uv;
+        tri.textureIndex          = diffuseTex;
+        tri.emissiveTextureIndex  = emissiveTex;
+        tri.normalMapTextureIndex = normalTex;
+        tri.roughnessTextureIndex = roughnessTex;
+        tri.metallicTextureIndex  = metallicTex;
+        tri.alphaTextureIndex     = alphaTex;
+        out.push_back(tri);
+    }
+}
+
+void SceneGeometryCache::setupCPUInstances(const Scene& scene, vex::CPURaytracer& cpuRT)
+{
+    auto t_inst = std::chrono::steady_clock::now();
+
+    m_cpuInstanceMesh.clear();
+    m_cpuMeshSource.clear();
+
+    std::unordered_map<uint64_t, std::vector<uint32_t>> buckets; // geometry hash → mesh ids
+    std::vector<vex::CPURaytracer::Instance> instances;
+    for (int ni = 0; ni < (int)scene.nodes.size(); ++ni)
+    {
+        const glm::mat4 nodeWorld = scene.getWorldMatrix(ni);
+        for (int si = 0; si < (int)scene.nodes[ni].submeshes.size(); ++si)
+        {
+            const auto& sm = scene.nodes[ni].submeshes[si];
+            auto& bucket = buckets[geometryHash(sm.meshData)];
+            uint32_t meshId = UINT32_MAX;
+            for (uint32_t id : bucket)
+            {
+                auto [rn, rs] = m_cpuMeshSource[id];
+                const auto& rep = scene.nodes[rn].submeshes[rs].meshData;
+                if (sameGeometry(sm.meshData, rep) && sameMaterial(sm.meshData, rep))
+                {
+                    meshId = id;
+                    break;
+                }
+            }
+            if (meshId == UINT32_MAX)
+            {
+                meshId = static_cast<uint32_t>(m_cpuMeshSource.size());
+                m_cpuMeshSource.push_back({ni, si});
+                bucket.push_back(meshId);
+            }
+            m_cpuInstanceMesh.push_back(meshId);
+            instances.push_back({ meshId, nodeWorld * sm.modelMatrix });
+        }
+    }
+
+    std::vector<std::vector<vex::CPURaytracer::Triangle>> meshes(m_cpuMeshSource.size());
+    for (size_t m = 0; m < meshes.size(); ++m)
+    {
+        auto [ni, si] = m_cpuMeshSource[m];
+        bakeObjectSpaceMesh(scene.nodes[ni].submeshes[si].meshData, meshes[m]);
+    }
+
+    cpuRT.setInstancedGeometry(std::move(meshes), std::move(instances), m_rtTextures);
+
+    float ms = std::chrono::duration<float, std::milli>(
+        std::chrono::steady_clock::now() - t_inst).count();
+    char buf[160];
+    std::snprintf(buf, sizeof(buf),
+        "  CPU two-level BVH: %.0f ms  (%u meshes, %u instances, %.1f MB triangles)",
+        ms, cpuRT.getMeshCount(), cpuRT.getInstanceCount(),
+        static_cast<float>(cpuRT.getTriangleMemoryBytes()) / (1024.0f * 1024.0f));
+    vex::Log::info(buf);
+}
+
+bool SceneGeometryCache::refitCPUInstances(const Scene& scene, vex::CPURaytracer& cpuRT)
+{
+    if (!cpuRT.isInstanced() || scene.nodes.size() != m_nodeLocalAABBs.size())
+        return false;
+
+    std::vector<glm::mat4> transforms;
+    transforms.reserve(m_cpuInstanceMesh.size());
+    for (int ni = 0; ni < (int)scene.nodes.size(); ++ni)
+    {
+        const glm::mat4 nodeWorld = scene.getWorldMatrix(ni);
+        for (const auto& sm : scene.nodes[ni].submeshes)
+            transforms.push_back(nodeWorld * sm.modelMatrix);
+    }
+    if (transforms.size() != m_cpuInstanceMesh.size())
+        return false;
+
+    auto t_tlas = std::chrono::steady_clock::now();
+    cpuRT.setInstanceTransforms(transforms);
+    float ms = std::chrono::duration<float, std::milli>(
+        std::chrono::steady_clock::now() - t_tlas).count();
+    char buf[96];
+    std::snprintf(buf, sizeof(buf), "  CPU TLAS rebuild: %.2f ms  (%zu instances)", ms, transforms.size());
+    vex::Log::info(buf);
+    return true;
+}
+
+void SceneGeometryCache::updateCPUInstanceMaterials(const Scene& scene, vex::CPURaytracer& cpuRT)
+{
+    // An edit that makes a submesh differ from the mesh it shares needs new groups
+    bool grouped = true;
+    size_t flatSm = 0;
+    for (const auto& node : scene.nodes)
+    {
+        for (const auto& sm : node.submeshes)
+        {
+            if (flatSm >= m_cpuInstanceMesh.size())
+            {
+                grouped = false;
+                break;
+            }
+            auto [rn, rs] = m_cpuMeshSource[m_cpuInstanceMesh[flatSm++]];
+            if (!sameMaterial(sm.meshData, scene.nodes[rn].submeshes[rs].meshData))
+                grouped = false;
+        }
+    }
+    if (!grouped || flatSm != m_cpuInstanceMesh.size())
+    {
+        setupCPUInstances(scene, cpuRT);
+        return;
+    }
+
+    std::vector<std::vector<vex::CPURaytracer::Triangle>> meshes(m_cpuMeshSource.size());
+    for (size_t m = 0; m < meshes.size(); ++m)
+    {
+        auto [ni, si] = m_cpuMeshSource[m];
+        bakeObjectSpaceMesh(scene.nodes[ni].submeshes[si].meshData, meshes[m]);
+    }
+    cpuRT.updateInstancedMaterials(meshes);
+}
+
 // ---------------------------------------------------------------------------
 // SceneGeometryCache::buildAccelerationStructures  (VK only)
 // ---------------------------------------------------------------------------
@@ -593,6 +963,284 @@ void SceneGeometryCache::buildAccelerationStructures(const Scene& scene,
 }
 #endif // VEX_BACKEND_VULKAN
 
+// ---------------------------------------------------------------------------
+// SceneGeometryCache::refitTransforms
+// ---------------------------------------------------------------------------
+
+bool SceneGeometryCache::refitTransforms(const Scene& scene, const std::vector<int>& movedNodes,
+                                         vex::CPURaytracer& cpuRT)
+{
+    m_lastRefitTris.clear();
+    if (!m_ready || scene.nodes.size() != m_nodeLocalAABBs.size())
+        return false;
+
+    auto t_refit = std::chrono::steady_clock::now();
+
+    // A node's world matrix feeds every descendant, so the whole subtree moves
+    const size_t nodeCount = scene.nodes.size();
+    std::vector<uint8_t> moved(nodeCount, 0);
+    std::vector<int> stack;
+    for (int ni : movedNodes)
+        if (ni >= 0 && ni < (int)nodeCount)
+            stack.push_back(ni);
+    while (!stack.empty())
+    {
+        int ni = stack.back();
+        stack.pop_back();
+        if (moved[ni]) continue;
+        moved[ni] = 1;
+        for (int c : scene.nodes[ni].childIndices)
+            if (c >= 0 && c < (int)nodeCount)
+                stack.push_back(c);
+    }
+
+    // Flat submesh numbering (node-major, the order rebuild() flattens in), plus a
+    // topology check: any added/removed submesh or triangle needs a full rebuild
+    std::vector<int> smBase(nodeCount + 1, 0);
+    size_t triTotal = 0;
+    for (size_t ni = 0; ni < nodeCount; ++ni)
+    {
+        smBase[ni + 1] = smBase[ni] + (int)scene.nodes[ni].submeshes.size();
+        for (const auto& sm : scene.nodes[ni].submeshes)
+            triTotal += sm.meshData.indices.size() / 3;
+    }
+    if (triTotal != m_rtBVH.primitiveCount())
+        return false;
+#ifdef VEX_BACKEND_VULKAN
+    if ((size_t)smBase[nodeCount] != m_vkInstanceOffsets.size())
+        return false;
+#endif
+
+    std::vector<glm::mat4> worldMats(smBase[nodeCount]);
+    std::vector<glm::mat3> normalMats(smBase[nodeCount]);
+    for (size_t ni = 0; ni < nodeCount; ++ni)
+    {
+        if (!moved[ni]) continue;
+        const glm::mat4 nodeWorld = scene.getWorldMatrix((int)ni);
+        for (int si = 0; si < (int)scene.nodes[ni].submeshes.size(); ++si)
+        {
+            const glm::mat4 combined = nodeWorld * scene.nodes[ni].submeshes[si].modelMatrix;
+            worldMats[smBase[ni] + si]  = combined;
+            normalMats[smBase[ni] + si] = glm::mat3(glm::transpose(glm::inverse(combined)));
+        }
+    }
+
+#ifdef VEX_BACKEND_VULKAN
+    static constexpr size_t FLOATS_PER_TRI = 52;
+#endif
+
+    // Re-transform every BVH reference whose source submesh moved
+    std::vector<bool> dirty(m_rtTriangles.size(), false);
+    bool emissiveMoved = false;
+    for (size_t i = 0; i < m_rtTriangles.size(); ++i)
+    {
+        auto [ni, si] = m_rtTriangleSrcSubmesh[i];
+        if (!moved[ni]) continue;
+
+        const int flatSm  = smBase[ni] + si;
+        const int triIdx  = m_rtTriangleSrcTriIdx[i];
+        const auto& md    = scene.nodes[ni].submeshes[si].meshData;
+        const auto& verts = md.vertices;
+        auto& tri = m_rtTriangles[i];
+        bakeTriangleGeometry(verts[md.indices[triIdx * 3 + 0]],
+                             verts[md.indices[triIdx * 3 + 1]],
+                             verts[md.indices[triIdx * 3 + 2]],
+                             worldMats[flatSm], normalMats[flatSm], tri);
+        dirty[i] = true;
+        m_lastRefitTris.push_back(static_cast<uint32_t>(i));
+        if (glm::length(tri.emissive) > 0.001f)
+            emissiveMoved = true;
+
+#ifdef VEX_BACKEND_VULKAN
+        if (!m_vkTriShading.empty())
+        {
+            size_t vkTri = static_cast<size_t>(m_vkInstanceOffsets[flatSm]) + triIdx;
+            packShadingGeometry(tri, &m_vkTriShading[vkTri * FLOATS_PER_TRI]);
+        }
+#endif
+    }
+
+    if (m_lastRefitTris.empty())
+        return true;
+    ++m_geometryGeneration;
+
+    m_rtBVH.refit([this](uint32_t i)
+    {
+        vex::AABB b;
+        b.grow(m_rtTriangles[i].v0);
+        b.grow(m_rtTriangles[i].v1);
+        b.grow(m_rtTriangles[i].v2);
+        return b;
+    }, dirty);
+
+    // A flat CPU BVH shares this topology and refits from its own triangle copy;
+    // a two-level one only moves its instances
+    float degradation = m_rtBVH.refitDegradation();
+    if (cpuRT.isInstanced())
+    {
+        if (!refitCPUInstances(scene, cpuRT))
+            return false;
+    }
+    else
+    {
+        degradation = cpuRT.refitGeometry(m_rtTriangles, m_lastRefitTris);
+    }
+
+    if (emissiveMoved)
+        rebuildLightCDF(m_luminanceCDF);
+
+    {
+        float ms = std::chrono::duration<float, std::milli>(
+            std::chrono::steady_clock::now() - t_refit).count();
+        char buf[160];
+        std::snprintf(buf, sizeof(buf),
+            "  BVH refit: %.1f ms  (%zu tris, SAH %.1f, %.2fx of build)",
+            ms, m_lastRefitTris.size(), m_rtBVH.sahCost(), degradation);
+        vex::Log::info(buf);
+    }
+
+    if (degradation > REFIT_MAX_SAH_GROWTH)
+    {
+        vex::Log::info("  BVH refit degraded past threshold, rebuilding");
+        return false;
+    }
+    return true;
+}
+
+#ifdef VEX_BACKEND_VULKAN
+void SceneGeometryCache::refitAccelerationStructures(const Scene& scene,
+                                                      vex::VKGpuRaytracer* vkRaytracer)
+{
+    if (!vkRaytracer || !m_blasTlasReady) return;
+
+    std::vector<glm::mat4> blasTransforms;
+    std::vector<bool>      blasOpaque;
+    blasTransforms.reserve(m_vkInstanceOffsets.size());
+    blasOpaque.reserve(m_vkInstanceOffsets.size());
+    for (int ni = 0; ni < (int)scene.nodes.size(); ++ni)
+    {
+        const glm::mat4 nodeWorld = scene.getWorldMatrix(ni);
+        for (const auto& sm : scene.nodes[ni].submeshes)
+        {
+            blasTransforms.push_back(nodeWorld * sm.modelMatrix);
+            bool needsAnyHit = sm.meshData.alphaClip || (sm.meshData.materialType == 3);
+            blasOpaque.push_back(!needsAnyHit);
+        }
+    }
+
+    auto t_tlas = std::chrono::steady_clock::now();
+    vkRaytracer->buildTlas(blasTransforms, blasOpaque);
+    float ms = std::chrono::duration<float, std::milli>(
+        std::chrono::steady_clock::now() - t_tlas).count();
+    char buf[64];
+    std::snprintf(buf, sizeof(buf), "  VK TLAS rebuild (GPU): %.1f ms", ms);
+    vex::Log::info(buf);
+}
+#endif // VEX_BACKEND_VULKAN
+
+// ---------------------------------------------------------------------------
+// SceneGeometryCache: disk cache housekeeping
+// ---------------------------------------------------------------------------
+
+void SceneGeometryCache::pruneDiskCache() const
+{
+    // Files are named by key, so edits leave old ones behind; keep the most
+    // recently written few (other scenes, undo targets)
+    std::error_code ec;
+    std::vector<std::pair<std::filesystem::file_time_type, std::filesystem::path>> files;
+    for (const auto& entry : std::filesystem::directory_iterator(m_diskCacheDir, ec))
+    {
+        if (entry.is_regular_file(ec) && entry.path().extension() == ".vgc")
+            files.push_back({ entry.last_write_time(ec), entry.path() });
+    }
+    if (files.size() <= DISK_CACHE_MAX_FILES)
+        return;
+
+    std::sort(files.begin(), files.end(), [](const auto& a, const auto& b) { return a.first > b.first; });
+    for (size_t i = DISK_CACHE_MAX_FILES; i < files.size(); ++i)
+        std::filesystem::remove(files[i].second, ec);
+}
+
+// ---------------------------------------------------------------------------
+// SceneGeometryCache: background SAH upgrade
+// ---------------------------------------------------------------------------
+
+void SceneGeometryCache::startSAHUpgrade(vex::BVHBuildOptions options)
+{
+    if (m_sahUpgrade || !m_ready || m_rtTriangles.empty())
+        return;
+
+    // Primitives are the current BVH-ordered triangles, so the new indices()
+    // permute every array that shares that order
+    std::vector<glm::vec3> verts(m_rtTriangles.size() * 3);
+    for (size_t i = 0; i < m_rtTriangles.size(); ++i)
+    {
+        verts[i * 3 + 0] = m_rtTriangles[i].v0;
+        verts[i * 3 + 1] = m_rtTriangles[i].v1;
+        verts[i * 3 + 2] = m_rtTriangles[i].v2;
+    }
+
+    // Leave half the cores to the renderer that keeps running meanwhile
+    options.builder = vex::BVHBuilder::SAH;
+    if (options.threadCount == 0)
+        options.threadCount = std::max(1u, std::thread::hardware_concurrency() / 2);
+
+    m_sahUpgrade = std::make_unique<SAHUpgrade>();
+    m_sahUpgrade->generation = m_geometryGeneration;
+    SAHUpgrade* upgrade = m_sahUpgrade.get();
+    upgrade->worker = std::thread([upgrade, verts = std::move(verts), options]()
+    {
+        auto t_build = std::chrono::steady_clock::now();
+        upgrade->bvh.buildFromTriangles(verts, options);
+        upgrade->buildMs = std::chrono::duration<float, std::milli>(
+            std::chrono::steady_clock::now() - t_build).count();
+        upgrade->done.store(true, std::memory_order_release);
+    });
+}
+
+bool SceneGeometryCache::pollSAHUpgrade(vex::CPURaytracer& cpuRT)
+{
+    if (!m_sahUpgrade || !m_sahUpgrade->done.load(std::memory_order_acquire))
+        return false;
+
+    m_sahUpgrade->worker.join();
+    std::unique_ptr<SAHUpgrade> upgrade = std::move(m_sahUpgrade);
+    if (upgrade->generation != m_geometryGeneration || upgrade->bvh.primitiveCount() != m_rtTriangles.size())
+    {
+        vex::Log::info("  BVH SAH upgrade discarded (geometry changed while building)");
+        return false;
+    }
+
+    const float fastSAH = m_rtBVH.sahCost();
+    const auto& indices = upgrade->bvh.indices();
+    std::vector<vex::CPURaytracer::Triangle> tris(indices.size());
+    std::vector<std::pair<int,int>>          src(indices.size());
+    std::vector<int>                         srcIdx(indices.size());
+    for (size_t i = 0; i < indices.size(); ++i)
+    {
+        tris[i]   = m_rtTriangles[indices[i]];
+        src[i]    = m_rtTriangleSrcSubmesh[indices[i]];
+        srcIdx[i] = m_rtTriangleSrcTriIdx[indices[i]];
+    }
+    m_rtTriangles          = std::move(tris);
+    m_rtTriangleSrcSubmesh = std::move(src);
+    m_rtTriangleSrcTriIdx  = std::move(srcIdx);
+    m_lastRefitTris.clear();
+
+    m_rtBVH = upgrade->bvh;
+    if (!cpuRT.isInstanced())
+        cpuRT.adoptBVH(std::move(upgrade->bvh));
+    buildRTLightCDF();
+    m_fastBuild = false;
+
+    char buf[128];
+    std::snprintf(buf, sizeof(buf),
+        "  BVH SAH upgrade swapped in: %.0f ms background build, SAH %.1f -> %.1f",
+        upgrade->buildMs, fastSAH, m_rtBVH.sahCost());
+    vex::Log::info(buf);
+    return true;
+}
+
 // ---------------------------------------------------------------------------
 // SceneGeometryCache::rebuildMaterials
 // ---------------------------------------------------------------------------
@@ -619,26 +1267,11 @@ void SceneGeometryCache::rebuildMaterials(const Scene& scene, vex::CPURaytracer*
         m_rtTriangles[i].alphaClip        = md.alphaClip;
     }
 
-    m_rtLightIndices.clear();
-    m_rtLightCDF.clear();
-    m_rtTotalLightArea = 0.0f;
-    for (uint32_t i = 0; i < static_cast<uint32_t>(m_rtTriangles.size()); ++i)
-    {
-        if (glm::length(m_rtTriangles[i].emissive) > 0.001f)
-        {
-            m_rtLightIndices.push_back(i);
-            const auto& em = m_rtTriangles[i].emissive;
-            float w = m_luminanceCDF
-                ? (0.2126f * em.r + 0.7152f * em.g + 0.0722f * em.b) * m_rtTriangles[i].area
-                : m_rtTriangles[i].area;
-            m_rtTotalLightArea += w;
-            m_rtLightCDF.push_back(m_rtTotalLightArea);
-        }
-    }
-    if (m_rtTotalLightArea > 0.0f)
-        for (float& c : m_rtLightCDF) c /= m_rtTotalLightArea;
+    buildRTLightCDF();
 
-    if (cpuRT)
+    if (cpuRT && cpuRT->isInstanced())
+        updateCPUInstanceMaterials(scene, *cpuRT);
+    else if (cpuRT)
         cpuRT->updateMaterials(m_rtTriangles);
 
 #ifdef VEX_BACKEND_VULKAN
@@ -729,19 +1362,22 @@ void SceneGeometryCache::rebuildMaterials(const Scene& scene, vex::CPURaytracer*
 }
 
 // ---------------------------------------------------------------------------
-// SceneGeometryCache::rebuildLightCDF
+// SceneGeometryCache::buildRTLightCDF
 // ---------------------------------------------------------------------------
 
-void SceneGeometryCache::rebuildLightCDF(bool luminanceCDF)
+void SceneGeometryCache::buildRTLightCDF()
 {
-    m_luminanceCDF = luminanceCDF;
+    // Spatial splits can reference one triangle from several leaves; only the
+    // first copy goes into the CDF so each emitter keeps its true probability.
+    const std::vector<bool> firstRef = m_rtBVH.firstReferenceMask();
 
-    // Rebuild CPU/compute light CDF from existing triangle data
     m_rtLightIndices.clear();
     m_rtLightCDF.clear();
     m_rtTotalLightArea = 0.0f;
     for (uint32_t i = 0; i < static_cast<uint32_t>(m_rtTriangles.size()); ++i)
     {
+        if (i < firstRef.size() && !firstRef[i])
+            continue;
         if (glm::length(m_rtTriangles[i].emissive) > 0.001f)
         {
             m_rtLightIndices.push_back(i);
@@ -756,6 +1392,23 @@ void SceneGeometryCache::rebuildLightCDF(bool luminanceCDF)
     if (m_rtTotalLightArea > 0.0f)
         for (float& c : m_rtLightCDF) c /= m_rtTotalLightArea;
 
+    std::vector<float> pmf(m_rtLightCDF.size());
+    for (size_t i = 0; i < pmf.size(); ++i)
+        pmf[i] = m_rtLightCDF[i] - (i > 0 ? m_rtLightCDF[i - 1] : 0.0f);
+    m_rtLightAlias.build(pmf);
+}
+
+// ---------------------------------------------------------------------------
+// SceneGeometryCache::rebuildLightCDF
+// ---------------------------------------------------------------------------
+
+void SceneGeometryCache::rebuildLightCDF(bool luminanceCDF)
+{
+    m_luminanceCDF = luminanceCDF;
+
+    // Rebuild CPU/compute light CDF from existing triangle data
+    buildRTLightCDF();
+
 #ifdef VEX_BACKEND_VULKAN
     // Rebuild VK HW RT light SSBO from m_vkTriShading (emissive at [6].xyz, area at [6].w)
     if (!m_vkTriShading.empty())
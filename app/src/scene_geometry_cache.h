@@ -3,8 +3,11 @@
 #include <vex/raytracing/cpu_raytracer.h>
 #include <vex/raytracing/bvh.h>
 
+#include <atomic>
 #include <functional>
+#include <memory>
 #include <string>
+#include <thread>
 #include <unordered_map>
 #include <utility>
 #include <vector>
@@ -13,6 +16,7 @@
 namespace vex { class VKGpuRaytracer; }
 #endif
 
+namespace vex { struct MeshData; }
 struct Scene;
 
 // Owns all packed geometry data (CPU triangles, BVH, VK SSBOs) and the logic
@@ -23,10 +27,16 @@ class SceneGeometryCache
 public:
     using ProgressFn = std::function<void(const std::string& stage, float progress)>;
 
+    SceneGeometryCache() = default;
+    ~SceneGeometryCache();
+    SceneGeometryCache(const SceneGeometryCache&) = delete;
+    SceneGeometryCache& operator=(const SceneGeometryCache&) = delete;
+
     // Full rebuild — packs all CPU + VK SSBO data. Call buildAccelerationStructures()
-    // afterwards on Vulkan to commit BLAS/TLAS to the GPU.
+    // afterwards on Vulkan to commit BLAS/TLAS to the GPU. fastBuild uses the
+    // Morton-code LBVH builder for the shared BVH (see startSAHUpgrade()).
     void rebuild(const Scene& scene, vex::CPURaytracer& cpuRT, bool luminanceCDF,
-                 ProgressFn progress = nullptr);
+                 ProgressFn progress = nullptr, bool fastBuild = false);
 
 #ifdef VEX_BACKEND_VULKAN
     // Builds BLAS per submesh and TLAS. Must be called after rebuild() on Vulkan.
@@ -34,6 +44,52 @@ public:
                                      ProgressFn progress = nullptr);
 #endif
 
+    // Incremental update for transform edits. Re-transforms only the triangles of
+    // movedNodes (and their descendants), refits the shared BVH bottom-up and patches
+    // the packed arrays in place. Returns false when rebuild() is needed instead:
+    // the cache is stale, the mesh topology changed, or the refit grew the BVH's SAH
+    // cost past REFIT_MAX_SAH_GROWTH of its last full build.
+    bool refitTransforms(const Scene& scene, const std::vector<int>& movedNodes,
+                         vex::CPURaytracer& cpuRT);
+
+    // BVH-ordered triangle indices patched by the last refitTransforms(), sorted.
+    const std::vector<uint32_t>& lastRefitTriangles() const { return m_lastRefitTris; }
+
+#ifdef VEX_BACKEND_VULKAN
+    // Rebuilds only the TLAS with the current node transforms (BLASes are in
+    // object space and stay valid). Call after a successful refitTransforms().
+    void refitAccelerationStructures(const Scene& scene, vex::VKGpuRaytracer* vkRaytracer);
+#endif
+
+    // Two-level CPU geometry: rebuild() hands the CPU tracer one BLAS per unique
+    // submesh (same vertices, indices and material) and an instance per submesh.
+    // Takes effect on the next rebuild().
+    void setCPUInstancing(bool enabled) { m_cpuInstancing = enabled; }
+    bool cpuInstancing() const { return m_cpuInstancing; }
+
+    // Moves the CPU tracer's instances to the current node transforms (TLAS only,
+    // the flat arrays are left alone). Returns false when the CPU tracer is not
+    // instanced or the submesh layout changed since rebuild().
+    bool refitCPUInstances(const Scene& scene, vex::CPURaytracer& cpuRT);
+
+    // Persistent cache of the flat CPU geometry (BVH, BVH-ordered triangles and
+    // light CDF) in dir, one memory-mapped file per content key: geometry,
+    // materials, transforms, texture slots and BVH build options. A changed
+    // input yields a new key and so a miss; only the DISK_CACHE_MAX_FILES most
+    // recent files are kept. Empty dir disables it. Fast builds bypass it.
+    void setDiskCacheDir(std::string dir) { m_diskCacheDir = std::move(dir); }
+    const std::string& diskCacheDir() const { return m_diskCacheDir; }
+
+    // Background SAH upgrade of a fastBuild tree. startSAHUpgrade() copies the
+    // triangle vertices and builds on a worker thread; pollSAHUpgrade() swaps the
+    // result in (reordering every BVH-ordered array and the CPU tracer) once it is
+    // done. A result is dropped if the geometry moved while it was building.
+    // Returns true when a new tree was swapped in.
+    void startSAHUpgrade(vex::BVHBuildOptions options);
+    bool pollSAHUpgrade(vex::CPURaytracer& cpuRT);
+    bool isFastBuild()        const { return m_fastBuild; }
+    bool sahUpgradeRunning()  const { return m_sahUpgrade != nullptr; }
+
     // Patch material properties (baseColor, emissive, emissiveStrength) for changed
     // submeshes, then rebuild the light CDF. Much cheaper than full rebuild.
     void rebuildMaterials(const Scene& scene, vex::CPURaytracer* cpuRT, bool luminanceCDF);
@@ -50,6 +106,8 @@ public:
     const vex::BVH&                                    bvh()            const { return m_rtBVH; }
     const std::vector<uint32_t>&                       lightIndices()   const { return m_rtLightIndices; }
     const std::vector<float>&                          lightCDF()       const { return m_rtLightCDF; }
+    // Alias table over lightIndices() with the CDF's probabilities; O(1) sampling
+    const vex::AliasTable&                             lightAlias()     const { return m_rtLightAlias; }
     float                                              totalLightArea() const { return m_rtTotalLightArea; }
     const std::vector<vex::CPURaytracer::TextureData>& textures()       const { return m_rtTextures; }
     const std::vector<vex::AABB>&                      nodeLocalAABBs() const { return m_nodeLocalAABBs; }
@@ -73,9 +131,41 @@ public:
 #endif
 
 private:
+    // A refit stretches boxes the splits were never chosen for; past this SAH
+    // growth a full rebuild pays for itself within a few samples.
+    static constexpr float REFIT_MAX_SAH_GROWTH = 1.3f;
+    static constexpr size_t DISK_CACHE_MAX_FILES = 8;
+
+    // CPU/compute light CDF and alias table over m_rtTriangles (first BVH reference of each triangle only)
+    void buildRTLightCDF();
+    void pruneDiskCache() const;
+
+    // Groups submeshes into shared meshes and uploads the two-level CPU geometry
+    void setupCPUInstances(const Scene& scene, vex::CPURaytracer& cpuRT);
+    void updateCPUInstanceMaterials(const Scene& scene, vex::CPURaytracer& cpuRT);
+    // Object-space triangles of one submesh, baked like rebuild() bakes world space
+    void bakeObjectSpaceMesh(const vex::MeshData& md, std::vector<vex::CPURaytracer::Triangle>& out) const;
+
     bool m_ready        = false;
     bool m_blasTlasReady = false;
     bool m_luminanceCDF = false;
+    bool m_cpuInstancing = false;
+    bool m_fastBuild     = false; // m_rtBVH came from the LBVH builder
+    std::string m_diskCacheDir;
+
+    // Bumped whenever triangle positions change; an SAH upgrade built from an
+    // older generation no longer matches the arrays and is discarded.
+    uint64_t m_geometryGeneration = 0;
+
+    struct SAHUpgrade
+    {
+        std::thread       worker;
+        std::atomic<bool> done{false};
+        vex::BVH          bvh;
+        uint64_t          generation = 0;
+        float             buildMs    = 0.0f;
+    };
+    std::unique_ptr<SAHUpgrade> m_sahUpgrade;
 
     std::vector<vex::CPURaytracer::Triangle>    m_rtTriangles;
     std::vector<std::pair<int,int>>             m_rtTriangleSrcSubmesh;
@@ -84,8 +174,12 @@ private:
     vex::BVH                                    m_rtBVH;
     std::vector<uint32_t>                       m_rtLightIndices;
     std::vector<float>                          m_rtLightCDF;
+    vex::AliasTable                             m_rtLightAlias;
     float                                       m_rtTotalLightArea = 0.0f;
     std::vector<vex::AABB>                      m_nodeLocalAABBs;
+    std::vector<uint32_t>                       m_lastRefitTris;
+    std::vector<uint32_t>                       m_cpuInstanceMesh;  // flat submesh → CPU mesh id
+    std::vector<std::pair<int,int>>             m_cpuMeshSource;    // CPU mesh id → representative {node, submesh}
     // Maps texture path → texture index; populated during rebuild() so rebuildMaterials()
     // can re-derive alpha texture indices without reading back from the SSBO.
     std::unordered_map<std::string, int>        m_texturePathToIndex;
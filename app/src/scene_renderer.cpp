@@ -113,6 +113,18 @@ bool SceneRenderer::init([[maybe_unused]] Scene& scene)
 
     // Initialize CPU raytracer
     m_cpuRaytracer = std::make_unique<vex::CPURaytracer>();
+    {
+        // Final-quality builds (scene load, the background SAH upgrade) get a
+        // couple of reinsertion passes, capped at 250 ms for large scenes;
+        // edit-time LBVH builds skip them. Leaves of up to four triangles
+        // fill the tracer's SIMD blocks.
+        vex::BVHBuildOptions options = m_cpuRaytracer->getBVHBuildOptions();
+        options.optimizePasses   = 2;
+        options.optimizeBudgetMs = 250.0f;
+        options.leafSize         = 4;
+        m_cpuRaytracer->setBVHBuildOptions(options);
+    }
+    setGeometryDiskCache(true);
 
     // Initialize denoiser (no-op if OIDN not compiled in)
     m_denoiser = std::make_unique<vex::Denoiser>();
@@ -449,6 +461,11 @@ float SceneRenderer::getSamplesPerSec() const
     return m_activeMode ? m_activeMode->getSamplesPerSec() : 0.0f;
 }
 
+float SceneRenderer::getRaysPerSec() const
+{
+    return m_activeMode ? m_activeMode->getRaysPerSec() : 0.0f;
+}
+
 uint32_t SceneRenderer::getRaytraceSampleCount() const
 {
     return m_activeMode ? m_activeMode->getSampleCount() : 0;
@@ -487,10 +504,51 @@ void SceneRenderer::setUseLuminanceCDF(bool v)
 #endif
 }
 
+void SceneRenderer::setBVHBuildOptions(const vex::BVHBuildOptions& options)
+{
+    const vex::BVHBuildOptions& cur = m_cpuRaytracer->getBVHBuildOptions();
+    if (cur.threadCount == options.threadCount
+        && cur.spatialSplits == options.spatialSplits
+        && cur.spatialSplitBudget == options.spatialSplitBudget
+        && cur.spatialSplitAlpha == options.spatialSplitAlpha
+        && cur.builder == options.builder
+        && cur.leafSize == options.leafSize
+        && cur.optimizePasses == options.optimizePasses
+        && cur.optimizeBudgetMs == options.optimizeBudgetMs)
+        return;
+
+    m_cpuRaytracer->setBVHBuildOptions(options);
+    if (m_geomCache.isReady())
+        m_pendingGeomRebuild = true;
+}
+
+uint32_t SceneRenderer::getCPUBVHWidth() const { return m_cpuRaytracer ? m_cpuRaytracer->getBVHWidth() : 2; }
+size_t   SceneRenderer::getCPUBVHMemoryBytes() const { return m_cpuRaytracer ? m_cpuRaytracer->getTraversalBVHMemoryBytes() : 0; }
+size_t   SceneRenderer::getCPUTriangleMemoryBytes() const { return m_cpuRaytracer ? m_cpuRaytracer->getTriangleMemoryBytes() : 0; }
+uint32_t SceneRenderer::getCPUInstanceCount() const { return m_cpuRaytracer ? m_cpuRaytracer->getInstanceCount() : 0; }
+uint32_t SceneRenderer::getCPUMeshCount() const { return m_cpuRaytracer ? m_cpuRaytracer->getMeshCount() : 0; }
+
+float SceneRenderer::getCPUConvergedTileFraction() const { return m_cpuRaytracer ? m_cpuRaytracer->getConvergedTileFraction() : 0.0f; }
+
+std::vector<vex::CPURaytracer::WorkerStats> SceneRenderer::getCPUWorkerStats() const
+{
+    return m_cpuRaytracer ? m_cpuRaytracer->getWorkerStats() : std::vector<vex::CPURaytracer::WorkerStats>{};
+}
+
+size_t SceneRenderer::getGPUBVHMemoryBytes() const
+{
+#ifdef VEX_BACKEND_OPENGL
+    if (m_gpuMode && m_gpuMode->getRaytracer())
+        return m_gpuMode->getRaytracer()->getBVHMemoryBytes();
+#endif
+    return 0;
+}
+
 uint32_t  SceneRenderer::getBVHNodeCount()  const { return m_geomCache.isReady() ? m_geomCache.bvh().nodeCount()   : 0; }
 size_t    SceneRenderer::getBVHMemoryBytes() const { return m_geomCache.isReady() ? m_geomCache.bvh().memoryBytes() : 0; }
 vex::AABB SceneRenderer::getBVHRootAABB()   const { return m_geomCache.isReady() ? m_geomCache.bvh().rootAABB()    : vex::AABB{}; }
 float     SceneRenderer::getBVHSAHCost()    const { return m_geomCache.isReady() ? m_geomCache.bvh().sahCost()     : 0.0f; }
+float     SceneRenderer::getBVHDuplicationRatio() const { return m_geomCache.isReady() ? m_geomCache.bvh().duplicationRatio() : 1.0f; }
 size_t    SceneRenderer::getLightTriangleCount() const { return m_geomCache.isReady() ? m_geomCache.lightIndices().size() : 0; }
 float     SceneRenderer::getTotalLightArea()     const { return m_geomCache.isReady() ? m_geomCache.totalLightArea()      : 0.0f; }
 
@@ -518,6 +576,26 @@ void SceneRenderer::applyCPURTSettings()
     m_cpuRaytracer->setEnableACES(s.enableACES);
     m_cpuRaytracer->setRayEps(s.rayEps);
     m_cpuRaytracer->setEnableRR(s.enableRR);
+    m_cpuRaytracer->setUseLightBVH(s.lightBVH);
+    m_cpuRaytracer->setSphericalLightSampling(s.sphericalLights);
+    m_cpuRaytracer->setPathGuiding(s.pathGuiding);
+    m_cpuRaytracer->setPathGuideMemoryLimit(static_cast<size_t>(std::max(1, s.pathGuideMemoryMB)) << 20);
+    m_cpuRaytracer->setSampler(static_cast<vex::CPURaytracer::Sampler>(std::clamp(s.samplerType, 0, 2)));
+    m_cpuRaytracer->setBVHWidth(static_cast<uint32_t>(s.bvhWidth));
+    m_cpuRaytracer->setCompressedBVH(s.compressedBVH);
+    m_cpuRaytracer->setPacketTracing(s.packetTracing);
+    m_cpuRaytracer->setWavefront(s.wavefront);
+    m_cpuRaytracer->setAdaptiveSampling(s.adaptiveSampling);
+    m_cpuRaytracer->setAdaptiveThreshold(s.adaptiveThreshold);
+    m_cpuRaytracer->setAdaptiveMinSamples(static_cast<uint32_t>(std::max(2, s.adaptiveMinSamples)));
+
+    // Switching between flat and two-level geometry needs a rebuild
+    if (s.instancedBVH != m_geomCache.cpuInstancing())
+    {
+        m_geomCache.setCPUInstancing(s.instancedBVH);
+        if (m_geomCache.isReady())
+            m_pendingGeomRebuild = true;
+    }
 }
 
 void SceneRenderer::applyRasterSettings()
@@ -598,9 +676,13 @@ void SceneRenderer::flushPendingGeomRebuild(Scene& scene, ProgressFn progress)
 #endif
 }
 
-void SceneRenderer::rebuildRaytraceGeometry(Scene& scene, ProgressFn progress)
+void SceneRenderer::rebuildRaytraceGeometry(Scene& scene, ProgressFn progress, bool interactive)
 {
-    m_geomCache.rebuild(scene, *m_cpuRaytracer, m_luminanceCDF, progress);
+    m_pendingRefitNodes.clear(); // a full rebuild picks up every transform
+    m_deferredRefitNodes.clear();
+    m_lastGeometryEdit = std::chrono::steady_clock::now();
+    m_geomCache.rebuild(scene, *m_cpuRaytracer, m_luminanceCDF, progress,
+                        interactive && m_fastEditRebuilds);
 #ifdef VEX_BACKEND_VULKAN
     m_geomCache.buildAccelerationStructures(scene, m_gpuMode ? m_gpuMode->getRaytracer() : nullptr, progress);
 #endif
@@ -610,6 +692,57 @@ void SceneRenderer::rebuildRaytraceGeometry(Scene& scene, ProgressFn progress)
 #endif
 }
 
+void SceneRenderer::refitRaytraceGeometry(Scene& scene)
+{
+    std::vector<int> moved = std::move(m_pendingRefitNodes);
+    m_pendingRefitNodes.clear();
+    m_lastGeometryEdit = std::chrono::steady_clock::now();
+
+    // The two-level CPU BVH only rebuilds its TLAS. The shared flat arrays are
+    // read by the GPU modes alone, so they catch up once one of those is active.
+    if (m_renderMode == RenderMode::CPURaytrace && m_cpuRaytracer->isInstanced()
+        && m_geomCache.refitCPUInstances(scene, *m_cpuRaytracer))
+    {
+        for (int ni : moved)
+            if (std::find(m_deferredRefitNodes.begin(), m_deferredRefitNodes.end(), ni) == m_deferredRefitNodes.end())
+                m_deferredRefitNodes.push_back(ni);
+        return;
+    }
+
+    if (!m_geomCache.refitTransforms(scene, moved, *m_cpuRaytracer))
+    {
+        vex::Log::info("Building scene geometry (transform changed)");
+        rebuildRaytraceGeometry(scene, nullptr, true);
+        return;
+    }
+
+#ifdef VEX_BACKEND_VULKAN
+    m_geomCache.refitAccelerationStructures(scene, m_gpuMode ? m_gpuMode->getRaytracer() : nullptr);
+#endif
+    if (m_gpuMode) m_gpuMode->onGeometryRefit();
+#ifdef VEX_BACKEND_VULKAN
+    if (m_computeMode) m_computeMode->onGeometryRefit();
+#endif
+}
+
+void SceneRenderer::updateSAHUpgrade()
+{
+    if (m_geomCache.pollSAHUpgrade(*m_cpuRaytracer))
+    {
+        // The shared triangle/BVH arrays were reordered; the VK BLASes are per mesh
+        // and unaffected
+        if (m_gpuMode) m_gpuMode->onGeometryRebuilt();
+#ifdef VEX_BACKEND_VULKAN
+        if (m_computeMode) m_computeMode->onGeometryRebuilt();
+#endif
+        return;
+    }
+
+    if (m_geomCache.isFastBuild() && !m_geomCache.sahUpgradeRunning()
+        && std::chrono::steady_clock::now() - m_lastGeometryEdit >= SAH_UPGRADE_DELAY)
+        m_geomCache.startSAHUpgrade(m_cpuRaytracer->getBVHBuildOptions());
+}
+
 void SceneRenderer::rebuildMaterials(Scene& scene)
 {
     m_geomCache.rebuildMaterials(scene, m_cpuRaytracer.get(), m_luminanceCDF);
@@ -744,6 +877,16 @@ void SceneRenderer::renderShadowPrePass(Scene& scene)
 
 void SceneRenderer::renderScene(Scene& scene, int selectedNodeIdx, int selectedSubmesh)
 {
+    // Transform-only edits accumulate until a RT mode is active, then refit
+    if (!scene.transformDirtyNodes.empty())
+    {
+        for (int ni : scene.transformDirtyNodes)
+            if (std::find(m_pendingRefitNodes.begin(), m_pendingRefitNodes.end(), ni) == m_pendingRefitNodes.end())
+                m_pendingRefitNodes.push_back(ni);
+        scene.transformDirtyNodes.clear();
+        m_shadowMapDirty = true;
+    }
+
     // If we just switched to a path tracing mode, force a geometry rebuild so that
     // any gizmo model matrix changes from rasterization mode are applied.
     if (m_pendingGeomRebuild)
@@ -771,7 +914,7 @@ void SceneRenderer::renderScene(Scene& scene, int selectedNodeIdx, int selectedS
     if (scene.geometryDirty)
     {
         vex::Log::info("Building scene geometry (geometry changed)");
-        rebuildRaytraceGeometry(scene, nullptr);
+        rebuildRaytraceGeometry(scene, nullptr, true);
         scene.geometryDirty = false;
         scene.materialDirty = false; // geometry rebuild includes material bake
         m_shadowMapDirty    = true;
@@ -782,6 +925,21 @@ void SceneRenderer::renderScene(Scene& scene, int selectedNodeIdx, int selectedS
         scene.materialDirty = false;
     }
 
+    if (!m_deferredRefitNodes.empty() && m_renderMode != RenderMode::Rasterize
+        && m_renderMode != RenderMode::CPURaytrace)
+    {
+        for (int ni : m_deferredRefitNodes)
+            if (std::find(m_pendingRefitNodes.begin(), m_pendingRefitNodes.end(), ni) == m_pendingRefitNodes.end())
+                m_pendingRefitNodes.push_back(ni);
+        m_deferredRefitNodes.clear();
+    }
+
+    if (!m_pendingRefitNodes.empty() && m_renderMode != RenderMode::Rasterize)
+        refitRaytraceGeometry(scene);
+
+    if (m_renderMode != RenderMode::Rasterize)
+        updateSAHUpgrade();
+
     // Outline mask pass — runs unconditionally for all render modes so path tracers
     // can sample it in their display pass. Must happen before the mode dispatch.
     {
@@ -842,6 +1000,8 @@ SharedRenderData SceneRenderer::buildSharedRenderData()
     shared.enableNormalMapping = m_rasterSettings.enableNormalMapping;
     shared.showDenoisedResult  = &m_showDenoisedResult;
     shared.maxSamples          = m_maxSamples;
+    shared.cpuShowSampleCounts = m_cpuRTSettings.showSampleCounts;
+    shared.cpuFrameBudgetMs    = m_cpuRTSettings.frameBudgetMs;
     shared.debugMode           = static_cast<int>(m_debugMode);
     shared.drawCalls           = &m_drawCalls;
 
@@ -955,6 +1115,21 @@ void SceneRenderer::loadEnvData(Scene& scene)
                 std::copy(margCDF.begin(), margCDF.end(), m_vkEnvCdfData.begin());
                 std::copy(condCDF.begin(), condCDF.end(), m_vkEnvCdfData.begin() + eh);
                 m_vkEnvCdfData.back() = totalIntegral;
+
+                // The same distribution as alias tables: row marginal, then
+                // each row's conditional (W entries)
+                vex::AliasTable table;
+                table.build(rowSums);
+                m_vkEnvAliasData = table.entries();
+                std::vector<float> rowWeights(ew);
+                for (int y = 0; y < eh; ++y)
+                {
+                    float sinTheta = std::sin((y + 0.5f) / float(eh) * PI);
+                    for (int x = 0; x < ew; ++x)
+                        rowWeights[x] = lum[y * ew + x] * sinTheta;
+                    table.build(rowWeights);
+                    m_vkEnvAliasData.insert(m_vkEnvAliasData.end(), table.entries().begin(), table.entries().end());
+                }
             }
 
             // RGBA8 env texture for VK rasterizer
@@ -1003,6 +1178,7 @@ void SceneRenderer::loadEnvData(Scene& scene)
         m_vkRasterEnvTex.reset();
         m_vkEnvMapData.clear();
         m_vkEnvCdfData.clear();
+        m_vkEnvAliasData.clear();
         m_vkEnvMapW = 0;
         m_vkEnvMapH = 0;
 #endif
@@ -1132,6 +1308,7 @@ FrameChanges SceneRenderer::computeFrameChanges(Scene& scene)
     // Populate VK env data pointers in changes (valid this frame after loadEnvData)
     changes.vkEnvMapData = m_vkEnvMapData.empty()  ? nullptr : &m_vkEnvMapData;
     changes.vkEnvCdfData = m_vkEnvCdfData.empty()  ? nullptr : &m_vkEnvCdfData;
+    changes.vkEnvAliasData = m_vkEnvAliasData.empty() ? nullptr : &m_vkEnvAliasData;
     changes.vkEnvMapW    = m_vkEnvMapW;
     changes.vkEnvMapH    = m_vkEnvMapH;
 #endif
@@ -1254,6 +1431,8 @@ void SceneRenderer::triggerDenoiseAux()
 #endif
     if (m_renderMode == RenderMode::CPURaytrace && m_cpuRaytracer)
     {
+        // The aux buffers are live, so the background passes stop first
+        m_cpuRaytracer->cancelSample();
         m_cpuRaytracer->getLinearHDR(m_denoiseLinearHDR);
         m_cpuRaytracer->getAuxBuffers(m_denoiseAlbedo, m_denoiseNormal);
     }
@@ -58,6 +58,7 @@ public:
     vex::Framebuffer* getFramebuffer() { return m_framebuffer.get(); }
     int getDrawCalls() const { return m_drawCalls; }
     float getSamplesPerSec() const;
+    float getRaysPerSec() const;
 
     // Shadow map debug display
     // Returns an ImTextureID-compatible handle (0 if shadow map not yet rendered).
@@ -84,10 +85,37 @@ public:
     void setUseLuminanceCDF(bool v);
     bool getUseLuminanceCDF() const { return m_luminanceCDF; }
 
+    // BVH build options (spatial splits etc.) — a change schedules a geometry rebuild
+    void setBVHBuildOptions(const vex::BVHBuildOptions& options);
+    const vex::BVHBuildOptions& getBVHBuildOptions() const { return m_cpuRaytracer->getBVHBuildOptions(); }
+
+    // Edit-triggered rebuilds use the LBVH builder; a SAH tree is built in the
+    // background and swapped in once edits pause for SAH_UPGRADE_DELAY
+    void setFastEditRebuilds(bool v) { m_fastEditRebuilds = v; }
+    bool getFastEditRebuilds() const { return m_fastEditRebuilds; }
+
+    // Final-quality geometry builds are cached on disk (GEOMETRY_CACHE_DIR) and
+    // reloaded when the scene content and build settings match
+    void setGeometryDiskCache(bool v) { m_geomCache.setDiskCacheDir(v ? GEOMETRY_CACHE_DIR : ""); }
+    bool getGeometryDiskCache() const { return !m_geomCache.diskCacheDir().empty(); }
+    static constexpr const char* GEOMETRY_CACHE_DIR = "cache/geometry";
+
+    // Active CPU traversal width (2 = binary, 4 = BVH4/SSE, 8 = BVH8/AVX2)
+    uint32_t getCPUBVHWidth() const;
+    size_t   getCPUBVHMemoryBytes() const; // nodes the CPU tracer traverses (active layout)
+    size_t   getCPUTriangleMemoryBytes() const;
+    uint32_t getCPUInstanceCount() const;  // 0 unless the CPU tracer uses the two-level BVH
+    uint32_t getCPUMeshCount() const;
+    // Tile scheduler stats of the last CPU sample, one entry per worker thread
+    std::vector<vex::CPURaytracer::WorkerStats> getCPUWorkerStats() const;
+    float getCPUConvergedTileFraction() const; // adaptive sampling; 0 when off
+    size_t   getGPUBVHMemoryBytes() const; // node buffer uploaded by the GL path tracer
+
     uint32_t getBVHNodeCount() const;
     size_t   getBVHMemoryBytes() const;
     vex::AABB getBVHRootAABB() const;
     float    getBVHSAHCost() const;
+    float    getBVHDuplicationRatio() const;
     size_t   getLightTriangleCount() const;
     float    getTotalLightArea() const;
 
@@ -127,7 +155,13 @@ private:
                            const glm::mat4& view, const glm::mat4& proj);
     void renderShadowPrePass(Scene& scene);
     void rebuildMaterials(Scene& scene);
-    void rebuildRaytraceGeometry(Scene& scene, ProgressFn progress = nullptr);
+    // interactive = triggered by an edit (eligible for the fast LBVH build)
+    void rebuildRaytraceGeometry(Scene& scene, ProgressFn progress = nullptr, bool interactive = false);
+    // Applies m_pendingRefitNodes via SceneGeometryCache::refitTransforms, falling
+    // back to a full rebuild when the refit is rejected.
+    void refitRaytraceGeometry(Scene& scene);
+    // Swaps in a finished background SAH build, or starts one once edits pause
+    void updateSAHUpgrade();
 
     SharedRenderData buildSharedRenderData();
     FrameChanges     computeFrameChanges(Scene& scene);
@@ -197,6 +231,11 @@ private:
 
     // CPU raytracing
     bool m_pendingGeomRebuild = false;
+    std::vector<int> m_pendingRefitNodes; // transform edits not yet applied to the RT geometry
+    std::vector<int> m_deferredRefitNodes; // moves only the two-level CPU BVH has applied so far
+    bool m_fastEditRebuilds = true;
+    std::chrono::steady_clock::time_point m_lastGeometryEdit{};
+    static constexpr std::chrono::milliseconds SAH_UPGRADE_DELAY{1000};
     std::unique_ptr<vex::CPURaytracer> m_cpuRaytracer;
     std::unique_ptr<vex::Texture2D>    m_raytraceTexture; // CPU/denoised display texture
     uint32_t m_raytraceTexW      = 0;
@@ -221,6 +260,7 @@ private:
     // VK RT env map data (reloaded by loadEnvData() on env change)
     std::vector<float> m_vkEnvMapData;
     std::vector<float> m_vkEnvCdfData;
+    std::vector<vex::AliasTable::Entry> m_vkEnvAliasData; // same layout as CPURaytracer::exportEnvAliasTables()
     int m_vkEnvMapW = 0;
     int m_vkEnvMapH = 0;
 #endif
@@ -2,6 +2,7 @@
 
 #include <vex/raytracing/cpu_raytracer.h>
 #include <vex/raytracing/bvh.h>
+#include <vex/raytracing/compressed_bvh.h>
 
 #include <glm/glm.hpp>
 
@@ -26,6 +27,16 @@ public:
                         float totalLightArea,
                         const std::vector<CPURaytracer::TextureData>& textures);
 
+    // In-place update after a BVH refit: same triangle count and order, same tree
+    // topology. Rewrites the node buffer, patches only changedTriangles (sorted
+    // BVH-order indices) in the triangle buffers and re-uploads the lights.
+    void updateGeometry(const std::vector<CPURaytracer::Triangle>& triangles,
+                        const BVH& bvh,
+                        const std::vector<uint32_t>& changedTriangles,
+                        const std::vector<uint32_t>& lightIndices,
+                        const std::vector<float>& lightCDF,
+                        float totalLightArea);
+
     // Environment
     void setEnvironmentMap(const float* data, int w, int h);
     void clearEnvironmentMap();
@@ -57,6 +68,15 @@ public:
     void setEnableRR(bool v);
     bool getEnableRR() const { return m_enableRR; }
 
+    // BVH node layout for the next uploadGeometry(): full-precision binary
+    // nodes (32 B each) or compressed 4-wide nodes with 8-bit child bounds
+    // (64 B per 4 children). The caller re-uploads geometry after a change.
+    void setCompressedBVH(bool v) { m_compressedBVH = v; }
+    bool getCompressedBVH() const { return m_compressedBVH; }
+    bool isUploadedBVHCompressed() const { return m_uploadedCompressed; }
+    uint32_t getBVHNodeCount() const { return m_bvhNodeCount; }
+    size_t   getBVHMemoryBytes() const { return m_bvhBytes; } // uploaded node buffer size
+
     // Depth of field (aperture=0 → pinhole; reset must be called externally when changed)
     void setDoF(float aperture, float focusDistance, glm::vec3 right, glm::vec3 up);
 
@@ -87,6 +107,10 @@ private:
     bool compileComputeShader(const std::string& path);
     void createAccumTexture();
     void cacheUniformLocations();
+    void uploadBVHNodes(const BVH& bvh, bool inPlace);
+    void uploadLights(const std::vector<uint32_t>& lightIndices,
+                      const std::vector<float>& lightCDF,
+                      float totalLightArea);
 
     uint32_t m_computeProgram = 0;
     uint32_t m_accumTexture = 0;
@@ -135,6 +159,7 @@ private:
     int32_t m_locUseLuminanceCDF = -1;
     int32_t m_locTriangleCount = -1;
     int32_t m_locBvhNodeCount = -1;
+    int32_t m_locCompressedBVH = -1;
     int32_t m_locRayEps = -1;
     int32_t m_locEnableRR = -1;
     int32_t m_locAperture = -1;
@@ -188,6 +213,11 @@ private:
     // Geometry counts for dispatch
     uint32_t m_triangleCount = 0;
     uint32_t m_bvhNodeCount = 0;
+
+    // BVH layout
+    bool   m_compressedBVH = false;
+    bool   m_uploadedCompressed = false;
+    size_t m_bvhBytes = 0;
 };
 
 } // namespace vex
@@ -138,6 +138,7 @@ void GLGPURaytracer::cacheUniformLocations()
     m_locUseLuminanceCDF     = loc("u_useLuminanceCDF");
     m_locTriangleCount       = loc("u_triangleCount");
     m_locBvhNodeCount        = loc("u_bvhNodeCount");
+    m_locCompressedBVH       = loc("u_compressedBVH");
     m_locRayEps              = loc("u_rayEps");
     m_locEnableRR            = loc("u_enableRR");
     m_locAperture            = loc("u_aperture");
@@ -200,110 +201,110 @@ void GLGPURaytracer::shutdown()
     if (m_computeProgram) { glDeleteProgram(m_computeProgram);     m_computeProgram = 0; }
 }
 
-void GLGPURaytracer::uploadGeometry(
-    const std::vector<CPURaytracer::Triangle>& triangles,
-    const BVH& bvh,
-    const std::vector<uint32_t>& lightIndices,
-    const std::vector<float>& lightCDF,
-    float totalLightArea,
-    const std::vector<CPURaytracer::TextureData>& textures)
-{
-    m_triangleCount = static_cast<uint32_t>(triangles.size());
-    m_bvhNodeCount  = bvh.nodeCount();
+// 3 vec4s per triangle (48 bytes): v0+pad, v1+pad, v2+pad
+static constexpr size_t TRI_VERT_FLOATS = 12;
+// 10 vec4s per triangle (160 bytes)
+static constexpr size_t TRI_SHADING_FLOATS = 40;
 
-    // ── Upload BVH nodes ───────────────────────────────────────────
-    // GPU layout: vec3 boundsMin, uint leftFirst, vec3 boundsMax, uint triCount (32 bytes)
-    struct GPUBVHNode {
-        float minX, minY, minZ;
-        uint32_t leftFirst;
-        float maxX, maxY, maxZ;
-        uint32_t triCount;
-    };
+static void packTriVerts(const CPURaytracer::Triangle& tri, float* p)
+{
+    p[0]  = tri.v0.x; p[1]  = tri.v0.y; p[2]  = tri.v0.z; p[3]  = 0.0f;
+    p[4]  = tri.v1.x; p[5]  = tri.v1.y; p[6]  = tri.v1.z; p[7]  = 0.0f;
+    p[8]  = tri.v2.x; p[9]  = tri.v2.y; p[10] = tri.v2.z; p[11] = 0.0f;
+}
 
-    const auto& nodes = bvh.nodes();
-    std::vector<GPUBVHNode> gpuNodes(nodes.size());
-    for (size_t i = 0; i < nodes.size(); ++i)
-    {
-        gpuNodes[i].minX = nodes[i].bounds.min.x;
-        gpuNodes[i].minY = nodes[i].bounds.min.y;
-        gpuNodes[i].minZ = nodes[i].bounds.min.z;
-        gpuNodes[i].leftFirst = nodes[i].leftFirst;
-        gpuNodes[i].maxX = nodes[i].bounds.max.x;
-        gpuNodes[i].maxY = nodes[i].bounds.max.y;
-        gpuNodes[i].maxZ = nodes[i].bounds.max.z;
-        gpuNodes[i].triCount = nodes[i].triCount;
-    }
+static void packTriShading(const CPURaytracer::Triangle& tri, float* p)
+{
+    // vec4 0: n0 + roughnessTextureIndex (int bits)
+    p[0]  = tri.n0.x; p[1]  = tri.n0.y; p[2]  = tri.n0.z;
+    { uint32_t bits; std::memcpy(&bits, &tri.roughnessTextureIndex, sizeof(int)); std::memcpy(&p[3], &bits, sizeof(float)); }
+    // vec4 1: n1 + metallicTextureIndex (int bits)
+    p[4]  = tri.n1.x; p[5]  = tri.n1.y; p[6]  = tri.n1.z;
+    { uint32_t bits; std::memcpy(&bits, &tri.metallicTextureIndex, sizeof(int)); std::memcpy(&p[7], &bits, sizeof(float)); }
+    // vec4 2: n2 + emissiveStrength
+    p[8]  = tri.n2.x; p[9]  = tri.n2.y; p[10] = tri.n2.z; p[11] = tri.emissiveStrength;
+    // vec4 3: uv0.xy, uv1.xy
+    p[12] = tri.uv0.x; p[13] = tri.uv0.y; p[14] = tri.uv1.x; p[15] = tri.uv1.y;
+    // vec4 4: uv2.xy, roughness, metallic
+    p[16] = tri.uv2.x; p[17] = tri.uv2.y; p[18] = tri.roughness; p[19] = tri.metallic;
+    // vec4 5: color + texIndex (as int bits)
+    p[20] = tri.color.x; p[21] = tri.color.y; p[22] = tri.color.z;
+    uint32_t texBits;
+    std::memcpy(&texBits, &tri.textureIndex, sizeof(int));
+    std::memcpy(&p[23], &texBits, sizeof(float));
+    // vec4 6: emissive + area
+    p[24] = tri.emissive.x; p[25] = tri.emissive.y; p[26] = tri.emissive.z; p[27] = tri.area;
+    // vec4 7: geometricNormal + normalMapTexIndex (as int bits)
+    p[28] = tri.geometricNormal.x; p[29] = tri.geometricNormal.y; p[30] = tri.geometricNormal.z;
+    uint32_t normalTexBits;
+    std::memcpy(&normalTexBits, &tri.normalMapTextureIndex, sizeof(int));
+    std::memcpy(&p[31], &normalTexBits, sizeof(float));
+    // vec4 8: alphaClip, materialType (as float), ior, emissiveTexIndex (as int bits)
+    p[32] = tri.alphaClip ? 1.0f : 0.0f;
+    p[33] = static_cast<float>(tri.materialType);
+    p[34] = tri.ior;
+    uint32_t emissiveTexBits;
+    std::memcpy(&emissiveTexBits, &tri.emissiveTextureIndex, sizeof(int));
+    std::memcpy(&p[35], &emissiveTexBits, sizeof(float));
+    // vec4 9: tangent.xyz + bitangentSign
+    p[36] = tri.tangent.x; p[37] = tri.tangent.y; p[38] = tri.tangent.z; p[39] = tri.bitangentSign;
+}
 
+void GLGPURaytracer::uploadBVHNodes(const BVH& bvh, bool inPlace)
+{
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_bvhSSBO);
-    glBufferData(GL_SHADER_STORAGE_BUFFER,
-                 static_cast<GLsizeiptr>(gpuNodes.size() * sizeof(GPUBVHNode)),
-                 gpuNodes.data(), GL_STATIC_DRAW);
-
-    // ── Upload triangle vertices (hot — intersection only) ──────────
-    // 3 vec4s per triangle (48 bytes): v0+pad, v1+pad, v2+pad
-    std::vector<float> vertsBuffer(triangles.size() * 12); // 3 vec4s * 4 floats
-    for (size_t i = 0; i < triangles.size(); ++i)
+    auto upload = [&](const void* data, size_t bytes)
     {
-        const auto& tri = triangles[i];
-        float* p = &vertsBuffer[i * 12];
-        p[0]  = tri.v0.x; p[1]  = tri.v0.y; p[2]  = tri.v0.z; p[3]  = 0.0f;
-        p[4]  = tri.v1.x; p[5]  = tri.v1.y; p[6]  = tri.v1.z; p[7]  = 0.0f;
-        p[8]  = tri.v2.x; p[9]  = tri.v2.y; p[10] = tri.v2.z; p[11] = 0.0f;
-    }
-
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_triVertsSSBO);
-    glBufferData(GL_SHADER_STORAGE_BUFFER,
-                 static_cast<GLsizeiptr>(vertsBuffer.size() * sizeof(float)),
-                 vertsBuffer.data(), GL_STATIC_DRAW);
+        if (inPlace && bytes == m_bvhBytes)
+            glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, static_cast<GLsizeiptr>(bytes), data);
+        else
+            glBufferData(GL_SHADER_STORAGE_BUFFER, static_cast<GLsizeiptr>(bytes), data, GL_STATIC_DRAW);
+        m_bvhBytes = bytes;
+    };
 
-    // ── Upload triangle shading data (cold — only on confirmed hits) ─
-    // 10 vec4s per triangle (160 bytes)
-    std::vector<float> shadingBuffer(triangles.size() * 40); // 10 vec4s * 4 floats
-    for (size_t i = 0; i < triangles.size(); ++i)
+    if (m_compressedBVH)
     {
-        const auto& tri = triangles[i];
-        float* p = &shadingBuffer[i * 40];
-        // vec4 0: n0 + roughnessTextureIndex (int bits)
-        p[0]  = tri.n0.x; p[1]  = tri.n0.y; p[2]  = tri.n0.z;
-        { uint32_t bits; std::memcpy(&bits, &tri.roughnessTextureIndex, sizeof(int)); std::memcpy(&p[3], &bits, sizeof(float)); }
-        // vec4 1: n1 + metallicTextureIndex (int bits)
-        p[4]  = tri.n1.x; p[5]  = tri.n1.y; p[6]  = tri.n1.z;
-        { uint32_t bits; std::memcpy(&bits, &tri.metallicTextureIndex, sizeof(int)); std::memcpy(&p[7], &bits, sizeof(float)); }
-        // vec4 2: n2 + emissiveStrength
-        p[8]  = tri.n2.x; p[9]  = tri.n2.y; p[10] = tri.n2.z; p[11] = tri.emissiveStrength;
-        // vec4 3: uv0.xy, uv1.xy
-        p[12] = tri.uv0.x; p[13] = tri.uv0.y; p[14] = tri.uv1.x; p[15] = tri.uv1.y;
-        // vec4 4: uv2.xy, roughness, metallic
-        p[16] = tri.uv2.x; p[17] = tri.uv2.y; p[18] = tri.roughness; p[19] = tri.metallic;
-        // vec4 5: color + texIndex (as int bits)
-        p[20] = tri.color.x; p[21] = tri.color.y; p[22] = tri.color.z;
-        uint32_t texBits;
-        std::memcpy(&texBits, &tri.textureIndex, sizeof(int));
-        std::memcpy(&p[23], &texBits, sizeof(float));
-        // vec4 6: emissive + area
-        p[24] = tri.emissive.x; p[25] = tri.emissive.y; p[26] = tri.emissive.z; p[27] = tri.area;
-        // vec4 7: geometricNormal + normalMapTexIndex (as int bits)
-        p[28] = tri.geometricNormal.x; p[29] = tri.geometricNormal.y; p[30] = tri.geometricNormal.z;
-        uint32_t normalTexBits;
-        std::memcpy(&normalTexBits, &tri.normalMapTextureIndex, sizeof(int));
-        std::memcpy(&p[31], &normalTexBits, sizeof(float));
-        // vec4 8: alphaClip, materialType (as float), ior, emissiveTexIndex (as int bits)
-        p[32] = tri.alphaClip ? 1.0f : 0.0f;
-        p[33] = static_cast<float>(tri.materialType);
-        p[34] = tri.ior;
-        uint32_t emissiveTexBits;
-        std::memcpy(&emissiveTexBits, &tri.emissiveTextureIndex, sizeof(int));
-        std::memcpy(&p[35], &emissiveTexBits, sizeof(float));
-        // vec4 9: tangent.xyz + bitangentSign
-        p[36] = tri.tangent.x; p[37] = tri.tangent.y; p[38] = tri.tangent.z; p[39] = tri.bitangentSign;
+        // Compressed layout: 4 uvec4s per 4-wide node, matching CompressedBVHNode byte for byte
+        CompressedBVH cbvh;
+        cbvh.build(bvh);
+        const auto& nodes = cbvh.nodes();
+        m_bvhNodeCount = cbvh.nodeCount();
+        upload(nodes.data(), nodes.size() * sizeof(CompressedBVHNode));
     }
+    else
+    {
+        // GPU layout: vec3 boundsMin, uint leftFirst, vec3 boundsMax, uint triCount (32 bytes)
+        struct GPUBVHNode {
+            float minX, minY, minZ;
+            uint32_t leftFirst;
+            float maxX, maxY, maxZ;
+            uint32_t triCount;
+        };
+
+        const auto& nodes = bvh.nodes();
+        std::vector<GPUBVHNode> gpuNodes(nodes.size());
+        for (size_t i = 0; i < nodes.size(); ++i)
+        {
+            gpuNodes[i].minX = nodes[i].bounds.min.x;
+            gpuNodes[i].minY = nodes[i].bounds.min.y;
+            gpuNodes[i].minZ = nodes[i].bounds.min.z;
+            gpuNodes[i].leftFirst = nodes[i].leftFirst;
+            gpuNodes[i].maxX = nodes[i].bounds.max.x;
+            gpuNodes[i].maxY = nodes[i].bounds.max.y;
+            gpuNodes[i].maxZ = nodes[i].bounds.max.z;
+            gpuNodes[i].triCount = nodes[i].triCount;
+        }
 
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_triShadingSSBO);
-    glBufferData(GL_SHADER_STORAGE_BUFFER,
-                 static_cast<GLsizeiptr>(shadingBuffer.size() * sizeof(float)),
-                 shadingBuffer.data(), GL_STATIC_DRAW);
+        m_bvhNodeCount = bvh.nodeCount();
+        upload(gpuNodes.data(), gpuNodes.size() * sizeof(GPUBVHNode));
+    }
+    m_uploadedCompressed = m_compressedBVH;
+}
 
-    // ── Upload light data ──────────────────────────────────────────
+void GLGPURaytracer::uploadLights(const std::vector<uint32_t>& lightIndices,
+                                  const std::vector<float>& lightCDF,
+                                  float totalLightArea)
+{
     // Header: lightCount (uint), totalLightArea (float), pad, pad
     // Then: lightIndices[lightCount], lightCDF[lightCount] (as uint bits)
     uint32_t lc = static_cast<uint32_t>(lightIndices.size());
@@ -328,6 +329,43 @@ void GLGPURaytracer::uploadGeometry(
     glBufferData(GL_SHADER_STORAGE_BUFFER,
                  static_cast<GLsizeiptr>(lightBuf.size() * sizeof(uint32_t)),
                  lightBuf.data(), GL_STATIC_DRAW);
+}
+
+void GLGPURaytracer::uploadGeometry(
+    const std::vector<CPURaytracer::Triangle>& triangles,
+    const BVH& bvh,
+    const std::vector<uint32_t>& lightIndices,
+    const std::vector<float>& lightCDF,
+    float totalLightArea,
+    const std::vector<CPURaytracer::TextureData>& textures)
+{
+    m_triangleCount = static_cast<uint32_t>(triangles.size());
+
+    // ── Upload BVH nodes ───────────────────────────────────────────
+    uploadBVHNodes(bvh, false);
+
+    // ── Upload triangle vertices (hot — intersection only) ──────────
+    std::vector<float> vertsBuffer(triangles.size() * TRI_VERT_FLOATS);
+    for (size_t i = 0; i < triangles.size(); ++i)
+        packTriVerts(triangles[i], &vertsBuffer[i * TRI_VERT_FLOATS]);
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_triVertsSSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER,
+                 static_cast<GLsizeiptr>(vertsBuffer.size() * sizeof(float)),
+                 vertsBuffer.data(), GL_STATIC_DRAW);
+
+    // ── Upload triangle shading data (cold — only on confirmed hits) ─
+    std::vector<float> shadingBuffer(triangles.size() * TRI_SHADING_FLOATS);
+    for (size_t i = 0; i < triangles.size(); ++i)
+        packTriShading(triangles[i], &shadingBuffer[i * TRI_SHADING_FLOATS]);
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_triShadingSSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER,
+                 static_cast<GLsizeiptr>(shadingBuffer.size() * sizeof(float)),
+                 shadingBuffer.data(), GL_STATIC_DRAW);
+
+    // ── Upload light data ──────────────────────────────────────────
+    uploadLights(lightIndices, lightCDF, totalLightArea);
 
     // ── Upload texture data ────────────────────────────────────────
     // Header: [0] = texCount
@@ -374,6 +412,62 @@ void GLGPURaytracer::uploadGeometry(
     reset();
 }
 
+void GLGPURaytracer::updateGeometry(
+    const std::vector<CPURaytracer::Triangle>& triangles,
+    const BVH& bvh,
+    const std::vector<uint32_t>& changedTriangles,
+    const std::vector<uint32_t>& lightIndices,
+    const std::vector<float>& lightCDF,
+    float totalLightArea)
+{
+    if (triangles.size() != m_triangleCount)
+    {
+        // Not an in-place edit; the caller should have uploaded from scratch
+        return;
+    }
+
+    // Node count is unchanged by a refit, so the node buffer is overwritten in place
+    uploadBVHNodes(bvh, true);
+
+    // Patch runs of consecutive triangles, one sub-upload per run per buffer
+    std::vector<float> verts;
+    std::vector<float> shading;
+    size_t i = 0;
+    while (i < changedTriangles.size())
+    {
+        size_t runEnd = i + 1;
+        while (runEnd < changedTriangles.size() && changedTriangles[runEnd] == changedTriangles[runEnd - 1] + 1)
+            ++runEnd;
+
+        const uint32_t first = changedTriangles[i];
+        const size_t   count = runEnd - i;
+        verts.resize(count * TRI_VERT_FLOATS);
+        shading.resize(count * TRI_SHADING_FLOATS);
+        for (size_t k = 0; k < count; ++k)
+        {
+            packTriVerts(triangles[first + k], &verts[k * TRI_VERT_FLOATS]);
+            packTriShading(triangles[first + k], &shading[k * TRI_SHADING_FLOATS]);
+        }
+
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_triVertsSSBO);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER,
+                        static_cast<GLintptr>(first * TRI_VERT_FLOATS * sizeof(float)),
+                        static_cast<GLsizeiptr>(verts.size() * sizeof(float)), verts.data());
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_triShadingSSBO);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER,
+                        static_cast<GLintptr>(first * TRI_SHADING_FLOATS * sizeof(float)),
+                        static_cast<GLsizeiptr>(shading.size() * sizeof(float)), shading.data());
+        i = runEnd;
+    }
+
+    // Emitter areas may have changed with scale
+    uploadLights(lightIndices, lightCDF, totalLightArea);
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    reset();
+}
+
 void GLGPURaytracer::setEnvironmentMap(const float* data, int w, int h)
 {
     m_envMapWidth  = w;
@@ -667,6 +761,7 @@ void GLGPURaytracer::traceSample()
 
     glUniform1ui(m_locTriangleCount, m_triangleCount);
     glUniform1ui(m_locBvhNodeCount, m_bvhNodeCount);
+    glUniform1i(m_locCompressedBVH, m_uploadedCompressed ? 1 : 0);
     glUniform1f(m_locRayEps, m_rayEps);
     glUniform1i(m_locEnableRR, m_enableRR ? 1 : 0);
     glUniform1f(m_locAperture, m_aperture);
@@ -0,0 +1,114 @@
+// Throughput of the CPU tracer's batched queries against a loop of single
+// traceRay() calls, for coherent camera-like rays and for incoherent
+// ambient-occlusion rays leaving the surface in random directions. The
+// single-ray loop runs on one thread; the batched queries use the tracer's
+// worker pool, so their speed-up includes the thread count.
+//
+//   vex_bench_ray_queries [grid] [rays]
+
+#include <vex/raytracing/cpu_raytracer.h>
+#include <vex/raytracing/ray.h>
+#include <vex/raytracing/hit.h>
+
+#include "bench_scenes.h"
+
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+using namespace vex;
+using namespace vex::bench;
+
+namespace
+{
+
+struct Workload
+{
+    const char*      name;
+    std::vector<Ray> rays;
+};
+
+// Camera rays from above in scanline order, and short-range AO rays from
+// the first hits of those rays
+std::vector<Workload> makeWorkloads(const CPURaytracer& rt, uint32_t count)
+{
+    uint32_t state = 12345u;
+    auto next = [&]()
+    {
+        state = state * 1664525u + 1013904223u;
+        return static_cast<float>(state >> 8) / 16777216.0f;
+    };
+
+    const uint32_t side = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(count))));
+    Workload camera{ "camera", std::vector<Ray>(count) };
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        const float x = (static_cast<float>(i % side) + 0.5f) / static_cast<float>(side);
+        const float y = (static_cast<float>(i / side) + 0.5f) / static_cast<float>(side);
+        camera.rays[i].origin = glm::vec3(0.0f, 1.5f, -2.0f);
+        camera.rays[i].direction = glm::normalize(glm::vec3(x * 1.6f - 0.8f, -0.9f - y * 0.6f, 1.5f));
+    }
+
+    Workload ao{ "ambient occlusion", {} };
+    ao.rays.reserve(count);
+    for (uint32_t i = 0; i < count && ao.rays.size() < count; ++i)
+    {
+        const HitRecord hit = rt.traceRay(camera.rays[i]);
+        if (!hit.hit)
+            continue;
+        glm::vec3 dir(next() * 2.0f - 1.0f, next() * 2.0f - 1.0f, next() * 2.0f - 1.0f);
+        if (glm::dot(dir, hit.geometricNormal) < 0.0f)
+            dir = -dir;
+        ao.rays.push_back({ hit.position + hit.geometricNormal * 1e-4f, glm::normalize(dir) });
+    }
+    return { std::move(camera), std::move(ao) };
+}
+
+template <typename Fn>
+double timeSeconds(Fn&& fn)
+{
+    fn(); // warm-up
+    const auto start = std::chrono::steady_clock::now();
+    fn();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    const int grid = argc > 1 ? std::max(1, std::atoi(argv[1])) : 256;
+    const uint32_t rayCount = argc > 2 ? static_cast<uint32_t>(std::max(1, std::atoi(argv[2]))) : 1u << 20;
+
+    CPURaytracer rt;
+    rt.setGeometry(makeTerrain(grid));
+    const auto workloads = makeWorkloads(rt, rayCount);
+    std::printf("%u triangles, %u hardware threads\n\n", grid * grid * 2, std::thread::hardware_concurrency());
+    std::printf("%-18s  %8s  %14s  %14s  %14s\n", "workload", "rays", "single Mrays/s", "traceRays", "occluded");
+
+    for (const auto& workload : workloads)
+    {
+        const auto& rays = workload.rays;
+        const uint32_t n = static_cast<uint32_t>(rays.size());
+        std::vector<HitRecord> hits(n);
+        std::vector<float> tMax(n, 0.25f); // AO radius
+        std::vector<uint64_t> occluded((n + 63) / 64);
+
+        const double single = timeSeconds([&]
+        {
+            for (uint32_t i = 0; i < n; ++i)
+                hits[i] = rt.traceRay(rays[i]);
+        });
+        const double batched  = timeSeconds([&] { rt.traceRays(rays, hits); });
+        const double shadowed = timeSeconds([&] { rt.occluded(rays, tMax, occluded); });
+
+        std::printf("%-18s  %8u  %14.2f  %14.2f  %14.2f\n", workload.name, n,
+                    n / single * 1e-6, n / batched * 1e-6, n / shadowed * 1e-6);
+    }
+    return 0;
+}
@@ -0,0 +1,158 @@
+// Sampling throughput of alias tables against binary search over a CDF, the
+// two ways the CPU tracer can pick an emitter for next-event estimation or an
+// environment map pixel. Lights have a few bright emitters among many dim
+// ones; the environment map is a sky-like gradient with a sun spot, sampled
+// as a row marginal and per-row conditionals.
+//
+//   vex_bench_sampling [lights] [env width]
+
+#include <vex/raytracing/alias_table.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+using namespace vex;
+
+namespace
+{
+
+volatile uint64_t sink; // keeps the sampling loops from being optimized out
+
+struct Uniforms
+{
+    uint32_t state = 12345u;
+    float next()
+    {
+        state = state * 1664525u + 1013904223u;
+        return static_cast<float>(state >> 8) / 16777216.0f;
+    }
+};
+
+std::vector<float> makeCDF(const std::vector<float>& weights)
+{
+    std::vector<float> cdf(weights.size());
+    float sum = 0.0f;
+    for (size_t i = 0; i < weights.size(); ++i)
+    {
+        sum += weights[i];
+        cdf[i] = sum;
+    }
+    for (float& c : cdf)
+        c /= sum;
+    return cdf;
+}
+
+uint32_t searchCDF(const float* begin, uint32_t count, float u)
+{
+    const uint32_t i = static_cast<uint32_t>(std::lower_bound(begin, begin + count, u) - begin);
+    return std::min(i, count - 1);
+}
+
+template <typename Fn>
+double timeSeconds(Fn&& fn)
+{
+    fn(); // warm-up
+    const auto start = std::chrono::steady_clock::now();
+    fn();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    const uint32_t lightCount = argc > 1 ? static_cast<uint32_t>(std::max(1, std::atoi(argv[1]))) : 100000u;
+    const uint32_t envW = argc > 2 ? static_cast<uint32_t>(std::max(2, std::atoi(argv[2]))) : 2048u;
+    const uint32_t envH = envW / 2;
+    const uint32_t sampleCount = 1u << 22;
+
+    Uniforms rng;
+    std::vector<float> u(sampleCount * 3);
+    for (float& v : u)
+        v = rng.next();
+
+    std::printf("%-20s  %10s  %14s  %14s\n", "distribution", "entries", "CDF Msamples/s", "alias");
+
+    // Emitters: every 64th is 100x brighter
+    {
+        std::vector<float> weights(lightCount);
+        for (uint32_t i = 0; i < lightCount; ++i)
+            weights[i] = (i % 64 == 0 ? 100.0f : 1.0f) * (0.5f + rng.next());
+        const std::vector<float> cdf = makeCDF(weights);
+        AliasTable alias;
+        alias.build(weights);
+
+        uint64_t checksum = 0;
+        const double search = timeSeconds([&]
+        {
+            for (uint32_t s = 0; s < sampleCount; ++s)
+                checksum += searchCDF(cdf.data(), lightCount, u[s]);
+        });
+        const double table = timeSeconds([&]
+        {
+            for (uint32_t s = 0; s < sampleCount; ++s)
+                checksum += alias.sample(u[s], u[sampleCount + s]);
+        });
+        std::printf("%-20s  %10u  %14.2f  %14.2f\n", "lights", lightCount,
+                    sampleCount / search * 1e-6, sampleCount / table * 1e-6);
+        sink = checksum;
+    }
+
+    // Environment map: sin(theta)-weighted sky with a sun
+    {
+        std::vector<float> rowWeights(envH);
+        std::vector<float> pixelWeights(static_cast<size_t>(envW) * envH);
+        for (uint32_t y = 0; y < envH; ++y)
+        {
+            const float theta = 3.14159265f * (static_cast<float>(y) + 0.5f) / static_cast<float>(envH);
+            for (uint32_t x = 0; x < envW; ++x)
+            {
+                const float dx = static_cast<float>(x) - 0.3f * envW, dy = static_cast<float>(y) - 0.25f * envH;
+                const float sun = dx * dx + dy * dy < 16.0f ? 5000.0f : 0.0f;
+                const float sky = y < envH / 2 ? 1.0f + std::cos(theta) : 0.2f;
+                pixelWeights[y * envW + x] = (sky + sun) * std::sin(theta);
+                rowWeights[y] += pixelWeights[y * envW + x];
+            }
+        }
+
+        const std::vector<float> marginalCDF = makeCDF(rowWeights);
+        std::vector<float> conditionalCDF(pixelWeights.size());
+        AliasTable marginal;
+        marginal.build(rowWeights);
+        std::vector<AliasTable> conditional(envH);
+        for (uint32_t y = 0; y < envH; ++y)
+        {
+            const std::vector<float> row(pixelWeights.begin() + y * envW, pixelWeights.begin() + (y + 1) * envW);
+            const std::vector<float> cdf = makeCDF(row);
+            std::copy(cdf.begin(), cdf.end(), conditionalCDF.begin() + y * envW);
+            conditional[y].build(row);
+        }
+
+        uint64_t checksum = 0;
+        const double search = timeSeconds([&]
+        {
+            for (uint32_t s = 0; s < sampleCount; ++s)
+            {
+                const uint32_t y = searchCDF(marginalCDF.data(), envH, u[s]);
+                checksum += y * envW + searchCDF(conditionalCDF.data() + y * envW, envW, u[sampleCount + s]);
+            }
+        });
+        const double table = timeSeconds([&]
+        {
+            for (uint32_t s = 0; s < sampleCount; ++s)
+            {
+                float side = u[2 * sampleCount + s];
+                const uint32_t y = marginal.sample(u[s], side, &side);
+                checksum += y * envW + conditional[y].sample(u[sampleCount + s], side);
+            }
+        });
+        std::printf("%-20s  %10u  %14.2f  %14.2f\n", "environment map", envW * envH,
+                    sampleCount / search * 1e-6, sampleCount / table * 1e-6);
+        sink = checksum;
+    }
+    return 0;
+}
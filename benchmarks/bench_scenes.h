@@ -0,0 +1,54 @@
+#pragma once
+
+// Scenes shared by the CPU tracer benchmarks
+
+#include <vex/raytracing/cpu_raytracer.h>
+
+#include <glm/glm.hpp>
+#include <cmath>
+#include <vector>
+
+namespace vex::bench
+{
+
+inline CPURaytracer::Triangle makeTri(glm::vec3 v0, glm::vec3 v1, glm::vec3 v2)
+{
+    CPURaytracer::Triangle t;
+    t.v0 = v0; t.v1 = v1; t.v2 = v2;
+    const glm::vec3 crossed = glm::cross(v1 - v0, v2 - v0);
+    t.area = 0.5f * glm::length(crossed);
+    t.geometricNormal = glm::normalize(crossed);
+    t.n0 = t.n1 = t.n2 = t.geometricNormal;
+    return t;
+}
+
+// Rolling height field of grid x grid quads over [-1, 1]^2
+inline std::vector<CPURaytracer::Triangle> makeTerrain(int grid)
+{
+    auto height = [](float x, float z)
+    {
+        return 0.15f * std::sin(x * 7.0f) * std::cos(z * 5.0f) + 0.05f * std::sin(x * 23.0f + z * 17.0f);
+    };
+    auto vertex = [&](int i, int j)
+    {
+        const float x = -1.0f + 2.0f * static_cast<float>(i) / static_cast<float>(grid);
+        const float z = -1.0f + 2.0f * static_cast<float>(j) / static_cast<float>(grid);
+        return glm::vec3(x, height(x, z), z);
+    };
+
+    std::vector<CPURaytracer::Triangle> tris;
+    tris.reserve(static_cast<size_t>(grid) * grid * 2);
+    for (int j = 0; j < grid; ++j)
+    {
+        for (int i = 0; i < grid; ++i)
+        {
+            const glm::vec3 a = vertex(i, j), b = vertex(i + 1, j);
+            const glm::vec3 c = vertex(i, j + 1), d = vertex(i + 1, j + 1);
+            tris.push_back(makeTri(a, c, b));
+            tris.push_back(makeTri(b, c, d));
+        }
+    }
+    return tris;
+}
+
+} // namespace vex::bench
@@ -0,0 +1,90 @@
+// Triangle intersection throughput of the CPU tracer's binary BVH for a range
+// of leaf sizes. Larger leaves mean fewer node visits but more triangle tests
+// per ray; the leaf tests run a SIMD block of triangles at a time, so the
+// interesting number is how rays per second move as tests per ray grow.
+//
+//   vex_bench_triangles [grid] [rays]
+
+#include <vex/raytracing/cpu_raytracer.h>
+#include <vex/raytracing/ray.h>
+#include <vex/raytracing/hit.h>
+
+#include "bench_scenes.h"
+
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+using namespace vex;
+using namespace vex::bench;
+
+namespace
+{
+
+// Downward rays from a raster of points above the terrain, in scanline order
+// like camera rays, each tilted slightly at random
+std::vector<Ray> makeRays(uint32_t count)
+{
+    uint32_t state = 12345u;
+    auto next = [&]()
+    {
+        state = state * 1664525u + 1013904223u;
+        return static_cast<float>(state >> 8) / 16777216.0f;
+    };
+
+    const uint32_t side = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(count))));
+    std::vector<Ray> rays(count);
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        const float x = (static_cast<float>(i % side) + 0.5f) / static_cast<float>(side);
+        const float z = (static_cast<float>(i / side) + 0.5f) / static_cast<float>(side);
+        rays[i].origin = glm::vec3(x * 1.6f - 0.8f, 1.0f, z * 1.6f - 0.8f);
+        rays[i].direction = glm::normalize(glm::vec3((next() - 0.5f) * 0.2f, -1.0f, (next() - 0.5f) * 0.2f));
+    }
+    return rays;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    const int grid = argc > 1 ? std::max(1, std::atoi(argv[1])) : 256;
+    const uint32_t rayCount = argc > 2 ? static_cast<uint32_t>(std::max(1, std::atoi(argv[2]))) : 1u << 20;
+
+    const auto tris = makeTerrain(grid);
+    const auto rays = makeRays(rayCount);
+    std::printf("%zu triangles, %u rays, single thread\n\n", tris.size(), rayCount);
+    std::printf("leaf  nodes     Mrays/s  tris/ray  Mtri tests/s\n");
+
+    for (uint32_t leafSize : {1u, 2u, 3u, 4u, 8u})
+    {
+        BVHBuildOptions options;
+        options.leafSize = leafSize;
+        CPURaytracer rt;
+        rt.setBVHBuildOptions(options);
+        rt.setGeometry(tris);
+
+        // Warm-up pass, then the timed one; both walk the binary BVH
+        CPURaytracer::TraversalStats stats;
+        uint32_t hits = 0;
+        for (const auto& ray : rays)
+            hits += rt.traceRayStats(ray, stats).hit;
+
+        stats = {};
+        const auto start = std::chrono::steady_clock::now();
+        for (const auto& ray : rays)
+            hits += rt.traceRayStats(ray, stats).hit;
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        std::printf("%4u  %8u  %7.2f  %8.2f  %12.1f%s\n", leafSize, rt.getBVHNodeCount(),
+                    rayCount / seconds * 1e-6,
+                    static_cast<double>(stats.trianglesTested) / rayCount,
+                    stats.trianglesTested / seconds * 1e-6,
+                    hits == 0 ? "  (no hits)" : "");
+    }
+    return 0;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace vex
+{
+
+// Walker/Vose alias table: draws index i with probability weights[i] / sum in
+// O(1), one table lookup and one comparison instead of a binary search over
+// a CDF. The table only samples; callers keep their own pmf evaluation.
+class AliasTable
+{
+public:
+    // 8 bytes, an array of these uploads as-is to a std430 buffer of uvec2
+    // (threshold read through uintBitsToFloat). Slot i is taken with
+    // probability threshold, otherwise its alias is.
+    struct Entry
+    {
+        float    threshold;
+        uint32_t alias;
+    };
+    static_assert(sizeof(Entry) == 8, "AliasTable::Entry must match the GPU layout");
+
+    // Negative weights count as zero; all-zero weights give a uniform table
+    void build(std::span<const float> weights);
+    void clear() { m_entries.clear(); }
+
+    // uSlot picks a slot, uSide one of its two sides. With uRemapped the
+    // part of uSide not spent on the decision comes back as a fresh uniform
+    // number, so a caller can pick an entry and a point on it from two numbers.
+    // uSlot resolves 2^24 slots at most; split bigger domains into a
+    // marginal table and conditional ones.
+    uint32_t sample(float uSlot, float uSide, float* uRemapped = nullptr) const
+    {
+        const uint32_t last = static_cast<uint32_t>(m_entries.size()) - 1;
+        const uint32_t slot = std::min(static_cast<uint32_t>(uSlot * static_cast<float>(m_entries.size())), last);
+        const Entry& e = m_entries[slot];
+        uSide = std::min(uSide, ONE_MINUS_EPSILON);
+        if (uSide < e.threshold)
+        {
+            if (uRemapped)
+                *uRemapped = std::min(uSide / e.threshold, ONE_MINUS_EPSILON);
+            return slot;
+        }
+        if (uRemapped)
+            *uRemapped = std::min((uSide - e.threshold) / (1.0f - e.threshold), ONE_MINUS_EPSILON);
+        return e.alias;
+    }
+
+    const std::vector<Entry>& entries() const { return m_entries; }
+    size_t size() const { return m_entries.size(); }
+    bool empty() const { return m_entries.empty(); }
+    size_t memoryBytes() const { return m_entries.capacity() * sizeof(Entry); }
+
+private:
+    static constexpr float ONE_MINUS_EPSILON = 0x1.fffffep-1f;
+
+    std::vector<Entry> m_entries;
+};
+
+} // namespace vex
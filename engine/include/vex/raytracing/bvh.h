@@ -62,6 +62,79 @@ inline bool intersectAABB(const AABB& box, const glm::vec3& origin,
     return tmax >= std::max(tmin, 0.0f) && tmin < tMax;
 }
 
+// Same slab test, returning the entry distance (0 for an origin inside the box)
+// so callers can order children front to back. FLT_MAX = missed, or entered
+// at or beyond tMax.
+inline float intersectAABBNear(const AABB& box, const glm::vec3& origin,
+                               const glm::vec3& invDir, float tMax)
+{
+    float t1 = (box.min.x - origin.x) * invDir.x;
+    float t2 = (box.max.x - origin.x) * invDir.x;
+    float tmin = std::min(t1, t2);
+    float tmax = std::max(t1, t2);
+
+    t1 = (box.min.y - origin.y) * invDir.y;
+    t2 = (box.max.y - origin.y) * invDir.y;
+    tmin = std::max(tmin, std::min(t1, t2));
+    tmax = std::min(tmax, std::max(t1, t2));
+
+    t1 = (box.min.z - origin.z) * invDir.z;
+    t2 = (box.max.z - origin.z) * invDir.z;
+    tmin = std::max(tmin, std::min(t1, t2));
+    tmax = std::min(tmax, std::max(t1, t2));
+
+    const float tEnter = std::max(tmin, 0.0f);
+    return (tmax >= tEnter && tmin < tMax) ? tEnter : FLT_MAX;
+}
+
+enum class BVHBuilder
+{
+    SAH,  // binned SAH: best trees, for final rendering
+    LBVH  // Morton-code linear BVH: a fraction of the build time, looser trees
+};
+
+struct BVHBuildOptions
+{
+    // Worker threads for the build (0 = std::thread::hardware_concurrency()).
+    // The resulting tree is identical for every thread count (unless
+    // optimizeBudgetMs cuts reinsertion short).
+    uint32_t threadCount = 0;
+
+    // LBVH sorts primitives along a Morton curve and splits each range at its
+    // highest differing code bit. Spatial splits are ignored with LBVH.
+    BVHBuilder builder = BVHBuilder::SAH;
+
+    // Spatial-split SAH (SBVH): nodes may split straddling triangles at a plane
+    // instead of accepting overlapping child boxes. Only honoured by
+    // buildFromTriangles(), which has the vertices needed for clipping.
+    // The spatial-split build is single-threaded.
+    bool  spatialSplits = false;
+    // Extra references allowed, as a fraction of the triangle count
+    // (0.3 = at most 30% more leaf references than triangles).
+    float spatialSplitBudget = 0.3f;
+    // Spatial splits are only tried where the best object split's child overlap
+    // exceeds this fraction of the root surface area.
+    float spatialSplitAlpha = 1e-5f;
+
+    // Reinsertion passes for optimize() after the build (0 = skip). Worth it
+    // for final-quality trees that are traced for a long time. A run that
+    // completes its passes gives the same tree every time.
+    uint32_t optimizePasses = 0;
+    // Wall-clock cap on those passes in milliseconds (0 = none), so large
+    // scenes do not pay for whole passes. A run the deadline cuts short
+    // depends on timing; BVH::optimizeStoppedEarly() reports it.
+    float optimizeBudgetMs = 0.0f;
+
+    // Ranges of at most this many triangles become leaves without a split
+    // search (the SAH can still stop earlier); LBVH collapses Morton subtrees
+    // of this size into leaves. The CPU tracer tests triangles in SIMD blocks
+    // of four, so larger leaves (4-8) cost little per visit and save node
+    // tests; leaves of one or two triangles often straddle two blocks and
+    // trace slower than scalar tests would. 0 = the builder's default: 2 for
+    // SAH, 4 for LBVH, whose unsearched splits gain less from small leaves.
+    uint32_t leafSize = 0;
+};
+
 class BVH
 {
 public:
@@ -76,7 +149,17 @@ public:
 
     // Build from per-triangle AABBs. After build, use indices() to
     // reorder your triangle array for direct leaf-node access.
-    void build(const std::vector<AABB>& triBounds);
+    // Top levels are split with parallel binning; subtrees below a size
+    // threshold are built on worker threads and spliced back in serial order.
+    // With options.builder == LBVH the Morton-code builder runs instead; its
+    // output has the same layout (child pairs adjacent, parents before children).
+    void build(const std::vector<AABB>& triBounds, const BVHBuildOptions& options = {});
+
+    // Build from triangle vertices (three per triangle: v0, v1, v2). Identical to
+    // build() unless options.spatialSplits is set, in which case a triangle may be
+    // referenced from several leaves and indices().size() can exceed the triangle
+    // count — reorder with indices() exactly as before (duplicating entries).
+    void buildFromTriangles(const std::vector<glm::vec3>& triVerts, const BVHBuildOptions& options = {});
 
     const std::vector<Node>& nodes() const { return m_nodes; }
     const std::vector<uint32_t>& indices() const { return m_indices; }
@@ -93,22 +176,171 @@ public:
 
     float sahCost() const { return m_cachedSAHCost; }
 
+    // Refits the existing topology to moved geometry. refBounds(i) returns the
+    // current box of reference i (indices() order). Only leaves holding a dirty
+    // reference are recomputed (every leaf when dirtyRefs is empty); ancestors
+    // of changed nodes are re-unioned bottom-up. Returns the number of nodes
+    // whose bounds were recomputed.
+    template <typename RefBoundsFn>
+    uint32_t refit(RefBoundsFn&& refBounds, const std::vector<bool>& dirtyRefs = {});
+
+    // SAH cost of the tree as last built; sahCost() / buildSAHCost() grows as
+    // refits stretch boxes the splits were not chosen for.
+    float buildSAHCost() const { return m_buildSAHCost; }
+    float refitDegradation() const
+    {
+        return m_buildSAHCost > 0.0f ? m_cachedSAHCost / m_buildSAHCost : 1.0f;
+    }
+
+    // Triangles the tree was built over, and leaf references per triangle
+    // (1.0 unless spatial splits duplicated references).
+    uint32_t primitiveCount() const { return m_primCount; }
+    float duplicationRatio() const
+    {
+        return m_primCount > 0 ? static_cast<float>(m_indices.size()) / static_cast<float>(m_primCount) : 1.0f;
+    }
+
+    // True at i for the first occurrence of each triangle in indices(). Per-triangle
+    // passes over BVH-ordered data (light CDFs, area sums) should skip the rest.
+    std::vector<bool> firstReferenceMask() const;
+
+    // Lowers the SAH cost of a built tree by reinsertion (Bittner et al.):
+    // subtrees are cut out and reinserted where they cost least. Each pass
+    // searches every node's best position in parallel, then applies the
+    // non-overlapping moves; passes repeat until one no longer helps,
+    // maxPasses have run or budgetMs (0 = no limit) runs out. Unless the
+    // deadline stops it, the result does not depend on threadCount. Leaves
+    // keep their triangles, but the node and indices() order change, so
+    // callers reorder their triangles as after build(). Returns the number
+    // of moves applied.
+    uint32_t optimize(uint32_t maxPasses, uint32_t threadCount = 0, float budgetMs = 0.0f);
+    // True when the last optimize() ran out of time before finishing its
+    // passes, so the tree is not reproducible (e.g. not worth a disk cache)
+    bool optimizeStoppedEarly() const { return m_optimizeStoppedEarly; }
+
+    // Installs a tree saved from nodes() and indices() (e.g. a disk cache)
+    // in place of a build. primitiveCount is the triangle count it was built
+    // over; the layout is trusted, only the SAH cost is recomputed.
+    void restore(std::vector<Node> nodes, std::vector<uint32_t> indices, uint32_t primitiveCount);
+
 private:
     static constexpr uint32_t SAH_BINS = 12;
     static constexpr float TRAVERSAL_COST = 1.0f;
     static constexpr float INTERSECT_COST = 1.0f;
 
-    void updateNodeBounds(uint32_t nodeIdx);
-    void subdivide(uint32_t nodeIdx);
+    // Parallel build tuning
+    static constexpr uint32_t PARALLEL_BIN_MIN_TRIS = 65536; // below this, bin on one thread
+    static constexpr uint32_t SUBTREE_TASK_MIN_TRIS = 4096;  // smallest subtree handed to a worker
+
+    struct Bin
+    {
+        AABB bounds;
+        uint32_t count = 0;
+    };
+
+    // Split search / partition over m_indices[first, first + count).
+    // Both are pure functions of the index range, so every build path
+    // (serial, top-level parallel, per-worker subtree) picks identical splits.
+    bool findSplit(const Node& node, uint32_t threadCount, int& outAxis, float& outPos) const;
+    uint32_t partition(const Node& node, int axis, float splitPos);
+    AABB computeBounds(uint32_t first, uint32_t count, uint32_t threadCount) const;
+
+    // Recursive serial build into an arbitrary node array (m_nodes or a worker-local array).
+    void subdivide(std::vector<Node>& nodes, uint32_t& nodesUsed, uint32_t nodeIdx);
+
+    // --- Spatial-split build ---
+    static constexpr uint32_t SPATIAL_BINS = 32;
+    static constexpr int SPATIAL_MAX_DEPTH = 48; // keeps leaves well inside the 64-entry traversal stack
+
+    struct Reference
+    {
+        AABB bounds;   // triangle bounds clipped to the splits above it
+        uint32_t prim;
+    };
+
+    struct SpatialBuild
+    {
+        const std::vector<glm::vec3>* verts = nullptr;
+        float minOverlapArea = 0.0f; // alpha * root surface area
+        size_t maxRefs = 0;          // reference budget (triangles + allowed duplicates)
+        size_t refCount = 0;         // references currently live in the tree
+    };
+
+    void subdivideSpatial(SpatialBuild& sb, uint32_t nodeIdx, std::vector<Reference>& refs, int depth);
+
+    // --- Morton-code LBVH build ---
+    static constexpr uint32_t SAH_DEFAULT_LEAF_SIZE  = 2;
+    static constexpr uint32_t LBVH_DEFAULT_LEAF_SIZE = 4;
+
+    // options.leafSize, or the builder's default when it is 0
+    static uint32_t leafSizeFor(const BVHBuildOptions& options);
+
+    void buildLBVH(uint32_t threadCount);
+
+    // --- Reinsertion optimization ---
+    static constexpr uint32_t OPTIMIZE_MAX_DEPTH = 48; // unless the build was deeper already
+    static constexpr uint32_t OPTIMIZE_CHUNK     = 256; // candidates per job; the deadline (if any) is checked per job
+
+    struct ReinsertTree; // pointer-linked copy of m_nodes the passes edit
+    void finishBuild();
+    void updateSAHCost();
 
     std::vector<Node> m_nodes;
     std::vector<uint32_t> m_indices;
     uint32_t m_nodesUsed    = 0;
+    uint32_t m_primCount    = 0;
+    uint32_t m_leafSize     = 2;
     float    m_cachedSAHCost = 0.0f;
+    float    m_buildSAHCost  = 0.0f;
+    bool     m_optimizeStoppedEarly = false;
 
     // Temporary build data (cleared after build)
     std::vector<AABB> m_triBounds;
     std::vector<glm::vec3> m_centroids;
 };
 
+template <typename RefBoundsFn>
+uint32_t BVH::refit(RefBoundsFn&& refBounds, const std::vector<bool>& dirtyRefs)
+{
+    if (m_nodes.empty())
+        return 0;
+
+    // Children are always allocated after their parent, so a reverse sweep
+    // visits every child before the node that owns it
+    std::vector<uint8_t> changed(m_nodes.size(), 0);
+    uint32_t updated = 0;
+    for (size_t n = m_nodes.size(); n-- > 0;)
+    {
+        Node& node = m_nodes[n];
+        if (node.isLeaf())
+        {
+            bool dirty = dirtyRefs.empty();
+            for (uint32_t i = 0; !dirty && i < node.triCount; ++i)
+                dirty = dirtyRefs[node.leftFirst + i];
+            if (!dirty)
+                continue;
+
+            AABB bounds;
+            for (uint32_t i = 0; i < node.triCount; ++i)
+                bounds.grow(refBounds(node.leftFirst + i));
+            node.bounds = bounds;
+        }
+        else
+        {
+            if (!changed[node.leftFirst] && !changed[node.leftFirst + 1])
+                continue;
+
+            AABB bounds = m_nodes[node.leftFirst].bounds;
+            bounds.grow(m_nodes[node.leftFirst + 1].bounds);
+            node.bounds = bounds;
+        }
+        changed[n] = 1;
+        ++updated;
+    }
+
+    if (updated > 0)
+        updateSAHCost();
+    return updated;
+}
+
 } // namespace vex
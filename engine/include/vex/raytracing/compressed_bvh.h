@@ -0,0 +1,84 @@
+#pragma once
+
+#include <vex/raytracing/wide_bvh.h>
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace vex
+{
+
+// 4-wide BVH node with child bounds quantized to 8 bits per plane relative to
+// the node's own box (64 bytes, one cache line, vs 128 bytes for a full
+// precision WideBVHNode<4>). Each axis has its own power-of-two scale so a
+// plane decodes as origin + q * 2^(exponent - 127). Quantization rounds
+// outward, so a decoded child box always encloses the exact one.
+//
+// The layout is shared with the GPU path tracer (4 uvec4s):
+//   [0] origin.xyz, exponent.xyz | childMask << 24
+//   [1] child[0..3]
+//   [2] triCount[0..1], triCount[2..3], qloX, qloY
+//   [3] qloZ, qhiX, qhiY, qhiZ
+struct alignas(64) CompressedBVHNode
+{
+    static constexpr uint32_t WIDTH = 4;
+    static constexpr uint32_t EMPTY = 0xFFFFFFFFu;
+    static constexpr uint32_t MAX_LEAF_TRIS = 0xFFFF;
+
+    float    origin[3];
+    uint8_t  exponent[3];  // biased IEEE-754 exponent of the per-axis scale
+    uint8_t  childMask;    // bit i set = slot i is used
+    uint32_t child[4];     // internal child: node index; leaf child: first triangle; EMPTY = unused slot
+    uint16_t triCount[4];  // 0 = internal child (or unused slot), >0 = leaf child
+    uint8_t  qloX[4], qloY[4];
+    uint8_t  qloZ[4], qhiX[4], qhiY[4], qhiZ[4];
+
+    float scale(int axis) const
+    {
+        uint32_t bits = static_cast<uint32_t>(exponent[axis]) << 23;
+        float s;
+        std::memcpy(&s, &bits, sizeof(float));
+        return s;
+    }
+
+    // Decoded (conservative) bounds of child slot i
+    AABB childBounds(uint32_t i) const
+    {
+        const float sx = scale(0), sy = scale(1), sz = scale(2);
+        AABB b;
+        b.min = { origin[0] + static_cast<float>(qloX[i]) * sx,
+                  origin[1] + static_cast<float>(qloY[i]) * sy,
+                  origin[2] + static_cast<float>(qloZ[i]) * sz };
+        b.max = { origin[0] + static_cast<float>(qhiX[i]) * sx,
+                  origin[1] + static_cast<float>(qhiY[i]) * sy,
+                  origin[2] + static_cast<float>(qhiZ[i]) * sz };
+        return b;
+    }
+};
+static_assert(sizeof(CompressedBVHNode) == 64, "CompressedBVHNode must match the GPU layout");
+
+class CompressedBVH
+{
+public:
+    using Node = CompressedBVHNode;
+
+    // Quantizes a built binary BVH via the 4-wide collapse. Leaf triangle
+    // ranges are reused unchanged; leaves above MAX_LEAF_TRIS are split into
+    // extra nodes that share the leaf's box.
+    void build(const BVH& bvh);
+    void clear();
+
+    const std::vector<Node>& nodes() const { return m_nodes; }
+    bool empty() const { return m_nodes.empty(); }
+    uint32_t nodeCount() const { return static_cast<uint32_t>(m_nodes.size()); }
+    size_t memoryBytes() const { return m_nodes.capacity() * sizeof(Node); }
+
+private:
+    void quantize(Node& node, const AABB* childBounds, uint32_t childCount) const;
+    uint32_t splitLeaf(const AABB& bounds, uint32_t first, uint32_t count);
+
+    std::vector<Node> m_nodes;
+};
+
+} // namespace vex
@@ -1,14 +1,25 @@
 #pragma once
 
+#include <vex/raytracing/alias_table.h>
 #include <vex/raytracing/ray.h>
 #include <vex/raytracing/hit.h>
 #include <vex/raytracing/bvh.h>
+#include <vex/raytracing/compressed_bvh.h>
+#include <vex/raytracing/light_bvh.h>
+#include <vex/raytracing/path_guiding.h>
+#include <vex/raytracing/wide_bvh.h>
 
 #include <glm/glm.hpp>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cstdint>
 #include <condition_variable>
+#include <functional>
 #include <mutex>
+#include <span>
+#include <string>
 #include <thread>
 #include <vector>
 
@@ -50,28 +61,130 @@ public:
         int height = 0;
     };
 
+    // One placement of a mesh passed to setInstancedGeometry()
+    struct Instance
+    {
+        uint32_t  mesh = 0;
+        glm::mat4 transform{1.0f};
+    };
+
     void setGeometry(std::vector<Triangle> triangles, std::vector<TextureData> textures = {});
     void updateMaterials(const std::vector<Triangle>& triangles);
+    // Moves triangles without rebuilding the BVH. `triangles` is in BVH-leaf order
+    // (as from getReorderedTriangles()); only the entries listed in `changed` are
+    // read. The tree is refit bottom-up, only the SIMD triangle blocks holding
+    // moved triangles are repacked, and accumulation resets. Returns the SAH
+    // cost relative to the last full build (1 = no degradation).
+    float refitGeometry(const std::vector<Triangle>& triangles, const std::vector<uint32_t>& changed);
+    // Swaps in a tree built elsewhere (e.g. a background SAH build) over the
+    // current getReorderedTriangles() order; triangles are reordered by its
+    // indices(). Ignored for instanced geometry or a different triangle count.
+    void adoptBVH(BVH bvh);
+
+    // Two-level geometry: one BLAS per mesh built over its object-space triangles,
+    // and a TLAS over the instances' world bounds. Instances of one mesh share its
+    // triangles and BLAS; rays are transformed into instance space for traversal.
+    // Replaces any flat geometry (getBVH() and getReorderedTriangles() are empty).
+    void setInstancedGeometry(std::vector<std::vector<Triangle>> meshes, std::vector<Instance> instances,
+                              std::vector<TextureData> textures = {});
+    // Moves instances (one transform per instance): rebuilds only the TLAS and the
+    // emitter list, so the cost is O(instances) rather than O(triangles).
+    void setInstanceTransforms(const std::vector<glm::mat4>& transforms);
+    // Material-only update; meshes in the order given to setInstancedGeometry()
+    void updateInstancedMaterials(const std::vector<std::vector<Triangle>>& meshes);
+    bool     isInstanced() const { return !m_blases.empty(); }
+    uint32_t getInstanceCount() const { return static_cast<uint32_t>(m_instances.size()); }
+    uint32_t getMeshCount() const { return static_cast<uint32_t>(m_blases.size()); }
     void setCamera(const glm::vec3& origin, const glm::mat4& inverseVP);
 
     void resize(uint32_t width, uint32_t height);
     void reset();
+    // Traces one pass over every unconverged tile and waits for it
     void traceSample();
+    // Returns at once; the workers then trace pass after pass until
+    // maxSamples (0 = no limit), full convergence or cancelSample(). Each
+    // finished pass is resolved into a back frame that swaps with the front
+    // one, and the frame getters below read the front, so the caller sees
+    // the last completed pass without waiting on the one in flight. Calling
+    // it again while sampling only changes maxSamples.
+    void traceSampleAsync(uint32_t maxSamples = 0);
+    // Stops handing out tiles and waits for those in flight (one tile, or one
+    // wavefront bounce, per worker). A pass cut short keeps its samples in
+    // the accumulation but is not shown until the next one completes.
+    // Everything that changes what the workers read (geometry, camera,
+    // lights, settings, resize, reset, worker count, the batched queries)
+    // calls this first.
+    void cancelSample();
+    bool isSampling() const { return m_sampling.load(std::memory_order_acquire); }
+    // Time-budgeted progressive rendering on the calling thread: traces tiles
+    // of the current pass until budgetMs has passed (each worker finishes the
+    // tile, or wavefront batch, it holds), then publishes the front frame.
+    // A pass spread over several calls completes before the next begins, so
+    // getSampleCount() still counts whole passes while the pixels traced so
+    // far already show, each averaged over its own sample count. Returns
+    // true when a pass completed in this call.
+    bool traceSampleBudget(float budgetMs);
 
     ~CPURaytracer();
 
-    const std::vector<uint8_t>& getPixelBuffer() const { return m_pixelBuffer; }
+    // Front frame: tone-mapped RGBA8 (exposure, gamma and ACES applied)
+    void getPixelBuffer(std::vector<uint8_t>& outRGBA) const;
 
     // Returns averaged linear HDR float RGB (3 floats per pixel, no tone-mapping)
     void getLinearHDR(std::vector<float>& outRGB) const;
 
     // Returns first-hit albedo and world-space normal buffers (3 floats per pixel each).
+    // These are the live buffers, not the front frame: cancel sampling first.
     void getAuxBuffers(std::vector<float>& outAlbedo, std::vector<float>& outNormal) const;
 
-    uint32_t getSampleCount() const { return m_sampleCount; }
+    // Passes in the front frame since the last reset: the sample count of
+    // every pixel that is still being sampled (see adaptive sampling below)
+    uint32_t getSampleCount() const { return m_sampleCount.load(std::memory_order_acquire); }
+    // Extension and shadow rays traced since the last reset
+    uint64_t getRaysTraced() const { return m_raysTraced.load(std::memory_order_relaxed); }
     uint32_t getWidth()  const { return m_width; }
     uint32_t getHeight() const { return m_height; }
 
+    // traceSample() hands out TILE_SIZE x TILE_SIZE pixel tiles in Morton
+    // order. Each worker starts on an even share of them and, when its own
+    // share runs out, steals half of what another worker has left.
+    static constexpr uint32_t TILE_SIZE = 16;
+    // One worker's part in the front frame's pass. Busy is time spent tracing
+    // tiles; idle is the rest of the frame (wake-up, looking for work, and
+    // waiting for the last worker to finish).
+    struct WorkerStats
+    {
+        float    busyMs = 0.0f;
+        float    idleMs = 0.0f;
+        uint32_t tiles  = 0;
+        uint32_t steals = 0;  // tile runs taken from other workers
+        uint64_t rays   = 0;  // extension and shadow rays
+    };
+    std::vector<WorkerStats> getWorkerStats() const;
+    // Adaptive sampling: every pixel keeps its own sample count and a second
+    // accumulator over its odd-numbered samples. Once a tile has minSamples,
+    // its error is the mean over its pixels of |all - odd| / sqrt(all) (L1
+    // over RGB, both as averages); a tile below threshold is converged and
+    // later passes skip it. Changing any of these resets accumulation.
+    void setAdaptiveSampling(bool enabled);
+    bool getAdaptiveSampling() const { return m_adaptiveSampling; }
+    void  setAdaptiveThreshold(float error);
+    float getAdaptiveThreshold() const { return m_adaptiveThreshold; }
+    void     setAdaptiveMinSamples(uint32_t samples);
+    uint32_t getAdaptiveMinSamples() const { return m_adaptiveMinSamples; }
+    float getConvergedTileFraction() const;
+    // Every tile converged: traceSample() has nothing left to do
+    bool  isConverged() const { return !m_tiles.empty() && m_convergedTiles.load() == m_tiles.size(); }
+    std::vector<uint32_t> getPixelSampleCounts() const;
+    // Per-pixel sample counts as a blue (none) to red (getSampleCount()) ramp,
+    // 3 floats per pixel
+    void getSampleCountHeatmap(std::vector<float>& outRGB) const;
+
+    // Worker threads for traceSample() and the batched queries; 0 = one per
+    // hardware thread (default)
+    void setWorkerCount(uint32_t count);
+    uint32_t getWorkerCount() const { return static_cast<uint32_t>(m_workers.size()); }
+
     // Settings (each resets accumulation when changed)
     void setMaxDepth(int depth);
     int  getMaxDepth() const { return m_maxDepth; }
@@ -82,6 +195,32 @@ public:
     void setUseLuminanceCDF(bool v);
     bool getUseLuminanceCDF() const { return m_useLuminanceCDF; }
 
+    // Emissive-triangle NEE picks lights from a light BVH by their estimated
+    // contribution at the shading point (power, distance, orientation)
+    // instead of from the global CDF. The tree is kept up to date either way.
+    void setUseLightBVH(bool v);
+    bool getUseLightBVH() const { return m_useLightBVH; }
+
+    // Emissive-triangle NEE picks a direction uniformly inside the solid
+    // angle the chosen triangle subtends (Arvo) instead of a point uniformly
+    // on its area. Removes the dist^2 / cos term that makes large, close
+    // emitters noisy; triangles too small or too wide in solid angle for
+    // stable spherical sampling still sample by area.
+    void setSphericalLightSampling(bool v);
+    bool getSphericalLightSampling() const { return m_sphericalLightSampling; }
+
+    // Path guiding: Cook-Torrance bounces learn where light arrives from over
+    // the progressive passes (see PathGuide) and pick each next direction from
+    // that distribution or the BSDF with equal odds, weighted by the pdf of
+    // both (one-sample MIS). What was learned is dropped on reset().
+    void setPathGuiding(bool v);
+    bool getPathGuiding() const { return m_pathGuiding; }
+    // Bytes the guide's trees may take (default 64 MB)
+    void   setPathGuideMemoryLimit(size_t bytes);
+    size_t getPathGuideMemoryLimit() const { return m_pathGuide.getMemoryLimit(); }
+    size_t getPathGuideMemoryBytes() const { return m_pathGuide.memoryBytes(); }
+    uint32_t getPathGuideRegionCount() const { return m_pathGuide.regionCount(); }
+
     void setEnableFireflyClamping(bool v);
     bool getEnableFireflyClamping() const { return m_enableFireflyClamping; }
     void setFireflyClampThreshold(float v);
@@ -120,6 +259,19 @@ public:
     void setEnableRR(bool v);
     bool getEnableRR() const { return m_enableRR; }
 
+    // Source of every random decision along a path (AA jitter, lens, light
+    // selection and position, BSDF, Russian roulette):
+    //   PCG       independent pseudo-random numbers (default)
+    //   Sobol     Owen-scrambled Sobol with a per-pixel scramble; each pair of
+    //             dimensions is a 2D Sobol sequence shuffled by its own seed
+    //   BlueNoise one scrambled Sobol sequence shared by every pixel, shifted
+    //             per pixel and dimension by interleaved gradient noise, so
+    //             the remaining error is spread as blue noise over the screen
+    // The low-discrepancy samplers index by the pixel's own sample count.
+    enum class Sampler : uint32_t { PCG = 0, Sobol = 1, BlueNoise = 2 };
+    void    setSampler(Sampler sampler);
+    Sampler getSampler() const { return m_sampler; }
+
     // Depth of field (resets accumulation when changed; aperture=0 → pinhole)
     void setDoF(float aperture, float focusDistance, glm::vec3 right, glm::vec3 up);
 
@@ -128,13 +280,84 @@ public:
     size_t   getBVHMemoryBytes() const { return m_bvh.memoryBytes(); }
     AABB     getBVHRootAABB() const { return m_bvh.rootAABB(); }
     float    getBVHSAHCost() const { return m_bvh.sahCost(); }
+    // BVH build options (threads, spatial splits); take effect on the next setGeometry()
+    void setBVHBuildOptions(const BVHBuildOptions& options) { m_bvhOptions = options; }
+    const BVHBuildOptions& getBVHBuildOptions() const { return m_bvhOptions; }
+    // Traversal width: 0 = widest the CPU supports (default), 2 = binary,
+    // 4 = BVH4 (SSE), 8 = BVH8 (AVX2). Unsupported widths fall back to the
+    // next narrower one. Results are identical; only speed differs.
+    void setBVHWidth(uint32_t width);
+    uint32_t getBVHWidth() const { return m_bvhWidth; } // active width
+    // Compressed layout: 4-wide nodes with 8-bit quantized child bounds, about
+    // a third of the node memory for some decode work per node. Takes
+    // precedence over the width while enabled; results are identical.
+    void setCompressedBVH(bool enabled);
+    bool getCompressedBVH() const { return m_compressedBVH; }
+    // Packet tracing: the primary rays of each 4x4 pixel tile walk the binary
+    // BVH together, one node visit per packet. Secondary bounces are
+    // incoherent and stay single-ray. Results are identical either way.
+    void setPacketTracing(bool enabled);
+    bool getPacketTracing() const { return m_packetTracing; }
+    // Wavefront mode: rather than running each pixel's path to the end, a
+    // batch of paths advances one bounce at a time through queues — extend
+    // (closest-hit rays traced as streams sorted by direction), shade (grouped
+    // by material) and shadow (light samples traced as occlusion streams).
+    // Renders the same image as the default path tracer; packet tracing does
+    // not apply.
+    void setWavefront(bool enabled);
+    bool getWavefront() const { return m_wavefront; }
+    // Node memory of the structure traceRay() walks (binary, wide, compressed,
+    // or every BLAS plus the TLAS)
+    size_t getTraversalBVHMemoryBytes() const;
+    // Triangle storage (intersection + shading arrays)
+    size_t getTriangleMemoryBytes() const
+    {
+        return m_triVerts.capacity() * sizeof(TriVerts) + m_triData.capacity() * sizeof(TriData)
+             + m_triBlocks.capacity() * sizeof(TriBlock)
+             + m_opacityMicromaps.capacity() * sizeof(OpacityMicromap);
+    }
+
+    // Opacity micromaps: when geometry is set, every alpha-clipped triangle is
+    // split into 8x8 micro-triangles (in barycentric space) and each one is
+    // classified against the texels it covers. Hits on opaque or transparent
+    // micro-triangles skip the texture lookup; only mixed ones sample.
+    struct OpacityMicromapStats
+    {
+        uint32_t triangles = 0;    // alpha-clipped triangles
+        uint32_t opaque = 0;       // micro-triangles whose texels all pass the alpha test
+        uint32_t transparent = 0;  // micro-triangles whose texels all fail it
+        uint32_t mixed = 0;        // micro-triangles still sampled on a hit
+    };
+    OpacityMicromapStats getOpacityMicromapStats() const;
+
     // Full BVH (for sharing with GPU compute path — avoids a second identical build)
     const BVH& getBVH() const { return m_bvh; }
 
+    // Light BVH over the emissive triangles; leaves index the internal light list
+    const LightBVH& getLightBVH() const { return m_lightBVH; }
+    // Light BVH nodes in their GPU layout with each leaf's childOrLight set to
+    // its triangle in getReorderedTriangles() order. Empty for instanced geometry.
+    std::vector<LightBVHNode> exportLightBVH() const;
+    // Alias table behind light sampling, over the internal light list
+    const AliasTable& getLightAliasTable() const { return m_lightAlias; }
+    // Environment map alias tables in their GPU layout: the row marginal
+    // (height entries) followed by each row's conditional (width entries),
+    // weighted by luminance x sin(theta). Empty without an env map.
+    std::vector<AliasTable::Entry> exportEnvAliasTables() const;
+
     // Fills `out` with triangles in BVH-leaf order (same permutation as internal m_triVerts/m_triData).
     // Call after setGeometry(). Used by SceneGeometryCache to avoid a second full flatten pass.
     void getReorderedTriangles(std::vector<Triangle>& out) const;
 
+    // Persistent geometry cache. saveGeometryCache() writes the built BVH, the
+    // BVH-ordered triangle arrays and the light CDF to path, tagged with key
+    // (a hash of everything the build depended on). loadGeometryCache() maps
+    // such a file and installs it in place of setGeometry(); it returns false
+    // and leaves the tracer untouched on a missing file, another key, or a
+    // file written by a build with a different layout. Flat geometry only.
+    bool saveGeometryCache(const std::string& path, uint64_t key) const;
+    bool loadGeometryCache(const std::string& path, uint64_t key, const std::vector<TextureData>& textures = {});
+
     // Point light (caller is responsible for calling reset() after changes)
     void setPointLight(const glm::vec3& pos, const glm::vec3& color, bool enabled);
 
@@ -151,30 +374,123 @@ public:
     // Traces a single ray and returns the closest hit. Exposed for testing.
     HitRecord traceRay(const Ray& ray) const;
 
+    // Work done by one binary-BVH closest-hit query
+    struct TraversalStats
+    {
+        uint32_t nodesVisited = 0;    // nodes entered (box hit and nearer than the closest hit)
+        uint32_t boxTests = 0;
+        uint32_t trianglesTested = 0;
+    };
+
+    // traceRay over the binary BVH, accumulating into stats. ordered = false
+    // runs the unsorted left/right walk instead, for comparison. Exposed for testing.
+    HitRecord traceRayStats(const Ray& ray, TraversalStats& stats, bool ordered = true) const;
+
+    // Closest hits for count rays, traced PACKET_SIZE at a time (single rays on
+    // instanced geometry). Exposed for testing.
+    void traceRayPacket(const Ray* rays, uint32_t count, HitRecord* hits) const;
+    static constexpr uint32_t PACKET_SIZE = 16;
+
+    // Closest hits for count rays, traced as one stream over the binary BVH
+    // (single rays on instanced geometry). Exposed for testing.
+    void traceRayStream(const Ray* rays, uint32_t count, HitRecord* hits) const;
+
+    // Batched queries (picking, baking, visibility, tools). The rays are cut
+    // into chunks of QUERY_CHUNK_RAYS that the worker pool claims one at a
+    // time. Each chunk is sorted by direction octant, then traced as streams
+    // over the binary BVH, or ray by ray through the wide/compressed/instanced
+    // traversal when one is active (its SIMD node tests outrun the streams).
+    // Batches of a single chunk run on the calling thread; larger ones need
+    // the pool and cancel any sampling in flight.
+    void traceRays(std::span<const Ray> rays, std::span<HitRecord> hits);
+    // Bit i % 64 of occluded[i / 64] is set when rays[i] hits anything nearer
+    // than tMax[i]; occluded needs (rays.size() + 63) / 64 words
+    void occluded(std::span<const Ray> rays, std::span<const float> tMax, std::span<uint64_t> occluded);
+    static constexpr uint32_t QUERY_CHUNK_RAYS = 4096; // a multiple of 64
+
 private:
+    // Per-path sample source. PCG draws independent numbers; the other
+    // samplers return dimension `dim` of the pixel's sample `index`, one
+    // dimension per next() call.
     struct RNG
     {
         uint32_t state;
+        Sampler  sampler = Sampler::PCG;
+        uint32_t index = 0;         // the pixel's sample number
+        uint32_t seed  = 0;         // Owen scramble seed
+        uint32_t dim   = 0;
+        uint32_t x = 0, y = 0;      // pixel, for the blue-noise shift
+        RNG() : state(0) {}
         explicit RNG(uint32_t seed) : state(seed) {}
 
         float next()
         {
+            if (sampler != Sampler::PCG)
+                return nextDimension();
             state = state * 747796405u + 2891336453u;
             uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
             word = (word >> 22u) ^ word;
             return static_cast<float>(word) / 4294967296.0f;
         }
+        // Bounce depth starts at dimension CAMERA_DIMS + depth * BOUNCE_DIMS,
+        // so a decision sees the same dimension in every sample of a pixel.
+        // Never moves back: a bounce that ran over keeps its numbers apart.
+        void beginBounce(int depth)
+        {
+            dim = std::max(dim, CAMERA_DIMS + static_cast<uint32_t>(depth) * BOUNCE_DIMS);
+        }
+        float nextDimension();
+
+        static constexpr uint32_t CAMERA_DIMS = 4;  // AA jitter, lens
+        static constexpr uint32_t BOUNCE_DIMS = 16; // roulette, lights, BSDF
     };
+    RNG pixelRNG(uint32_t x, uint32_t y) const;
 
     static uint32_t hash(uint32_t x);
 
     // Thread pool
-    struct WorkRange { uint32_t startRow, endRow; };
     void buildThreadPool();
     void shutdownPool();
-    void rebuildWorkerRanges();
     void workerLoop(uint32_t id);
-    void traceRowRange(uint32_t startRow, uint32_t endRow);
+
+    // Tile scheduler. A worker's queue is a run [begin, end) of m_tiles
+    // packed into one atomic word: the owner takes tiles from the front,
+    // thieves take the back half.
+    struct Tile { uint32_t x0, y0, x1, y1; };
+    struct alignas(64) TileQueue
+    {
+        std::atomic<uint64_t> range{0}; // begin | end << 32
+    };
+    void buildTiles(); // after a resize
+    // Claims up to maxTiles tiles for worker, stealing when its queue is
+    // empty; false once every queue is empty or the pass is cancelled
+    bool nextTiles(uint32_t worker, uint32_t maxTiles, uint32_t& begin, uint32_t& end);
+    void traceTiles(uint32_t worker);
+    uint64_t traceTile(const Tile& tile); // returns the rays traced
+    // Marks the tile converged once its error estimate drops below threshold
+    void updateTileConvergence(uint32_t tile);
+    // Wakes every worker to run job and waits until all are done
+    void dispatchPool(const std::function<void()>& job);
+
+    // Passes. The caller starts one with startSampling(); the worker that
+    // finishes it last runs endPass(), which publishes it and, while
+    // sampling is continuous, queues the next one itself. A pass cut off by
+    // its time budget is paused with its remaining tiles left in the queues.
+    void startSampling(bool continuous, uint32_t maxSamples);
+    bool beginPass(); // fills the tile queues; false when nothing is left to trace
+    bool endPass();   // true when the next pass has begun
+    void resolveFrame(bool completed);
+    void startPassClock(); // clears the worker stats
+    // Resolved output of one completed pass
+    struct Frame
+    {
+        std::vector<glm::vec3>   hdr;      // per-pixel average
+        std::vector<uint8_t>     pixels;   // tone-mapped RGBA8
+        std::vector<uint32_t>    samples;  // per-pixel sample counts
+        std::vector<WorkerStats> workerStats;
+    };
+    // Calls chunk(begin, end) over [0, count) in QUERY_CHUNK_RAYS steps
+    void runQueryChunks(uint32_t count, const std::function<void(uint32_t, uint32_t)>& chunk);
 
     // Hot intersection data — compact for cache-efficient BVH traversal (36 bytes)
     struct TriVerts
@@ -205,51 +521,274 @@ private:
         glm::vec3 tangent{1, 0, 0};
         float bitangentSign = 1.0f;
         float emissiveStrength = 1.0f;
+        uint32_t opacityMicromap = UINT32_MAX; // into m_opacityMicromaps; alpha-clipped only
+    };
+
+    // One bit per micro-triangle of an alpha-clipped triangle. Micro-triangle
+    // (i, j, upper) of the OPACITY_MICROMAP_SEGMENTS^2 subdivision is bit
+    // j * (2N - j) + 2i + upper; bits set in neither mask are mixed.
+    static constexpr int OPACITY_MICROMAP_SEGMENTS = 8;
+    struct OpacityMicromap
+    {
+        uint64_t opaque = 0;
+        uint64_t transparent = 0;
+    };
+    static uint32_t microTriangleIndex(float u, float v);
+    void buildOpacityMicromaps(); // after the triangles and textures are set
+    // Alpha test at barycentrics (u, v): true when the surface is cut out there
+    bool alphaCutout(const TriData& data, float u, float v) const;
+
+    // m_triVerts regrouped in SoA blocks (vertex 0 and both edges): triangle i
+    // is lane i % 4 of block i / 4, so one SIMD Möller–Trumbore step tests a ray
+    // against four neighbouring triangles. Unused lanes of the last block are
+    // zero and never report a hit.
+    static constexpr uint32_t TRI_BLOCK_WIDTH = 4;
+    struct alignas(16) TriBlock
+    {
+        float v0x[TRI_BLOCK_WIDTH], v0y[TRI_BLOCK_WIDTH], v0z[TRI_BLOCK_WIDTH];
+        float e1x[TRI_BLOCK_WIDTH], e1y[TRI_BLOCK_WIDTH], e1z[TRI_BLOCK_WIDTH];
+        float e2x[TRI_BLOCK_WIDTH], e2y[TRI_BLOCK_WIDTH], e2z[TRI_BLOCK_WIDTH];
     };
 
     bool intersectTriangle(const Ray& ray, const TriVerts& verts,
                            float& t, float& u, float& v) const;
+    // Lane mask of the block's triangles hit nearer than tMax; t/u/v per lane
+    static uint32_t intersectTriBlock(const TriBlock& block, const Ray& ray, float tMax,
+                                      float* t, float* u, float* v);
+    // Calls onHit(tri, t, u, v) for each leaf triangle hit nearer than tMax,
+    // in triangle order; stops early when onHit returns true
+    template <typename OnHit>
+    bool forEachLeafHit(const Ray& ray, uint32_t first, uint32_t count, const float& tMax,
+                        OnHit&& onHit) const;
     bool traceShadowRay(const Ray& ray, float maxDist) const;
+
+    // Leaf tests shared by the binary and wide traversals. facing = -1 flips the
+    // back-face test for rays in the space of a mirrored instance.
+    void intersectLeaf(const Ray& ray, uint32_t first, uint32_t count, TriangleHit& closest,
+                       float facing = 1.0f) const;
+    // Back-face and alpha tests for a triangle hit nearer than closest.t;
+    // records it in closest if the hit stands
+    void acceptHit(const Ray& ray, uint32_t tri, float t, float u, float v, float facing,
+                   TriangleHit& closest) const;
+    // Shading attributes of the final hit, in the space of ray
+    HitRecord resolveHit(const Ray& ray, const TriangleHit& nearest) const;
+    bool occludedLeaf(const Ray& ray, uint32_t first, uint32_t count, float maxDist,
+                      float facing = 1.0f) const;
+
+    // Binary BVH traversal: both children are slab-tested at their parent, the
+    // nearer one is entered first and the farther one is skipped on pop once a
+    // closer hit is known.
+    template <bool CountStats> TriangleHit traceRayBinary(const Ray& ray, TraversalStats* stats) const;
+
+    // Wide BVH traversal (SIMD node tests, front-to-back child order)
+    template <typename WideBVHT> TriangleHit traceRayWide(const WideBVHT& bvh, const Ray& ray) const;
+    template <typename WideBVHT> bool traceShadowRayWide(const WideBVHT& bvh, const Ray& ray, float maxDist) const;
+    TriangleHit traceRayAVX2(const Ray& ray) const;
+    bool traceShadowRayAVX2(const Ray& ray, float maxDist) const;
+
+    // Packet traversal: rays in SoA lanes, a node is entered when any active
+    // lane hits it. Coherent packets first try an interval (frustum) test that
+    // rejects a box for all lanes at once.
+    struct RayPacket;
+    static uint32_t intersectPacketAABB(const RayPacket& packet, const AABB& box, uint32_t mask,
+                                        float* tNear, float& first);
+    static bool packetMissesAABB(const RayPacket& packet, const AABB& box);
+    void intersectLeafPacket(RayPacket& packet, uint32_t mask, uint32_t first, uint32_t count,
+                             const Ray* rays, TriangleHit* hits) const;
+    void tracePacket(RayPacket& packet, const Ray* rays, TriangleHit* hits) const;
+    static constexpr uint32_t PACKET_TILE_WIDTH = 4; // pixels; PACKET_SIZE / PACKET_TILE_WIDTH rows
+
+    // Stream traversal: a node is fetched once for every ray that reaches it
+    void occludedStream(const Ray* rays, const float* maxDist, uint32_t count, uint8_t* occluded) const;
+
     Ray generateRay(int x, int y, float jitterX, float jitterY, RNG& rng) const;
+
+    // A guided bounce whose incident radiance goes back to the guide when the
+    // path ends: radiance / throughput is what arrived along direction
+    struct GuideVertex
+    {
+        uint32_t  region;
+        glm::vec3 direction;
+        float     pdf;
+        glm::vec3 throughput;  // right after the bounce
+        glm::vec3 radiance;    // path radiance added since
+    };
+    static constexpr uint32_t MAX_GUIDE_VERTICES = 8;
+
+    // State carried by a path from one bounce to the next
+    struct PathState
+    {
+        Ray ray;
+        glm::vec3 radiance{0.0f};
+        glm::vec3 throughput{1.0f};
+        float prevBsdfPdf = 0.0f;
+        bool prevWasDelta = false;
+        glm::vec3 prevPosition{0.0f};  // where the ray left (light pdf for MIS)
+        glm::vec3 prevNormal{0.0f};
+        uint32_t guideVertexCount = 0;
+        GuideVertex guideVertices[MAX_GUIDE_VERTICES];
+
+        // Adds to the path and to the first `vertices` guide vertices (a
+        // light sample only reaches the ones made before it)
+        void addRadiance(const glm::vec3& contribution, uint32_t vertices)
+        {
+            radiance += contribution;
+            for (uint32_t i = 0; i < vertices; ++i)
+                guideVertices[i].radiance += contribution;
+        }
+        void addRadiance(const glm::vec3& contribution) { addRadiance(contribution, guideVertexCount); }
+    };
+
+    // Russian roulette ahead of a bounce; false = the path ends here
+    bool survivesRoulette(PathState& path, RNG& rng, int depth) const;
+    // Shades the hit (or miss) of path.ray and sets up the next ray. Each light
+    // sample is handed to shadow(ray, maxDist, contribution), which adds the
+    // contribution to path.radiance if the ray is unoccluded — immediately in
+    // pathTrace(), after a batched shadow stage in wavefront mode. Returns
+    // false when the path ends.
+    template <typename ShadowFn>
+    bool shadeBounce(PathState& path, HitRecord& hit, RNG& rng, int depth,
+                     glm::vec3* outAlbedo, glm::vec3* outNormal, ShadowFn&& shadow) const;
+    // primaryHit: first hit already traced for ray (packet path), or null.
+    // outRays, when set, is incremented per extension and shadow ray.
     glm::vec3 pathTrace(const Ray& ray, RNG& rng,
                         glm::vec3* outAlbedo = nullptr,
-                        glm::vec3* outNormal = nullptr) const;
+                        glm::vec3* outNormal = nullptr,
+                        const HitRecord* primaryHit = nullptr,
+                        uint64_t* outRays = nullptr) const;
+    // Hands the path's guide vertices to m_pathGuide
+    void recordGuideVertices(const PathState& path) const;
+    void accumulatePixel(uint32_t index, glm::vec3 color, const glm::vec3& albedo, const glm::vec3& normal);
+
+    // Wavefront mode: each worker claims tiles in batches of about
+    // WAVEFRONT_BATCH_PATHS paths
+    struct WavefrontPath;
+    struct ShadowQuery;
+    void traceTilesWavefront(uint32_t worker);
+    static constexpr uint32_t WAVEFRONT_BATCH_PATHS = 16384;
     glm::vec3 sampleEnvironment(const glm::vec3& direction) const;
     glm::vec4 sampleTexture(int textureIndex, const glm::vec2& uv) const;
 
     // Environment map importance sampling
-    void buildEnvMapCDF();
+    void buildEnvMapAlias();
     glm::vec3 sampleEnvMap(RNG& rng, glm::vec3& outDir, float& outPdf) const;
     float envMapPdf(const glm::vec3& dir) const;
 
     // Acceleration structure
     void buildBVH();
+    void applyBVHOrder(); // reorders the triangle arrays by m_bvh.indices()
+    void buildWideBVH();
+    void buildTriBlocks(); // after any change to m_triVerts
+    void packTriBlockLane(size_t tri); // after moving one triangle (SIMD builds only)
+
+    // --- Two-level acceleration structure ---
+    struct BLAS
+    {
+        BVH bvh;               // over the mesh's object-space triangles
+        uint32_t firstTri = 0; // mesh triangles live at m_triVerts[firstTri, firstTri + refs)
+    };
+
+    struct InstanceData
+    {
+        uint32_t  mesh = 0;
+        glm::mat4 toWorld{1.0f};
+        glm::mat4 toObject{1.0f};
+        glm::mat3 normalToWorld{1.0f};
+        float     handedness = 1.0f; // -1 when the transform mirrors (negative determinant)
+    };
+
+    // Meshes at least this large get a multithreaded BLAS build of their own;
+    // smaller ones are built one per thread
+    static constexpr size_t BLAS_PARALLEL_MIN_TRIS = 65536;
+
+    void buildTLAS();
+    void intersectInstance(const InstanceData& inst, const Ray& worldRay, TriangleHit& closest) const;
+    bool occludedInstance(const InstanceData& inst, const Ray& worldRay, float maxDist) const;
+    HitRecord traceRayInstanced(const Ray& ray) const;
+    bool traceShadowRayInstanced(const Ray& ray, float maxDist) const;
 
     // Light sampling
     void buildLightData();
-    glm::vec3 sampleLightPoint(RNG& rng, uint32_t& outTriIndex) const;
+    void buildLightSampling();  // alias table, light BVH and triangle -> light map, from m_lightTris/m_lightCDF
+
+    struct GeometryCacheHeader;
+    static constexpr uint32_t GEOMETRY_CACHE_VERSION = 2;
+    // Picks an emissive triangle for shading point p (normal n) and a point on
+    // it. Always draws three numbers; false when no light can reach p.
+    bool sampleLightPoint(RNG& rng, const glm::vec3& p, const glm::vec3& n,
+                          uint32_t& outLightIndex, float& outPmf, glm::vec3& outPoint) const;
+    // Probability that sampleLightPoint() picks `light` from p, n
+    float lightPmf(uint32_t light, const glm::vec3& p, const glm::vec3& n) const;
+    // Solid-angle density at p of the point sampleLightPoint() places on
+    // `light` once it has been picked (0 when the light faces away)
+    float lightPointPdf(uint32_t light, const glm::vec3& p, const glm::vec3& onLight) const;
+    // Solid angle `light` subtends at p when it is in the range spherical
+    // sampling handles, else 0 (sample by area)
+    float sphericalSampleArea(uint32_t light, const glm::vec3& p) const;
+    // Light under a hit on an emissive triangle, or UINT32_MAX
+    uint32_t lightIndexOf(const HitRecord& hit) const;
 
     BVH m_bvh;
-    std::vector<TriVerts> m_triVerts;   // hot: intersection only
+    BVHBuildOptions m_bvhOptions;
+    WideBVH<4> m_bvh4;                // collapsed from m_bvh when m_bvhWidth == 4
+    WideBVH<8> m_bvh8;                // collapsed from m_bvh when m_bvhWidth == 8
+    CompressedBVH m_cbvh;             // quantized from m_bvh when m_compressedBVH is set
+    bool m_compressedBVH = false;
+    bool m_packetTracing = true;
+    bool m_wavefront = false;
+    uint32_t m_bvhWidthRequest = 0;   // 0 = auto
+    uint32_t m_bvhWidth = 2;
+    std::vector<TriVerts> m_triVerts;   // hot: intersection only (object space when instanced)
     std::vector<TriData>  m_triData;    // cold: shading only
+    std::vector<TriBlock> m_triBlocks;  // hot: m_triVerts in SIMD blocks (SIMD builds only)
+    std::vector<BLAS>         m_blases;    // one per mesh; empty = flat geometry
+    std::vector<InstanceData> m_instances;
+    BVH                       m_tlas;      // over instance world bounds; indices() = instance ids
     std::vector<TextureData> m_textures;
+    std::vector<OpacityMicromap> m_opacityMicromaps;
     uint32_t m_width = 0, m_height = 0;
 
     std::vector<glm::vec3> m_accumBuffer;
+    std::vector<glm::vec3> m_oddAccumBuffer;  // odd-numbered samples only (error estimate)
+    std::vector<uint32_t>  m_pixelSamples;    // samples in m_accumBuffer, per pixel
     std::vector<glm::vec3> m_albedoBuffer;  // first-hit albedo (overwritten each sample)
     std::vector<glm::vec3> m_normalBuffer;  // first-hit world-space normal (overwritten each sample)
-    std::vector<uint8_t> m_pixelBuffer;
-    uint32_t m_sampleCount = 0;
+    uint32_t m_passIndex = 0;  // seeds the RNG; counts cancelled passes too
+
+    Frame                 m_frames[2];
+    uint32_t              m_frontFrame = 0;         // written under m_frameMutex
+    mutable std::mutex    m_frameMutex;
+    std::atomic<uint32_t> m_sampleCount{0};         // passes in the front frame
+    std::atomic<bool>     m_sampling{false};        // written under m_poolMutex
+    std::atomic<bool>     m_cancelSample{false};
+    std::atomic<bool>     m_passCancelled{false};   // some worker stopped early
+    bool                  m_continuousSampling = false;
+    std::atomic<uint32_t> m_maxSamples{0};
+    std::atomic<uint64_t> m_raysTraced{0};
+    bool                  m_passPaused = false;     // budget ran out with tiles left
+    bool                  m_passTimed  = false;     // tiles stop at m_passDeadline
+    std::chrono::steady_clock::time_point m_passDeadline;
+    std::chrono::steady_clock::time_point m_passStart;
 
     // Thread pool — persistent workers, fork-join via condition variables
     std::vector<std::thread>  m_workers;
-    std::vector<WorkRange>    m_workerRanges;
+    uint32_t                  m_workerCountRequest = 0; // 0 = hardware threads
+    std::vector<TileQueue>    m_tileQueues;  // one per worker
+    std::vector<WorkerStats>  m_workerStats; // one per worker
+    std::vector<Tile>         m_tiles;       // Morton order
+    std::vector<uint32_t>     m_activeTiles; // this pass: indices into m_tiles; queues index this
+    std::vector<uint8_t>      m_tileConverged;
+    std::atomic<uint32_t>     m_convergedTiles{0};
+    bool                      m_adaptiveSampling   = false;
+    float                     m_adaptiveThreshold  = 0.01f;
+    uint32_t                  m_adaptiveMinSamples = 16;
     std::mutex                m_poolMutex;
     std::condition_variable   m_cvWork;
     std::condition_variable   m_cvDone;
     uint64_t                  m_poolEpoch   = 0;
     uint32_t                  m_poolPending = 0;
     bool                      m_poolStop    = false;
+    const std::function<void()>* m_poolJob  = nullptr; // null = trace a pass
 
     glm::vec3 m_cameraOrigin{0.0f};
     glm::mat4 m_inverseVP{1.0f};
@@ -258,6 +797,9 @@ private:
     int  m_maxDepth = 5;
     bool m_enableNEE = true;
     bool m_useLuminanceCDF = false;
+    bool m_useLightBVH = false;
+    bool m_sphericalLightSampling = false;
+    bool m_pathGuiding = false;
     bool  m_enableFireflyClamping = false;
     float m_fireflyClampThreshold = 10.0f;
     bool m_enableAA = true;
@@ -271,6 +813,7 @@ private:
     bool m_enableACES = true;
     float m_rayEps = 1e-4f;
     bool  m_enableRR = true;
+    Sampler m_sampler = Sampler::PCG;
 
     // Depth of field
     float      m_aperture      = 0.0f;
@@ -298,15 +841,36 @@ private:
     int m_envMapHeight = 0;
     bool m_hasEnvMap = false;
 
-    // Environment map CDF for importance sampling
-    std::vector<float> m_envCondCDF;    // per-row conditional CDF [width * height]
-    std::vector<float> m_envMarginalCDF; // row marginal CDF [height]
+    // Environment map importance sampling: row marginal and per-row conditionals
+    AliasTable              m_envMarginalAlias;
+    std::vector<AliasTable> m_envRowAlias;
     float m_envTotalIntegral = 0.0f;
 
-    // Light data (emissive triangles)
-    std::vector<uint32_t> m_lightIndices;
-    std::vector<float> m_lightCDF;
+    // Light data (emissive triangles), world space in both geometry modes
+    struct LightTri
+    {
+        glm::vec3 v0, v1, v2;
+        glm::vec3 geometricNormal;
+        glm::vec3 emissive;
+        float     area;
+        uint32_t  triangle;  // index into m_triData
+        uint32_t  instance;  // index into m_instances (0 for flat geometry)
+    };
+    std::vector<LightTri> m_lightTris;
+    std::vector<float> m_lightCDF;  // pmf of light i = m_lightCDF[i] - m_lightCDF[i - 1]
+    AliasTable m_lightAlias;        // samples that pmf in O(1)
     float m_totalLightArea = 0.0f;
+    LightBVH m_lightBVH;
+
+    // Recorded into by the const tracing functions (atomically, during a
+    // pass); refined in endPass()
+    mutable PathGuide m_pathGuide;
+    // Light of an emitter hit: m_slotLights[m_instanceLightBase[instance] +
+    // m_triEmitterSlot[tri]]. The slot numbers a mesh's emitting triangles
+    // (UINT32_MAX elsewhere) and is shared by duplicated references.
+    std::vector<uint32_t> m_triEmitterSlot;
+    std::vector<uint32_t> m_instanceLightBase;
+    std::vector<uint32_t> m_slotLights;
 };
 
 } // namespace vex
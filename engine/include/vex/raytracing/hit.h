@@ -7,28 +7,29 @@
 namespace vex
 {
 
+// Nearest triangle found so far during traversal. Candidates that a closer
+// hit later replaces never get further than this record.
+struct TriangleHit
+{
+    float t = FLT_MAX;
+    float u = 0.0f;             // barycentric weight of v1
+    float v = 0.0f;             // barycentric weight of v2
+    uint32_t triangleIndex = UINT32_MAX;
+};
+
+// Surface at the final hit, interpolated once from the winning TriangleHit.
+// Material constants are not copied; they are looked up by triangleIndex.
 struct HitRecord
 {
     float t = FLT_MAX;
     glm::vec3 position;
     glm::vec3 normal;           // interpolated shading normal
     glm::vec3 geometricNormal;  // face normal (for light pdf)
-    glm::vec3 color;
-    glm::vec3 emissive;
     glm::vec2 uv;
-    int textureIndex = -1;
-    int emissiveTextureIndex = -1;
-    int normalMapTextureIndex = -1;
-    int roughnessTextureIndex = -1;
-    int metallicTextureIndex = -1;
-    uint32_t triangleIndex = UINT32_MAX;
-    int materialType = 0;
-    float ior = 1.5f;
-    float roughness = 0.5f;
-    float metallic = 0.0f;
     glm::vec3 tangent{1, 0, 0};
     float bitangentSign = 1.0f;
-    float emissiveStrength = 1.0f;
+    uint32_t triangleIndex = UINT32_MAX;
+    uint32_t instanceIndex = UINT32_MAX;  // placement hit (instanced geometry only)
     bool hit = false;
 };
 
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <vex/raytracing/bvh.h>
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace vex
+{
+
+// What a group of emitters looks like from afar (Conty Estevez & Kulla,
+// "Importance Sampling of Many Lights with Adaptive Tree Splitting", 2018):
+// a box, the total emitted power, and a cone around `axis` that holds every
+// emitter normal (half-angle acos(cosThetaO)). Each emitter radiates up to
+// acos(cosThetaE) beyond its normal: pi/2 for one-sided area lights.
+struct LightBounds
+{
+    AABB      bounds;
+    float     power = 0.0f;
+    glm::vec3 axis{0.0f, 0.0f, 1.0f};
+    float     cosThetaO = 1.0f;
+    float     cosThetaE = 0.0f;
+};
+
+// Light tree node (64 bytes). The layout is meant for the GPU path tracers
+// as well (4 vec4s, std430; the last one read through floatBitsToUint):
+//   [0] boundsMin.xyz, power
+//   [1] boundsMax.xyz, cosThetaO
+//   [2] axis.xyz, cosThetaE
+//   [3] childOrLight, parent, lightCount, 0
+// Nodes are in depth-first order: an internal node's first child is the next
+// node. Every leaf holds one light.
+struct alignas(16) LightBVHNode
+{
+    static constexpr uint32_t INVALID = 0xFFFFFFFFu;
+
+    float    boundsMin[3];
+    float    power;
+    float    boundsMax[3];
+    float    cosThetaO;
+    float    axis[3];
+    float    cosThetaE;
+    uint32_t childOrLight;  // internal: second child; leaf: light index
+    uint32_t parent;        // INVALID at the root
+    uint32_t lightCount;    // 0 = internal, 1 = leaf
+    uint32_t pad;
+
+    bool isLeaf() const { return lightCount > 0; }
+};
+static_assert(sizeof(LightBVHNode) == 64, "LightBVHNode must match the GPU layout");
+
+// Picks one emitter per shading point with probability proportional to a
+// conservative estimate of its contribution there (power, distance, emitter
+// and receiver orientation), descending the tree one child at a time.
+class LightBVH
+{
+public:
+    using Node = LightBVHNode;
+
+    // Binned SAOH build (surface area x orientation x power, 12 buckets per
+    // axis). Light indices in the tree are indices into `lights`.
+    void build(std::span<const LightBounds> lights);
+    void clear();
+
+    // Chooses a light for point p with normal n; lights behind the surface
+    // are skipped (a zero n disables the receiver term). u in [0, 1) is
+    // rescaled at every level, so one number steers the whole descent.
+    // Returns false when nothing can reach p.
+    bool sample(const glm::vec3& p, const glm::vec3& n, float u, uint32_t& outLight, float& outPmf) const;
+    // Probability that sample() returns `light` for p and n
+    float pmf(const glm::vec3& p, const glm::vec3& n, uint32_t light) const;
+
+    static float importance(const Node& node, const glm::vec3& p, const glm::vec3& n);
+
+    const std::vector<Node>&     nodes() const { return m_nodes; }
+    const std::vector<uint32_t>& leaves() const { return m_leaves; } // leaf node of each light
+    bool empty() const { return m_nodes.empty(); }
+    size_t memoryBytes() const
+    {
+        return m_nodes.capacity() * sizeof(Node) + m_leaves.capacity() * sizeof(uint32_t);
+    }
+
+private:
+    uint32_t buildRecursive(std::span<const LightBounds> lights, uint32_t* order, uint32_t count, uint32_t parent);
+
+    std::vector<Node>     m_nodes;
+    std::vector<uint32_t> m_leaves;
+};
+
+} // namespace vex
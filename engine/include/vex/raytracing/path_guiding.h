@@ -0,0 +1,110 @@
+#pragma once
+
+#include <vex/raytracing/bvh.h>
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace vex
+{
+
+// Online path guiding with a spatial-directional tree (Müller, Gross and
+// Novák, "Practical Path Guiding for Efficient Light-Transport Simulation",
+// 2017). A binary tree over the scene box splits space into regions; each
+// region learns the incident radiance around it as a quadtree over the
+// sphere (D-tree), in the cylindrical square (u, v) -> (cos theta = 2u - 1,
+// phi = 2 pi v), where equal areas are equal solid angles.
+//
+// Learning runs in iterations of 1, 2, 4, ... progressive passes. During an
+// iteration paths sample each region's sampling D-tree and record into its
+// building D-tree; when the iteration ends the building trees become the
+// sampling ones, busy regions split and fresh building trees are refined
+// from the new sampling distributions.
+class PathGuide
+{
+public:
+    static constexpr uint32_t INVALID = 0xFFFFFFFFu;
+
+    // Starts learning from scratch over bounds; an empty box clears the guide
+    void reset(const AABB& bounds);
+    void clear();
+    bool empty() const { return m_nodes.empty(); }
+
+    // Bytes the trees may take; refinement stops growing them at the limit
+    void   setMemoryLimit(size_t bytes) { m_memoryLimit = bytes; }
+    size_t getMemoryLimit() const { return m_memoryLimit; }
+
+    // Region holding p (points outside the box go to the nearest region)
+    uint32_t regionAt(const glm::vec3& p) const;
+    // True once the region has learned a distribution to sample
+    bool canSample(uint32_t region) const { return m_regions[region].sampling.total > 0.0f; }
+    // Direction from the region's learned distribution, and its solid-angle
+    // pdf. Only meaningful when canSample(region).
+    glm::vec3 sample(uint32_t region, float u1, float u2) const;
+    float pdf(uint32_t region, const glm::vec3& direction) const;
+
+    // Adds one estimate of the radiance arriving at the region from direction:
+    // its luminance over the pdf the direction was sampled with. Any number
+    // of threads may record at once, never while endPass() runs.
+    void record(uint32_t region, const glm::vec3& direction, float value);
+
+    // Counts a completed progressive pass and ends the iteration when it is
+    // due. Call with no record() in flight.
+    void endPass();
+
+    uint32_t iteration() const { return m_iteration; }
+    uint32_t regionCount() const { return static_cast<uint32_t>(m_regions.size()); }
+    size_t   memoryBytes() const;
+
+private:
+    // Four quadrants (x bit 0, y bit 1) of a square; child 0 = leaf quadrant.
+    // Only leaf quadrants are recorded into; build() sums up the rest.
+    struct QuadNode
+    {
+        float    sum[4];
+        uint32_t child[4];
+    };
+
+    struct DTree
+    {
+        std::vector<QuadNode> nodes;
+        float total = 0.0f;     // recorded flux, valid after build()
+
+        void reset();
+        void build();
+        void record(glm::vec2 p, float value);
+        glm::vec2 sample(glm::vec2 u) const;
+        float pdf(glm::vec2 p) const;   // over the unit square
+        // This tree subdivided wherever a quadrant of source holds more than
+        // `threshold` of its flux, at most maxNodes nodes, sums zeroed
+        void refineFrom(const DTree& source, float threshold, uint32_t maxNodes);
+    };
+
+    struct Region
+    {
+        DTree    sampling;
+        DTree    building;
+        uint32_t samples = 0;   // records this iteration
+    };
+
+    // Children of a node halve it along axis depth % 3. child 0 = leaf.
+    struct SpatialNode
+    {
+        uint32_t child;   // first of two consecutive nodes
+        uint32_t region;
+    };
+
+    void refine();
+
+    AABB                     m_bounds;   // cube around the scene
+    std::vector<SpatialNode> m_nodes;
+    std::vector<Region>      m_regions;
+    size_t   m_memoryLimit       = size_t(64) << 20;
+    uint32_t m_iteration         = 0;
+    uint32_t m_passesInIteration = 0;
+};
+
+} // namespace vex
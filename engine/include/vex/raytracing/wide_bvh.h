@@ -0,0 +1,73 @@
+#pragma once
+
+#include <vex/raytracing/bvh.h>
+
+#include <cstdint>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define VEX_BVH_SIMD_X86 1
+#endif
+
+// AVX2 code paths are compiled into the default build and only entered after
+// detectBVHWidth() confirmed support. GCC/Clang need the target attribute to
+// emit AVX2 instructions in such functions; MSVC accepts the intrinsics as-is.
+#if defined(VEX_BVH_SIMD_X86) && (defined(__GNUC__) || defined(__clang__))
+#define VEX_TARGET_AVX2 __attribute__((target("avx2")))
+// For traversal entry points: flatten inlines the generic traversal loop so the
+// per-node AVX2 box test is inlined rather than called.
+#define VEX_TARGET_AVX2_FLATTEN __attribute__((target("avx2"), flatten))
+#else
+#define VEX_TARGET_AVX2
+#define VEX_TARGET_AVX2_FLATTEN
+#endif
+
+namespace vex
+{
+
+// Widest BVH node the running CPU can test in one SIMD step:
+// 8 with AVX2, 4 with SSE2 (any x86-64 CPU), 2 = scalar binary traversal.
+uint32_t detectBVHWidth();
+
+// N children per node with bounds stored per axis (SoA), so one SIMD load
+// fetches the same slab plane for every child.
+template <uint32_t N>
+struct alignas(32) WideBVHNode
+{
+    static constexpr uint32_t WIDTH = N;
+    static constexpr uint32_t EMPTY = 0xFFFFFFFFu;
+
+    float minX[N], minY[N], minZ[N];
+    float maxX[N], maxY[N], maxZ[N];
+    uint32_t child[N];    // internal child: wide node index; leaf child: first triangle; EMPTY = unused slot
+    uint32_t triCount[N]; // 0 = internal child (or unused slot), >0 = leaf child
+};
+
+template <uint32_t N>
+class WideBVH
+{
+public:
+    static_assert(N == 4 || N == 8, "WideBVH supports 4- and 8-wide nodes");
+    using Node = WideBVHNode<N>;
+
+    // Collapses a built binary BVH. Each wide node adopts up to N descendants,
+    // opening the internal child with the largest surface area first. Leaf
+    // triangle ranges are reused unchanged, so the triangle order is the same.
+    void build(const BVH& bvh);
+    void clear();
+
+    const std::vector<Node>& nodes() const { return m_nodes; }
+    bool empty() const { return m_nodes.empty(); }
+    uint32_t nodeCount() const { return static_cast<uint32_t>(m_nodes.size()); }
+    size_t memoryBytes() const { return m_nodes.capacity() * sizeof(Node); }
+
+private:
+    uint32_t collapse(const BVH& bvh, uint32_t binaryIdx);
+
+    std::vector<Node> m_nodes;
+};
+
+extern template class WideBVH<4>;
+extern template class WideBVH<8>;
+
+} // namespace vex
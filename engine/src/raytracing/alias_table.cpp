@@ -0,0 +1,48 @@
+#include <vex/raytracing/alias_table.h>
+
+namespace vex
+{
+
+void AliasTable::build(std::span<const float> weights)
+{
+    const uint32_t n = static_cast<uint32_t>(weights.size());
+    m_entries.resize(n);
+    for (uint32_t i = 0; i < n; ++i)
+        m_entries[i] = { 1.0f, i };
+
+    double total = 0.0;
+    for (float w : weights)
+        total += std::max(w, 0.0f);
+    if (total <= 0.0)
+        return;
+
+    // Vose: pair every under-full slot with an over-full one that tops it up.
+    // Doubles keep the running remainders from drifting on large tables.
+    std::vector<double>   scaled(n);
+    std::vector<uint32_t> small, large;
+    small.reserve(n);
+    large.reserve(n);
+    for (uint32_t i = 0; i < n; ++i)
+    {
+        scaled[i] = static_cast<double>(std::max(weights[i], 0.0f)) * n / total;
+        (scaled[i] < 1.0 ? small : large).push_back(i);
+    }
+
+    while (!small.empty() && !large.empty())
+    {
+        const uint32_t s = small.back();
+        small.pop_back();
+        const uint32_t l = large.back();
+
+        m_entries[s] = { static_cast<float>(scaled[s]), l };
+        scaled[l] -= 1.0 - scaled[s];
+        if (scaled[l] < 1.0)
+        {
+            large.pop_back();
+            small.push_back(l);
+        }
+    }
+    // Whatever is left is full up to rounding and keeps { 1, self }
+}
+
+} // namespace vex
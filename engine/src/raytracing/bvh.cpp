@@ -1,12 +1,49 @@
 #include <vex/raytracing/bvh.h>
 
 #include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
 #include <numeric>
+#include <thread>
 
 namespace vex
 {
 
-void BVH::build(const std::vector<AABB>& triBounds)
+// Runs fn(0..jobCount-1) on up to threadCount threads (the caller included).
+// Jobs are claimed through an atomic counter, so each job index runs exactly once.
+template <typename Fn>
+static void parallelFor(uint32_t jobCount, uint32_t threadCount, Fn&& fn)
+{
+    threadCount = std::min(threadCount, jobCount);
+    if (threadCount <= 1)
+    {
+        for (uint32_t i = 0; i < jobCount; ++i)
+            fn(i);
+        return;
+    }
+
+    std::atomic<uint32_t> nextJob{0};
+    auto worker = [&]()
+    {
+        for (;;)
+        {
+            uint32_t job = nextJob.fetch_add(1, std::memory_order_relaxed);
+            if (job >= jobCount) break;
+            fn(job);
+        }
+    };
+
+    std::vector<std::thread> workers;
+    workers.reserve(threadCount - 1);
+    for (uint32_t t = 1; t < threadCount; ++t)
+        workers.emplace_back(worker);
+    worker();
+    for (auto& w : workers)
+        w.join();
+}
+
+void BVH::build(const std::vector<AABB>& triBounds, const BVHBuildOptions& options)
 {
     uint32_t triCount = static_cast<uint32_t>(triBounds.size());
     if (triCount == 0)
@@ -15,9 +52,18 @@ void BVH::build(const std::vector<AABB>& triBounds)
         m_nodes.shrink_to_fit();
         m_indices.clear();
         m_indices.shrink_to_fit();
+        m_primCount = 0;
+        m_cachedSAHCost = 0.0f;
         return;
     }
 
+    const uint32_t threadCount = options.threadCount > 0
+        ? options.threadCount
+        : std::max(1u, std::thread::hardware_concurrency());
+
+    m_primCount = triCount;
+    m_leafSize  = leafSizeFor(options);
+
     // Store build data
     m_triBounds = triBounds;
     m_centroids.resize(triCount);
@@ -28,6 +74,15 @@ void BVH::build(const std::vector<AABB>& triBounds)
     m_indices.resize(triCount);
     std::iota(m_indices.begin(), m_indices.end(), 0u);
 
+    if (options.builder == BVHBuilder::LBVH)
+    {
+        buildLBVH(threadCount);
+        finishBuild();
+        if (options.optimizePasses > 0)
+            optimize(options.optimizePasses, threadCount, options.optimizeBudgetMs);
+        return;
+    }
+
     // Allocate worst-case node count (2N - 1)
     m_nodes.resize(2 * triCount);
     m_nodesUsed = 1;
@@ -36,10 +91,133 @@ void BVH::build(const std::vector<AABB>& triBounds)
     Node& root = m_nodes[0];
     root.leftFirst = 0;
     root.triCount = triCount;
-    updateNodeBounds(0);
+    root.bounds = computeBounds(0, triCount, threadCount);
+
+    if (threadCount == 1)
+    {
+        subdivide(m_nodes, m_nodesUsed, 0);
+    }
+    else
+    {
+        // --- Phase 1: top-level splits (parallel binning, serial partition) ---
+        // Nodes above the cutoff are split here; everything below becomes a
+        // subtree task. Splits only depend on the index range, so the cutoff
+        // changes where work runs, never what tree comes out.
+        struct TopNode
+        {
+            Node    node;
+            int32_t left  = -1; // TopNode index of left child (-1 = none)
+            int32_t right = -1;
+            int32_t task  = -1; // subtree task index (-1 = split here or leaf)
+        };
+        std::vector<TopNode> top;
+        std::vector<Node>    tasks; // subtree roots handed to workers
 
-    subdivide(0);
+        const uint32_t taskCutoff = std::max(SUBTREE_TASK_MIN_TRIS, triCount / (threadCount * 4));
 
+        top.push_back({ m_nodes[0] });
+        for (size_t i = 0; i < top.size(); ++i) // top grows while iterating (BFS order)
+        {
+            Node node = top[i].node;
+            if (node.triCount <= taskCutoff)
+            {
+                if (node.triCount > m_leafSize)
+                {
+                    top[i].task = static_cast<int32_t>(tasks.size());
+                    tasks.push_back(node);
+                }
+                continue;
+            }
+
+            int axis;
+            float splitPos;
+            if (!findSplit(node, threadCount, axis, splitPos))
+                continue;
+
+            uint32_t leftTriCount = partition(node, axis, splitPos);
+            if (leftTriCount == 0 || leftTriCount == node.triCount)
+                continue; // degenerate split — keep as leaf
+
+            Node leftNode, rightNode;
+            leftNode.leftFirst  = node.leftFirst;
+            leftNode.triCount   = leftTriCount;
+            leftNode.bounds     = computeBounds(leftNode.leftFirst, leftNode.triCount, threadCount);
+            rightNode.leftFirst = node.leftFirst + leftTriCount;
+            rightNode.triCount  = node.triCount - leftTriCount;
+            rightNode.bounds    = computeBounds(rightNode.leftFirst, rightNode.triCount, threadCount);
+
+            top[i].left  = static_cast<int32_t>(top.size());
+            top[i].right = top[i].left + 1;
+            top.push_back({ leftNode });
+            top.push_back({ rightNode });
+        }
+
+        // --- Phase 2: build subtrees on workers ---
+        // Each task owns a disjoint m_indices range and allocates from its own
+        // node array, so no synchronisation is needed beyond the job counter.
+        // Largest subtrees are claimed first for better load balance.
+        std::vector<uint32_t> taskOrder(tasks.size());
+        std::iota(taskOrder.begin(), taskOrder.end(), 0u);
+        std::stable_sort(taskOrder.begin(), taskOrder.end(), [&](uint32_t a, uint32_t b)
+            { return tasks[a].triCount > tasks[b].triCount; });
+
+        std::vector<std::vector<Node>> taskNodes(tasks.size());
+        parallelFor(static_cast<uint32_t>(tasks.size()), threadCount, [&](uint32_t job)
+        {
+            uint32_t taskIdx = taskOrder[job];
+            std::vector<Node>& local = taskNodes[taskIdx];
+            local.resize(2 * tasks[taskIdx].triCount);
+            local[0] = tasks[taskIdx];
+            uint32_t localUsed = 1;
+            subdivide(local, localUsed, 0);
+            local.resize(localUsed);
+        });
+
+        // --- Phase 3: splice into m_nodes in serial allocation order ---
+        // A serial build allocates each child pair when its parent is split and
+        // then recurses depth-first, so a subtree's descendants occupy one
+        // contiguous range starting at the allocation cursor. Local node 0 maps
+        // onto the already-allocated slot, local node i > 0 onto cursor + i - 1.
+        auto emit = [&](auto& self, int32_t topIdx, uint32_t dstIdx) -> void
+        {
+            const TopNode& t = top[topIdx];
+            if (t.task >= 0)
+            {
+                const std::vector<Node>& local = taskNodes[t.task];
+                const uint32_t base = m_nodesUsed;
+                auto remap = [&](uint32_t i) { return i == 0 ? dstIdx : base + i - 1; };
+                for (uint32_t i = 0; i < static_cast<uint32_t>(local.size()); ++i)
+                {
+                    Node n = local[i];
+                    if (!n.isLeaf())
+                        n.leftFirst = remap(n.leftFirst);
+                    m_nodes[remap(i)] = n;
+                }
+                m_nodesUsed += static_cast<uint32_t>(local.size()) - 1;
+                return;
+            }
+
+            m_nodes[dstIdx] = t.node;
+            if (t.left < 0)
+                return; // leaf
+
+            uint32_t leftIdx  = m_nodesUsed++;
+            uint32_t rightIdx = m_nodesUsed++;
+            m_nodes[dstIdx].leftFirst = leftIdx;
+            m_nodes[dstIdx].triCount  = 0;
+            self(self, t.left, leftIdx);
+            self(self, t.right, rightIdx);
+        };
+        emit(emit, 0, 0);
+    }
+
+    finishBuild();
+    if (options.optimizePasses > 0)
+        optimize(options.optimizePasses, threadCount, options.optimizeBudgetMs);
+}
+
+void BVH::finishBuild()
+{
     // Trim to actual size
     m_nodes.resize(m_nodesUsed);
 
@@ -50,6 +228,13 @@ void BVH::build(const std::vector<AABB>& triBounds)
     m_centroids.shrink_to_fit();
 
     // Cache SAH cost (avoids O(N) traversal on every stats query)
+    updateSAHCost();
+    m_buildSAHCost = m_cachedSAHCost;
+    m_optimizeStoppedEarly = false;
+}
+
+void BVH::updateSAHCost()
+{
     float rootArea = m_nodes.empty() ? 0.0f : m_nodes[0].bounds.surfaceArea();
     if (rootArea > 0.0f)
     {
@@ -69,58 +254,156 @@ void BVH::build(const std::vector<AABB>& triBounds)
     }
 }
 
-void BVH::updateNodeBounds(uint32_t nodeIdx)
+std::vector<bool> BVH::firstReferenceMask() const
 {
-    Node& node = m_nodes[nodeIdx];
-    node.bounds = AABB{};
-    for (uint32_t i = 0; i < node.triCount; ++i)
-        node.bounds.grow(m_triBounds[m_indices[node.leftFirst + i]]);
+    std::vector<bool> first(m_indices.size(), false);
+    std::vector<bool> seen(m_primCount, false);
+    for (size_t i = 0; i < m_indices.size(); ++i)
+    {
+        uint32_t prim = m_indices[i];
+        if (!seen[prim])
+        {
+            seen[prim] = true;
+            first[i] = true;
+        }
+    }
+    return first;
 }
 
-void BVH::subdivide(uint32_t nodeIdx)
+void BVH::restore(std::vector<Node> nodes, std::vector<uint32_t> indices, uint32_t primitiveCount)
 {
-    Node& node = m_nodes[nodeIdx];
+    m_nodes     = std::move(nodes);
+    m_indices   = std::move(indices);
+    m_nodesUsed = static_cast<uint32_t>(m_nodes.size());
+    m_primCount = primitiveCount;
+    updateSAHCost();
+    m_buildSAHCost = m_cachedSAHCost;
+    m_optimizeStoppedEarly = false;
+}
 
-    if (node.triCount <= 2)
-        return;
+AABB BVH::computeBounds(uint32_t first, uint32_t count, uint32_t threadCount) const
+{
+    AABB bounds;
+    if (threadCount <= 1 || count < PARALLEL_BIN_MIN_TRIS)
+    {
+        for (uint32_t i = 0; i < count; ++i)
+            bounds.grow(m_triBounds[m_indices[first + i]]);
+        return bounds;
+    }
+
+    // min/max reductions are exact, so the merge order cannot change the result
+    const uint32_t chunkSize = (count + threadCount - 1) / threadCount;
+    std::vector<AABB> partial(threadCount);
+    parallelFor(threadCount, threadCount, [&](uint32_t c)
+    {
+        uint32_t begin = first + c * chunkSize;
+        uint32_t end   = std::min(first + count, begin + chunkSize);
+        for (uint32_t i = begin; i < end; ++i)
+            partial[c].grow(m_triBounds[m_indices[i]]);
+    });
+    for (const auto& p : partial)
+        bounds.grow(p);
+    return bounds;
+}
+
+bool BVH::findSplit(const Node& node, uint32_t threadCount, int& outAxis, float& outPos) const
+{
+    const uint32_t first = node.leftFirst;
+    const uint32_t count = node.triCount;
+    const bool parallel = threadCount > 1 && count >= PARALLEL_BIN_MIN_TRIS;
+    const uint32_t chunkCount = parallel ? threadCount : 1;
+    const uint32_t chunkSize  = (count + chunkCount - 1) / chunkCount;
 
     // Centroid bounds for the triangles in this node
     AABB centroidBounds;
-    for (uint32_t i = 0; i < node.triCount; ++i)
-        centroidBounds.grow(m_centroids[m_indices[node.leftFirst + i]]);
+    if (parallel)
+    {
+        std::vector<AABB> partial(chunkCount);
+        parallelFor(chunkCount, threadCount, [&](uint32_t c)
+        {
+            uint32_t begin = first + c * chunkSize;
+            uint32_t end   = std::min(first + count, begin + chunkSize);
+            for (uint32_t i = begin; i < end; ++i)
+                partial[c].grow(m_centroids[m_indices[i]]);
+        });
+        for (const auto& p : partial)
+            centroidBounds.grow(p);
+    }
+    else
+    {
+        for (uint32_t i = 0; i < count; ++i)
+            centroidBounds.grow(m_centroids[m_indices[first + i]]);
+    }
+
+    float scale[3];
+    bool  axisValid[3];
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        axisValid[axis] = centroidBounds.min[axis] != centroidBounds.max[axis];
+        scale[axis] = axisValid[axis]
+            ? static_cast<float>(SAH_BINS) / (centroidBounds.max[axis] - centroidBounds.min[axis])
+            : 0.0f;
+    }
+
+    // Bin triangles by centroid position on all three axes in one pass
+    auto binRange = [&](uint32_t begin, uint32_t end, Bin (&bins)[3][SAH_BINS])
+    {
+        for (uint32_t i = begin; i < end; ++i)
+        {
+            uint32_t triIdx = m_indices[i];
+            const glm::vec3& c = m_centroids[triIdx];
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                if (!axisValid[axis])
+                    continue;
+                uint32_t binIdx = std::min(
+                    SAH_BINS - 1,
+                    static_cast<uint32_t>((c[axis] - centroidBounds.min[axis]) * scale[axis]));
+                bins[axis][binIdx].count++;
+                bins[axis][binIdx].bounds.grow(m_triBounds[triIdx]);
+            }
+        }
+    };
+
+    Bin bins[3][SAH_BINS] = {};
+    if (parallel)
+    {
+        struct ChunkBins { Bin bins[3][SAH_BINS] = {}; };
+        std::vector<ChunkBins> partial(chunkCount);
+        parallelFor(chunkCount, threadCount, [&](uint32_t c)
+        {
+            uint32_t begin = first + c * chunkSize;
+            uint32_t end   = std::min(first + count, begin + chunkSize);
+            binRange(begin, end, partial[c].bins);
+        });
+        for (const auto& p : partial)
+        {
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                for (uint32_t b = 0; b < SAH_BINS; ++b)
+                {
+                    bins[axis][b].count += p.bins[axis][b].count;
+                    bins[axis][b].bounds.grow(p.bins[axis][b].bounds);
+                }
+            }
+        }
+    }
+    else
+    {
+        binRange(first, first + count, bins);
+    }
 
     float parentArea = node.bounds.surfaceArea();
     float bestCost = FLT_MAX;
     int bestAxis = -1;
     float bestSplitPos = 0.0f;
 
-    // Evaluate SAH for each axis using binning
+    // Evaluate SAH for each axis
     for (int axis = 0; axis < 3; ++axis)
     {
-        float boundsMin = centroidBounds.min[axis];
-        float boundsMax = centroidBounds.max[axis];
-        if (boundsMin == boundsMax)
+        if (!axisValid[axis])
             continue;
 
-        // Bin triangles by centroid position
-        struct Bin
-        {
-            AABB bounds;
-            uint32_t count = 0;
-        };
-        Bin bins[SAH_BINS] = {};
-        float scale = static_cast<float>(SAH_BINS) / (boundsMax - boundsMin);
-
-        for (uint32_t i = 0; i < node.triCount; ++i)
-        {
-            uint32_t triIdx = m_indices[node.leftFirst + i];
-            uint32_t binIdx = std::min(
-                SAH_BINS - 1,
-                static_cast<uint32_t>((m_centroids[triIdx][axis] - boundsMin) * scale));
-            bins[binIdx].count++;
-            bins[binIdx].bounds.grow(m_triBounds[triIdx]);
-        }
-
         // Sweep left-to-right and right-to-left to build prefix sums
         float leftArea[SAH_BINS - 1], rightArea[SAH_BINS - 1];
         uint32_t leftCount[SAH_BINS - 1], rightCount[SAH_BINS - 1];
@@ -130,14 +413,14 @@ void BVH::subdivide(uint32_t nodeIdx)
 
         for (uint32_t i = 0; i < SAH_BINS - 1; ++i)
         {
-            leftSum += bins[i].count;
-            leftBounds.grow(bins[i].bounds);
+            leftSum += bins[axis][i].count;
+            leftBounds.grow(bins[axis][i].bounds);
             leftCount[i] = leftSum;
             leftArea[i] = leftBounds.surfaceArea();
 
             uint32_t ri = SAH_BINS - 1 - i;
-            rightSum += bins[ri].count;
-            rightBounds.grow(bins[ri].bounds);
+            rightSum += bins[axis][ri].count;
+            rightBounds.grow(bins[axis][ri].bounds);
             rightCount[ri - 1] = rightSum;
             rightArea[ri - 1] = rightBounds.surfaceArea();
         }
@@ -152,50 +435,1074 @@ void BVH::subdivide(uint32_t nodeIdx)
             {
                 bestCost = cost;
                 bestAxis = axis;
-                bestSplitPos = boundsMin + static_cast<float>(i + 1) / scale;
+                bestSplitPos = centroidBounds.min[axis] + static_cast<float>(i + 1) / scale[axis];
             }
         }
     }
 
     // If no split improves over leaf cost, keep as leaf
-    float leafCost = static_cast<float>(node.triCount) * INTERSECT_COST;
+    float leafCost = static_cast<float>(count) * INTERSECT_COST;
     if (bestAxis == -1 || bestCost >= leafCost)
-        return;
+        return false;
 
+    outAxis = bestAxis;
+    outPos  = bestSplitPos;
+    return true;
+}
+
+uint32_t BVH::partition(const Node& node, int axis, float splitPos)
+{
     // Partition triangle indices around the split position
     int left = static_cast<int>(node.leftFirst);
     int right = left + static_cast<int>(node.triCount) - 1;
     while (left <= right)
     {
-        if (m_centroids[m_indices[left]][bestAxis] < bestSplitPos)
+        if (m_centroids[m_indices[left]][axis] < splitPos)
             left++;
         else
             std::swap(m_indices[left], m_indices[right--]);
     }
+    return static_cast<uint32_t>(left) - node.leftFirst;
+}
+
+void BVH::subdivide(std::vector<Node>& nodes, uint32_t& nodesUsed, uint32_t nodeIdx)
+{
+    Node& node = nodes[nodeIdx];
+
+    if (node.triCount <= m_leafSize)
+        return;
+
+    int axis;
+    float splitPos;
+    if (!findSplit(node, 1, axis, splitPos))
+        return;
 
-    uint32_t leftTriCount = static_cast<uint32_t>(left) - node.leftFirst;
+    uint32_t leftTriCount = partition(node, axis, splitPos);
     if (leftTriCount == 0 || leftTriCount == node.triCount)
         return; // degenerate split — keep as leaf
 
     // Allocate child nodes (consecutive pair)
-    uint32_t leftIdx = m_nodesUsed++;
-    uint32_t rightIdx = m_nodesUsed++;
+    uint32_t leftIdx = nodesUsed++;
+    uint32_t rightIdx = nodesUsed++;
 
-    m_nodes[leftIdx].leftFirst = node.leftFirst;
-    m_nodes[leftIdx].triCount = leftTriCount;
+    nodes[leftIdx].leftFirst = node.leftFirst;
+    nodes[leftIdx].triCount = leftTriCount;
 
-    m_nodes[rightIdx].leftFirst = static_cast<uint32_t>(left);
-    m_nodes[rightIdx].triCount = node.triCount - leftTriCount;
+    nodes[rightIdx].leftFirst = node.leftFirst + leftTriCount;
+    nodes[rightIdx].triCount = node.triCount - leftTriCount;
 
     // Convert current node to internal
     node.leftFirst = leftIdx;
     node.triCount = 0;
 
-    updateNodeBounds(leftIdx);
-    updateNodeBounds(rightIdx);
+    nodes[leftIdx].bounds  = computeBounds(nodes[leftIdx].leftFirst, nodes[leftIdx].triCount, 1);
+    nodes[rightIdx].bounds = computeBounds(nodes[rightIdx].leftFirst, nodes[rightIdx].triCount, 1);
+
+    subdivide(nodes, nodesUsed, leftIdx);
+    subdivide(nodes, nodesUsed, rightIdx);
+}
+
+// --- Spatial-split build (SBVH) ---
+// Follows Stich et al., "Spatial Splits in Bounding Volume Hierarchies" (2009):
+// each node compares the best binned object split against a binned spatial
+// split that clips straddling triangles to the split plane, and reference
+// unsplitting sends a straddler to one side whenever that is cheaper.
+
+// Bounds of the part of triangle v[0..2] with lo <= p[axis] <= hi.
+// The clipped polygon's vertices are the triangle vertices inside the slab plus
+// the edge/plane crossings, so growing by exactly those gives tight bounds.
+static AABB clipTriangle(const glm::vec3* v, int axis, float lo, float hi)
+{
+    AABB box;
+    for (int e = 0; e < 3; ++e)
+    {
+        const glm::vec3& a = v[e];
+        const glm::vec3& b = v[(e + 1) % 3];
+        float pa = a[axis];
+        float pb = b[axis];
+        if (pa >= lo && pa <= hi)
+            box.grow(a);
+
+        for (float plane : { lo, hi })
+        {
+            if ((pa < plane && pb > plane) || (pa > plane && pb < plane))
+            {
+                glm::vec3 p = a + (b - a) * ((plane - pa) / (pb - pa));
+                p[axis] = plane;
+                box.grow(p);
+            }
+        }
+    }
+    return box;
+}
+
+static AABB intersectBounds(const AABB& a, const AABB& b)
+{
+    AABB r;
+    r.min = glm::max(a.min, b.min);
+    r.max = glm::min(a.max, b.max);
+    return r;
+}
+
+static bool isValid(const AABB& box)
+{
+    return box.min.x <= box.max.x && box.min.y <= box.max.y && box.min.z <= box.max.z;
+}
+
+void BVH::buildFromTriangles(const std::vector<glm::vec3>& triVerts, const BVHBuildOptions& options)
+{
+    uint32_t triCount = static_cast<uint32_t>(triVerts.size() / 3);
+    std::vector<AABB> triBounds(triCount);
+    for (uint32_t i = 0; i < triCount; ++i)
+    {
+        triBounds[i].grow(triVerts[i * 3 + 0]);
+        triBounds[i].grow(triVerts[i * 3 + 1]);
+        triBounds[i].grow(triVerts[i * 3 + 2]);
+    }
+
+    if (!options.spatialSplits || options.builder == BVHBuilder::LBVH || triCount == 0)
+    {
+        build(triBounds, options);
+        return;
+    }
+
+    m_primCount = triCount;
+    m_leafSize  = leafSizeFor(options);
+
+    std::vector<Reference> refs(triCount);
+    AABB rootBounds;
+    for (uint32_t i = 0; i < triCount; ++i)
+    {
+        refs[i] = { triBounds[i], i };
+        rootBounds.grow(triBounds[i]);
+    }
+    triBounds.clear();
+    triBounds.shrink_to_fit();
+
+    SpatialBuild sb;
+    sb.verts          = &triVerts;
+    sb.minOverlapArea = options.spatialSplitAlpha * rootBounds.surfaceArea();
+    sb.maxRefs        = triCount + static_cast<size_t>(
+        static_cast<double>(triCount) * std::max(0.0f, options.spatialSplitBudget));
+    sb.refCount       = triCount;
+
+    m_indices.clear();
+    m_indices.reserve(sb.maxRefs);
+    m_nodes.clear();
+    m_nodes.reserve(2 * static_cast<size_t>(triCount));
+
+    Node root;
+    root.bounds    = rootBounds;
+    root.leftFirst = 0;
+    root.triCount  = triCount;
+    m_nodes.push_back(root);
+
+    subdivideSpatial(sb, 0, refs, 0);
+
+    m_nodesUsed = static_cast<uint32_t>(m_nodes.size());
+    m_nodes.shrink_to_fit();
+    m_indices.shrink_to_fit();
+    finishBuild();
+    if (options.optimizePasses > 0)
+        optimize(options.optimizePasses, options.threadCount, options.optimizeBudgetMs);
+}
+
+void BVH::subdivideSpatial(SpatialBuild& sb, uint32_t nodeIdx, std::vector<Reference>& refs, int depth)
+{
+    const uint32_t count = static_cast<uint32_t>(refs.size());
+    const AABB nodeBounds = m_nodes[nodeIdx].bounds;
+
+    auto makeLeaf = [&]()
+    {
+        m_nodes[nodeIdx].leftFirst = static_cast<uint32_t>(m_indices.size());
+        m_nodes[nodeIdx].triCount  = count;
+        for (const auto& r : refs)
+            m_indices.push_back(r.prim);
+    };
+
+    if (count <= m_leafSize)
+    {
+        makeLeaf();
+        return;
+    }
+
+    const float parentArea = nodeBounds.surfaceArea();
+
+    // --- Object split: binned SAH over reference centroids ---
+    AABB centroidBounds;
+    for (const auto& r : refs)
+        centroidBounds.grow(r.bounds.centroid());
+
+    float objCost = FLT_MAX;
+    int   objAxis = -1;
+    float objPos  = 0.0f;
+    AABB  objLeft, objRight;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        float extent = centroidBounds.max[axis] - centroidBounds.min[axis];
+        if (extent <= 0.0f)
+            continue;
+        float scale = static_cast<float>(SAH_BINS) / extent;
+
+        Bin bins[SAH_BINS] = {};
+        for (const auto& r : refs)
+        {
+            uint32_t b = std::min(SAH_BINS - 1,
+                static_cast<uint32_t>((r.bounds.centroid()[axis] - centroidBounds.min[axis]) * scale));
+            bins[b].count++;
+            bins[b].bounds.grow(r.bounds);
+        }
+
+        AABB rightBounds[SAH_BINS - 1];
+        uint32_t rightCount[SAH_BINS - 1];
+        AABB acc;
+        uint32_t sum = 0;
+        for (uint32_t i = SAH_BINS - 1; i > 0; --i)
+        {
+            sum += bins[i].count;
+            acc.grow(bins[i].bounds);
+            rightBounds[i - 1] = acc;
+            rightCount[i - 1]  = sum;
+        }
+
+        AABB leftBounds;
+        uint32_t leftCount = 0;
+        for (uint32_t i = 0; i < SAH_BINS - 1; ++i)
+        {
+            leftCount += bins[i].count;
+            leftBounds.grow(bins[i].bounds);
+            if (leftCount == 0 || rightCount[i] == 0)
+                continue;
+            float cost = TRAVERSAL_COST +
+                INTERSECT_COST * (leftCount * leftBounds.surfaceArea() +
+                                  rightCount[i] * rightBounds[i].surfaceArea()) / parentArea;
+            if (cost < objCost)
+            {
+                objCost  = cost;
+                objAxis  = axis;
+                objPos   = centroidBounds.min[axis] + static_cast<float>(i + 1) / scale;
+                objLeft  = leftBounds;
+                objRight = rightBounds[i];
+            }
+        }
+    }
+
+    // --- Spatial split: only where object split children overlap noticeably ---
+    bool trySpatial = depth < SPATIAL_MAX_DEPTH && sb.refCount < sb.maxRefs;
+    if (trySpatial && objAxis >= 0)
+    {
+        AABB overlap = intersectBounds(objLeft, objRight);
+        trySpatial = isValid(overlap) && overlap.surfaceArea() > sb.minOverlapArea;
+    }
+
+    float spatialCost = FLT_MAX;
+    int   spatialAxis = -1;
+    float spatialPos  = 0.0f;
+    AABB  spatialLeft, spatialRight;
+    uint32_t spatialLeftCount = 0, spatialRightCount = 0;
+    if (trySpatial)
+    {
+        const std::vector<glm::vec3>& verts = *sb.verts;
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            float lo = nodeBounds.min[axis];
+            float extent = nodeBounds.max[axis] - lo;
+            if (extent <= 0.0f)
+                continue;
+            float binWidth = extent / static_cast<float>(SPATIAL_BINS);
+            float invWidth = 1.0f / binWidth;
+            auto binOf = [&](float p)
+            {
+                float f = (p - lo) * invWidth;
+                return f <= 0.0f ? 0u : std::min(SPATIAL_BINS - 1, static_cast<uint32_t>(f));
+            };
+
+            struct SpatialBin
+            {
+                AABB bounds;
+                uint32_t enter = 0;
+                uint32_t exit  = 0;
+            };
+            SpatialBin bins[SPATIAL_BINS] = {};
+
+            for (const auto& r : refs)
+            {
+                uint32_t first = binOf(r.bounds.min[axis]);
+                uint32_t last  = binOf(r.bounds.max[axis]);
+                bins[first].enter++;
+                bins[last].exit++;
+                if (first == last)
+                {
+                    bins[first].bounds.grow(r.bounds);
+                    continue;
+                }
+                const glm::vec3* v = &verts[static_cast<size_t>(r.prim) * 3];
+                for (uint32_t b = first; b <= last; ++b)
+                {
+                    float slabLo = lo + binWidth * static_cast<float>(b);
+                    float slabHi = (b == SPATIAL_BINS - 1) ? nodeBounds.max[axis] : slabLo + binWidth;
+                    AABB piece = intersectBounds(clipTriangle(v, axis, slabLo, slabHi), r.bounds);
+                    if (isValid(piece))
+                        bins[b].bounds.grow(piece);
+                }
+            }
+
+            AABB rightBounds[SPATIAL_BINS - 1];
+            uint32_t rightCount[SPATIAL_BINS - 1];
+            AABB acc;
+            uint32_t sum = 0;
+            for (uint32_t i = SPATIAL_BINS - 1; i > 0; --i)
+            {
+                sum += bins[i].exit;
+                acc.grow(bins[i].bounds);
+                rightBounds[i - 1] = acc;
+                rightCount[i - 1]  = sum;
+            }
+
+            AABB leftBounds;
+            uint32_t leftCount = 0;
+            for (uint32_t i = 0; i < SPATIAL_BINS - 1; ++i)
+            {
+                leftCount += bins[i].enter;
+                leftBounds.grow(bins[i].bounds);
+                // Children may both keep every reference (their boxes still shrink);
+                // termination comes from the duplication budget and depth limit.
+                if (leftCount == 0 || rightCount[i] == 0)
+                    continue;
+                size_t duplicates = leftCount + rightCount[i] - count;
+                if (sb.refCount + duplicates > sb.maxRefs)
+                    continue;
+                float cost = TRAVERSAL_COST +
+                    INTERSECT_COST * (leftCount * leftBounds.surfaceArea() +
+                                      rightCount[i] * rightBounds[i].surfaceArea()) / parentArea;
+                if (cost < spatialCost)
+                {
+                    spatialCost       = cost;
+                    spatialAxis       = axis;
+                    spatialPos        = lo + binWidth * static_cast<float>(i + 1);
+                    spatialLeft       = leftBounds;
+                    spatialRight      = rightBounds[i];
+                    spatialLeftCount  = leftCount;
+                    spatialRightCount = rightCount[i];
+                }
+            }
+        }
+    }
+
+    // If no split improves over leaf cost, keep as leaf
+    float leafCost = static_cast<float>(count) * INTERSECT_COST;
+    if (std::min(objCost, spatialCost) >= leafCost)
+    {
+        makeLeaf();
+        return;
+    }
+
+    std::vector<Reference> left, right;
+    const bool useSpatial = spatialCost < objCost;
+    size_t duplicated = 0;
+    if (useSpatial)
+    {
+        const glm::vec3* allVerts = sb.verts->data();
+        const int axis = spatialAxis;
+        const float leftArea  = spatialLeft.surfaceArea();
+        const float rightArea = spatialRight.surfaceArea();
+        const float nl = static_cast<float>(spatialLeftCount);
+        const float nr = static_cast<float>(spatialRightCount);
+        for (const auto& r : refs)
+        {
+            if (r.bounds.max[axis] <= spatialPos)
+            {
+                left.push_back(r);
+                continue;
+            }
+            if (r.bounds.min[axis] >= spatialPos)
+            {
+                right.push_back(r);
+                continue;
+            }
+
+            // Reference unsplitting: keep the straddler whole on one side when
+            // that is cheaper than duplicating it (or the budget is spent).
+            AABB withLeft = spatialLeft;
+            withLeft.grow(r.bounds);
+            AABB withRight = spatialRight;
+            withRight.grow(r.bounds);
+            float splitCost     = leftArea * nl + rightArea * nr;
+            float keepLeftCost  = withLeft.surfaceArea() * nl + rightArea * (nr - 1.0f);
+            float keepRightCost = leftArea * (nl - 1.0f) + withRight.surfaceArea() * nr;
+            bool budgetLeft = sb.refCount + duplicated < sb.maxRefs;
+
+            if (!budgetLeft || std::min(keepLeftCost, keepRightCost) <= splitCost)
+            {
+                (keepLeftCost <= keepRightCost ? left : right).push_back(r);
+                continue;
+            }
+
+            const glm::vec3* v = allVerts + static_cast<size_t>(r.prim) * 3;
+            AABB lb = intersectBounds(clipTriangle(v, axis, -FLT_MAX, spatialPos), r.bounds);
+            AABB rb = intersectBounds(clipTriangle(v, axis, spatialPos, FLT_MAX), r.bounds);
+            if (!isValid(lb) || !isValid(rb))
+            {
+                (isValid(rb) ? right : left).push_back(r);
+                continue;
+            }
+            left.push_back({ lb, r.prim });
+            right.push_back({ rb, r.prim });
+            duplicated++;
+        }
+    }
+
+    if (!useSpatial || left.empty() || right.empty())
+    {
+        // Object split (also the fallback when unsplitting emptied a side)
+        left.clear();
+        right.clear();
+        duplicated = 0;
+        if (objAxis < 0)
+        {
+            makeLeaf();
+            return;
+        }
+        for (const auto& r : refs)
+            (r.bounds.centroid()[objAxis] < objPos ? left : right).push_back(r);
+        if (left.empty() || right.empty())
+        {
+            makeLeaf();
+            return; // degenerate split — keep as leaf
+        }
+    }
+    sb.refCount += duplicated;
+    std::vector<Reference>().swap(refs);
+
+    // Allocate child nodes (consecutive pair)
+    uint32_t leftIdx  = static_cast<uint32_t>(m_nodes.size());
+    uint32_t rightIdx = leftIdx + 1;
+    Node leftNode, rightNode;
+    leftNode.leftFirst = rightNode.leftFirst = 0;
+    leftNode.triCount  = static_cast<uint32_t>(left.size());
+    rightNode.triCount = static_cast<uint32_t>(right.size());
+    for (const auto& r : left)
+        leftNode.bounds.grow(r.bounds);
+    for (const auto& r : right)
+        rightNode.bounds.grow(r.bounds);
+    m_nodes.push_back(leftNode);
+    m_nodes.push_back(rightNode);
+
+    // Convert current node to internal
+    m_nodes[nodeIdx].leftFirst = leftIdx;
+    m_nodes[nodeIdx].triCount  = 0;
+
+    subdivideSpatial(sb, leftIdx, left, depth + 1);
+    subdivideSpatial(sb, rightIdx, right, depth + 1);
+}
+
+// --- Morton-code LBVH build ---
+// Primitives are sorted along a 30-bit Morton curve of their centroids
+// (parallel LSD radix sort) and each range is split where its first and last
+// codes first differ (Karras, "Maximizing Parallelism in the Construction of
+// BVHs, Octrees, and k-d Trees", 2012). Node bounds are unioned bottom-up.
+
+// Spreads the low 10 bits of v so there are two zero bits between each.
+static uint32_t expandBits(uint32_t v)
+{
+    v = (v * 0x00010001u) & 0xFF0000FFu;
+    v = (v * 0x00000101u) & 0x0F00F00Fu;
+    v = (v * 0x00000011u) & 0xC30C30C3u;
+    v = (v * 0x00000005u) & 0x49249249u;
+    return v;
+}
+
+// Last index of the left half of sorted codes [first, last]
+static uint32_t findMortonSplit(const std::vector<uint32_t>& codes, uint32_t first, uint32_t last)
+{
+    const uint32_t firstCode = codes[first];
+    const uint32_t lastCode  = codes[last];
+    if (firstCode == lastCode)
+        return (first + last) >> 1; // identical codes: split the range in half
+
+    // Binary search for the last code sharing more leading bits with the first
+    // code than the whole range does
+    const int commonPrefix = std::countl_zero(firstCode ^ lastCode);
+    uint32_t split = first;
+    uint32_t step  = last - first;
+    do
+    {
+        step = (step + 1) >> 1;
+        const uint32_t candidate = split + step;
+        if (candidate < last && std::countl_zero(firstCode ^ codes[candidate]) > commonPrefix)
+            split = candidate;
+    } while (step > 1);
+    return split;
+}
+
+uint32_t BVH::leafSizeFor(const BVHBuildOptions& options)
+{
+    if (options.leafSize > 0)
+        return options.leafSize;
+    return options.builder == BVHBuilder::LBVH ? LBVH_DEFAULT_LEAF_SIZE : SAH_DEFAULT_LEAF_SIZE;
+}
+
+void BVH::buildLBVH(uint32_t threadCount)
+{
+    const uint32_t n = m_primCount;
+
+    // Work is cut into contiguous chunks; small inputs stay on one thread
+    const uint32_t chunkCount = std::max(1u, std::min(threadCount * 4, n / 16384));
+    const uint32_t chunkSize  = (n + chunkCount - 1) / chunkCount;
+    auto chunkRange = [&](uint32_t chunk, uint32_t& begin, uint32_t& end)
+    {
+        begin = std::min(n, chunk * chunkSize);
+        end   = std::min(n, begin + chunkSize);
+    };
+
+    // Centroid bounds frame the Morton grid
+    std::vector<AABB> chunkBounds(chunkCount);
+    parallelFor(chunkCount, threadCount, [&](uint32_t chunk)
+    {
+        uint32_t begin, end;
+        chunkRange(chunk, begin, end);
+        for (uint32_t i = begin; i < end; ++i)
+            chunkBounds[chunk].grow(m_centroids[i]);
+    });
+    AABB centroidBounds;
+    for (const auto& b : chunkBounds)
+        centroidBounds.grow(b);
+    const glm::vec3 extent = centroidBounds.max - centroidBounds.min;
+    const glm::vec3 scale(extent.x > 0.0f ? 1023.0f / extent.x : 0.0f,
+                          extent.y > 0.0f ? 1023.0f / extent.y : 0.0f,
+                          extent.z > 0.0f ? 1023.0f / extent.z : 0.0f);
+
+    // Keys are (code << 32 | primitive), so sorting keys sorts primitives by
+    // code and keeps equal codes in index order
+    std::vector<uint64_t> keys(n);
+    parallelFor(chunkCount, threadCount, [&](uint32_t chunk)
+    {
+        uint32_t begin, end;
+        chunkRange(chunk, begin, end);
+        for (uint32_t i = begin; i < end; ++i)
+        {
+            const glm::vec3 q = glm::clamp((m_centroids[i] - centroidBounds.min) * scale, 0.0f, 1023.0f);
+            const uint32_t code = (expandBits(static_cast<uint32_t>(q.x)) << 2)
+                                | (expandBits(static_cast<uint32_t>(q.y)) << 1)
+                                |  expandBits(static_cast<uint32_t>(q.z));
+            keys[i] = (static_cast<uint64_t>(code) << 32) | i;
+        }
+    });
+
+    // LSD radix sort over the 30 code bits, 10 bits per pass. Each chunk
+    // counts its digits, then scatters to offsets that follow every earlier
+    // chunk's, which keeps the sort stable.
+    constexpr uint32_t RADIX = 1024;
+    std::vector<uint64_t> scratch(n);
+    std::vector<uint32_t> histograms(static_cast<size_t>(chunkCount) * RADIX);
+    for (uint32_t shift = 32; shift < 62; shift += 10)
+    {
+        std::fill(histograms.begin(), histograms.end(), 0u);
+        parallelFor(chunkCount, threadCount, [&](uint32_t chunk)
+        {
+            uint32_t begin, end;
+            chunkRange(chunk, begin, end);
+            uint32_t* hist = &histograms[static_cast<size_t>(chunk) * RADIX];
+            for (uint32_t i = begin; i < end; ++i)
+                ++hist[(keys[i] >> shift) & (RADIX - 1)];
+        });
+
+        uint32_t offset = 0;
+        for (uint32_t digit = 0; digit < RADIX; ++digit)
+        {
+            for (uint32_t chunk = 0; chunk < chunkCount; ++chunk)
+            {
+                uint32_t& h = histograms[static_cast<size_t>(chunk) * RADIX + digit];
+                const uint32_t count = h;
+                h = offset;
+                offset += count;
+            }
+        }
+
+        parallelFor(chunkCount, threadCount, [&](uint32_t chunk)
+        {
+            uint32_t begin, end;
+            chunkRange(chunk, begin, end);
+            uint32_t* dst = &histograms[static_cast<size_t>(chunk) * RADIX];
+            for (uint32_t i = begin; i < end; ++i)
+                scratch[dst[(keys[i] >> shift) & (RADIX - 1)]++] = keys[i];
+        });
+        keys.swap(scratch);
+    }
+    scratch.clear();
+    scratch.shrink_to_fit();
+
+    std::vector<uint32_t> codes(n);
+    for (uint32_t i = 0; i < n; ++i)
+    {
+        m_indices[i] = static_cast<uint32_t>(keys[i]);
+        codes[i]     = static_cast<uint32_t>(keys[i] >> 32);
+    }
+    keys.clear();
+    keys.shrink_to_fit();
+
+    // Topology, depth-first in serial allocation order: a split allocates the
+    // child pair, so children always follow their parent
+    m_nodes.resize(2 * static_cast<size_t>(n));
+    m_nodesUsed = 1;
+    m_nodes[0].leftFirst = 0;
+    m_nodes[0].triCount  = n;
+
+    std::vector<uint32_t> stack;
+    stack.push_back(0);
+    while (!stack.empty())
+    {
+        const uint32_t nodeIdx = stack.back();
+        stack.pop_back();
+        Node& node = m_nodes[nodeIdx];
+        if (node.triCount <= m_leafSize)
+            continue;
+
+        const uint32_t first = node.leftFirst;
+        const uint32_t last  = first + node.triCount - 1;
+        const uint32_t split = findMortonSplit(codes, first, last);
+
+        const uint32_t leftIdx  = m_nodesUsed++;
+        const uint32_t rightIdx = m_nodesUsed++;
+        m_nodes[leftIdx].leftFirst  = first;
+        m_nodes[leftIdx].triCount   = split - first + 1;
+        m_nodes[rightIdx].leftFirst = split + 1;
+        m_nodes[rightIdx].triCount  = last - split;
+        node.leftFirst = leftIdx;
+        node.triCount  = 0;
+
+        stack.push_back(rightIdx);
+        stack.push_back(leftIdx);
+    }
+
+    // Leaf bounds in parallel, then internal nodes bottom-up (children have
+    // higher indices than their parent)
+    const uint32_t nodeCount  = m_nodesUsed;
+    const uint32_t nodeChunks = std::max(1u, std::min(threadCount * 4, nodeCount / 16384));
+    const uint32_t nodeChunkSize = (nodeCount + nodeChunks - 1) / nodeChunks;
+    parallelFor(nodeChunks, threadCount, [&](uint32_t chunk)
+    {
+        const uint32_t begin = std::min(nodeCount, chunk * nodeChunkSize);
+        const uint32_t end   = std::min(nodeCount, begin + nodeChunkSize);
+        for (uint32_t i = begin; i < end; ++i)
+        {
+            Node& node = m_nodes[i];
+            if (!node.isLeaf())
+                continue;
+            AABB bounds;
+            for (uint32_t j = 0; j < node.triCount; ++j)
+                bounds.grow(m_triBounds[m_indices[node.leftFirst + j]]);
+            node.bounds = bounds;
+        }
+    });
+    for (uint32_t i = nodeCount; i-- > 0;)
+    {
+        Node& node = m_nodes[i];
+        if (node.isLeaf())
+            continue;
+        AABB bounds = m_nodes[node.leftFirst].bounds;
+        bounds.grow(m_nodes[node.leftFirst + 1].bounds);
+        node.bounds = bounds;
+    }
+}
+
+// --- Reinsertion optimization ---
+// Bittner et al. 2013, with the parallel pass structure of Meister & Bittner
+// 2018: candidate searches only read the tree, so they run on every thread;
+// the chosen moves are applied serially.
+
+struct BVH::ReinsertTree
+{
+    static constexpr uint32_t NONE = 0xFFFFFFFFu;
+
+    struct Move
+    {
+        uint32_t node   = NONE;
+        uint32_t target = NONE; // node becomes the sibling of target
+        float    gain   = 0.0f;
+    };
+
+    // Indexed like m_nodes; leaves keep their m_indices range in first/count
+    std::vector<AABB>     bounds;
+    std::vector<float>    area;
+    std::vector<uint32_t> parent, left, right;
+    std::vector<uint32_t> first, count;
+    uint32_t root = 0;
+
+    bool isLeaf(uint32_t n) const { return count[n] > 0; }
+    uint32_t sibling(uint32_t n) const
+    {
+        const uint32_t p = parent[n];
+        return left[p] == n ? right[p] : left[p];
+    }
+    float nodeCost(uint32_t n) const
+    {
+        return isLeaf(n) ? area[n] * static_cast<float>(count[n]) * INTERSECT_COST
+                         : area[n] * TRAVERSAL_COST;
+    }
+
+    void replaceChild(uint32_t p, uint32_t oldChild, uint32_t newChild)
+    {
+        (left[p] == oldChild ? left[p] : right[p]) = newChild;
+        parent[newChild] = p;
+    }
+
+    void refitUp(uint32_t n)
+    {
+        for (; n != NONE; n = parent[n])
+        {
+            AABB b = bounds[left[n]];
+            b.grow(bounds[right[n]]);
+            bounds[n] = b;
+            area[n]   = b.surfaceArea();
+        }
+    }
+
+    bool isAncestor(uint32_t a, uint32_t n) const
+    {
+        for (; n != NONE; n = parent[n])
+            if (n == a)
+                return true;
+        return false;
+    }
+
+    // Best position for n by branch and bound from the root. Costs of the
+    // removal and the insertion are both taken against the current tree.
+    Move findMove(uint32_t n, std::vector<std::pair<float, uint32_t>>& heap) const
+    {
+        Move best;
+        best.node = n;
+        const uint32_t p = parent[n];
+        if (p == NONE)
+            return best;
+        const uint32_t s = sibling(n);
+
+        // Cutting n frees p and shrinks p's ancestors
+        float removed = area[p] * TRAVERSAL_COST;
+        AABB box = bounds[s];
+        for (uint32_t c = p, a = parent[p]; a != NONE; c = a, a = parent[a])
+        {
+            AABB shrunk = box;
+            shrunk.grow(bounds[left[a] == c ? right[a] : left[a]]);
+            const float sa = shrunk.surfaceArea();
+            if (sa >= area[a])
+                break;
+            removed += (area[a] - sa) * TRAVERSAL_COST;
+            box = shrunk;
+        }
+
+        // Inserting next to x re-creates p as union(x, n) and grows x's
+        // ancestors; 'induced' is the growth accumulated above x
+        const AABB& nb = bounds[n];
+        const float nodeFloor = area[n] * TRAVERSAL_COST; // no new parent is smaller than n
+        float bestCost = removed;
+        auto cmp = [](const std::pair<float, uint32_t>& a, const std::pair<float, uint32_t>& b)
+            { return a.first > b.first || (a.first == b.first && a.second > b.second); };
+        heap.clear();
+        heap.push_back({ 0.0f, root });
+        while (!heap.empty())
+        {
+            std::pop_heap(heap.begin(), heap.end(), cmp);
+            const auto [induced, x] = heap.back();
+            heap.pop_back();
+            if (induced + nodeFloor >= bestCost)
+                break; // every remaining entry is at least as expensive
+
+            AABB merged = bounds[x];
+            merged.grow(nb);
+            const float mergedArea = merged.surfaceArea();
+            const float cost = induced + mergedArea * TRAVERSAL_COST;
+            if (x != p && x != s && cost < bestCost)
+            {
+                bestCost    = cost;
+                best.target = x;
+            }
+
+            if (isLeaf(x))
+                continue;
+            const float childInduced = induced + (mergedArea - area[x]) * TRAVERSAL_COST;
+            if (childInduced + nodeFloor >= bestCost)
+                continue;
+            for (uint32_t c : { left[x], right[x] })
+            {
+                if (c == n)
+                    continue; // n's own subtree is never a valid target
+                heap.push_back({ childInduced, c });
+                std::push_heap(heap.begin(), heap.end(), cmp);
+            }
+        }
+
+        best.gain = best.target != NONE ? removed - bestCost : 0.0f;
+        return best;
+    }
+
+    // Cuts n out (its sibling takes the parent's slot) and reuses the freed
+    // parent as the new parent of n and target
+    void apply(uint32_t n, uint32_t target)
+    {
+        const uint32_t p = parent[n];
+        const uint32_t s = sibling(n);
+        const uint32_t g = parent[p];
+        if (g == NONE)
+        {
+            root = s;
+            parent[s] = NONE;
+        }
+        else
+        {
+            replaceChild(g, p, s);
+            refitUp(g);
+        }
+
+        const uint32_t q = parent[target];
+        if (q == NONE)
+        {
+            root = p;
+            parent[p] = NONE;
+        }
+        else
+        {
+            replaceChild(q, target, p);
+        }
+        left[p]  = target;
+        right[p] = n;
+        parent[target] = p;
+        parent[n]      = p;
+        refitUp(p);
+    }
+
+    // Nodes whose boxes a move of n next to target can change: the freed
+    // parent, the ancestors it leaves and the ancestors it joins
+    void affectedNodes(uint32_t n, uint32_t target, std::vector<uint32_t>& out) const
+    {
+        out.clear();
+        const uint32_t p = parent[n];
+        out.push_back(p);
+        for (uint32_t a = parent[p]; a != NONE; a = parent[a])
+            out.push_back(a);
+        for (uint32_t a = parent[target]; a != NONE; a = parent[a])
+            out.push_back(a);
+        std::sort(out.begin(), out.end());
+        out.erase(std::unique(out.begin(), out.end()), out.end());
+    }
+
+    float sumCost(const std::vector<uint32_t>& nodes) const
+    {
+        float cost = 0.0f;
+        for (uint32_t n : nodes)
+            cost += nodeCost(n);
+        return cost;
+    }
+
+    // SAH cost normalised by the root area (as BVH::updateSAHCost) and depth
+    void measure(float& outCost, uint32_t& outDepth, std::vector<std::pair<uint32_t, uint32_t>>& stack) const
+    {
+        float cost = 0.0f;
+        uint32_t depth = 0;
+        stack.clear();
+        stack.push_back({ root, 1u });
+        while (!stack.empty())
+        {
+            const auto [n, d] = stack.back();
+            stack.pop_back();
+            cost += nodeCost(n);
+            depth = std::max(depth, d);
+            if (!isLeaf(n))
+            {
+                stack.push_back({ left[n], d + 1 });
+                stack.push_back({ right[n], d + 1 });
+            }
+        }
+        outCost  = area[root] > 0.0f ? cost / area[root] : 0.0f;
+        outDepth = depth;
+    }
+};
+
+uint32_t BVH::optimize(uint32_t maxPasses, uint32_t threadCount, float budgetMs)
+{
+    using Tree = ReinsertTree;
+    m_optimizeStoppedEarly = false;
+    const uint32_t nodeCount = static_cast<uint32_t>(m_nodes.size());
+    if (nodeCount < 5 || maxPasses == 0)
+        return 0;
+
+    using Clock = std::chrono::steady_clock;
+    const bool timed = budgetMs > 0.0f;
+    const Clock::time_point deadline = Clock::now()
+        + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<float, std::milli>(budgetMs));
+    std::atomic<bool> expired{ false };
+    auto pastDeadline = [&]()
+    {
+        if (timed && !expired.load(std::memory_order_relaxed) && Clock::now() >= deadline)
+            expired.store(true, std::memory_order_relaxed);
+        return expired.load(std::memory_order_relaxed);
+    };
+
+    if (threadCount == 0)
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+    Tree tree;
+    tree.bounds.resize(nodeCount);
+    tree.area.resize(nodeCount);
+    tree.parent.assign(nodeCount, Tree::NONE);
+    tree.left.assign(nodeCount, Tree::NONE);
+    tree.right.assign(nodeCount, Tree::NONE);
+    tree.first.assign(nodeCount, 0);
+    tree.count.assign(nodeCount, 0);
+    for (uint32_t i = 0; i < nodeCount; ++i)
+    {
+        const Node& node = m_nodes[i];
+        tree.bounds[i] = node.bounds;
+        tree.area[i]   = node.bounds.surfaceArea();
+        if (node.isLeaf())
+        {
+            tree.first[i] = node.leftFirst;
+            tree.count[i] = node.triCount;
+        }
+        else
+        {
+            tree.left[i]  = node.leftFirst;
+            tree.right[i] = node.leftFirst + 1;
+            tree.parent[node.leftFirst]     = i;
+            tree.parent[node.leftFirst + 1] = i;
+        }
+    }
+
+    std::vector<std::pair<uint32_t, uint32_t>> depthStack;
+    float cost;
+    uint32_t depth;
+    tree.measure(cost, depth, depthStack);
+    const uint32_t maxDepth = std::max(OPTIMIZE_MAX_DEPTH, depth);
+
+    std::vector<uint32_t>   candidates;
+    std::vector<Tree::Move> moves;
+    std::vector<uint8_t>    locked(nodeCount);
+    std::vector<uint32_t>   affected;
+    uint32_t applied = 0;
+    for (uint32_t pass = 0; pass < maxPasses && !pastDeadline(); ++pass)
+    {
+        // Largest boxes first (Bittner's area measure): if the deadline falls
+        // mid-pass, the most promising nodes have been searched. Without a
+        // deadline every node is searched, so the result depends only on the
+        // pass count.
+        candidates.clear();
+        for (uint32_t i = 0; i < nodeCount; ++i)
+            if (i != tree.root)
+                candidates.push_back(i);
+        std::stable_sort(candidates.begin(), candidates.end(), [&](uint32_t a, uint32_t b)
+            { return tree.area[a] > tree.area[b]; });
+
+        const uint32_t candidateCount = static_cast<uint32_t>(candidates.size());
+        const uint32_t jobCount = (candidateCount + OPTIMIZE_CHUNK - 1) / OPTIMIZE_CHUNK;
+        moves.assign(candidateCount, Tree::Move{});
+        parallelFor(jobCount, threadCount, [&](uint32_t job)
+        {
+            if (pastDeadline())
+                return;
+            std::vector<std::pair<float, uint32_t>> heap;
+            const uint32_t begin = job * OPTIMIZE_CHUNK;
+            const uint32_t end   = std::min(candidateCount, begin + OPTIMIZE_CHUNK);
+            for (uint32_t i = begin; i < end; ++i)
+                moves[i] = tree.findMove(candidates[i], heap);
+        });
+
+        moves.erase(std::remove_if(moves.begin(), moves.end(),
+            [](const Tree::Move& m) { return m.target == Tree::NONE || m.gain <= 0.0f; }), moves.end());
+        if (moves.empty())
+            break;
+        std::sort(moves.begin(), moves.end(), [](const Tree::Move& a, const Tree::Move& b)
+            { return a.gain > b.gain || (a.gain == b.gain && a.node < b.node); });
+
+        // A move rewires n, its parent, sibling and grandparent, the target and
+        // the target's parent; any move touching a node already claimed this
+        // pass is left for the next pass, whose searches see the new tree.
+        // Gains were estimated before earlier moves changed the boxes, so each
+        // move is re-costed exactly and undone if it no longer pays off.
+        const Tree snapshot = tree;
+        std::fill(locked.begin(), locked.end(), 0);
+        uint32_t passApplied = 0;
+        for (const Tree::Move& m : moves)
+        {
+            const uint32_t p = tree.parent[m.node];
+            if (p == Tree::NONE)
+                continue; // became the root through an earlier move
+            const uint32_t touched[6] = { m.node, p, tree.sibling(m.node), tree.parent[p],
+                                          m.target, tree.parent[m.target] };
+            bool free = true;
+            for (uint32_t t : touched)
+                free = free && (t == Tree::NONE || !locked[t]);
+            // Earlier moves can have hung the target below the moved node
+            if (!free || tree.isAncestor(m.node, m.target))
+                continue;
+            const uint32_t sibling = tree.sibling(m.node);
+            tree.affectedNodes(m.node, m.target, affected);
+            const float costBefore = tree.sumCost(affected);
+            tree.apply(m.node, m.target);
+            if (tree.sumCost(affected) >= costBefore)
+            {
+                tree.apply(m.node, sibling);
+                continue;
+            }
+            for (uint32_t t : touched)
+                if (t != Tree::NONE)
+                    locked[t] = 1;
+            ++passApplied;
+        }
+
+        float passCost;
+        uint32_t passDepth;
+        tree.measure(passCost, passDepth, depthStack);
+        if (passApplied == 0 || passCost >= cost || passDepth > maxDepth)
+        {
+            tree = snapshot; // keep the last tree within the depth limit
+            break;
+        }
+        applied += passApplied;
+        const bool converged = passCost > cost * 0.999f;
+        cost = passCost;
+        if (converged)
+            break;
+    }
+    m_optimizeStoppedEarly = expired.load(std::memory_order_relaxed);
+
+    if (applied == 0)
+        return 0;
+
+    // Re-emit depth-first with adjacent child pairs and parents first, packing
+    // each leaf's references in traversal order
+    std::vector<Node>     nodes(nodeCount);
+    std::vector<uint32_t> indices;
+    indices.reserve(m_indices.size());
+    uint32_t used = 1;
+    std::vector<std::pair<uint32_t, uint32_t>> stack; // (tree node, output slot)
+    stack.push_back({ tree.root, 0u });
+    while (!stack.empty())
+    {
+        const auto [n, dst] = stack.back();
+        stack.pop_back();
+        Node& out = nodes[dst];
+        out.bounds = tree.bounds[n];
+        if (tree.isLeaf(n))
+        {
+            out.leftFirst = static_cast<uint32_t>(indices.size());
+            out.triCount  = tree.count[n];
+            indices.insert(indices.end(), m_indices.begin() + tree.first[n],
+                           m_indices.begin() + tree.first[n] + tree.count[n]);
+            continue;
+        }
+        out.leftFirst = used;
+        out.triCount  = 0;
+        stack.push_back({ tree.right[n], used + 1 });
+        stack.push_back({ tree.left[n], used });
+        used += 2;
+    }
 
-    subdivide(leftIdx);
-    subdivide(rightIdx);
+    m_nodes   = std::move(nodes);
+    m_indices = std::move(indices);
+    m_nodesUsed = nodeCount;
+    updateSAHCost();
+    m_buildSAHCost = m_cachedSAHCost;
+    return applied;
 }
 
 } // namespace vex
@@ -0,0 +1,164 @@
+#include <vex/raytracing/compressed_bvh.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace vex
+{
+
+// Planes are decoded as origin + q * scale. A GPU compiler may contract that
+// into an fma, which rounds differently, so the encoder checks both forms.
+static float decodeLow(float origin, int q, float scale)
+{
+    const float fq = static_cast<float>(q);
+    return std::min(origin + fq * scale, std::fma(fq, scale, origin));
+}
+
+static float decodeHigh(float origin, int q, float scale)
+{
+    const float fq = static_cast<float>(q);
+    return std::max(origin + fq * scale, std::fma(fq, scale, origin));
+}
+
+void CompressedBVH::clear()
+{
+    m_nodes.clear();
+    m_nodes.shrink_to_fit();
+}
+
+void CompressedBVH::quantize(Node& node, const AABB* childBounds, uint32_t childCount) const
+{
+    AABB frame;
+    for (uint32_t i = 0; i < childCount; ++i)
+        frame.grow(childBounds[i]);
+
+    node.childMask = static_cast<uint8_t>((1u << childCount) - 1u);
+
+    uint8_t* qlo[3] = { node.qloX, node.qloY, node.qloZ };
+    uint8_t* qhi[3] = { node.qhiX, node.qhiY, node.qhiZ };
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        const float lo = frame.min[axis];
+        const float hi = frame.max[axis];
+        node.origin[axis] = lo;
+
+        // Smallest power-of-two scale with lo + 255 * scale >= hi
+        int e = -126;
+        const float extent = hi - lo;
+        if (extent > 0.0f)
+        {
+            std::frexp(extent / 255.0f, &e);
+            e = std::clamp(e, -126, 127);
+        }
+        while (e < 127 && decodeLow(lo, 255, std::ldexp(1.0f, e)) < hi)
+            ++e;
+        node.exponent[axis] = static_cast<uint8_t>(e + 127);
+        const float scale = node.scale(axis);
+
+        for (uint32_t i = 0; i < 4; ++i)
+        {
+            if (i >= childCount)
+            {
+                qlo[axis][i] = 0;
+                qhi[axis][i] = 0;
+                continue;
+            }
+
+            // Round outward: floor the min plane, ceil the max plane
+            const float cmin = childBounds[i].min[axis];
+            const float cmax = childBounds[i].max[axis];
+            int ql = std::clamp(static_cast<int>(std::floor((cmin - lo) / scale)), 0, 255);
+            while (ql > 0 && decodeHigh(lo, ql, scale) > cmin)
+                --ql;
+            int qh = std::clamp(static_cast<int>(std::ceil((cmax - lo) / scale)), 0, 255);
+            while (qh < 255 && decodeLow(lo, qh, scale) < cmax)
+                ++qh;
+            qlo[axis][i] = static_cast<uint8_t>(ql);
+            qhi[axis][i] = static_cast<uint8_t>(qh);
+        }
+    }
+}
+
+uint32_t CompressedBVH::splitLeaf(const AABB& bounds, uint32_t first, uint32_t count)
+{
+    const uint32_t nodeIdx = static_cast<uint32_t>(m_nodes.size());
+    m_nodes.emplace_back();
+
+    Node node{};
+    AABB childBounds[4];
+    const uint32_t per = (count + 3) / 4;
+    uint32_t childCount = 0;
+    for (uint32_t offset = 0; offset < count; offset += per)
+    {
+        const uint32_t n = std::min(per, count - offset);
+        childBounds[childCount] = bounds;
+        if (n > Node::MAX_LEAF_TRIS)
+        {
+            node.child[childCount]    = splitLeaf(bounds, first + offset, n);
+            node.triCount[childCount] = 0;
+        }
+        else
+        {
+            node.child[childCount]    = first + offset;
+            node.triCount[childCount] = static_cast<uint16_t>(n);
+        }
+        ++childCount;
+    }
+    for (uint32_t i = childCount; i < 4; ++i)
+        node.child[i] = Node::EMPTY;
+
+    quantize(node, childBounds, childCount);
+    m_nodes[nodeIdx] = node;
+    return nodeIdx;
+}
+
+void CompressedBVH::build(const BVH& bvh)
+{
+    m_nodes.clear();
+
+    WideBVH<4> wide;
+    wide.build(bvh);
+    if (wide.empty())
+    {
+        m_nodes.shrink_to_fit();
+        return;
+    }
+
+    // Same topology and node indices as the 4-wide collapse; oversized
+    // leaves append their split nodes after it
+    const auto& wideNodes = wide.nodes();
+    m_nodes.resize(wideNodes.size());
+    for (size_t n = 0; n < wideNodes.size(); ++n)
+    {
+        const auto& w = wideNodes[n];
+        Node node{};
+        AABB childBounds[4];
+        uint32_t childCount = 0;
+        for (uint32_t i = 0; i < 4; ++i)
+        {
+            node.child[i] = Node::EMPTY;
+            if (w.child[i] == WideBVHNode<4>::EMPTY)
+                continue;
+
+            // The collapse fills slots front to back, so used slots are contiguous
+            childBounds[childCount].min = { w.minX[i], w.minY[i], w.minZ[i] };
+            childBounds[childCount].max = { w.maxX[i], w.maxY[i], w.maxZ[i] };
+            if (w.triCount[i] > Node::MAX_LEAF_TRIS)
+            {
+                node.child[childCount] = splitLeaf(childBounds[childCount], w.child[i], w.triCount[i]);
+            }
+            else
+            {
+                node.child[childCount]    = w.child[i];
+                node.triCount[childCount] = static_cast<uint16_t>(w.triCount[i]);
+            }
+            ++childCount;
+        }
+
+        quantize(node, childBounds, childCount);
+        m_nodes[n] = node;
+    }
+    m_nodes.shrink_to_fit();
+}
+
+} // namespace vex
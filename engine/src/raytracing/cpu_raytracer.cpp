@@ -1,11 +1,22 @@
 #include <vex/raytracing/cpu_raytracer.h>
 #include <vex/raytracing/bsdf.h>
+#include <vex/core/mapped_file.h>
 
 #include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
 #include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
 #include <limits>
 #include <thread>
 
+#if defined(VEX_BVH_SIMD_X86)
+#include <immintrin.h>
+#endif
+
 namespace vex
 {
 
@@ -21,10 +32,111 @@ uint32_t CPURaytracer::hash(uint32_t x)
     return x;
 }
 
+// --- Sampling ---
+
+static uint32_t reverseBits(uint32_t x)
+{
+    x = (x << 16) | (x >> 16);
+    x = ((x & 0x00ff00ffu) << 8) | ((x & 0xff00ff00u) >> 8);
+    x = ((x & 0x0f0f0f0fu) << 4) | ((x & 0xf0f0f0f0u) >> 4);
+    x = ((x & 0x33333333u) << 2) | ((x & 0xccccccccu) >> 2);
+    x = ((x & 0x55555555u) << 1) | ((x & 0xaaaaaaaau) >> 1);
+    return x;
+}
+
+static uint32_t hashCombine(uint32_t seed, uint32_t v)
+{
+    return seed ^ (v + (seed << 6) + (seed >> 2));
+}
+
+// Owen scrambling of a base-2 fraction (Burley, "Practical Hash-based Owen
+// Scrambling", 2020): the Laine-Karras permutation lets each bit depend only
+// on the bits below it, so applied to the bit-reversed value every digit is
+// flipped by a hash of the digits before it
+static uint32_t nestedUniformScramble(uint32_t x, uint32_t seed)
+{
+    x = reverseBits(x);
+    x ^= x * 0x3d20adeau;
+    x += seed;
+    x *= (seed >> 16) | 1u;
+    x ^= x * 0x05526c56u;
+    x ^= x * 0x53a22864u;
+    return reverseBits(x);
+}
+
+// First two Sobol dimensions: van der Corput, and the (x + 1) polynomial
+// whose direction numbers are each the previous one xor itself shifted right
+static uint32_t sobol(uint32_t index, uint32_t dim)
+{
+    if (dim == 0)
+        return reverseBits(index);
+    uint32_t r = 0;
+    for (uint32_t v = 1u << 31; index; index >>= 1, v ^= v >> 1)
+    {
+        if (index & 1u)
+            r ^= v;
+    }
+    return r;
+}
+
+// Interleaved gradient noise (Jimenez 2014), decorrelated per dimension by
+// offsetting the pixel, as the Vulkan ray generation shader does
+static float interleavedGradientNoise(uint32_t x, uint32_t y, uint32_t dim)
+{
+    const float offset = 5.588238f * static_cast<float>(dim);
+    const float px = static_cast<float>(x) + offset;
+    const float py = static_cast<float>(y) + offset;
+    const float f = 0.06711056f * px + 0.00583715f * py;
+    const float g = 52.9829189f * (f - std::floor(f));
+    return g - std::floor(g);
+}
+
+float CPURaytracer::RNG::nextDimension()
+{
+    // Each pair of dimensions is its own 2D Sobol sequence, decorrelated from
+    // the others by shuffling the sample index with a per-pair seed
+    const uint32_t d = dim++;
+    const uint32_t pairSeed = hashCombine(seed, d >> 1);
+    const uint32_t shuffled = nestedUniformScramble(index, pairSeed);
+    const uint32_t bits = nestedUniformScramble(sobol(shuffled, d & 1u), hashCombine(pairSeed, d & 1u));
+    float u = static_cast<float>(bits >> 8) * (1.0f / 16777216.0f);
+    if (sampler == Sampler::BlueNoise)
+    {
+        u += interleavedGradientNoise(x, y, d);
+        if (u >= 1.0f)
+            u -= 1.0f;
+    }
+    return u;
+}
+
+CPURaytracer::RNG CPURaytracer::pixelRNG(uint32_t x, uint32_t y) const
+{
+    const uint32_t pixel = x + y * m_width;
+    RNG rng(hash(pixel) ^ hash(m_passIndex));
+    if (m_sampler == Sampler::PCG)
+        return rng;
+
+    // Indexed by the pixel's own sample count, so adaptive sampling and
+    // cancelled passes still walk each pixel's sequence without gaps. Blue
+    // noise shares one sequence across the screen and decorrelates pixels
+    // only through the shift, which is what keeps their errors blue.
+    rng.sampler = m_sampler;
+    rng.index = m_pixelSamples[pixel];
+    rng.seed = m_sampler == Sampler::Sobol ? hash(pixel ^ 0x9e3779b9u) : 0x9e3779b9u;
+    rng.x = x;
+    rng.y = y;
+    return rng;
+}
+
 // --- Setup ---
 
 void CPURaytracer::setGeometry(std::vector<Triangle> triangles, std::vector<TextureData> textures)
 {
+    cancelSample();
+    m_blases.clear();
+    m_instances.clear();
+    m_tlas = BVH{};
+
     // Split into hot (intersection) and cold (shading) arrays
     size_t count = triangles.size();
     m_triVerts.resize(count);
@@ -47,13 +159,15 @@ void CPURaytracer::setGeometry(std::vector<Triangle> triangles, std::vector<Text
     }
     m_textures = std::move(textures);
     buildBVH();
+    buildOpacityMicromaps();
     buildLightData();
     reset();
 }
 
 void CPURaytracer::getReorderedTriangles(std::vector<Triangle>& out) const
 {
-    const size_t n = m_triVerts.size();
+    // Instanced triangles are in object space and have no flat ordering
+    const size_t n = isInstanced() ? 0 : m_triVerts.size();
     out.resize(n);
     for (size_t i = 0; i < n; ++i)
     {
@@ -86,6 +200,9 @@ void CPURaytracer::getReorderedTriangles(std::vector<Triangle>& out) const
 
 void CPURaytracer::updateMaterials(const std::vector<Triangle>& triangles)
 {
+    if (isInstanced()) return; // see updateInstancedMaterials()
+    cancelSample();
+
     // triangles is already in BVH-reordered order (same permutation as m_triData),
     // so index directly — no need to invert through m_bvh.indices().
     bool emissiveChanged = false;
@@ -108,37 +225,414 @@ void CPURaytracer::updateMaterials(const std::vector<Triangle>& triangles)
     reset();
 }
 
+float CPURaytracer::refitGeometry(const std::vector<Triangle>& triangles, const std::vector<uint32_t>& changed)
+{
+    // Instanced geometry moves through setInstanceTransforms()
+    if (isInstanced()) return 1.0f;
+    cancelSample();
+
+    std::vector<bool> dirty(m_triVerts.size(), false);
+    bool emissiveChanged = false;
+    for (uint32_t i : changed)
+    {
+        if (i >= m_triVerts.size() || i >= triangles.size()) continue;
+        const auto& tri = triangles[i];
+        auto& data = m_triData[i];
+        m_triVerts[i]        = { tri.v0, tri.v1, tri.v2 };
+        data.n0              = tri.n0;
+        data.n1              = tri.n1;
+        data.n2              = tri.n2;
+        data.geometricNormal = tri.geometricNormal;
+        data.area            = tri.area;
+        data.tangent         = tri.tangent;
+        data.bitangentSign   = tri.bitangentSign;
+        dirty[i] = true;
+#if defined(VEX_BVH_SIMD_X86)
+        packTriBlockLane(i);
+#endif
+        if (glm::length(data.emissive) > 0.001f)
+            emissiveChanged = true;
+    }
+
+    m_bvh.refit([this](uint32_t i)
+    {
+        AABB b;
+        b.grow(m_triVerts[i].v0);
+        b.grow(m_triVerts[i].v1);
+        b.grow(m_triVerts[i].v2);
+        return b;
+    }, dirty);
+    buildWideBVH();
+
+    // Emitter areas feed the light CDF
+    if (emissiveChanged)
+        buildLightData();
+    reset();
+    return m_bvh.refitDegradation();
+}
+
 void CPURaytracer::buildBVH()
 {
     uint32_t count = static_cast<uint32_t>(m_triVerts.size());
 
-    // Compute per-triangle AABBs from the compact vertex array
-    std::vector<AABB> triBounds(count);
-    for (uint32_t i = 0; i < count; ++i)
+    if (m_bvhOptions.spatialSplits)
+    {
+        // Spatial splits clip triangles, so the builder needs the vertices
+        std::vector<glm::vec3> verts(static_cast<size_t>(count) * 3);
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            verts[i * 3 + 0] = m_triVerts[i].v0;
+            verts[i * 3 + 1] = m_triVerts[i].v1;
+            verts[i * 3 + 2] = m_triVerts[i].v2;
+        }
+        m_bvh.buildFromTriangles(verts, m_bvhOptions);
+    }
+    else
     {
-        triBounds[i].grow(m_triVerts[i].v0);
-        triBounds[i].grow(m_triVerts[i].v1);
-        triBounds[i].grow(m_triVerts[i].v2);
+        // Compute per-triangle AABBs from the compact vertex array
+        std::vector<AABB> triBounds(count);
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            triBounds[i].grow(m_triVerts[i].v0);
+            triBounds[i].grow(m_triVerts[i].v1);
+            triBounds[i].grow(m_triVerts[i].v2);
+        }
+        m_bvh.build(triBounds, m_bvhOptions);
     }
 
-    m_bvh.build(triBounds);
+    applyBVHOrder();
+}
+
+void CPURaytracer::adoptBVH(BVH bvh)
+{
+    if (isInstanced() || bvh.primitiveCount() != m_triVerts.size())
+        return;
+    cancelSample();
+
+    m_bvh = std::move(bvh);
+    applyBVHOrder();
+    buildLightData();
+    reset();
+}
 
+void CPURaytracer::applyBVHOrder()
+{
     // Reorder both arrays to match BVH spatial ordering so leaf nodes
     // can reference contiguous ranges directly (better cache coherency).
+    // With spatial splits a triangle referenced from several leaves is copied
+    // once per reference, so the arrays can grow.
     const auto& indices = m_bvh.indices();
-    std::vector<TriVerts> reorderedVerts(count);
-    std::vector<TriData>  reorderedData(count);
-    for (uint32_t i = 0; i < count; ++i)
+    const size_t refCount = indices.size();
+    std::vector<TriVerts> reorderedVerts(refCount);
+    std::vector<TriData>  reorderedData(refCount);
+    for (size_t i = 0; i < refCount; ++i)
     {
         reorderedVerts[i] = m_triVerts[indices[i]];
         reorderedData[i]  = m_triData[indices[i]];
     }
     m_triVerts = std::move(reorderedVerts);
     m_triData  = std::move(reorderedData);
+
+    buildTriBlocks();
+    buildWideBVH();
+}
+
+void CPURaytracer::buildWideBVH()
+{
+    static const uint32_t supported = detectBVHWidth();
+    uint32_t width = m_bvhWidthRequest == 0 ? supported : std::min(m_bvhWidthRequest, supported);
+    m_bvhWidth = width >= 8 ? 8 : (width >= 4 ? 4 : 2);
+
+    // Only the active layout is kept; collapsing is a single linear pass
+    m_bvh4.clear();
+    m_bvh8.clear();
+    m_cbvh.clear();
+    if (m_compressedBVH)
+        m_cbvh.build(m_bvh);
+    else if (m_bvhWidth == 4)
+        m_bvh4.build(m_bvh);
+    else if (m_bvhWidth == 8)
+        m_bvh8.build(m_bvh);
+}
+
+void CPURaytracer::buildTriBlocks()
+{
+    m_triBlocks.clear();
+#if defined(VEX_BVH_SIMD_X86)
+    m_triBlocks.resize((m_triVerts.size() + TRI_BLOCK_WIDTH - 1) / TRI_BLOCK_WIDTH);
+    for (size_t i = 0; i < m_triVerts.size(); ++i)
+        packTriBlockLane(i);
+#endif
+}
+
+void CPURaytracer::packTriBlockLane(size_t tri)
+{
+    TriBlock& block = m_triBlocks[tri / TRI_BLOCK_WIDTH];
+    const size_t lane = tri % TRI_BLOCK_WIDTH;
+    const TriVerts& verts = m_triVerts[tri];
+    const glm::vec3 edge1 = verts.v1 - verts.v0;
+    const glm::vec3 edge2 = verts.v2 - verts.v0;
+    block.v0x[lane] = verts.v0.x; block.v0y[lane] = verts.v0.y; block.v0z[lane] = verts.v0.z;
+    block.e1x[lane] = edge1.x;    block.e1y[lane] = edge1.y;    block.e1z[lane] = edge1.z;
+    block.e2x[lane] = edge2.x;    block.e2y[lane] = edge2.y;    block.e2z[lane] = edge2.z;
+}
+
+void CPURaytracer::setCompressedBVH(bool enabled)
+{
+    if (m_compressedBVH == enabled) return;
+    cancelSample();
+    m_compressedBVH = enabled;
+    buildWideBVH();
+}
+
+void CPURaytracer::setPacketTracing(bool enabled)
+{
+    if (m_packetTracing == enabled) return;
+    cancelSample();
+    m_packetTracing = enabled;
+}
+
+void CPURaytracer::setWavefront(bool enabled)
+{
+    if (m_wavefront == enabled) return;
+    cancelSample();
+    m_wavefront = enabled;
+}
+
+size_t CPURaytracer::getTraversalBVHMemoryBytes() const
+{
+    if (isInstanced())
+    {
+        size_t bytes = m_tlas.memoryBytes();
+        for (const auto& blas : m_blases)
+            bytes += blas.bvh.memoryBytes();
+        return bytes;
+    }
+    if (m_compressedBVH) return m_cbvh.memoryBytes();
+    if (m_bvhWidth == 8) return m_bvh8.memoryBytes();
+    if (m_bvhWidth == 4) return m_bvh4.memoryBytes();
+    return m_bvh.memoryBytes();
+}
+
+// --- Two-level acceleration structure ---
+
+void CPURaytracer::setInstancedGeometry(std::vector<std::vector<Triangle>> meshes, std::vector<Instance> instances,
+                                        std::vector<TextureData> textures)
+{
+    cancelSample();
+    const uint32_t meshCount = static_cast<uint32_t>(meshes.size());
+
+    // One BLAS per mesh. Most meshes are small, so meshes are spread across
+    // threads with single-threaded builds; large meshes get the full pool.
+    std::vector<BVH> blasBVHs(meshCount);
+    std::vector<uint32_t> largeMeshes;
+    for (uint32_t m = 0; m < meshCount; ++m)
+    {
+        if (meshes[m].size() >= BLAS_PARALLEL_MIN_TRIS)
+            largeMeshes.push_back(m);
+    }
+
+    auto buildMesh = [&](uint32_t m, uint32_t threads)
+    {
+        BVHBuildOptions options = m_bvhOptions;
+        options.threadCount = threads;
+        const auto& tris = meshes[m];
+        if (options.spatialSplits)
+        {
+            std::vector<glm::vec3> verts(tris.size() * 3);
+            for (size_t i = 0; i < tris.size(); ++i)
+            {
+                verts[i * 3 + 0] = tris[i].v0;
+                verts[i * 3 + 1] = tris[i].v1;
+                verts[i * 3 + 2] = tris[i].v2;
+            }
+            blasBVHs[m].buildFromTriangles(verts, options);
+        }
+        else
+        {
+            std::vector<AABB> triBounds(tris.size());
+            for (size_t i = 0; i < tris.size(); ++i)
+            {
+                triBounds[i].grow(tris[i].v0);
+                triBounds[i].grow(tris[i].v1);
+                triBounds[i].grow(tris[i].v2);
+            }
+            blasBVHs[m].build(triBounds, options);
+        }
+    };
+
+    for (uint32_t m : largeMeshes)
+        buildMesh(m, m_bvhOptions.threadCount);
+
+    {
+        uint32_t threadCount = m_bvhOptions.threadCount != 0
+            ? m_bvhOptions.threadCount
+            : std::max(1u, std::thread::hardware_concurrency());
+        threadCount = std::min(threadCount, std::max(1u, meshCount));
+
+        std::atomic<uint32_t> next{0};
+        auto worker = [&]()
+        {
+            for (uint32_t m = next.fetch_add(1); m < meshCount; m = next.fetch_add(1))
+            {
+                if (meshes[m].size() < BLAS_PARALLEL_MIN_TRIS)
+                    buildMesh(m, 1);
+            }
+        };
+        std::vector<std::thread> threads;
+        for (uint32_t t = 1; t < threadCount; ++t)
+            threads.emplace_back(worker);
+        worker();
+        for (auto& t : threads)
+            t.join();
+    }
+
+    // Concatenate the meshes' triangles, each in its own BLAS order
+    size_t totalRefs = 0;
+    for (const auto& bvh : blasBVHs)
+        totalRefs += bvh.indices().size();
+
+    m_triVerts.clear();
+    m_triData.clear();
+    m_triVerts.reserve(totalRefs);
+    m_triData.reserve(totalRefs);
+    m_blases.clear();
+    m_blases.resize(meshCount);
+    for (uint32_t m = 0; m < meshCount; ++m)
+    {
+        m_blases[m].firstTri = static_cast<uint32_t>(m_triVerts.size());
+        for (uint32_t idx : blasBVHs[m].indices())
+        {
+            const auto& tri = meshes[m][idx];
+            m_triVerts.push_back({ tri.v0, tri.v1, tri.v2 });
+            m_triData.push_back({ tri.n0, tri.n1, tri.n2,
+                                  tri.uv0, tri.uv1, tri.uv2,
+                                  tri.color, tri.emissive, tri.geometricNormal,
+                                  tri.area, tri.textureIndex, tri.emissiveTextureIndex,
+                                  tri.normalMapTextureIndex,
+                                  tri.roughnessTextureIndex, tri.metallicTextureIndex,
+                                  tri.alphaTextureIndex,
+                                  tri.alphaClip, tri.materialType, tri.ior,
+                                  tri.roughness, tri.metallic,
+                                  tri.tangent, tri.bitangentSign,
+                                  tri.emissiveStrength });
+        }
+        m_blases[m].bvh = std::move(blasBVHs[m]);
+    }
+    buildTriBlocks();
+
+    // The flat structures are unused while instanced
+    m_bvh = BVH{};
+    m_bvh4.clear();
+    m_bvh8.clear();
+    m_cbvh.clear();
+
+    // Instances of unknown meshes are dropped
+    m_instances.clear();
+    std::vector<glm::mat4> transforms;
+    for (const auto& instance : instances)
+    {
+        if (instance.mesh >= meshCount) continue;
+        m_instances.emplace_back().mesh = instance.mesh;
+        transforms.push_back(instance.transform);
+    }
+
+    m_textures = std::move(textures);
+    buildOpacityMicromaps();
+    setInstanceTransforms(transforms);
+}
+
+void CPURaytracer::setInstanceTransforms(const std::vector<glm::mat4>& transforms)
+{
+    cancelSample();
+    const size_t count = std::min(transforms.size(), m_instances.size());
+    for (size_t i = 0; i < count; ++i)
+    {
+        auto& inst = m_instances[i];
+        const glm::mat3 linear(transforms[i]);
+        inst.toWorld       = transforms[i];
+        inst.toObject      = glm::inverse(transforms[i]);
+        inst.normalToWorld = glm::transpose(glm::inverse(linear));
+        inst.handedness    = glm::determinant(linear) < 0.0f ? -1.0f : 1.0f;
+    }
+
+    buildTLAS();
+    buildLightData();
+    reset();
+}
+
+void CPURaytracer::updateInstancedMaterials(const std::vector<std::vector<Triangle>>& meshes)
+{
+    cancelSample();
+    bool emissiveChanged = false;
+    for (size_t m = 0; m < m_blases.size() && m < meshes.size(); ++m)
+    {
+        const auto& blas = m_blases[m];
+        const auto& indices = blas.bvh.indices();
+        for (size_t r = 0; r < indices.size(); ++r)
+        {
+            if (indices[r] >= meshes[m].size()) continue;
+            const auto& tri = meshes[m][indices[r]];
+            auto& data = m_triData[blas.firstTri + r];
+            if (data.emissive != tri.emissive)
+                emissiveChanged = true;
+            data.color            = tri.color;
+            data.emissive         = tri.emissive;
+            data.emissiveStrength = tri.emissiveStrength;
+            data.materialType     = tri.materialType;
+            data.ior              = tri.ior;
+            data.roughness        = tri.roughness;
+            data.metallic         = tri.metallic;
+        }
+    }
+    if (emissiveChanged)
+        buildLightData();
+    reset();
+}
+
+void CPURaytracer::buildTLAS()
+{
+    // World box of each instance: the transformed corners of its BLAS root.
+    // Instances of empty meshes get a degenerate box far from everything.
+    std::vector<AABB> instBounds(m_instances.size());
+    for (size_t i = 0; i < m_instances.size(); ++i)
+    {
+        const auto& inst = m_instances[i];
+        const auto& blas = m_blases[inst.mesh];
+        if (blas.bvh.empty())
+        {
+            instBounds[i].grow(glm::vec3(0.0f));
+            continue;
+        }
+        const AABB local = blas.bvh.rootAABB();
+        for (int c = 0; c < 8; ++c)
+        {
+            const glm::vec3 corner((c & 1) ? local.max.x : local.min.x,
+                                   (c & 2) ? local.max.y : local.min.y,
+                                   (c & 4) ? local.max.z : local.min.z);
+            instBounds[i].grow(glm::vec3(inst.toWorld * glm::vec4(corner, 1.0f)));
+        }
+    }
+
+    // Few primitives: a single-threaded build is cheaper than spawning workers
+    BVHBuildOptions options;
+    options.threadCount = 1;
+    m_tlas.build(instBounds, options);
+}
+
+void CPURaytracer::setBVHWidth(uint32_t width)
+{
+    if (m_bvhWidthRequest == width) return;
+    cancelSample();
+    m_bvhWidthRequest = width;
+    buildWideBVH();
 }
 
 void CPURaytracer::setCamera(const glm::vec3& origin, const glm::mat4& inverseVP)
 {
+    if (m_cameraOrigin == origin && m_inverseVP == inverseVP)
+        return;
+    cancelSample();
     m_cameraOrigin = origin;
     m_inverseVP = inverseVP;
 }
@@ -148,27 +642,210 @@ void CPURaytracer::resize(uint32_t width, uint32_t height)
     if (m_width == width && m_height == height)
         return;
 
+    cancelSample();
     m_width = width;
     m_height = height;
     m_accumBuffer.assign(width * height, glm::vec3(0.0f));
+    m_oddAccumBuffer.assign(width * height, glm::vec3(0.0f));
+    m_pixelSamples.assign(width * height, 0u);
     m_albedoBuffer.assign(width * height, glm::vec3(0.0f));
     m_normalBuffer.assign(width * height, glm::vec3(0.0f));
-    m_pixelBuffer.assign(width * height * 4, 0);
+    for (Frame& frame : m_frames)
+    {
+        frame.hdr.assign(width * height, glm::vec3(0.0f));
+        frame.pixels.assign(width * height * 4, 0);
+        frame.samples.assign(width * height, 0u);
+        frame.workerStats.clear();
+    }
     m_sampleCount = 0;
+    m_passIndex = 0;
+    m_raysTraced = 0;
 
+    buildTiles();
+    m_tileConverged.assign(m_tiles.size(), 0);
+    m_convergedTiles = 0;
     if (m_workers.empty())
         buildThreadPool();
-    else
-        rebuildWorkerRanges();
 }
 
 void CPURaytracer::reset()
 {
+    cancelSample();
     std::fill(m_accumBuffer.begin(), m_accumBuffer.end(), glm::vec3(0.0f));
+    std::fill(m_oddAccumBuffer.begin(), m_oddAccumBuffer.end(), glm::vec3(0.0f));
+    std::fill(m_pixelSamples.begin(), m_pixelSamples.end(), 0u);
     std::fill(m_albedoBuffer.begin(), m_albedoBuffer.end(), glm::vec3(0.0f));
     std::fill(m_normalBuffer.begin(), m_normalBuffer.end(), glm::vec3(0.0f));
-    std::fill(m_pixelBuffer.begin(), m_pixelBuffer.end(), uint8_t(0));
-    m_sampleCount = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_frameMutex);
+        for (Frame& frame : m_frames)
+        {
+            std::fill(frame.hdr.begin(), frame.hdr.end(), glm::vec3(0.0f));
+            std::fill(frame.pixels.begin(), frame.pixels.end(), uint8_t(0));
+            std::fill(frame.samples.begin(), frame.samples.end(), 0u);
+            frame.workerStats.clear();
+        }
+        m_sampleCount = 0;
+    }
+    std::fill(m_tileConverged.begin(), m_tileConverged.end(), uint8_t(0));
+    m_convergedTiles = 0;
+    m_passIndex = 0;
+    m_raysTraced = 0;
+
+    // Learning starts over with the accumulation it fed
+    if (m_pathGuiding)
+        m_pathGuide.reset(m_instances.empty() ? m_bvh.rootAABB() : m_tlas.rootAABB());
+    else
+        m_pathGuide.clear();
+}
+
+// --- Geometry cache file ---
+// Header, then the sections back to back in this order. Structs are stored
+// as raw bytes, so the header records their sizes; a build whose layout
+// differs sees a mismatch and rebuilds instead of misreading the file.
+
+struct CPURaytracer::GeometryCacheHeader
+{
+    char     magic[4];
+    uint32_t version;
+    uint64_t key;
+    uint32_t nodeSize, triVertsSize, triDataSize, lightTriSize;
+    uint64_t nodeCount;
+    uint64_t indexCount;
+    uint64_t triCount;  // m_triVerts / m_triData entries (references)
+    uint64_t lightCount;
+    uint32_t primitiveCount;
+    uint32_t luminanceCDF;
+    float    totalLightArea;
+    uint32_t reserved;
+};
+
+static constexpr char GEOMETRY_CACHE_MAGIC[4] = { 'V', 'X', 'G', 'C' };
+
+bool CPURaytracer::saveGeometryCache(const std::string& path, uint64_t key) const
+{
+    if (isInstanced() || m_bvh.empty())
+        return false;
+
+    GeometryCacheHeader header{};
+    std::memcpy(header.magic, GEOMETRY_CACHE_MAGIC, sizeof(header.magic));
+    header.version        = GEOMETRY_CACHE_VERSION;
+    header.key            = key;
+    header.nodeSize       = sizeof(BVH::Node);
+    header.triVertsSize   = sizeof(TriVerts);
+    header.triDataSize    = sizeof(TriData);
+    header.lightTriSize   = sizeof(LightTri);
+    header.nodeCount      = m_bvh.nodes().size();
+    header.indexCount     = m_bvh.indices().size();
+    header.triCount       = m_triVerts.size();
+    header.lightCount     = m_lightTris.size();
+    header.primitiveCount = m_bvh.primitiveCount();
+    header.luminanceCDF   = m_useLuminanceCDF ? 1u : 0u;
+    header.totalLightArea = m_totalLightArea;
+
+    // Written next to the target and renamed over it, so a reader never maps
+    // a half-written file
+    std::error_code ec;
+    const std::filesystem::path target(path);
+    if (target.has_parent_path())
+        std::filesystem::create_directories(target.parent_path(), ec);
+    const std::filesystem::path temp = target.string() + ".tmp";
+    {
+        std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+        if (!out)
+            return false;
+        auto write = [&out](const void* data, size_t bytes)
+        {
+            out.write(static_cast<const char*>(data), static_cast<std::streamsize>(bytes));
+        };
+        write(&header, sizeof(header));
+        write(m_bvh.nodes().data(),   m_bvh.nodes().size() * sizeof(BVH::Node));
+        write(m_bvh.indices().data(), m_bvh.indices().size() * sizeof(uint32_t));
+        write(m_triVerts.data(),      m_triVerts.size() * sizeof(TriVerts));
+        write(m_triData.data(),       m_triData.size() * sizeof(TriData));
+        write(m_lightTris.data(),     m_lightTris.size() * sizeof(LightTri));
+        write(m_lightCDF.data(),      m_lightCDF.size() * sizeof(float));
+        if (!out.flush())
+        {
+            out.close();
+            std::filesystem::remove(temp, ec);
+            return false;
+        }
+    }
+    std::filesystem::rename(temp, target, ec);
+    if (ec)
+    {
+        std::filesystem::remove(temp, ec);
+        return false;
+    }
+    return true;
+}
+
+bool CPURaytracer::loadGeometryCache(const std::string& path, uint64_t key, const std::vector<TextureData>& textures)
+{
+    MappedFile file;
+    if (!file.open(path) || file.size() < sizeof(GeometryCacheHeader))
+        return false;
+
+    GeometryCacheHeader header;
+    std::memcpy(&header, file.data(), sizeof(header));
+    if (std::memcmp(header.magic, GEOMETRY_CACHE_MAGIC, sizeof(header.magic)) != 0
+        || header.version != GEOMETRY_CACHE_VERSION || header.key != key
+        || header.nodeSize != sizeof(BVH::Node) || header.triVertsSize != sizeof(TriVerts)
+        || header.triDataSize != sizeof(TriData) || header.lightTriSize != sizeof(LightTri)
+        || header.nodeCount == 0 || header.triCount != header.indexCount)
+        return false;
+
+    const uint64_t expected = sizeof(GeometryCacheHeader)
+        + header.nodeCount  * sizeof(BVH::Node)
+        + header.indexCount * sizeof(uint32_t)
+        + header.triCount   * (sizeof(TriVerts) + sizeof(TriData))
+        + header.lightCount * (sizeof(LightTri) + sizeof(float));
+    if (file.size() != expected)
+        return false;
+
+    const uint8_t* cursor = file.data() + sizeof(GeometryCacheHeader);
+    auto read = [&cursor](auto& vec, uint64_t count)
+    {
+        vec.resize(static_cast<size_t>(count));
+        const size_t bytes = vec.size() * sizeof(vec[0]);
+        if (bytes > 0)
+            std::memcpy(vec.data(), cursor, bytes);
+        cursor += bytes;
+    };
+
+    std::vector<BVH::Node> nodes;
+    std::vector<uint32_t>  indices;
+    read(nodes, header.nodeCount);
+    read(indices, header.indexCount);
+
+    cancelSample();
+    m_blases.clear();
+    m_instances.clear();
+    m_tlas = BVH{};
+    read(m_triVerts, header.triCount);
+    read(m_triData, header.triCount);
+    m_bvh.restore(std::move(nodes), std::move(indices), header.primitiveCount);
+    buildTriBlocks();
+    buildWideBVH();
+
+    // The CDF weights depend on the luminance setting at save time
+    if ((header.luminanceCDF != 0) == m_useLuminanceCDF)
+    {
+        read(m_lightTris, header.lightCount);
+        read(m_lightCDF, header.lightCount);
+        m_totalLightArea = header.totalLightArea;
+        buildLightSampling();
+    }
+    else
+    {
+        buildLightData();
+    }
+
+    m_textures = textures;
+    buildOpacityMicromaps();
+    reset();
+    return true;
 }
 
 // --- Settings (auto-reset on change) ---
@@ -176,6 +853,7 @@ void CPURaytracer::reset()
 void CPURaytracer::setMaxDepth(int depth)
 {
     if (m_maxDepth == depth) return;
+    cancelSample();
     m_maxDepth = depth;
     reset();
 }
@@ -183,6 +861,7 @@ void CPURaytracer::setMaxDepth(int depth)
 void CPURaytracer::setEnableNEE(bool v)
 {
     if (m_enableNEE == v) return;
+    cancelSample();
     m_enableNEE = v;
     reset();
 }
@@ -190,14 +869,48 @@ void CPURaytracer::setEnableNEE(bool v)
 void CPURaytracer::setUseLuminanceCDF(bool v)
 {
     if (m_useLuminanceCDF == v) return;
+    cancelSample();
     m_useLuminanceCDF = v;
     buildLightData();
     reset();
 }
 
+void CPURaytracer::setUseLightBVH(bool v)
+{
+    if (m_useLightBVH == v) return;
+    cancelSample();
+    m_useLightBVH = v;
+    reset();
+}
+
+void CPURaytracer::setSphericalLightSampling(bool v)
+{
+    if (m_sphericalLightSampling == v) return;
+    cancelSample();
+    m_sphericalLightSampling = v;
+    reset();
+}
+
+void CPURaytracer::setPathGuiding(bool v)
+{
+    if (m_pathGuiding == v) return;
+    cancelSample();
+    m_pathGuiding = v;
+    reset();
+}
+
+void CPURaytracer::setPathGuideMemoryLimit(size_t bytes)
+{
+    if (m_pathGuide.getMemoryLimit() == bytes) return;
+    cancelSample();
+    m_pathGuide.setMemoryLimit(bytes);
+    reset();
+}
+
 void CPURaytracer::setEnableFireflyClamping(bool v)
 {
     if (m_enableFireflyClamping == v) return;
+    cancelSample();
     m_enableFireflyClamping = v;
     reset();
 }
@@ -205,6 +918,7 @@ void CPURaytracer::setEnableFireflyClamping(bool v)
 void CPURaytracer::setFireflyClampThreshold(float v)
 {
     if (m_fireflyClampThreshold == v) return;
+    cancelSample();
     m_fireflyClampThreshold = v;
     reset();
 }
@@ -212,6 +926,7 @@ void CPURaytracer::setFireflyClampThreshold(float v)
 void CPURaytracer::setEnableAA(bool v)
 {
     if (m_enableAA == v) return;
+    cancelSample();
     m_enableAA = v;
     reset();
 }
@@ -219,6 +934,7 @@ void CPURaytracer::setEnableAA(bool v)
 void CPURaytracer::setEnableEnvironment(bool v)
 {
     if (m_enableEnvironment == v) return;
+    cancelSample();
     m_enableEnvironment = v;
     reset();
 }
@@ -226,6 +942,7 @@ void CPURaytracer::setEnableEnvironment(bool v)
 void CPURaytracer::setEnvLightMultiplier(float v)
 {
     if (m_envLightMultiplier == v) return;
+    cancelSample();
     m_envLightMultiplier = v;
     reset();
 }
@@ -233,6 +950,7 @@ void CPURaytracer::setEnvLightMultiplier(float v)
 void CPURaytracer::setFlatShading(bool v)
 {
     if (m_flatShading == v) return;
+    cancelSample();
     m_flatShading = v;
     reset();
 }
@@ -240,6 +958,7 @@ void CPURaytracer::setFlatShading(bool v)
 void CPURaytracer::setEnableNormalMapping(bool v)
 {
     if (m_enableNormalMapping == v) return;
+    cancelSample();
     m_enableNormalMapping = v;
     reset();
 }
@@ -247,17 +966,39 @@ void CPURaytracer::setEnableNormalMapping(bool v)
 void CPURaytracer::setEnableEmissive(bool v)
 {
     if (m_enableEmissive == v) return;
+    cancelSample();
     m_enableEmissive = v;
     reset();
 }
 
-void CPURaytracer::setExposure(float v)  { m_exposure = v; }
-void CPURaytracer::setGamma(float v)     { m_gamma = v; }
-void CPURaytracer::setEnableACES(bool v) { m_enableACES = v; }
+// Tone mapping only: the accumulation stays, and the next resolved pass
+// picks up the new values
+
+void CPURaytracer::setExposure(float v)
+{
+    if (m_exposure == v) return;
+    cancelSample();
+    m_exposure = v;
+}
+
+void CPURaytracer::setGamma(float v)
+{
+    if (m_gamma == v) return;
+    cancelSample();
+    m_gamma = v;
+}
+
+void CPURaytracer::setEnableACES(bool v)
+{
+    if (m_enableACES == v) return;
+    cancelSample();
+    m_enableACES = v;
+}
 
 void CPURaytracer::setRayEps(float v)
 {
     if (m_rayEps == v) return;
+    cancelSample();
     m_rayEps = v;
     reset();
 }
@@ -265,15 +1006,49 @@ void CPURaytracer::setRayEps(float v)
 void CPURaytracer::setEnableRR(bool v)
 {
     if (m_enableRR == v) return;
+    cancelSample();
     m_enableRR = v;
     reset();
 }
 
+void CPURaytracer::setSampler(Sampler sampler)
+{
+    if (m_sampler == sampler) return;
+    cancelSample();
+    m_sampler = sampler;
+    reset();
+}
+
+void CPURaytracer::setAdaptiveSampling(bool enabled)
+{
+    if (m_adaptiveSampling == enabled) return;
+    cancelSample();
+    m_adaptiveSampling = enabled;
+    reset();
+}
+
+void CPURaytracer::setAdaptiveThreshold(float error)
+{
+    if (m_adaptiveThreshold == error) return;
+    cancelSample();
+    m_adaptiveThreshold = error;
+    reset();
+}
+
+void CPURaytracer::setAdaptiveMinSamples(uint32_t samples)
+{
+    if (m_adaptiveMinSamples == samples) return;
+    cancelSample();
+    m_adaptiveMinSamples = samples;
+    reset();
+}
+
 void CPURaytracer::setDoF(float aperture, float focusDistance, glm::vec3 right, glm::vec3 up)
 {
     if (m_aperture == aperture && m_focusDistance == focusDistance &&
         m_cameraRight == right && m_cameraUp == up)
         return;
+    cancelSample();
     m_aperture      = aperture;
     m_focusDistance = focusDistance;
     m_cameraRight   = right;
@@ -285,6 +1060,7 @@ void CPURaytracer::setDoF(float aperture, float focusDistance, glm::vec3 right,
 
 void CPURaytracer::setPointLight(const glm::vec3& pos, const glm::vec3& color, bool enabled)
 {
+    cancelSample();
     m_pointLightPos = pos;
     m_pointLightColor = color;
     m_pointLightEnabled = enabled;
@@ -295,6 +1071,7 @@ void CPURaytracer::setPointLight(const glm::vec3& pos, const glm::vec3& color, b
 void CPURaytracer::setDirectionalLight(const glm::vec3& direction, const glm::vec3& color,
                                        float angularRadius, bool enabled)
 {
+    cancelSample();
     m_sunDir = glm::normalize(direction);
     m_sunColor = color;
     m_sunAngularRadius = angularRadius;
@@ -306,43 +1083,48 @@ void CPURaytracer::setDirectionalLight(const glm::vec3& direction, const glm::ve
 
 void CPURaytracer::setEnvironmentColor(const glm::vec3& color)
 {
+    cancelSample();
     m_envColor = color;
 }
 
 void CPURaytracer::setEnvRotation(float r)
 {
     if (m_envRotation == r) return;
+    cancelSample();
     m_envRotation = r;
     reset();
 }
 
 void CPURaytracer::setEnvironmentMap(const float* data, int width, int height)
 {
+    cancelSample();
     m_envMapWidth = width;
     m_envMapHeight = height;
     size_t size = static_cast<size_t>(width) * height * 3;
     m_envMapPixels.assign(data, data + size);
     m_hasEnvMap = true;
-    buildEnvMapCDF();
+    buildEnvMapAlias();
 }
 
 void CPURaytracer::clearEnvironmentMap()
 {
+    cancelSample();
     m_envMapPixels.clear();
     m_envMapWidth = 0;
     m_envMapHeight = 0;
     m_hasEnvMap = false;
-    m_envCondCDF.clear();
-    m_envMarginalCDF.clear();
+    m_envMarginalAlias.clear();
+    m_envRowAlias.clear();
     m_envTotalIntegral = 0.0f;
 }
 
-void CPURaytracer::buildEnvMapCDF()
+void CPURaytracer::buildEnvMapAlias()
 {
     int W = m_envMapWidth;
     int H = m_envMapHeight;
-    m_envCondCDF.resize(static_cast<size_t>(W) * H);
-    m_envMarginalCDF.resize(H);
+    std::vector<float> rowSums(H);
+    std::vector<float> weights(W);
+    m_envRowAlias.resize(H);
     m_envTotalIntegral = 0.0f;
 
     for (int y = 0; y < H; ++y)
@@ -359,51 +1141,40 @@ void CPURaytracer::buildEnvMapCDF()
             float lum = 0.2126f * r + 0.7152f * g + 0.0722f * b;
             float weight = lum * sinTheta;
             rowSum += weight;
-            m_envCondCDF[y * W + x] = rowSum;
-        }
-
-        // Normalize conditional CDF for this row
-        if (rowSum > 0.0f)
-        {
-            for (int x = 0; x < W; ++x)
-                m_envCondCDF[y * W + x] /= rowSum;
-        }
-        else
-        {
-            // Uniform distribution for zero-energy rows
-            for (int x = 0; x < W; ++x)
-                m_envCondCDF[y * W + x] = static_cast<float>(x + 1) / static_cast<float>(W);
+            weights[x] = weight;
         }
 
+        // Zero-energy rows get a uniform table; the marginal never picks them
+        m_envRowAlias[y].build(weights);
+        rowSums[y] = rowSum;
         m_envTotalIntegral += rowSum;
-        m_envMarginalCDF[y] = m_envTotalIntegral;
     }
 
-    // Normalize marginal CDF
-    if (m_envTotalIntegral > 0.0f)
-    {
-        for (int y = 0; y < H; ++y)
-            m_envMarginalCDF[y] /= m_envTotalIntegral;
-    }
+    m_envMarginalAlias.build(rowSums);
 }
 
-glm::vec3 CPURaytracer::sampleEnvMap(RNG& rng, glm::vec3& outDir, float& outPdf) const
+std::vector<AliasTable::Entry> CPURaytracer::exportEnvAliasTables() const
+{
+    if (!m_hasEnvMap)
+        return {};
+    std::vector<AliasTable::Entry> out(m_envMarginalAlias.entries());
+    for (const AliasTable& row : m_envRowAlias)
+        out.insert(out.end(), row.entries().begin(), row.entries().end());
+    return out;
+}
+
+glm::vec3 CPURaytracer::sampleEnvMap(RNG& rng, glm::vec3& outDir, float& outPdf) const
 {
     int W = m_envMapWidth;
     int H = m_envMapHeight;
 
-    // Sample row via marginal CDF
+    // Row from the marginal, column from that row's conditional; u3 settles
+    // both alias decisions (rescaled after the first)
     float u1 = rng.next();
-    auto rowIt = std::lower_bound(m_envMarginalCDF.begin(), m_envMarginalCDF.end(), u1);
-    int row = static_cast<int>(std::distance(m_envMarginalCDF.begin(), rowIt));
-    if (row >= H) row = H - 1;
-
-    // Sample column via conditional CDF for this row
     float u2 = rng.next();
-    auto colBegin = m_envCondCDF.begin() + row * W;
-    auto colIt = std::lower_bound(colBegin, colBegin + W, u2);
-    int col = static_cast<int>(std::distance(colBegin, colIt));
-    if (col >= W) col = W - 1;
+    float u3 = rng.next();
+    int row = static_cast<int>(m_envMarginalAlias.sample(u1, u3, &u3));
+    int col = static_cast<int>(m_envRowAlias[row].sample(u2, u3));
 
     // Convert pixel to texture coordinates (center of pixel)
     float texU = (static_cast<float>(col) + 0.5f) / static_cast<float>(W);
@@ -522,25 +1293,346 @@ glm::vec4 CPURaytracer::sampleTexture(int textureIndex, const glm::vec2& uv) con
                     glm::mix(fetch(x0, y1), fetch(x1, y1), wx), wy);
 }
 
+// --- Opacity micromaps ---
+// sampleTexture() blends four texels, so a filtered alpha never leaves the
+// range of the texels it reads. If every texel a micro-triangle can reach is
+// at least 128 (alpha >= 0.5) or every one is below it, the alpha test gives
+// the same answer anywhere on it without sampling.
+
+// Texel indices along one axis that bilinear filtering can read for
+// coordinates in [lo, hi], after the wrap in sampleTexture(). flip mirrors the
+// axis (V). A range that crosses a wrap gives two index ranges.
+static int filteredTexelRanges(float lo, float hi, int size, bool flip, int out[2][2])
+{
+    auto toTexels = [&](float f0, float f1, int* range)
+    {
+        const float t0 = flip ? 1.0f - f1 : f0;
+        const float t1 = flip ? 1.0f - f0 : f1;
+        range[0] = std::clamp(static_cast<int>(std::floor(t0 * static_cast<float>(size))), 0, size - 1);
+        range[1] = std::clamp(static_cast<int>(std::floor(t1 * static_cast<float>(size))) + 1, 0, size - 1);
+    };
+
+    if (hi - lo >= 1.0f)
+    {
+        out[0][0] = 0;
+        out[0][1] = size - 1;
+        return 1;
+    }
+    const float base = std::floor(lo);
+    const float a = lo - base;
+    const float b = hi - base;
+    if (b < 1.0f)
+    {
+        toTexels(a, b, out[0]);
+        return 1;
+    }
+    toTexels(a, 1.0f, out[0]);
+    toTexels(0.0f, b - 1.0f, out[1]);
+    return 2;
+}
+
+uint32_t CPURaytracer::microTriangleIndex(float u, float v)
+{
+    constexpr int N = OPACITY_MICROMAP_SEGMENTS;
+    const float fu = std::clamp(u, 0.0f, 1.0f) * static_cast<float>(N);
+    const float fv = std::clamp(v, 0.0f, 1.0f) * static_cast<float>(N);
+    const int j = std::min(static_cast<int>(fv), N - 1);
+    int i = std::min(static_cast<int>(fu), N - 1);
+    if (i + j > N - 1) // just past the long edge
+        i = N - 1 - j;
+    const bool upper = i + j < N - 1 && (fu - static_cast<float>(i)) + (fv - static_cast<float>(j)) > 1.0f;
+    return static_cast<uint32_t>(j * (2 * N - j) + 2 * i + (upper ? 1 : 0));
+}
+
+void CPURaytracer::buildOpacityMicromaps()
+{
+    m_opacityMicromaps.clear();
+
+    // Alpha-clipped triangles grouped by the texture and channel they test
+    // (map_d red, or diffuse alpha); triangles with neither are opaque
+    std::vector<std::vector<uint32_t>> byTexture(m_textures.size() * 2);
+    for (uint32_t i = 0; i < m_triData.size(); ++i)
+    {
+        auto& data = m_triData[i];
+        data.opacityMicromap = UINT32_MAX;
+        if (!data.alphaClip)
+            continue;
+        const int tex = data.alphaTextureIndex >= 0 ? data.alphaTextureIndex : data.textureIndex;
+        if (tex < 0)
+        {
+            data.opacityMicromap = static_cast<uint32_t>(m_opacityMicromaps.size());
+            m_opacityMicromaps.push_back({ ~uint64_t(0), 0 });
+            continue;
+        }
+        if (static_cast<size_t>(tex) >= m_textures.size() || m_textures[tex].width <= 0 || m_textures[tex].height <= 0)
+            continue;
+        byTexture[static_cast<size_t>(tex) * 2 + (data.alphaTextureIndex >= 0 ? 0 : 1)].push_back(i);
+    }
+
+    // One summed-area table of opaque texels at a time: any texel rectangle
+    // is then classified with four reads
+    std::vector<uint32_t> sums;
+    for (size_t key = 0; key < byTexture.size(); ++key)
+    {
+        const auto& tris = byTexture[key];
+        if (tris.empty())
+            continue;
+
+        const auto& tex = m_textures[key / 2];
+        const size_t channel = key % 2 == 0 ? 0 : 3;
+        const int W = tex.width;
+        const int H = tex.height;
+        const size_t stride = static_cast<size_t>(W) + 1;
+        sums.assign(stride * (static_cast<size_t>(H) + 1), 0);
+        for (int y = 0; y < H; ++y)
+        {
+            uint32_t row = 0;
+            for (int x = 0; x < W; ++x)
+            {
+                row += tex.pixels[(static_cast<size_t>(y) * W + x) * 4 + channel] >= 128 ? 1u : 0u;
+                sums[(y + 1) * stride + x + 1] = sums[y * stride + x + 1] + row;
+            }
+        }
+        auto opaqueTexels = [&](const int* xs, const int* ys)
+        {
+            return sums[(ys[1] + 1) * stride + xs[1] + 1] - sums[ys[0] * stride + xs[1] + 1]
+                 - sums[(ys[1] + 1) * stride + xs[0]] + sums[ys[0] * stride + xs[0]];
+        };
+
+        constexpr int N = OPACITY_MICROMAP_SEGMENTS;
+        for (uint32_t tri : tris)
+        {
+            auto& data = m_triData[tri];
+            const glm::vec2 du = (data.uv1 - data.uv0) / static_cast<float>(N);
+            const glm::vec2 dv = (data.uv2 - data.uv0) / static_cast<float>(N);
+            if (!std::isfinite(du.x + du.y + dv.x + dv.y + data.uv0.x + data.uv0.y))
+                continue;
+
+            // Hits may land slightly outside their micro-triangle (edge
+            // tolerance, rounding), so every box grows by a margin
+            const glm::vec2 lo = glm::min(data.uv0, glm::min(data.uv1, data.uv2));
+            const glm::vec2 hi = glm::max(data.uv0, glm::max(data.uv1, data.uv2));
+            const float extent = std::max(hi.x - lo.x, hi.y - lo.y);
+            const float largest = std::max(std::max(std::abs(lo.x), std::abs(lo.y)), std::max(std::abs(hi.x), std::abs(hi.y)));
+            const float margin = 1e-3f * extent + 1e-6f * (1.0f + largest);
+
+            OpacityMicromap map;
+            auto classify = [&](glm::vec2 a, glm::vec2 b, glm::vec2 c, uint32_t bit)
+            {
+                const glm::vec2 boxLo = glm::min(a, glm::min(b, c)) - margin;
+                const glm::vec2 boxHi = glm::max(a, glm::max(b, c)) + margin;
+                int xs[2][2], ys[2][2];
+                const int nx = filteredTexelRanges(boxLo.x, boxHi.x, W, false, xs);
+                const int ny = filteredTexelRanges(boxLo.y, boxHi.y, H, true, ys);
+                bool allOpaque = true, allTransparent = true;
+                for (int rx = 0; rx < nx; ++rx)
+                {
+                    for (int ry = 0; ry < ny; ++ry)
+                    {
+                        const uint32_t area = static_cast<uint32_t>((xs[rx][1] - xs[rx][0] + 1) * (ys[ry][1] - ys[ry][0] + 1));
+                        const uint32_t opaque = opaqueTexels(xs[rx], ys[ry]);
+                        allOpaque = allOpaque && opaque == area;
+                        allTransparent = allTransparent && opaque == 0;
+                    }
+                }
+                if (allOpaque)
+                    map.opaque |= uint64_t(1) << bit;
+                else if (allTransparent)
+                    map.transparent |= uint64_t(1) << bit;
+            };
+
+            for (int j = 0; j < N; ++j)
+            {
+                for (int i = 0; i + j < N; ++i)
+                {
+                    auto corner = [&](int ci, int cj)
+                    {
+                        return data.uv0 + du * static_cast<float>(ci) + dv * static_cast<float>(cj);
+                    };
+                    const uint32_t bit = static_cast<uint32_t>(j * (2 * N - j) + 2 * i);
+                    classify(corner(i, j), corner(i + 1, j), corner(i, j + 1), bit);
+                    if (i + j < N - 1)
+                        classify(corner(i + 1, j), corner(i + 1, j + 1), corner(i, j + 1), bit + 1);
+                }
+            }
+
+            data.opacityMicromap = static_cast<uint32_t>(m_opacityMicromaps.size());
+            m_opacityMicromaps.push_back(map);
+        }
+    }
+}
+
+bool CPURaytracer::alphaCutout(const TriData& data, float u, float v) const
+{
+    if (!data.alphaClip)
+        return false;
+    if (data.opacityMicromap != UINT32_MAX)
+    {
+        const OpacityMicromap& map = m_opacityMicromaps[data.opacityMicromap];
+        const uint64_t bit = uint64_t(1) << microTriangleIndex(u, v);
+        if (map.opaque & bit) return false;
+        if (map.transparent & bit) return true;
+    }
+
+    // Mixed micro-triangle: dedicated map_d takes priority; fall back to diffuse .a channel
+    float w = 1.0f - u - v;
+    glm::vec2 hitUV = w * data.uv0 + u * data.uv1 + v * data.uv2;
+    float alpha = (data.alphaTextureIndex >= 0)
+        ? sampleTexture(data.alphaTextureIndex, hitUV).r
+        : (data.textureIndex >= 0 ? sampleTexture(data.textureIndex, hitUV).a : 1.0f);
+    return alpha < 0.5f;
+}
+
+CPURaytracer::OpacityMicromapStats CPURaytracer::getOpacityMicromapStats() const
+{
+    OpacityMicromapStats stats;
+    constexpr int microTriangles = OPACITY_MICROMAP_SEGMENTS * OPACITY_MICROMAP_SEGMENTS;
+    for (const auto& map : m_opacityMicromaps)
+    {
+        const int opaque = std::popcount(map.opaque);
+        const int transparent = std::popcount(map.transparent);
+        ++stats.triangles;
+        stats.opaque += static_cast<uint32_t>(opaque);
+        stats.transparent += static_cast<uint32_t>(transparent);
+        stats.mixed += static_cast<uint32_t>(microTriangles - opaque - transparent);
+    }
+    return stats;
+}
+
 // --- Light data ---
 
+// Below this solid angle Arvo's construction loses too much precision in
+// float, above it the triangle is nearly a hemisphere (pbrt-v4's bounds)
+static constexpr float MIN_SPHERICAL_SAMPLE_AREA = 3e-4f;
+static constexpr float MAX_SPHERICAL_SAMPLE_AREA = 6.22f;
+
+// Angle between unit vectors, accurate near 0 and pi where acos(dot) is not
+static float angleBetween(const glm::vec3& a, const glm::vec3& b)
+{
+    if (glm::dot(a, b) < 0.0f)
+        return PI - 2.0f * std::asin(std::min(glm::length(a + b) * 0.5f, 1.0f));
+    return 2.0f * std::asin(std::min(glm::length(b - a) * 0.5f, 1.0f));
+}
+
+// Solid angle of the spherical triangle with unit-vector corners a, b, c
+// (Van Oosterom & Strackee)
+static float sphericalTriangleArea(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c)
+{
+    return std::abs(2.0f * std::atan2(glm::dot(a, glm::cross(b, c)),
+                                      1.0f + glm::dot(a, b) + glm::dot(a, c) + glm::dot(b, c)));
+}
+
+// Uniform direction inside the spherical triangle a, b, c (unit vectors),
+// Arvo, "Stratified Sampling of Spherical Triangles", 1995: u1 picks the
+// sub-triangle a, b, c' of the right area, u2 a point along the arc b..c'
+static bool sampleSphericalTriangle(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c,
+                                    float u1, float u2, glm::vec3& outDir)
+{
+    glm::vec3 nAB = glm::cross(a, b), nBC = glm::cross(b, c), nCA = glm::cross(c, a);
+    const float lenAB = glm::length(nAB), lenBC = glm::length(nBC), lenCA = glm::length(nCA);
+    if (lenAB <= 0.0f || lenBC <= 0.0f || lenCA <= 0.0f)
+        return false;
+    nAB /= lenAB;
+    nBC /= lenBC;
+    nCA /= lenCA;
+
+    // Interior angles; their excess over pi is the area
+    const float alpha = angleBetween(nAB, -nCA);
+    const float beta  = angleBetween(nBC, -nAB);
+    const float gamma = angleBetween(nCA, -nBC);
+    const float areaPi = alpha + beta + gamma;
+    if (areaPi <= PI)
+        return false;
+    const float subAreaPi = PI + u1 * (areaPi - PI);
+
+    const float cosAlpha = std::cos(alpha), sinAlpha = std::sin(alpha);
+    const float sinPhi = std::sin(subAreaPi) * cosAlpha - std::cos(subAreaPi) * sinAlpha;
+    const float cosPhi = std::cos(subAreaPi) * cosAlpha + std::sin(subAreaPi) * sinAlpha;
+    const float k1 = cosPhi + cosAlpha;
+    const float k2 = sinPhi - sinAlpha * glm::dot(a, b);
+    const float denom = (k2 * sinPhi + k1 * cosPhi) * sinAlpha;
+    if (denom == 0.0f)
+        return false;
+    const float cosBp = std::clamp((k2 + (k2 * cosPhi - k1 * sinPhi) * cosAlpha) / denom, -1.0f, 1.0f);
+    const float sinBp = std::sqrt(std::max(0.0f, 1.0f - cosBp * cosBp));
+
+    // c' on the arc a..c, then the direction on the arc b..c'
+    const glm::vec3 cPerp = c - glm::dot(c, a) * a;
+    const float cPerpLen = glm::length(cPerp);
+    if (cPerpLen <= 0.0f)
+        return false;
+    const glm::vec3 cp = cosBp * a + sinBp * (cPerp / cPerpLen);
+
+    const float cosTheta = 1.0f - u2 * (1.0f - glm::dot(cp, b));
+    const float sinTheta = std::sqrt(std::max(0.0f, 1.0f - cosTheta * cosTheta));
+    const glm::vec3 cpPerp = cp - glm::dot(cp, b) * b;
+    const float cpPerpLen = glm::length(cpPerp);
+    outDir = cpPerpLen > 0.0f ? cosTheta * b + sinTheta * (cpPerp / cpPerpLen) : b;
+    return true;
+}
+
 void CPURaytracer::buildLightData()
 {
-    m_lightIndices.clear();
+    m_lightTris.clear();
     m_lightCDF.clear();
     m_totalLightArea = 0.0f;
 
-    for (uint32_t i = 0; i < static_cast<uint32_t>(m_triData.size()); ++i)
+    auto addLight = [this](const LightTri& light)
     {
-        const auto& data = m_triData[i];
-        if (glm::length(data.emissive) > 0.001f)
+        m_lightTris.push_back(light);
+        const glm::vec3& e = light.emissive;
+        float w = m_useLuminanceCDF
+            ? (0.2126f * e.r + 0.7152f * e.g + 0.0722f * e.b) * light.area
+            : light.area;
+        m_totalLightArea += w;
+        m_lightCDF.push_back(m_totalLightArea);
+    };
+
+    if (isInstanced())
+    {
+        // Every placement of an emissive triangle is its own world-space light
+        for (uint32_t k = 0; k < static_cast<uint32_t>(m_instances.size()); ++k)
+        {
+            const auto& inst = m_instances[k];
+            const auto& blas = m_blases[inst.mesh];
+            const std::vector<bool> firstRef = blas.bvh.firstReferenceMask();
+            for (uint32_t r = 0; r < static_cast<uint32_t>(firstRef.size()); ++r)
+            {
+                const uint32_t i = blas.firstTri + r;
+                const auto& data = m_triData[i];
+                if (!firstRef[r] || glm::length(data.emissive) <= 0.001f)
+                    continue;
+
+                LightTri light;
+                light.v0 = glm::vec3(inst.toWorld * glm::vec4(m_triVerts[i].v0, 1.0f));
+                light.v1 = glm::vec3(inst.toWorld * glm::vec4(m_triVerts[i].v1, 1.0f));
+                light.v2 = glm::vec3(inst.toWorld * glm::vec4(m_triVerts[i].v2, 1.0f));
+                const glm::vec3 c = glm::cross(light.v1 - light.v0, light.v2 - light.v0);
+                const float len = glm::length(c);
+                if (len <= 0.0f)
+                    continue;
+                light.geometricNormal = glm::normalize(inst.normalToWorld * data.geometricNormal) * inst.handedness;
+                light.emissive        = data.emissive;
+                light.area            = 0.5f * len;
+                light.triangle        = i;
+                light.instance        = k;
+                addLight(light);
+            }
+        }
+    }
+    else
+    {
+        // Duplicated references (spatial splits) must not be sampled twice
+        const std::vector<bool> firstRef = m_bvh.firstReferenceMask();
+
+        for (uint32_t i = 0; i < static_cast<uint32_t>(m_triData.size()); ++i)
         {
-            m_lightIndices.push_back(i);
-            float w = m_useLuminanceCDF
-                ? (0.2126f * data.emissive.r + 0.7152f * data.emissive.g + 0.0722f * data.emissive.b) * data.area
-                : data.area;
-            m_totalLightArea += w;
-            m_lightCDF.push_back(m_totalLightArea);
+            const auto& data = m_triData[i];
+            if (firstRef[i] && glm::length(data.emissive) > 0.001f)
+            {
+                const auto& verts = m_triVerts[i];
+                addLight({ verts.v0, verts.v1, verts.v2, data.geometricNormal, data.emissive, data.area, i, 0 });
+            }
         }
     }
 
@@ -549,24 +1641,185 @@ void CPURaytracer::buildLightData()
         for (float& c : m_lightCDF)
             c /= m_totalLightArea;
     }
+    buildLightSampling();
 }
 
-glm::vec3 CPURaytracer::sampleLightPoint(RNG& rng, uint32_t& outTriIndex) const
+void CPURaytracer::buildLightSampling()
 {
-    float u = rng.next();
-    auto it = std::lower_bound(m_lightCDF.begin(), m_lightCDF.end(), u);
-    uint32_t lightIdx = static_cast<uint32_t>(std::distance(m_lightCDF.begin(), it));
-    if (lightIdx >= m_lightIndices.size())
-        lightIdx = static_cast<uint32_t>(m_lightIndices.size()) - 1;
+    // Built from the normalized CDF so a drawn light's probability is
+    // exactly the pmf lightPmf() reports for it
+    std::vector<float> pmf(m_lightCDF.size());
+    for (size_t i = 0; i < pmf.size(); ++i)
+        pmf[i] = m_lightCDF[i] - (i > 0 ? m_lightCDF[i - 1] : 0.0f);
+    m_lightAlias.build(pmf);
+
+    std::vector<LightBounds> bounds(m_lightTris.size());
+    for (size_t i = 0; i < m_lightTris.size(); ++i)
+    {
+        const LightTri& light = m_lightTris[i];
+        const glm::vec3& e = light.emissive;
+        bounds[i].bounds.grow(light.v0);
+        bounds[i].bounds.grow(light.v1);
+        bounds[i].bounds.grow(light.v2);
+        bounds[i].power = (0.2126f * e.r + 0.7152f * e.g + 0.0722f * e.b) * light.area;
+        bounds[i].axis  = light.geometricNormal;
+    }
+    m_lightBVH.build(bounds);
+
+    // Slots are numbered per mesh, so each placement owns one row of them
+    m_triEmitterSlot.assign(m_triData.size(), UINT32_MAX);
+    std::vector<uint32_t> meshSlots(isInstanced() ? m_blases.size() : 1, 0u);
+    for (const LightTri& light : m_lightTris)
+    {
+        const uint32_t mesh = isInstanced() ? m_instances[light.instance].mesh : 0;
+        uint32_t& slot = m_triEmitterSlot[light.triangle];
+        if (slot == UINT32_MAX)
+            slot = meshSlots[mesh]++;
+    }
+
+    // Lights sit on the first reference of a triangle; spatial-split
+    // duplicates take the same slot
+    auto shareSlots = [this](const BVH& bvh, uint32_t firstTri)
+    {
+        const auto& indices = bvh.indices();
+        std::vector<uint32_t> primSlot(bvh.primitiveCount(), UINT32_MAX);
+        for (uint32_t r = 0; r < static_cast<uint32_t>(indices.size()); ++r)
+        {
+            if (primSlot[indices[r]] == UINT32_MAX)
+                primSlot[indices[r]] = m_triEmitterSlot[firstTri + r];
+            m_triEmitterSlot[firstTri + r] = primSlot[indices[r]];
+        }
+    };
+    if (isInstanced())
+    {
+        for (const auto& blas : m_blases)
+            shareSlots(blas.bvh, blas.firstTri);
+    }
+    else if (m_bvh.indices().size() == m_triData.size())
+    {
+        shareSlots(m_bvh, 0);
+    }
+
+    uint32_t slotCount = isInstanced() ? 0 : meshSlots[0];
+    m_instanceLightBase.assign(m_instances.size(), 0u);
+    if (isInstanced())
+    {
+        for (size_t k = 0; k < m_instances.size(); ++k)
+        {
+            m_instanceLightBase[k] = slotCount;
+            slotCount += meshSlots[m_instances[k].mesh];
+        }
+    }
+    m_slotLights.assign(slotCount, UINT32_MAX);
+    for (uint32_t i = 0; i < static_cast<uint32_t>(m_lightTris.size()); ++i)
+    {
+        const LightTri& light = m_lightTris[i];
+        const uint32_t base = isInstanced() ? m_instanceLightBase[light.instance] : 0;
+        m_slotLights[base + m_triEmitterSlot[light.triangle]] = i;
+    }
+}
 
-    outTriIndex = m_lightIndices[lightIdx];
-    const auto& verts = m_triVerts[outTriIndex];
+std::vector<LightBVHNode> CPURaytracer::exportLightBVH() const
+{
+    if (isInstanced())
+        return {};
+    std::vector<LightBVHNode> nodes = m_lightBVH.nodes();
+    for (LightBVHNode& node : nodes)
+    {
+        if (node.isLeaf())
+            node.childOrLight = m_lightTris[node.childOrLight].triangle;
+    }
+    return nodes;
+}
 
+bool CPURaytracer::sampleLightPoint(RNG& rng, const glm::vec3& p, const glm::vec3& n,
+                                    uint32_t& outLightIndex, float& outPmf, glm::vec3& outPoint) const
+{
+    float u = rng.next();
     float u1 = rng.next();
     float u2 = rng.next();
+
+    uint32_t lightIdx;
+    if (m_useLightBVH)
+    {
+        if (!m_lightBVH.sample(p, n, u, lightIdx, outPmf))
+            return false;
+    }
+    else
+    {
+        // The side decision reuses u1, which comes back rescaled for the point
+        lightIdx = m_lightAlias.sample(u, u1, &u1);
+        outPmf = lightPmf(lightIdx, p, n);
+    }
+
+    outLightIndex = lightIdx;
+    const auto& verts = m_lightTris[lightIdx];
+    if (sphericalSampleArea(lightIdx, p) > 0.0f)
+    {
+        // A direction in the triangle's solid angle, carried to its plane
+        glm::vec3 dir;
+        if (!sampleSphericalTriangle(glm::normalize(verts.v0 - p), glm::normalize(verts.v1 - p),
+                                     glm::normalize(verts.v2 - p), u1, u2, dir))
+            return false;
+        const float denom = glm::dot(dir, verts.geometricNormal);
+        const float t = glm::dot(verts.v0 - p, verts.geometricNormal) / denom;
+        if (!(t > 0.0f) || !std::isfinite(t))
+            return false;
+        outPoint = p + dir * t;
+        return true;
+    }
+
     float su0 = std::sqrt(u1);
+    outPoint = verts.v0 * (1.0f - su0) + verts.v1 * (su0 * (1.0f - u2)) + verts.v2 * (su0 * u2);
+    return true;
+}
+
+float CPURaytracer::sphericalSampleArea(uint32_t light, const glm::vec3& p) const
+{
+    if (!m_sphericalLightSampling)
+        return 0.0f;
+    const auto& verts = m_lightTris[light];
+    const float area = sphericalTriangleArea(glm::normalize(verts.v0 - p), glm::normalize(verts.v1 - p),
+                                             glm::normalize(verts.v2 - p));
+    return area >= MIN_SPHERICAL_SAMPLE_AREA && area <= MAX_SPHERICAL_SAMPLE_AREA ? area : 0.0f;
+}
 
-    return verts.v0 * (1.0f - su0) + verts.v1 * (su0 * (1.0f - u2)) + verts.v2 * (su0 * u2);
+float CPURaytracer::lightPointPdf(uint32_t light, const glm::vec3& p, const glm::vec3& onLight) const
+{
+    const auto& verts = m_lightTris[light];
+    const glm::vec3 toLight = onLight - p;
+    const float dist2 = glm::dot(toLight, toLight);
+    const float cosLight = -glm::dot(verts.geometricNormal, toLight) / std::sqrt(dist2);
+    if (cosLight <= 0.0f)
+        return 0.0f;
+    const float solidAngle = sphericalSampleArea(light, p);
+    if (solidAngle > 0.0f)
+        return 1.0f / solidAngle;
+    return dist2 / (cosLight * verts.area);
+}
+
+float CPURaytracer::lightPmf(uint32_t light, const glm::vec3& p, const glm::vec3& n) const
+{
+    if (m_useLightBVH)
+        return m_lightBVH.pmf(p, n, light);
+    return light > 0 ? m_lightCDF[light] - m_lightCDF[light - 1] : m_lightCDF[0];
+}
+
+uint32_t CPURaytracer::lightIndexOf(const HitRecord& hit) const
+{
+    if (hit.triangleIndex >= m_triEmitterSlot.size())
+        return UINT32_MAX;
+    const uint32_t slot = m_triEmitterSlot[hit.triangleIndex];
+    if (slot == UINT32_MAX)
+        return UINT32_MAX;
+    uint32_t base = 0;
+    if (isInstanced())
+    {
+        if (hit.instanceIndex >= m_instanceLightBase.size())
+            return UINT32_MAX;
+        base = m_instanceLightBase[hit.instanceIndex];
+    }
+    return m_slotLights[base + slot];
 }
 
 // --- Ray generation and intersection ---
@@ -645,95 +1898,262 @@ bool CPURaytracer::intersectTriangle(const Ray& ray, const TriVerts& verts,
     return t > 1e-7f;
 }
 
+// Möller–Trumbore for four triangles at once, in the operation order of
+// intersectTriangle so every lane reproduces the scalar distance
+uint32_t CPURaytracer::intersectTriBlock(const TriBlock& block, const Ray& ray, float tMax,
+                                         float* t, float* u, float* v)
+{
+#if defined(VEX_BVH_SIMD_X86)
+    const __m128 dx = _mm_set1_ps(ray.direction.x), dy = _mm_set1_ps(ray.direction.y), dz = _mm_set1_ps(ray.direction.z);
+    const __m128 e1x = _mm_load_ps(block.e1x), e1y = _mm_load_ps(block.e1y), e1z = _mm_load_ps(block.e1z);
+    const __m128 e2x = _mm_load_ps(block.e2x), e2y = _mm_load_ps(block.e2y), e2z = _mm_load_ps(block.e2z);
+
+    // h = cross(d, edge2), a = dot(edge1, h)
+    const __m128 hx = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(e2y, dz));
+    const __m128 hy = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(e2z, dx));
+    const __m128 hz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(e2x, dy));
+    const __m128 a = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, hx), _mm_mul_ps(e1y, hy)), _mm_mul_ps(e1z, hz));
+
+    const __m128 f = _mm_div_ps(_mm_set1_ps(1.0f), a);
+    const __m128 sx = _mm_sub_ps(_mm_set1_ps(ray.origin.x), _mm_load_ps(block.v0x));
+    const __m128 sy = _mm_sub_ps(_mm_set1_ps(ray.origin.y), _mm_load_ps(block.v0y));
+    const __m128 sz = _mm_sub_ps(_mm_set1_ps(ray.origin.z), _mm_load_ps(block.v0z));
+    const __m128 uu = _mm_mul_ps(f, _mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, hx), _mm_mul_ps(sy, hy)), _mm_mul_ps(sz, hz)));
+
+    // q = cross(s, edge1)
+    const __m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(e1y, sz));
+    const __m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(e1z, sx));
+    const __m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(e1x, sy));
+    const __m128 vv = _mm_mul_ps(f, _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)));
+    const __m128 tt = _mm_mul_ps(f, _mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)));
+
+    // Zero padding lanes have a == 0 and fall out as parallel
+    const __m128 parallel = _mm_and_ps(_mm_cmpgt_ps(a, _mm_set1_ps(-1e-9f)), _mm_cmplt_ps(a, _mm_set1_ps(1e-9f)));
+    __m128 hit = _mm_andnot_ps(parallel, _mm_cmpge_ps(uu, _mm_set1_ps(-1e-5f)));
+    hit = _mm_and_ps(hit, _mm_cmple_ps(uu, _mm_set1_ps(1.0f + 1e-5f)));
+    hit = _mm_and_ps(hit, _mm_cmpge_ps(vv, _mm_set1_ps(-1e-5f)));
+    hit = _mm_and_ps(hit, _mm_cmple_ps(_mm_add_ps(uu, vv), _mm_set1_ps(1.0f + 1e-5f)));
+    hit = _mm_and_ps(hit, _mm_cmpgt_ps(tt, _mm_set1_ps(1e-7f)));
+    hit = _mm_and_ps(hit, _mm_cmplt_ps(tt, _mm_set1_ps(tMax)));
+
+    _mm_storeu_ps(t, tt);
+    _mm_storeu_ps(u, uu);
+    _mm_storeu_ps(v, vv);
+    return static_cast<uint32_t>(_mm_movemask_ps(hit));
+#else
+    (void)block; (void)ray; (void)tMax; (void)t; (void)u; (void)v;
+    return 0; // blocks are only built for SIMD leaf tests
+#endif
+}
+
+template <typename OnHit>
+bool CPURaytracer::forEachLeafHit(const Ray& ray, uint32_t first, uint32_t count, const float& tMax,
+                                  OnHit&& onHit) const
+{
+#if defined(VEX_BVH_SIMD_X86)
+    // A leaf range need not start on a block boundary; lanes outside it are masked
+    const uint32_t end = first + count;
+    for (uint32_t base = first & ~(TRI_BLOCK_WIDTH - 1); base < end; base += TRI_BLOCK_WIDTH)
+    {
+        float t[TRI_BLOCK_WIDTH], u[TRI_BLOCK_WIDTH], v[TRI_BLOCK_WIDTH];
+        uint32_t hits = intersectTriBlock(m_triBlocks[base / TRI_BLOCK_WIDTH], ray, tMax, t, u, v);
+        if (base < first)
+            hits &= ~0u << (first - base);
+        if (end - base < TRI_BLOCK_WIDTH)
+            hits &= (1u << (end - base)) - 1;
+        while (hits)
+        {
+            const uint32_t lane = static_cast<uint32_t>(std::countr_zero(hits));
+            hits &= hits - 1;
+            // tMax may have shrunk on an earlier lane
+            if (t[lane] < tMax && onHit(base + lane, t[lane], u[lane], v[lane]))
+                return true;
+        }
+    }
+#else
+    for (uint32_t i = first; i < first + count; ++i)
+    {
+        float t, u, v;
+        if (intersectTriangle(ray, m_triVerts[i], t, u, v) && t < tMax && onHit(i, t, u, v))
+            return true;
+    }
+#endif
+    return false;
+}
+
+void CPURaytracer::intersectLeaf(const Ray& ray, uint32_t first, uint32_t count, TriangleHit& closest,
+                                 float facing) const
+{
+    forEachLeafHit(ray, first, count, closest.t, [&](uint32_t tri, float t, float u, float v)
+    {
+        acceptHit(ray, tri, t, u, v, facing, closest);
+        return false;
+    });
+}
+
+void CPURaytracer::acceptHit(const Ray& ray, uint32_t tri, float t, float u, float v, float facing,
+                             TriangleHit& closest) const
+{
+    const auto& data = m_triData[tri];
+
+    // Back-face culling: matches Vulkan RT default behavior.
+    // Dielectrics (2) and thin glass (3) allow back-face hits.
+    if (glm::dot(data.geometricNormal, -ray.direction) * facing <= 0.0f &&
+        data.materialType != 2 && data.materialType != 3)
+        return;
+
+    if (alphaCutout(data, u, v))
+        return;
+
+    closest.t = t;
+    closest.u = u;
+    closest.v = v;
+    closest.triangleIndex = tri;
+}
+
+HitRecord CPURaytracer::resolveHit(const Ray& ray, const TriangleHit& nearest) const
+{
+    HitRecord hit;
+    if (nearest.triangleIndex == UINT32_MAX)
+        return hit;
+
+    const auto& data = m_triData[nearest.triangleIndex];
+    const float u = nearest.u;
+    const float v = nearest.v;
+    const float w = 1.0f - u - v;
+
+    hit.t = nearest.t;
+    hit.hit = true;
+    hit.position = ray.at(nearest.t);
+    hit.normal = m_flatShading
+        ? data.geometricNormal
+        : glm::normalize(w * data.n0 + u * data.n1 + v * data.n2);
+    hit.geometricNormal = data.geometricNormal;
+    hit.uv = w * data.uv0 + u * data.uv1 + v * data.uv2;
+    hit.tangent = data.tangent;
+    hit.bitangentSign = data.bitangentSign;
+    hit.triangleIndex = nearest.triangleIndex;
+    return hit;
+}
+
+bool CPURaytracer::occludedLeaf(const Ray& ray, uint32_t first, uint32_t count, float maxDist,
+                                float facing) const
+{
+    return forEachLeafHit(ray, first, count, maxDist, [&](uint32_t tri, float, float u, float v)
+    {
+        const auto& data = m_triData[tri];
+
+        // Back-face culling: back-facing surfaces don't cast shadows.
+        // Thin glass (3) is also exempt — it needs both faces for correct shadowing.
+        if (glm::dot(data.geometricNormal, -ray.direction) * facing <= 0.0f &&
+            data.materialType != 2 && data.materialType != 3)
+            return false;
+
+        // Thin glass is transparent to shadow rays
+        if (data.materialType == 3) return false;
+        // Alpha clip: transparent surfaces don't occlude
+        return !alphaCutout(data, u, v);
+    });
+}
+
+// Slab-tests both children of an internal node and orders them front to back.
+// Returns how many are entered before tMax; child[0] / tNear[0] is the nearer.
+static inline int orderChildren(const BVH::Node* nodes, const BVH::Node& node, const glm::vec3& origin,
+                                const glm::vec3& invDir, float tMax, uint32_t child[2], float tNear[2])
+{
+    child[0] = node.leftFirst;
+    child[1] = node.leftFirst + 1;
+    tNear[0] = intersectAABBNear(nodes[child[0]].bounds, origin, invDir, tMax);
+    tNear[1] = intersectAABBNear(nodes[child[1]].bounds, origin, invDir, tMax);
+    if (tNear[1] < tNear[0])
+    {
+        std::swap(child[0], child[1]);
+        std::swap(tNear[0], tNear[1]);
+    }
+    return (tNear[0] < FLT_MAX) + (tNear[1] < FLT_MAX);
+}
+
 HitRecord CPURaytracer::traceRay(const Ray& ray) const
 {
-    HitRecord closest;
+    if (isInstanced()) return traceRayInstanced(ray);
+    if (m_compressedBVH) return resolveHit(ray, traceRayWide(m_cbvh, ray));
+#if defined(VEX_BVH_SIMD_X86)
+    if (m_bvhWidth == 8) return resolveHit(ray, traceRayAVX2(ray));
+#endif
+    if (m_bvhWidth == 4) return resolveHit(ray, traceRayWide(m_bvh4, ray));
+
+    return resolveHit(ray, traceRayBinary<false>(ray, nullptr));
+}
+
+template <bool CountStats>
+TriangleHit CPURaytracer::traceRayBinary(const Ray& ray, TraversalStats* stats) const
+{
+    TriangleHit closest;
 
     if (m_bvh.empty())
         return closest;
 
-    const auto& nodes = m_bvh.nodes();
+    const auto* nodes = m_bvh.nodes().data();
     glm::vec3 invDir = 1.0f / ray.direction;
 
+    if constexpr (CountStats) ++stats->boxTests;
+    if (intersectAABBNear(nodes[0].bounds, ray.origin, invDir, closest.t) == FLT_MAX)
+        return closest;
+
+    // Pending far children with their entry distances
     uint32_t stack[64];
+    float stackNear[64];
     int stackPtr = 0;
-    stack[stackPtr++] = 0;
+    uint32_t nodeIdx = 0;
 
-    while (stackPtr > 0)
+    for (;;)
     {
-        const auto& node = nodes[stack[--stackPtr]];
-
-        if (!intersectAABB(node.bounds, ray.origin, invDir, closest.t))
-            continue;
+        const auto& node = nodes[nodeIdx];
+        if constexpr (CountStats) ++stats->nodesVisited;
 
         if (node.isLeaf())
         {
-            for (uint32_t i = node.leftFirst; i < node.leftFirst + node.triCount; ++i)
+            if constexpr (CountStats) stats->trianglesTested += node.triCount;
+            intersectLeaf(ray, node.leftFirst, node.triCount, closest);
+        }
+        else
+        {
+            uint32_t child[2];
+            float tNear[2];
+            const int entered = orderChildren(nodes, node, ray.origin, invDir, closest.t, child, tNear);
+            if constexpr (CountStats) stats->boxTests += 2;
+            if (entered > 0)
             {
-                float t, u, v;
-                if (intersectTriangle(ray, m_triVerts[i], t, u, v) && t < closest.t)
+                if (entered == 2)
                 {
-                    const auto& data = m_triData[i];
-
-                    // Back-face culling: matches Vulkan RT default behavior.
-                    // Dielectrics (2) and thin glass (3) allow back-face hits.
-                    if (glm::dot(data.geometricNormal, -ray.direction) <= 0.0f &&
-                        data.materialType != 2 && data.materialType != 3)
-                        continue;
-
-                    float w = 1.0f - u - v;
-
-                    // Alpha clip: dedicated map_d takes priority; fall back to diffuse .a channel.
-                    if (data.alphaClip)
-                    {
-                        glm::vec2 hitUV = w * data.uv0 + u * data.uv1 + v * data.uv2;
-                        float alpha = (data.alphaTextureIndex >= 0)
-                            ? sampleTexture(data.alphaTextureIndex, hitUV).r
-                            : (data.textureIndex >= 0 ? sampleTexture(data.textureIndex, hitUV).a : 1.0f);
-                        if (alpha < 0.5f)
-                            continue;
-                    }
-
-                    closest.t = t;
-                    closest.hit = true;
-                    closest.position = ray.at(t);
-                    closest.normal = m_flatShading
-                        ? data.geometricNormal
-                        : glm::normalize(w * data.n0 + u * data.n1 + v * data.n2);
-                    closest.geometricNormal = data.geometricNormal;
-                    closest.color            = data.color;
-                    closest.emissive         = data.emissive;
-                    closest.emissiveStrength = data.emissiveStrength;
-                    closest.uv = w * data.uv0 + u * data.uv1 + v * data.uv2;
-                    closest.textureIndex = data.textureIndex;
-                    closest.emissiveTextureIndex = data.emissiveTextureIndex;
-                    closest.normalMapTextureIndex = data.normalMapTextureIndex;
-                    closest.roughnessTextureIndex = data.roughnessTextureIndex;
-                    closest.metallicTextureIndex = data.metallicTextureIndex;
-                    closest.triangleIndex = i;
-                    closest.materialType = data.materialType;
-                    closest.ior = data.ior;
-                    closest.roughness = data.roughness;
-                    closest.metallic = data.metallic;
-                    closest.tangent = data.tangent;
-                    closest.bitangentSign = data.bitangentSign;
+                    stack[stackPtr] = child[1];
+                    stackNear[stackPtr++] = tNear[1];
                 }
+                nodeIdx = child[0];
+                continue;
             }
         }
-        else
-        {
-            stack[stackPtr++] = node.leftFirst;
-            stack[stackPtr++] = node.leftFirst + 1;
-        }
+
+        // Resume at the most recent far child still in front of the closest hit
+        while (stackPtr > 0 && stackNear[stackPtr - 1] >= closest.t)
+            --stackPtr;
+        if (stackPtr == 0)
+            break;
+        nodeIdx = stack[--stackPtr];
     }
 
     return closest;
 }
 
-bool CPURaytracer::traceShadowRay(const Ray& ray, float maxDist) const
+HitRecord CPURaytracer::traceRayStats(const Ray& ray, TraversalStats& stats, bool ordered) const
 {
+    if (ordered)
+        return resolveHit(ray, traceRayBinary<true>(ray, &stats));
+
+    // Unsorted walk: children pushed left then right and culled when popped
+    TriangleHit closest;
     if (m_bvh.empty())
-        return false;
+        return {};
 
     const auto& nodes = m_bvh.nodes();
     glm::vec3 invDir = 1.0f / ray.direction;
@@ -746,40 +2166,15 @@ bool CPURaytracer::traceShadowRay(const Ray& ray, float maxDist) const
     {
         const auto& node = nodes[stack[--stackPtr]];
 
-        if (!intersectAABB(node.bounds, ray.origin, invDir, maxDist))
+        ++stats.boxTests;
+        if (!intersectAABB(node.bounds, ray.origin, invDir, closest.t))
             continue;
+        ++stats.nodesVisited;
 
         if (node.isLeaf())
         {
-            for (uint32_t i = node.leftFirst; i < node.leftFirst + node.triCount; ++i)
-            {
-                float t, u, v;
-                if (intersectTriangle(ray, m_triVerts[i], t, u, v) && t < maxDist)
-                {
-                    const auto& data = m_triData[i];
-
-                    // Back-face culling: back-facing surfaces don't cast shadows.
-                    // Thin glass (3) is also exempt — it needs both faces for correct shadowing.
-                    if (glm::dot(data.geometricNormal, -ray.direction) <= 0.0f &&
-                        data.materialType != 2 && data.materialType != 3)
-                        continue;
-
-                    // Thin glass is transparent to shadow rays
-                    if (data.materialType == 3) continue;
-                    // Alpha clip: transparent surfaces don't occlude
-                    if (data.alphaClip)
-                    {
-                        float w = 1.0f - u - v;
-                        glm::vec2 hitUV = w * data.uv0 + u * data.uv1 + v * data.uv2;
-                        float alpha = (data.alphaTextureIndex >= 0)
-                            ? sampleTexture(data.alphaTextureIndex, hitUV).r
-                            : (data.textureIndex >= 0 ? sampleTexture(data.textureIndex, hitUV).a : 1.0f);
-                        if (alpha < 0.5f)
-                            continue;
-                    }
-                    return true; // occluded
-                }
-            }
+            stats.trianglesTested += node.triCount;
+            intersectLeaf(ray, node.leftFirst, node.triCount, closest);
         }
         else
         {
@@ -788,440 +2183,2140 @@ bool CPURaytracer::traceShadowRay(const Ray& ray, float maxDist) const
         }
     }
 
-    return false;
+    return resolveHit(ray, closest);
 }
 
-// --- Path tracing ---
-
-glm::vec3 CPURaytracer::pathTrace(const Ray& initialRay, RNG& rng,
-                                    glm::vec3* outAlbedo, glm::vec3* outNormal) const
+bool CPURaytracer::traceShadowRay(const Ray& ray, float maxDist) const
 {
-    glm::vec3 radiance(0.0f);
-    glm::vec3 throughput(1.0f);
-    Ray ray = initialRay;
-    float prevBsdfPdf = 0.0f;
-    bool prevWasDelta = false;
-    bool hasLights = !m_lightIndices.empty();
+    if (isInstanced()) return traceShadowRayInstanced(ray, maxDist);
+    if (m_compressedBVH) return traceShadowRayWide(m_cbvh, ray, maxDist);
+#if defined(VEX_BVH_SIMD_X86)
+    if (m_bvhWidth == 8) return traceShadowRayAVX2(ray, maxDist);
+#endif
+    if (m_bvhWidth == 4) return traceShadowRayWide(m_bvh4, ray, maxDist);
 
-    for (int depth = 0; depth < m_maxDepth; ++depth)
+    if (m_bvh.empty())
+        return false;
+
+    const auto* nodes = m_bvh.nodes().data();
+    glm::vec3 invDir = 1.0f / ray.direction;
+
+    if (!intersectAABB(nodes[0].bounds, ray.origin, invDir, maxDist))
+        return false;
+
+    // Nearer child first: occluders close to the origin end the walk sooner
+    uint32_t stack[64];
+    int stackPtr = 0;
+    uint32_t nodeIdx = 0;
+
+    for (;;)
     {
-        // Russian Roulette — terminate low-throughput paths after the first 2 bounces
-        if (m_enableRR && depth >= 2)
+        const auto& node = nodes[nodeIdx];
+
+        if (node.isLeaf())
         {
-            float p = std::min(0.2126f * throughput.r + 0.7152f * throughput.g + 0.0722f * throughput.b, 0.95f);
-            if (rng.next() > p)
-                break;
-            throughput /= p;
+            if (occludedLeaf(ray, node.leftFirst, node.triCount, maxDist))
+                return true;
         }
-
-        HitRecord hit = traceRay(ray);
-
-        if (!hit.hit)
+        else
         {
-            // Sun contribution when ray misses geometry
-            // m_sunColor stores irradiance; radiance of the disk = irradiance / solidAngle
-            if (m_sunEnabled && glm::dot(ray.direction, -m_sunDir) > m_sunCosAngle)
+            uint32_t child[2];
+            float tNear[2];
+            const int entered = orderChildren(nodes, node, ray.origin, invDir, maxDist, child, tNear);
+            if (entered > 0)
             {
-                float sunSolidAngle = 2.0f * PI * (1.0f - m_sunCosAngle);
-                float sunRadiance   = 1.0f / sunSolidAngle;
-                float lightPdf      = 1.0f / sunSolidAngle;
+                if (entered == 2)
+                    stack[stackPtr++] = child[1];
+                nodeIdx = child[0];
+                continue;
+            }
+        }
 
-                if (depth == 0 || !m_enableNEE || prevWasDelta)
-                {
-                    radiance += throughput * m_sunColor * sunRadiance;
-                }
-                else
+        if (stackPtr == 0)
+            break;
+        nodeIdx = stack[--stackPtr];
+    }
+
+    return false;
+}
+
+// --- Two-level traversal ---
+
+// The ray enters instance space unnormalized, so hit distances along it are the
+// same as along the world ray and closest.t can be shared across instances.
+static Ray toInstanceSpace(const glm::mat4& toObject, const Ray& worldRay)
+{
+    Ray ray;
+    ray.origin    = glm::vec3(toObject * glm::vec4(worldRay.origin, 1.0f));
+    ray.direction = glm::mat3(toObject) * worldRay.direction;
+    return ray;
+}
+
+void CPURaytracer::intersectInstance(const InstanceData& inst, const Ray& worldRay, TriangleHit& closest) const
+{
+    const auto& blas = m_blases[inst.mesh];
+    if (blas.bvh.empty())
+        return;
+
+    const Ray ray = toInstanceSpace(inst.toObject, worldRay);
+    const auto* nodes = blas.bvh.nodes().data();
+    glm::vec3 invDir = 1.0f / ray.direction;
+
+    if (intersectAABBNear(nodes[0].bounds, ray.origin, invDir, closest.t) == FLT_MAX)
+        return;
+
+    uint32_t stack[64];
+    float stackNear[64];
+    int stackPtr = 0;
+    uint32_t nodeIdx = 0;
+
+    for (;;)
+    {
+        const auto& node = nodes[nodeIdx];
+
+        if (node.isLeaf())
+        {
+            intersectLeaf(ray, blas.firstTri + node.leftFirst, node.triCount, closest, inst.handedness);
+        }
+        else
+        {
+            uint32_t child[2];
+            float tNear[2];
+            const int entered = orderChildren(nodes, node, ray.origin, invDir, closest.t, child, tNear);
+            if (entered > 0)
+            {
+                if (entered == 2)
                 {
-                    // MIS: BSDF hit the sun disk
-                    float weight = prevBsdfPdf / (prevBsdfPdf + lightPdf);
-                    radiance += throughput * m_sunColor * sunRadiance * weight;
+                    stack[stackPtr] = child[1];
+                    stackNear[stackPtr++] = tNear[1];
                 }
+                nodeIdx = child[0];
+                continue;
             }
+        }
+
+        while (stackPtr > 0 && stackNear[stackPtr - 1] >= closest.t)
+            --stackPtr;
+        if (stackPtr == 0)
+            break;
+        nodeIdx = stack[--stackPtr];
+    }
+}
+
+bool CPURaytracer::occludedInstance(const InstanceData& inst, const Ray& worldRay, float maxDist) const
+{
+    const auto& blas = m_blases[inst.mesh];
+    if (blas.bvh.empty())
+        return false;
+
+    const Ray ray = toInstanceSpace(inst.toObject, worldRay);
+    const auto* nodes = blas.bvh.nodes().data();
+    glm::vec3 invDir = 1.0f / ray.direction;
+
+    if (!intersectAABB(nodes[0].bounds, ray.origin, invDir, maxDist))
+        return false;
+
+    uint32_t stack[64];
+    int stackPtr = 0;
+    uint32_t nodeIdx = 0;
+
+    for (;;)
+    {
+        const auto& node = nodes[nodeIdx];
+
+        if (node.isLeaf())
+        {
+            if (occludedLeaf(ray, blas.firstTri + node.leftFirst, node.triCount, maxDist, inst.handedness))
+                return true;
+        }
+        else
+        {
+            uint32_t child[2];
+            float tNear[2];
+            const int entered = orderChildren(nodes, node, ray.origin, invDir, maxDist, child, tNear);
+            if (entered > 0)
+            {
+                if (entered == 2)
+                    stack[stackPtr++] = child[1];
+                nodeIdx = child[0];
+                continue;
+            }
+        }
+
+        if (stackPtr == 0)
+            break;
+        nodeIdx = stack[--stackPtr];
+    }
+    return false;
+}
 
+HitRecord CPURaytracer::traceRayInstanced(const Ray& ray) const
+{
+    TriangleHit closest;
+
+    if (m_tlas.empty())
+        return {};
+
+    const auto* nodes = m_tlas.nodes().data();
+    const auto& instIndices = m_tlas.indices();
+    glm::vec3 invDir = 1.0f / ray.direction;
+    uint32_t hitInst = UINT32_MAX;
+
+    if (intersectAABBNear(nodes[0].bounds, ray.origin, invDir, closest.t) == FLT_MAX)
+        return {};
+
+    uint32_t stack[64];
+    float stackNear[64];
+    int stackPtr = 0;
+    uint32_t nodeIdx = 0;
+
+    for (;;)
+    {
+        const auto& node = nodes[nodeIdx];
+
+        if (node.isLeaf())
+        {
+            for (uint32_t i = node.leftFirst; i < node.leftFirst + node.triCount; ++i)
+            {
+                const float prevT = closest.t;
+                intersectInstance(m_instances[instIndices[i]], ray, closest);
+                if (closest.t < prevT)
+                    hitInst = instIndices[i];
+            }
+        }
+        else
+        {
+            uint32_t child[2];
+            float tNear[2];
+            const int entered = orderChildren(nodes, node, ray.origin, invDir, closest.t, child, tNear);
+            if (entered > 0)
             {
-                glm::vec3 envContrib = sampleEnvironment(ray.direction);
-                if (depth == 0)
+                if (entered == 2)
                 {
-                    // Background always visible regardless of enableEnvironment toggle
-                    radiance += throughput * envContrib;
+                    stack[stackPtr] = child[1];
+                    stackNear[stackPtr++] = tNear[1];
                 }
-                else if (m_enableEnvironment)
+                nodeIdx = child[0];
+                continue;
+            }
+        }
+
+        while (stackPtr > 0 && stackNear[stackPtr - 1] >= closest.t)
+            --stackPtr;
+        if (stackPtr == 0)
+            break;
+        nodeIdx = stack[--stackPtr];
+    }
+
+    // Triangle attributes are stored in object space; only the winning
+    // instance's frame is needed, so convert once here. The distance is
+    // shared with the world ray, so the position comes straight from it.
+    HitRecord hit = resolveHit(ray, closest);
+    if (hitInst != UINT32_MAX)
+    {
+        const InstanceData& inst = m_instances[hitInst];
+        const glm::vec3 geoN = glm::normalize(inst.normalToWorld * hit.geometricNormal) * inst.handedness;
+        hit.normal          = m_flatShading ? geoN : glm::normalize(inst.normalToWorld * hit.normal);
+        hit.geometricNormal = geoN;
+        hit.tangent         = glm::normalize(glm::mat3(inst.toWorld) * hit.tangent);
+        hit.instanceIndex   = hitInst;
+    }
+
+    return hit;
+}
+
+bool CPURaytracer::traceShadowRayInstanced(const Ray& ray, float maxDist) const
+{
+    if (m_tlas.empty())
+        return false;
+
+    const auto* nodes = m_tlas.nodes().data();
+    const auto& instIndices = m_tlas.indices();
+    glm::vec3 invDir = 1.0f / ray.direction;
+
+    if (!intersectAABB(nodes[0].bounds, ray.origin, invDir, maxDist))
+        return false;
+
+    uint32_t stack[64];
+    int stackPtr = 0;
+    uint32_t nodeIdx = 0;
+
+    for (;;)
+    {
+        const auto& node = nodes[nodeIdx];
+
+        if (node.isLeaf())
+        {
+            for (uint32_t i = node.leftFirst; i < node.leftFirst + node.triCount; ++i)
+            {
+                if (occludedInstance(m_instances[instIndices[i]], ray, maxDist))
+                    return true;
+            }
+        }
+        else
+        {
+            uint32_t child[2];
+            float tNear[2];
+            const int entered = orderChildren(nodes, node, ray.origin, invDir, maxDist, child, tNear);
+            if (entered > 0)
+            {
+                if (entered == 2)
+                    stack[stackPtr++] = child[1];
+                nodeIdx = child[0];
+                continue;
+            }
+        }
+
+        if (stackPtr == 0)
+            break;
+        nodeIdx = stack[--stackPtr];
+    }
+
+    return false;
+}
+
+// --- Wide BVH traversal ---
+
+// Slab test of one ray against all N children of a wide node. Returns a bit
+// mask of the children entered before tMax and writes their entry distances.
+// Same arithmetic as the scalar intersectAABB, one lane per child.
+template <uint32_t N>
+static inline uint32_t intersectWideNode(const WideBVHNode<N>& node, const glm::vec3& origin,
+                                         const glm::vec3& invDir, float tMax, float* tNear)
+{
+    uint32_t mask = 0;
+    for (uint32_t i = 0; i < N; ++i)
+    {
+        float t1 = (node.minX[i] - origin.x) * invDir.x;
+        float t2 = (node.maxX[i] - origin.x) * invDir.x;
+        float tmin = std::min(t1, t2);
+        float tmax = std::max(t1, t2);
+
+        t1 = (node.minY[i] - origin.y) * invDir.y;
+        t2 = (node.maxY[i] - origin.y) * invDir.y;
+        tmin = std::max(tmin, std::min(t1, t2));
+        tmax = std::min(tmax, std::max(t1, t2));
+
+        t1 = (node.minZ[i] - origin.z) * invDir.z;
+        t2 = (node.maxZ[i] - origin.z) * invDir.z;
+        tmin = std::max(tmin, std::min(t1, t2));
+        tmax = std::min(tmax, std::max(t1, t2));
+
+        tNear[i] = std::max(tmin, 0.0f);
+        if (tmax >= tNear[i] && tmin < tMax)
+            mask |= 1u << i;
+    }
+    return mask;
+}
+
+#if defined(VEX_BVH_SIMD_X86)
+template <>
+inline uint32_t intersectWideNode<4>(const WideBVHNode<4>& node, const glm::vec3& origin,
+                                     const glm::vec3& invDir, float tMax, float* tNear)
+{
+    const __m128 ox = _mm_set1_ps(origin.x), oy = _mm_set1_ps(origin.y), oz = _mm_set1_ps(origin.z);
+    const __m128 ix = _mm_set1_ps(invDir.x), iy = _mm_set1_ps(invDir.y), iz = _mm_set1_ps(invDir.z);
+
+    __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.minX), ox), ix);
+    __m128 t2 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.maxX), ox), ix);
+    __m128 tmin = _mm_min_ps(t1, t2);
+    __m128 tmax = _mm_max_ps(t1, t2);
+
+    t1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.minY), oy), iy);
+    t2 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.maxY), oy), iy);
+    tmin = _mm_max_ps(tmin, _mm_min_ps(t1, t2));
+    tmax = _mm_min_ps(tmax, _mm_max_ps(t1, t2));
+
+    t1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.minZ), oz), iz);
+    t2 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.maxZ), oz), iz);
+    tmin = _mm_max_ps(tmin, _mm_min_ps(t1, t2));
+    tmax = _mm_min_ps(tmax, _mm_max_ps(t1, t2));
+
+    const __m128 near = _mm_max_ps(tmin, _mm_setzero_ps());
+    _mm_storeu_ps(tNear, near);
+    const __m128 hit = _mm_and_ps(_mm_cmpge_ps(tmax, near), _mm_cmplt_ps(tmin, _mm_set1_ps(tMax)));
+    return static_cast<uint32_t>(_mm_movemask_ps(hit));
+}
+
+template <>
+VEX_TARGET_AVX2 inline uint32_t intersectWideNode<8>(const WideBVHNode<8>& node, const glm::vec3& origin,
+                                                     const glm::vec3& invDir, float tMax, float* tNear)
+{
+    const __m256 ox = _mm256_set1_ps(origin.x), oy = _mm256_set1_ps(origin.y), oz = _mm256_set1_ps(origin.z);
+    const __m256 ix = _mm256_set1_ps(invDir.x), iy = _mm256_set1_ps(invDir.y), iz = _mm256_set1_ps(invDir.z);
+
+    __m256 t1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.minX), ox), ix);
+    __m256 t2 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.maxX), ox), ix);
+    __m256 tmin = _mm256_min_ps(t1, t2);
+    __m256 tmax = _mm256_max_ps(t1, t2);
+
+    t1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.minY), oy), iy);
+    t2 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.maxY), oy), iy);
+    tmin = _mm256_max_ps(tmin, _mm256_min_ps(t1, t2));
+    tmax = _mm256_min_ps(tmax, _mm256_max_ps(t1, t2));
+
+    t1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.minZ), oz), iz);
+    t2 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.maxZ), oz), iz);
+    tmin = _mm256_max_ps(tmin, _mm256_min_ps(t1, t2));
+    tmax = _mm256_min_ps(tmax, _mm256_max_ps(t1, t2));
+
+    const __m256 near = _mm256_max_ps(tmin, _mm256_setzero_ps());
+    _mm256_storeu_ps(tNear, near);
+    const __m256 hit = _mm256_and_ps(_mm256_cmp_ps(tmax, near, _CMP_GE_OQ),
+                                     _mm256_cmp_ps(tmin, _mm256_set1_ps(tMax), _CMP_LT_OQ));
+    return static_cast<uint32_t>(_mm256_movemask_ps(hit));
+}
+#endif
+
+// Same test against the dequantized child boxes of a compressed node. Unused
+// slots decode to a point at the origin, so they are masked out explicitly.
+#if defined(VEX_BVH_SIMD_X86)
+static inline __m128 dequantize(const uint8_t* q, __m128 origin, __m128 scale)
+{
+    int32_t packed;
+    std::memcpy(&packed, q, sizeof(packed));
+    const __m128i zero = _mm_setzero_si128();
+    __m128i v = _mm_unpacklo_epi8(_mm_cvtsi32_si128(packed), zero);
+    v = _mm_unpacklo_epi16(v, zero);
+    return _mm_add_ps(origin, _mm_mul_ps(_mm_cvtepi32_ps(v), scale));
+}
+
+static inline uint32_t intersectWideNode(const CompressedBVHNode& node, const glm::vec3& origin,
+                                         const glm::vec3& invDir, float tMax, float* tNear)
+{
+    const __m128 ox = _mm_set1_ps(origin.x), oy = _mm_set1_ps(origin.y), oz = _mm_set1_ps(origin.z);
+    const __m128 ix = _mm_set1_ps(invDir.x), iy = _mm_set1_ps(invDir.y), iz = _mm_set1_ps(invDir.z);
+    const __m128 bx = _mm_set1_ps(node.origin[0]), by = _mm_set1_ps(node.origin[1]), bz = _mm_set1_ps(node.origin[2]);
+    const __m128 sx = _mm_set1_ps(node.scale(0)), sy = _mm_set1_ps(node.scale(1)), sz = _mm_set1_ps(node.scale(2));
+
+    __m128 t1 = _mm_mul_ps(_mm_sub_ps(dequantize(node.qloX, bx, sx), ox), ix);
+    __m128 t2 = _mm_mul_ps(_mm_sub_ps(dequantize(node.qhiX, bx, sx), ox), ix);
+    __m128 tmin = _mm_min_ps(t1, t2);
+    __m128 tmax = _mm_max_ps(t1, t2);
+
+    t1 = _mm_mul_ps(_mm_sub_ps(dequantize(node.qloY, by, sy), oy), iy);
+    t2 = _mm_mul_ps(_mm_sub_ps(dequantize(node.qhiY, by, sy), oy), iy);
+    tmin = _mm_max_ps(tmin, _mm_min_ps(t1, t2));
+    tmax = _mm_min_ps(tmax, _mm_max_ps(t1, t2));
+
+    t1 = _mm_mul_ps(_mm_sub_ps(dequantize(node.qloZ, bz, sz), oz), iz);
+    t2 = _mm_mul_ps(_mm_sub_ps(dequantize(node.qhiZ, bz, sz), oz), iz);
+    tmin = _mm_max_ps(tmin, _mm_min_ps(t1, t2));
+    tmax = _mm_min_ps(tmax, _mm_max_ps(t1, t2));
+
+    const __m128 near = _mm_max_ps(tmin, _mm_setzero_ps());
+    _mm_storeu_ps(tNear, near);
+    const __m128 hit = _mm_and_ps(_mm_cmpge_ps(tmax, near), _mm_cmplt_ps(tmin, _mm_set1_ps(tMax)));
+    return static_cast<uint32_t>(_mm_movemask_ps(hit)) & node.childMask;
+}
+#else
+static inline uint32_t intersectWideNode(const CompressedBVHNode& node, const glm::vec3& origin,
+                                         const glm::vec3& invDir, float tMax, float* tNear)
+{
+    uint32_t mask = 0;
+    for (uint32_t i = 0; i < CompressedBVHNode::WIDTH; ++i)
+    {
+        if (!(node.childMask & (1u << i)))
+            continue;
+        const AABB box = node.childBounds(i);
+        float t1 = (box.min.x - origin.x) * invDir.x;
+        float t2 = (box.max.x - origin.x) * invDir.x;
+        float tmin = std::min(t1, t2);
+        float tmax = std::max(t1, t2);
+
+        t1 = (box.min.y - origin.y) * invDir.y;
+        t2 = (box.max.y - origin.y) * invDir.y;
+        tmin = std::max(tmin, std::min(t1, t2));
+        tmax = std::min(tmax, std::max(t1, t2));
+
+        t1 = (box.min.z - origin.z) * invDir.z;
+        t2 = (box.max.z - origin.z) * invDir.z;
+        tmin = std::max(tmin, std::min(t1, t2));
+        tmax = std::min(tmax, std::max(t1, t2));
+
+        tNear[i] = std::max(tmin, 0.0f);
+        if (tmax >= tNear[i] && tmin < tMax)
+            mask |= 1u << i;
+    }
+    return mask;
+}
+#endif
+
+// Front-to-back traversal of a wide BVH. Children that are hit are pushed
+// far-to-near so the nearest is popped first, and popped entries farther than
+// the current tMax are skipped. leaf(first, count, tMax) processes a leaf,
+// may lower tMax, and returns false to stop traversal (any-hit queries).
+// Works on WideBVH<N> and CompressedBVH alike.
+template <typename WideBVHT, typename LeafFn>
+static inline void traverseWide(const WideBVHT& bvh, const Ray& ray, float tMax, LeafFn&& leaf)
+{
+    if (bvh.empty())
+        return;
+
+    constexpr uint32_t N = WideBVHT::Node::WIDTH;
+
+    struct Entry
+    {
+        uint32_t child;
+        uint32_t triCount; // >0 = leaf
+        float    tNear;
+    };
+
+    const auto& nodes = bvh.nodes();
+    const glm::vec3 invDir = 1.0f / ray.direction;
+
+    // Each internal pop pushes at most N entries and replaces one, so the
+    // stack stays below 64 levels * (N - 1) + 1 entries.
+    Entry stack[64 * (N - 1) + 1];
+    int stackPtr = 0;
+    stack[stackPtr++] = { 0, 0, 0.0f };
+
+    while (stackPtr > 0)
+    {
+        const Entry entry = stack[--stackPtr];
+        if (entry.tNear >= tMax)
+            continue;
+
+        if (entry.triCount > 0)
+        {
+            if (!leaf(entry.child, entry.triCount, tMax))
+                return;
+            continue;
+        }
+
+        const auto& node = nodes[entry.child];
+        alignas(32) float tNear[N];
+        uint32_t mask = intersectWideNode(node, ray.origin, invDir, tMax, tNear);
+
+        // Insertion-sort the hit children by entry distance (at most N)
+        Entry hits[N];
+        uint32_t hitCount = 0;
+        while (mask)
+        {
+            const uint32_t lane = static_cast<uint32_t>(std::countr_zero(mask));
+            mask &= mask - 1;
+            Entry e = { node.child[lane], node.triCount[lane], tNear[lane] };
+            uint32_t j = hitCount++;
+            while (j > 0 && hits[j - 1].tNear > e.tNear)
+            {
+                hits[j] = hits[j - 1];
+                --j;
+            }
+            hits[j] = e;
+        }
+
+        for (uint32_t i = hitCount; i > 0; --i)
+            stack[stackPtr++] = hits[i - 1];
+    }
+}
+
+template <typename WideBVHT>
+TriangleHit CPURaytracer::traceRayWide(const WideBVHT& bvh, const Ray& ray) const
+{
+    TriangleHit closest;
+    traverseWide(bvh, ray, closest.t, [&](uint32_t first, uint32_t count, float& tMax)
+    {
+        intersectLeaf(ray, first, count, closest);
+        tMax = closest.t;
+        return true;
+    });
+    return closest;
+}
+
+template <typename WideBVHT>
+bool CPURaytracer::traceShadowRayWide(const WideBVHT& bvh, const Ray& ray, float maxDist) const
+{
+    bool occluded = false;
+    traverseWide(bvh, ray, maxDist, [&](uint32_t first, uint32_t count, float& tMax)
+    {
+        occluded = occludedLeaf(ray, first, count, tMax);
+        return !occluded;
+    });
+    return occluded;
+}
+
+#if defined(VEX_BVH_SIMD_X86)
+VEX_TARGET_AVX2_FLATTEN TriangleHit CPURaytracer::traceRayAVX2(const Ray& ray) const
+{
+    return traceRayWide(m_bvh8, ray);
+}
+
+VEX_TARGET_AVX2_FLATTEN bool CPURaytracer::traceShadowRayAVX2(const Ray& ray, float maxDist) const
+{
+    return traceShadowRayWide(m_bvh8, ray, maxDist);
+}
+#endif
+
+// --- Packet traversal ---
+
+struct CPURaytracer::RayPacket
+{
+    alignas(32) float ox[PACKET_SIZE], oy[PACKET_SIZE], oz[PACKET_SIZE];
+    alignas(32) float dx[PACKET_SIZE], dy[PACKET_SIZE], dz[PACKET_SIZE];
+    alignas(32) float ix[PACKET_SIZE], iy[PACKET_SIZE], iz[PACKET_SIZE];
+    alignas(32) float tMax[PACKET_SIZE];
+    uint32_t activeMask = 0;
+
+    // Interval bounds over all lanes, valid when every direction component
+    // keeps its sign across the packet (always true for a small pixel tile
+    // unless it straddles an axis)
+    bool coherent = false;
+    glm::vec3 oMin, oMax, iMin, iMax;
+};
+
+// Same arithmetic as the scalar intersectAABBNear, one lane per ray. Writes
+// each lane's entry distance (FLT_MAX = miss), returns the lanes of mask that
+// hit and their nearest entry distance in first.
+#if defined(VEX_BVH_SIMD_X86)
+uint32_t CPURaytracer::intersectPacketAABB(const RayPacket& p, const AABB& box, uint32_t mask,
+                                           float* tNear, float& first)
+{
+    const __m128 minX = _mm_set1_ps(box.min.x), minY = _mm_set1_ps(box.min.y), minZ = _mm_set1_ps(box.min.z);
+    const __m128 maxX = _mm_set1_ps(box.max.x), maxY = _mm_set1_ps(box.max.y), maxZ = _mm_set1_ps(box.max.z);
+    const __m128 miss = _mm_set1_ps(FLT_MAX);
+    const __m128i laneBits = _mm_setr_epi32(1, 2, 4, 8);
+
+    __m128 nearest = miss;
+    uint32_t hits = 0;
+    for (uint32_t g = 0; g < PACKET_SIZE; g += 4)
+    {
+        const __m128 ox = _mm_load_ps(p.ox + g), oy = _mm_load_ps(p.oy + g), oz = _mm_load_ps(p.oz + g);
+        const __m128 ix = _mm_load_ps(p.ix + g), iy = _mm_load_ps(p.iy + g), iz = _mm_load_ps(p.iz + g);
+
+        __m128 t1 = _mm_mul_ps(_mm_sub_ps(minX, ox), ix);
+        __m128 t2 = _mm_mul_ps(_mm_sub_ps(maxX, ox), ix);
+        __m128 tmin = _mm_min_ps(t1, t2);
+        __m128 tmax = _mm_max_ps(t1, t2);
+
+        t1 = _mm_mul_ps(_mm_sub_ps(minY, oy), iy);
+        t2 = _mm_mul_ps(_mm_sub_ps(maxY, oy), iy);
+        tmin = _mm_max_ps(tmin, _mm_min_ps(t1, t2));
+        tmax = _mm_min_ps(tmax, _mm_max_ps(t1, t2));
+
+        t1 = _mm_mul_ps(_mm_sub_ps(minZ, oz), iz);
+        t2 = _mm_mul_ps(_mm_sub_ps(maxZ, oz), iz);
+        tmin = _mm_max_ps(tmin, _mm_min_ps(t1, t2));
+        tmax = _mm_min_ps(tmax, _mm_max_ps(t1, t2));
+
+        const __m128 active = _mm_castsi128_ps(_mm_cmpeq_epi32(
+            _mm_and_si128(_mm_set1_epi32(static_cast<int>(mask >> g)), laneBits), laneBits));
+        const __m128 near = _mm_max_ps(tmin, _mm_setzero_ps());
+        __m128 hit = _mm_and_ps(_mm_cmpge_ps(tmax, near), _mm_cmplt_ps(tmin, _mm_load_ps(p.tMax + g)));
+        hit = _mm_and_ps(hit, active);
+
+        const __m128 laneNear = _mm_or_ps(_mm_and_ps(hit, near), _mm_andnot_ps(hit, miss));
+        _mm_storeu_ps(tNear + g, laneNear);
+        nearest = _mm_min_ps(nearest, laneNear);
+        hits |= static_cast<uint32_t>(_mm_movemask_ps(hit)) << g;
+    }
+
+    nearest = _mm_min_ps(nearest, _mm_shuffle_ps(nearest, nearest, _MM_SHUFFLE(2, 3, 0, 1)));
+    nearest = _mm_min_ps(nearest, _mm_shuffle_ps(nearest, nearest, _MM_SHUFFLE(1, 0, 3, 2)));
+    first = _mm_cvtss_f32(nearest);
+    return hits;
+}
+#else
+uint32_t CPURaytracer::intersectPacketAABB(const RayPacket& p, const AABB& box, uint32_t mask,
+                                           float* tNear, float& first)
+{
+    uint32_t hits = 0;
+    first = FLT_MAX;
+    for (uint32_t i = 0; i < PACKET_SIZE; ++i)
+    {
+        const glm::vec3 origin(p.ox[i], p.oy[i], p.oz[i]);
+        const glm::vec3 invDir(p.ix[i], p.iy[i], p.iz[i]);
+        tNear[i] = (mask & (1u << i)) ? intersectAABBNear(box, origin, invDir, p.tMax[i]) : FLT_MAX;
+        hits |= static_cast<uint32_t>(tNear[i] < FLT_MAX) << i;
+        first = std::min(first, tNear[i]);
+    }
+    return hits;
+}
+#endif
+
+// Interval arithmetic over the packet's origins and inverse directions: a
+// lower bound on every lane's entry distance and an upper bound on every
+// exit. If they do not overlap, no lane can hit the box. Rounding is
+// monotonic, so the bounds hold exactly for the per-lane arithmetic above.
+bool CPURaytracer::packetMissesAABB(const RayPacket& p, const AABB& box)
+{
+    float enter = 0.0f;
+    float exit = FLT_MAX;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        const float lo = box.min[axis], hi = box.max[axis];
+        const float oMin = p.oMin[axis], oMax = p.oMax[axis];
+        const float iMin = p.iMin[axis], iMax = p.iMax[axis];
+        if (iMin > 0.0f)
+        {
+            const float a = lo - oMax, b = hi - oMin;
+            enter = std::max(enter, a * (a >= 0.0f ? iMin : iMax));
+            exit  = std::min(exit,  b * (b >= 0.0f ? iMax : iMin));
+        }
+        else
+        {
+            const float a = hi - oMin, b = lo - oMax;
+            enter = std::max(enter, a * (a >= 0.0f ? iMin : iMax));
+            exit  = std::min(exit,  b * (b <= 0.0f ? iMin : iMax));
+        }
+    }
+    return enter > exit;
+}
+
+// Möller–Trumbore across the lanes, with the same operation order as
+// intersectTriangle so each lane computes the same distance as a single ray
+void CPURaytracer::intersectLeafPacket(RayPacket& p, uint32_t mask, uint32_t first, uint32_t count,
+                                       const Ray* rays, TriangleHit* hits) const
+{
+    for (uint32_t tri = first; tri < first + count; ++tri)
+    {
+        const TriVerts& verts = m_triVerts[tri];
+        const glm::vec3 edge1 = verts.v1 - verts.v0;
+        const glm::vec3 edge2 = verts.v2 - verts.v0;
+
+        alignas(32) float tHit[PACKET_SIZE], uHit[PACKET_SIZE], vHit[PACKET_SIZE];
+        uint32_t candidates = 0;
+#if defined(VEX_BVH_SIMD_X86)
+        const __m128 e1x = _mm_set1_ps(edge1.x), e1y = _mm_set1_ps(edge1.y), e1z = _mm_set1_ps(edge1.z);
+        const __m128 e2x = _mm_set1_ps(edge2.x), e2y = _mm_set1_ps(edge2.y), e2z = _mm_set1_ps(edge2.z);
+        const __m128 v0x = _mm_set1_ps(verts.v0.x), v0y = _mm_set1_ps(verts.v0.y), v0z = _mm_set1_ps(verts.v0.z);
+        for (uint32_t g = 0; g < PACKET_SIZE; g += 4)
+        {
+            const __m128 dx = _mm_load_ps(p.dx + g), dy = _mm_load_ps(p.dy + g), dz = _mm_load_ps(p.dz + g);
+
+            // h = cross(d, edge2), a = dot(edge1, h)
+            const __m128 hx = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(e2y, dz));
+            const __m128 hy = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(e2z, dx));
+            const __m128 hz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(e2x, dy));
+            const __m128 a = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, hx), _mm_mul_ps(e1y, hy)), _mm_mul_ps(e1z, hz));
+
+            const __m128 f = _mm_div_ps(_mm_set1_ps(1.0f), a);
+            const __m128 sx = _mm_sub_ps(_mm_load_ps(p.ox + g), v0x);
+            const __m128 sy = _mm_sub_ps(_mm_load_ps(p.oy + g), v0y);
+            const __m128 sz = _mm_sub_ps(_mm_load_ps(p.oz + g), v0z);
+            const __m128 u = _mm_mul_ps(f, _mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, hx), _mm_mul_ps(sy, hy)), _mm_mul_ps(sz, hz)));
+
+            // q = cross(s, edge1)
+            const __m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(e1y, sz));
+            const __m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(e1z, sx));
+            const __m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(e1x, sy));
+            const __m128 v = _mm_mul_ps(f, _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)));
+            const __m128 t = _mm_mul_ps(f, _mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)));
+
+            const __m128 parallel = _mm_and_ps(_mm_cmpgt_ps(a, _mm_set1_ps(-1e-9f)), _mm_cmplt_ps(a, _mm_set1_ps(1e-9f)));
+            __m128 hit = _mm_andnot_ps(parallel, _mm_cmpge_ps(u, _mm_set1_ps(-1e-5f)));
+            hit = _mm_and_ps(hit, _mm_cmple_ps(u, _mm_set1_ps(1.0f + 1e-5f)));
+            hit = _mm_and_ps(hit, _mm_cmpge_ps(v, _mm_set1_ps(-1e-5f)));
+            hit = _mm_and_ps(hit, _mm_cmple_ps(_mm_add_ps(u, v), _mm_set1_ps(1.0f + 1e-5f)));
+            hit = _mm_and_ps(hit, _mm_cmpgt_ps(t, _mm_set1_ps(1e-7f)));
+            hit = _mm_and_ps(hit, _mm_cmplt_ps(t, _mm_load_ps(p.tMax + g)));
+
+            _mm_store_ps(tHit + g, t);
+            _mm_store_ps(uHit + g, u);
+            _mm_store_ps(vHit + g, v);
+            candidates |= static_cast<uint32_t>(_mm_movemask_ps(hit)) << g;
+        }
+#else
+        for (uint32_t i = 0; i < PACKET_SIZE; ++i)
+        {
+            const Ray ray{ glm::vec3(p.ox[i], p.oy[i], p.oz[i]), glm::vec3(p.dx[i], p.dy[i], p.dz[i]) };
+            if (intersectTriangle(ray, verts, tHit[i], uHit[i], vHit[i]) && tHit[i] < p.tMax[i])
+                candidates |= 1u << i;
+        }
+#endif
+
+        candidates &= mask;
+        while (candidates)
+        {
+            const uint32_t lane = static_cast<uint32_t>(std::countr_zero(candidates));
+            candidates &= candidates - 1;
+            acceptHit(rays[lane], tri, tHit[lane], uHit[lane], vHit[lane], 1.0f, hits[lane]);
+            p.tMax[lane] = hits[lane].t;
+        }
+    }
+}
+
+void CPURaytracer::tracePacket(RayPacket& p, const Ray* rays, TriangleHit* hits) const
+{
+    // A far child waits with the lanes that entered it and their distances
+    struct Entry
+    {
+        uint32_t node;
+        uint32_t mask;
+        float    tNear[PACKET_SIZE];
+    };
+
+    const auto* nodes = m_bvh.nodes().data();
+    alignas(32) float tNear[2][PACKET_SIZE];
+
+    float first[2];
+    uint32_t mask = intersectPacketAABB(p, nodes[0].bounds, p.activeMask, tNear[0], first[0]);
+    if (!mask)
+        return;
+
+    Entry stack[64];
+    int stackPtr = 0;
+    uint32_t nodeIdx = 0;
+
+    for (;;)
+    {
+        const auto& node = nodes[nodeIdx];
+
+        if (node.isLeaf())
+        {
+            intersectLeafPacket(p, mask, node.leftFirst, node.triCount, rays, hits);
+        }
+        else
+        {
+            uint32_t childMask[2];
+            for (uint32_t c = 0; c < 2; ++c)
+            {
+                const AABB& box = nodes[node.leftFirst + c].bounds;
+                childMask[c] = 0;
+                first[c] = FLT_MAX;
+                if (!p.coherent || !packetMissesAABB(p, box))
+                    childMask[c] = intersectPacketAABB(p, box, mask, tNear[c], first[c]);
+            }
+
+            if (childMask[0] | childMask[1])
+            {
+                // Enter first the child the packet reaches first
+                const uint32_t nearC = first[1] < first[0] ? 1u : 0u;
+                const uint32_t farC = nearC ^ 1u;
+                if (childMask[nearC] && childMask[farC])
                 {
-                    glm::vec3 scaledEnv = envContrib * m_envLightMultiplier;
-                    bool hasEnvCDF = m_hasEnvMap && m_envTotalIntegral > 0.0f;
-                    if (m_enableNEE && !prevWasDelta && hasEnvCDF)
-                    {
-                        float ePdf = envMapPdf(ray.direction);
-                        if (ePdf > 1e-8f)
-                            scaledEnv *= prevBsdfPdf / (prevBsdfPdf + ePdf);
-                    }
-                    radiance += throughput * scaledEnv;
+                    Entry& e = stack[stackPtr++];
+                    e.node = node.leftFirst + farC;
+                    e.mask = childMask[farC];
+                    std::copy(tNear[farC], tNear[farC] + PACKET_SIZE, e.tNear);
                 }
+                nodeIdx = node.leftFirst + (childMask[nearC] ? nearC : farC);
+                mask = childMask[nearC] ? childMask[nearC] : childMask[farC];
+                continue;
             }
+        }
+
+        // Resume at the most recent far child some lane can still improve on
+        mask = 0;
+        while (stackPtr > 0 && !mask)
+        {
+            const Entry& e = stack[--stackPtr];
+            for (uint32_t m = e.mask; m; m &= m - 1)
+            {
+                const uint32_t lane = static_cast<uint32_t>(std::countr_zero(m));
+                if (e.tNear[lane] < p.tMax[lane])
+                    mask |= 1u << lane;
+            }
+            nodeIdx = e.node;
+        }
+        if (!mask)
             break;
+    }
+}
+
+void CPURaytracer::traceRayPacket(const Ray* rays, uint32_t count, HitRecord* hits) const
+{
+    for (uint32_t i = 0; i < count; ++i)
+        hits[i] = HitRecord();
+
+    if (isInstanced())
+    {
+        for (uint32_t i = 0; i < count; ++i)
+            hits[i] = traceRay(rays[i]);
+        return;
+    }
+    if (m_bvh.empty())
+        return;
+
+    for (uint32_t base = 0; base < count; base += PACKET_SIZE)
+    {
+        const uint32_t n = std::min(PACKET_SIZE, count - base);
+        const Ray* r = rays + base;
+
+        // Unused lanes repeat the first ray and stay out of the active mask
+        RayPacket p;
+        p.activeMask = (1u << n) - 1u;
+        for (uint32_t i = 0; i < PACKET_SIZE; ++i)
+        {
+            const Ray& ray = r[i < n ? i : 0];
+            p.ox[i] = ray.origin.x;    p.oy[i] = ray.origin.y;    p.oz[i] = ray.origin.z;
+            p.dx[i] = ray.direction.x; p.dy[i] = ray.direction.y; p.dz[i] = ray.direction.z;
+            p.ix[i] = 1.0f / ray.direction.x;
+            p.iy[i] = 1.0f / ray.direction.y;
+            p.iz[i] = 1.0f / ray.direction.z;
+            p.tMax[i] = FLT_MAX;
+        }
+
+        const float* lanes[2][3] = { { p.ox, p.oy, p.oz }, { p.ix, p.iy, p.iz } };
+        glm::vec3* bounds[2][2] = { { &p.oMin, &p.oMax }, { &p.iMin, &p.iMax } };
+        for (int k = 0; k < 2; ++k)
+        {
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                const auto [lo, hi] = std::minmax_element(lanes[k][axis], lanes[k][axis] + PACKET_SIZE);
+                (*bounds[k][0])[axis] = *lo;
+                (*bounds[k][1])[axis] = *hi;
+            }
+        }
+        p.coherent = true;
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            if (!std::isfinite(p.iMin[axis]) || !std::isfinite(p.iMax[axis]) ||
+                (p.iMin[axis] < 0.0f && p.iMax[axis] > 0.0f))
+                p.coherent = false;
         }
 
-        // Determine front/back face
-        bool frontFace = glm::dot(hit.geometricNormal, -ray.direction) > 0.0f;
+        TriangleHit nearest[PACKET_SIZE];
+        tracePacket(p, r, nearest);
+        for (uint32_t i = 0; i < n; ++i)
+            hits[base + i] = resolveHit(r[i], nearest[i]);
+    }
+}
+
+// --- Stream traversal ---
+
+// Walks the binary BVH once for a whole stream of rays. A node carries the ids
+// of the rays that entered it, with their entry distances, in a shared arena;
+// they are filtered against both children, so each node is fetched once per
+// stream rather than once per ray. Entries are popped in LIFO order, so the
+// arena above a popped entry belongs to finished subtrees and is reused.
+// tMax(id) is a ray's initial limit; leaf(id, first, count) tests a leaf and
+// returns the ray's new limit (its closest hit, or -FLT_MAX to retire it).
+template <typename TMaxFn, typename LeafFn>
+static void traverseStream(const BVH::Node* nodes, const Ray* rays, uint32_t count,
+                           TMaxFn&& tMax, LeafFn&& leaf)
+{
+    struct Entry { uint32_t node, begin, end; };
+
+    // Ray data in SoA so the filter below can gather four rays per step
+    std::vector<float> ox(count), oy(count), oz(count), ix(count), iy(count), iz(count), limit(count);
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        ox[i] = rays[i].origin.x;
+        oy[i] = rays[i].origin.y;
+        oz[i] = rays[i].origin.z;
+        ix[i] = 1.0f / rays[i].direction.x;
+        iy[i] = 1.0f / rays[i].direction.y;
+        iz[i] = 1.0f / rays[i].direction.z;
+        limit[i] = tMax(i);
+    }
+
+    std::vector<uint32_t> ids;
+    std::vector<float> tNear;
+    ids.reserve(count * 2);
+    tNear.reserve(count * 2);
 
-        // Opaque back-face hit — mesh has inverted normals (e.g. CAD export with outward-facing
-        // inner surfaces). Bouncing from here with offsetNormal = -Ng sends the ray toward the
-        // arch interior where it oscillates forever. Pass through instead: advance the origin
-        // past the surface and keep the same direction. Dielectrics are exempt because they
-        // legitimately need back-face handling for refraction.
-        if (!frontFace && hit.materialType != 2 && hit.materialType != 3) // 2=Dielectric 3=ThinGlass
+    // Appends the rays of ids[begin, end) that enter box before their limit.
+    // A ray whose limit dropped to its parent's entry distance or below (a
+    // closer hit found after the parent was pushed) is dropped as well.
+    auto filter = [&](const AABB& box, uint32_t begin, uint32_t end)
+    {
+        uint32_t k = begin;
+#if defined(VEX_BVH_SIMD_X86)
+        const __m128 minX = _mm_set1_ps(box.min.x), minY = _mm_set1_ps(box.min.y), minZ = _mm_set1_ps(box.min.z);
+        const __m128 maxX = _mm_set1_ps(box.max.x), maxY = _mm_set1_ps(box.max.y), maxZ = _mm_set1_ps(box.max.z);
+        for (; k + 4 <= end; k += 4)
         {
-            ray.origin = hit.position + ray.direction * m_rayEps;
+            const uint32_t a = ids[k], b = ids[k + 1], c = ids[k + 2], d = ids[k + 3];
+            const __m128 rayLimit = _mm_setr_ps(limit[a], limit[b], limit[c], limit[d]);
+
+            __m128 ro = _mm_setr_ps(ox[a], ox[b], ox[c], ox[d]);
+            __m128 ri = _mm_setr_ps(ix[a], ix[b], ix[c], ix[d]);
+            __m128 t1 = _mm_mul_ps(_mm_sub_ps(minX, ro), ri);
+            __m128 t2 = _mm_mul_ps(_mm_sub_ps(maxX, ro), ri);
+            __m128 tmin = _mm_min_ps(t1, t2);
+            __m128 tmax = _mm_max_ps(t1, t2);
+
+            ro = _mm_setr_ps(oy[a], oy[b], oy[c], oy[d]);
+            ri = _mm_setr_ps(iy[a], iy[b], iy[c], iy[d]);
+            t1 = _mm_mul_ps(_mm_sub_ps(minY, ro), ri);
+            t2 = _mm_mul_ps(_mm_sub_ps(maxY, ro), ri);
+            tmin = _mm_max_ps(tmin, _mm_min_ps(t1, t2));
+            tmax = _mm_min_ps(tmax, _mm_max_ps(t1, t2));
+
+            ro = _mm_setr_ps(oz[a], oz[b], oz[c], oz[d]);
+            ri = _mm_setr_ps(iz[a], iz[b], iz[c], iz[d]);
+            t1 = _mm_mul_ps(_mm_sub_ps(minZ, ro), ri);
+            t2 = _mm_mul_ps(_mm_sub_ps(maxZ, ro), ri);
+            tmin = _mm_max_ps(tmin, _mm_min_ps(t1, t2));
+            tmax = _mm_min_ps(tmax, _mm_max_ps(t1, t2));
+
+            const __m128 enter = _mm_max_ps(tmin, _mm_setzero_ps());
+            __m128 hit = _mm_and_ps(_mm_cmpge_ps(tmax, enter), _mm_cmplt_ps(tmin, rayLimit));
+            hit = _mm_and_ps(hit, _mm_cmplt_ps(_mm_loadu_ps(&tNear[k]), rayLimit));
+
+            uint32_t mask = static_cast<uint32_t>(_mm_movemask_ps(hit));
+            if (mask == 0)
+                continue;
+            alignas(16) float laneEnter[4];
+            _mm_store_ps(laneEnter, enter);
+            while (mask)
+            {
+                const uint32_t lane = static_cast<uint32_t>(std::countr_zero(mask));
+                mask &= mask - 1;
+                const uint32_t id = ids[k + lane];
+                ids.push_back(id);
+                tNear.push_back(laneEnter[lane]);
+            }
+        }
+#endif
+        for (; k < end; ++k)
+        {
+            const uint32_t id = ids[k];
+            if (tNear[k] >= limit[id])
+                continue;
+            const float t = intersectAABBNear(box, glm::vec3(ox[id], oy[id], oz[id]),
+                                              glm::vec3(ix[id], iy[id], iz[id]), limit[id]);
+            if (t < FLT_MAX)
+            {
+                ids.push_back(id);
+                tNear.push_back(t);
+            }
+        }
+    };
+
+    // The root's rays start out with an entry distance of -FLT_MAX, which
+    // never drops them
+    ids.resize(count);
+    tNear.assign(count, -FLT_MAX);
+    for (uint32_t i = 0; i < count; ++i)
+        ids[i] = i;
+    filter(nodes[0].bounds, 0, count);
+    if (ids.size() == count)
+        return;
+
+    Entry stack[64];
+    int stackPtr = 0;
+    stack[stackPtr++] = { 0, count, static_cast<uint32_t>(ids.size()) };
+
+    while (stackPtr > 0)
+    {
+        const Entry entry = stack[--stackPtr];
+        ids.resize(entry.end);
+        tNear.resize(entry.end);
+        const auto& node = nodes[entry.node];
+
+        if (node.isLeaf())
+        {
+            for (uint32_t k = entry.begin; k < entry.end; ++k)
+            {
+                const uint32_t id = ids[k];
+                if (tNear[k] < limit[id])
+                    limit[id] = leaf(id, node.leftFirst, node.triCount);
+            }
             continue;
         }
 
-        // Ray origin offsets must follow the geometric normal, not the shading normal.
-        // After normal mapping the shading normal can be nearly tangent to the surface,
-        // so hit.normal * eps barely moves the origin away from the actual surface —
-        // no amount of EPS increase helps. The geometric normal always points cleanly
-        // away from the real surface, so it is the correct offset direction.
-        const glm::vec3 offsetNormal = frontFace ? hit.geometricNormal : -hit.geometricNormal;
+        // One visit order for the whole stream, from its first ray: the child
+        // whose centre lies further along that ray is the far one
+        uint32_t nearChild = node.leftFirst;
+        uint32_t farChild  = node.leftFirst + 1;
+        const glm::vec3 between = nodes[farChild].bounds.centroid() - nodes[nearChild].bounds.centroid();
+        if (glm::dot(between, rays[ids[entry.begin]].direction) < 0.0f)
+            std::swap(nearChild, farChild);
+
+        // The far child's rays go into the arena first so the near child's are on top
+        for (const uint32_t child : { farChild, nearChild })
+        {
+            const uint32_t begin = static_cast<uint32_t>(ids.size());
+            filter(nodes[child].bounds, entry.begin, entry.end);
+            if (ids.size() > begin)
+                stack[stackPtr++] = { child, begin, static_cast<uint32_t>(ids.size()) };
+        }
+    }
+}
+
+void CPURaytracer::traceRayStream(const Ray* rays, uint32_t count, HitRecord* hits) const
+{
+    if (isInstanced())
+    {
+        for (uint32_t i = 0; i < count; ++i)
+            hits[i] = traceRay(rays[i]);
+        return;
+    }
+
+    std::fill(hits, hits + count, HitRecord{});
+    if (m_bvh.empty() || count == 0)
+        return;
+
+    std::vector<TriangleHit> nearest(count);
+    traverseStream(m_bvh.nodes().data(), rays, count,
+                   [](uint32_t) { return FLT_MAX; },
+                   [&](uint32_t id, uint32_t first, uint32_t triCount)
+                   {
+                       intersectLeaf(rays[id], first, triCount, nearest[id]);
+                       return nearest[id].t;
+                   });
+    for (uint32_t i = 0; i < count; ++i)
+        hits[i] = resolveHit(rays[i], nearest[i]);
+}
+
+void CPURaytracer::occludedStream(const Ray* rays, const float* maxDist, uint32_t count, uint8_t* occluded) const
+{
+    if (isInstanced())
+    {
+        for (uint32_t i = 0; i < count; ++i)
+            occluded[i] = traceShadowRay(rays[i], maxDist[i]) ? 1 : 0;
+        return;
+    }
+
+    std::fill(occluded, occluded + count, uint8_t(0));
+    if (m_bvh.empty() || count == 0)
+        return;
+
+    traverseStream(m_bvh.nodes().data(), rays, count,
+                   [&](uint32_t id) { return maxDist[id]; },
+                   [&](uint32_t id, uint32_t first, uint32_t triCount)
+                   {
+                       if (!occludedLeaf(rays[id], first, triCount, maxDist[id]))
+                           return maxDist[id];
+                       occluded[id] = 1;
+                       return -FLT_MAX;
+                   });
+}
+
+// --- Path tracing ---
+
+// Share of guided bounces once a region can be sampled, and the roughness
+// below which a lobe is too narrow to gain from guiding
+static constexpr float GUIDE_FRACTION      = 0.5f;
+static constexpr float GUIDE_MIN_ROUGHNESS = 0.1f;
+
+bool CPURaytracer::survivesRoulette(PathState& path, RNG& rng, int depth) const
+{
+    // Russian Roulette — terminate low-throughput paths after the first 2 bounces
+    if (m_enableRR && depth >= 2)
+    {
+        const glm::vec3& throughput = path.throughput;
+        float p = std::min(0.2126f * throughput.r + 0.7152f * throughput.g + 0.0722f * throughput.b, 0.95f);
+        if (rng.next() > p)
+            return false;
+        path.throughput /= p;
+    }
+    return true;
+}
+
+template <typename ShadowFn>
+bool CPURaytracer::shadeBounce(PathState& path, HitRecord& hit, RNG& rng, int depth,
+                               glm::vec3* outAlbedo, glm::vec3* outNormal, ShadowFn&& shadow) const
+{
+    Ray& ray = path.ray;
+    glm::vec3& throughput = path.throughput;
+    float& prevBsdfPdf = path.prevBsdfPdf;
+    bool& prevWasDelta = path.prevWasDelta;
+    const bool hasLights = !m_lightTris.empty();
+
+    if (!hit.hit)
+    {
+        // Sun contribution when ray misses geometry
+        // m_sunColor stores irradiance; radiance of the disk = irradiance / solidAngle
+        if (m_sunEnabled && glm::dot(ray.direction, -m_sunDir) > m_sunCosAngle)
+        {
+            float sunSolidAngle = 2.0f * PI * (1.0f - m_sunCosAngle);
+            float sunRadiance   = 1.0f / sunSolidAngle;
+            float lightPdf      = 1.0f / sunSolidAngle;
+
+            if (depth == 0 || !m_enableNEE || prevWasDelta)
+            {
+                path.addRadiance(throughput * m_sunColor * sunRadiance);
+            }
+            else
+            {
+                // MIS: BSDF hit the sun disk
+                float weight = prevBsdfPdf / (prevBsdfPdf + lightPdf);
+                path.addRadiance(throughput * m_sunColor * sunRadiance * weight);
+            }
+        }
+
+        {
+            glm::vec3 envContrib = sampleEnvironment(ray.direction);
+            if (depth == 0)
+            {
+                // Background always visible regardless of enableEnvironment toggle
+                path.addRadiance(throughput * envContrib);
+            }
+            else if (m_enableEnvironment)
+            {
+                glm::vec3 scaledEnv = envContrib * m_envLightMultiplier;
+                bool hasEnvCDF = m_hasEnvMap && m_envTotalIntegral > 0.0f;
+                if (m_enableNEE && !prevWasDelta && hasEnvCDF)
+                {
+                    float ePdf = envMapPdf(ray.direction);
+                    if (ePdf > 1e-8f)
+                        scaledEnv *= prevBsdfPdf / (prevBsdfPdf + ePdf);
+                }
+                path.addRadiance(throughput * scaledEnv);
+            }
+        }
+        return false;
+    }
+
+    const TriData& mat = m_triData[hit.triangleIndex];
+
+    // Determine front/back face
+    bool frontFace = glm::dot(hit.geometricNormal, -ray.direction) > 0.0f;
+
+    // Opaque back-face hit — mesh has inverted normals (e.g. CAD export with outward-facing
+    // inner surfaces). Bouncing from here with offsetNormal = -Ng sends the ray toward the
+    // arch interior where it oscillates forever. Pass through instead: advance the origin
+    // past the surface and keep the same direction. Dielectrics are exempt because they
+    // legitimately need back-face handling for refraction.
+    if (!frontFace && mat.materialType != 2 && mat.materialType != 3) // 2=Dielectric 3=ThinGlass
+    {
+        ray.origin = hit.position + ray.direction * m_rayEps;
+        return true;
+    }
+
+    // Ray origin offsets must follow the geometric normal, not the shading normal.
+    // After normal mapping the shading normal can be nearly tangent to the surface,
+    // so hit.normal * eps barely moves the origin away from the actual surface —
+    // no amount of EPS increase helps. The geometric normal always points cleanly
+    // away from the real surface, so it is the correct offset direction.
+    const glm::vec3 offsetNormal = frontFace ? hit.geometricNormal : -hit.geometricNormal;
+
+    // Ensure the shading normal is on the same side as the geometric normal.
+    // Covers front-face hits where interpolated vertex normals cross the geometric
+    // boundary, and dielectric back-face hits (opaque back-face hits are handled above).
+    // The NdotL guard in sample() and evaluate() requires N to agree with Ng.
+    if (glm::dot(hit.normal, offsetNormal) < 0.0f)
+        hit.normal = -hit.normal;
+
+    // --- Hit emissive surface ---
+    glm::vec3 emission(0.0f);
+    if (m_enableEmissive)
+    {
+        emission = mat.emissive;  // already scaled by emissiveStrength (baked at upload)
+        if (mat.emissiveTextureIndex >= 0)
+            emission = glm::vec3(sampleTexture(mat.emissiveTextureIndex, hit.uv)) * mat.emissiveStrength;
+    }
+
+    if (glm::length(emission) > 0.001f)
+    {
+        float cosLight = glm::dot(hit.geometricNormal, -ray.direction);
+        bool isTexturedEmitter = (mat.emissiveTextureIndex >= 0);
+
+        if (depth == 0 || prevWasDelta || isTexturedEmitter)
+        {
+            // Direct view, delta bounce, or textured emitter (not in light CDF) — full contribution
+            if (cosLight > 0.0f)
+                path.addRadiance(throughput * emission);
+        }
+        else if (m_enableNEE && hasLights && cosLight > 0.0f)
+        {
+            // MIS weight for BSDF path hitting a light: the pdf with which NEE
+            // at the previous vertex would have picked this point
+            float pdfLight = 0.0f;
+            const uint32_t lightIdx = lightIndexOf(hit);
+            if (lightIdx != UINT32_MAX)
+            {
+                pdfLight = lightPmf(lightIdx, path.prevPosition, path.prevNormal)
+                         * lightPointPdf(lightIdx, path.prevPosition, hit.position);
+            }
+            float weight = prevBsdfPdf / (prevBsdfPdf + pdfLight);
+            path.addRadiance(throughput * emission * weight);
+        }
+        else if (!m_enableNEE)
+        {
+            // No NEE — BSDF is the only strategy, weight = 1
+            if (cosLight > 0.0f)
+                path.addRadiance(throughput * emission);
+        }
+
+    }
+
+    glm::vec3 albedo = mat.color;
+    if (mat.textureIndex >= 0)
+        albedo *= glm::vec3(sampleTexture(mat.textureIndex, hit.uv));
+
+    if (depth == 0 && outAlbedo)
+        *outAlbedo = albedo;
+
+    // Normal map perturbation
+    if (m_enableNormalMapping && mat.normalMapTextureIndex >= 0)
+    {
+        glm::vec3 N = hit.normal;
+        glm::vec4 mapSample = sampleTexture(mat.normalMapTextureIndex, hit.uv);
+        glm::vec3 mapN(mapSample.x * 2.0f - 1.0f,
+                       mapSample.y * 2.0f - 1.0f,
+                       mapSample.z * 2.0f - 1.0f);
+        mapN = glm::normalize(mapN);
+
+        glm::vec3 T = hit.tangent;
+        T = glm::normalize(T - glm::dot(T, N) * N);  // re-orthogonalize
+        glm::vec3 B = glm::cross(N, T) * hit.bitangentSign;
+
+        hit.normal = glm::normalize(T * mapN.x + B * mapN.y + N * mapN.z);
 
-        // Ensure the shading normal is on the same side as the geometric normal.
-        // Covers front-face hits where interpolated vertex normals cross the geometric
-        // boundary, and dielectric back-face hits (opaque back-face hits are handled above).
-        // The NdotL guard in sample() and evaluate() requires N to agree with Ng.
+        // Re-apply alignment after normal map perturbation.
         if (glm::dot(hit.normal, offsetNormal) < 0.0f)
             hit.normal = -hit.normal;
+    }
+
+    if (depth == 0 && outNormal)
+        *outNormal = hit.normal; // world-space, after normal mapping
+
+    // Sample roughness/metallic textures
+    // G channel = roughness, B channel = metallic (ARM packing).
+    // Safe for OBJ separate grayscale textures too since R=G=B there.
+    // Thin glass (type 3) repurposes metallic as tint strength — skip texture override.
+    float roughness = mat.roughness;
+    float metallic = mat.metallic;
+    if (mat.materialType != 3)
+    {
+        if (mat.roughnessTextureIndex >= 0)
+            roughness = sampleTexture(mat.roughnessTextureIndex, hit.uv).y;
+        if (mat.metallicTextureIndex >= 0)
+            metallic = sampleTexture(mat.metallicTextureIndex, hit.uv).z;
+    }
+
+    // --- Material dispatch ---
+    if (mat.materialType == 3)
+    {
+        // Thin glass: Fresnel reflection or tinted passthrough — no refraction.
+        glm::vec3 wo  = -ray.direction;
+        float cosI    = glm::max(glm::dot(hit.normal, wo), 0.0f);
+        float dF0     = (1.0f - mat.ior) / (1.0f + mat.ior); dF0 = dF0 * dF0;
+        float F       = dF0 + (1.0f - dF0) * std::pow(1.0f - cosI, 5.0f);
+
+        prevBsdfPdf  = 1.0f;
+        prevWasDelta = true;
+
+        if (rng.next() < F)
+        {
+            ray.origin    = hit.position + offsetNormal * m_rayEps;
+            ray.direction = glm::reflect(-wo, hit.normal);
+        }
+        else
+        {
+            throughput   *= glm::mix(glm::vec3(1.0f), albedo, metallic);
+            ray.origin    = hit.position - offsetNormal * m_rayEps;
+            // ray.direction unchanged
+        }
+    }
+    else if (mat.materialType == 2)
+    {
+        // Dielectric: Fresnel reflect/refract
+        DielectricBSDF glassBsdf{ albedo, mat.ior };
+        glm::vec3 wo = -ray.direction;
+        BSDFSample sample = glassBsdf.sample(hit.normal, wo, frontFace, rng.next());
+
+        throughput *= sample.throughput;
+        prevBsdfPdf = sample.pdf;
+        prevWasDelta = true;
+
+        // Offset origin: same side for reflection, opposite for refraction
+        if (glm::dot(sample.direction, offsetNormal) > 0.0f)
+            ray.origin = hit.position + offsetNormal * m_rayEps;
+        else
+            ray.origin = hit.position - offsetNormal * m_rayEps;
+        ray.direction = sample.direction;
+    }
+    else if (mat.materialType == 1 || (metallic > 0.99f && roughness < 0.01f))
+    {
+        // Mirror: explicit mirror material, or perfect-metallic PBR params (delta BRDF, no NEE)
+        MirrorBSDF mirrorBsdf{ albedo };
+        glm::vec3 wo = -ray.direction;
+        BSDFSample sample = mirrorBsdf.sample(hit.normal, wo);
+
+        throughput *= sample.throughput;
+        prevBsdfPdf = sample.pdf;
+        prevWasDelta = true;
+
+        ray.origin    = hit.position + offsetNormal * m_rayEps;
+        ray.direction = sample.direction;
+    }
+    else
+    {
+        // Cook-Torrance GGX (handles both diffuse and metallic materials)
+        glm::vec3 wo = -ray.direction;
+        CookTorranceBSDF bsdf{ albedo, roughness, metallic, mat.ior };
+
+        // Path guiding: the bounce is recorded into the region it leaves from,
+        // and once that region has learned something half of the bounces
+        // sample it. Near-mirror lobes stay with the BSDF, which already
+        // knows where they go. scatterPdf() is the pdf of the two combined.
+        uint32_t guideRegion = PathGuide::INVALID;
+        float guideFraction = 0.0f;
+        if (m_pathGuiding && !m_pathGuide.empty())
+        {
+            guideRegion = m_pathGuide.regionAt(hit.position);
+            if (roughness >= GUIDE_MIN_ROUGHNESS && m_pathGuide.canSample(guideRegion))
+                guideFraction = GUIDE_FRACTION;
+        }
+        auto scatterPdf = [&](const glm::vec3& dir)
+        {
+            const float pdfBsdf = bsdf.pdf(hit.normal, wo, dir);
+            if (guideFraction == 0.0f)
+                return pdfBsdf;
+            return glm::mix(pdfBsdf, m_pathGuide.pdf(guideRegion, dir), guideFraction);
+        };
+
+        // Light samples below go to shadow() with the radiance they add if unoccluded
+
+        // --- NEE: emissive triangle sampling ---
+        uint32_t lightIdx;
+        float lightPmf;
+        glm::vec3 lightPos;
+        if (m_enableNEE && m_enableEmissive && hasLights
+            && sampleLightPoint(rng, hit.position, hit.normal, lightIdx, lightPmf, lightPos))
+        {
+            const auto& lightData = m_lightTris[lightIdx];
+
+            glm::vec3 toLight = lightPos - hit.position;
+            float dist = glm::length(toLight);
+            glm::vec3 lightDir = toLight / dist;
+
+            float cosSurface = glm::dot(hit.normal, lightDir);
+            float cosLight   = glm::dot(lightData.geometricNormal, -lightDir);
+
+            if (cosSurface > 0.0f && cosLight > 0.0f && glm::dot(offsetNormal, lightDir) > 0.0f)
+            {
+                // Aimed at the sample from the offset origin: along lightDir the
+                // offset ray would meet the emitter's plane eps / cos early and,
+                // at grazing angles, be shadowed by the emitter itself
+                Ray shadowRay;
+                shadowRay.origin    = hit.position + offsetNormal * m_rayEps;
+                glm::vec3 toSample  = lightPos - shadowRay.origin;
+                float shadowDist    = glm::length(toSample);
+                shadowRay.direction = toSample / shadowDist;
+
+                float pdfLight = lightPmf * lightPointPdf(lightIdx, hit.position, lightPos);
+                float pdfBsdf  = scatterPdf(lightDir);
+                float misWeight = pdfLight / (pdfLight + pdfBsdf);
+
+                glm::vec3 brdf = bsdf.evaluate(hit.normal, wo, lightDir);
+                shadow(shadowRay, shadowDist - 2.0f * m_rayEps,
+                       throughput * brdf * lightData.emissive * cosSurface / pdfLight * misWeight);
+            }
+        }
+
+        // --- NEE: point light sampling ---
+        if (m_enableNEE && m_pointLightEnabled)
+        {
+            glm::vec3 toLight = m_pointLightPos - hit.position;
+            float dist = glm::length(toLight);
+            glm::vec3 lightDir = toLight / dist;
+
+            float cosSurface = glm::dot(hit.normal, lightDir);
+
+            if (cosSurface > 0.0f && glm::dot(offsetNormal, lightDir) > 0.0f)
+            {
+                Ray shadowRay;
+                shadowRay.origin    = hit.position + offsetNormal * m_rayEps;
+                shadowRay.direction = lightDir;
+
+                glm::vec3 brdf = bsdf.evaluate(hit.normal, wo, lightDir);
+                // Point light: no MIS (delta distribution, BSDF can never hit it)
+                // Inverse-square attenuation
+                shadow(shadowRay, dist - 2.0f * m_rayEps,
+                       throughput * brdf * m_pointLightColor * cosSurface / (dist * dist));
+            }
+        }
+
+        // --- NEE: directional (sun) light sampling ---
+        if (m_enableNEE && m_sunEnabled)
+        {
+            // Sample direction uniformly within sun cone
+            float sunSolidAngle = 2.0f * PI * (1.0f - m_sunCosAngle);
+            float u1 = rng.next();
+            float u2 = rng.next();
+
+            float cosTheta = 1.0f - u1 * (1.0f - m_sunCosAngle);
+            float sinTheta = std::sqrt(1.0f - cosTheta * cosTheta);
+            float phi = 2.0f * PI * u2;
+
+            // Build ONB around -sunDir (direction toward sun)
+            glm::vec3 toSun = -m_sunDir;
+            glm::vec3 t, b;
+            buildONB(toSun, t, b);
+
+            glm::vec3 lightDir = t * (std::cos(phi) * sinTheta)
+                               + b * (std::sin(phi) * sinTheta)
+                               + toSun * cosTheta;
+            lightDir = glm::normalize(lightDir);
+
+            float cosSurface = glm::dot(hit.normal, lightDir);
+
+            if (cosSurface > 0.0f && glm::dot(offsetNormal, lightDir) > 0.0f)
+            {
+                Ray shadowRay;
+                shadowRay.origin    = hit.position + offsetNormal * m_rayEps;
+                shadowRay.direction = lightDir;
+
+                float lightPdf  = 1.0f / sunSolidAngle;
+                float bsdfPdf   = scatterPdf(lightDir);
+                float misWeight = lightPdf / (lightPdf + bsdfPdf);
+
+                glm::vec3 brdf = bsdf.evaluate(hit.normal, wo, lightDir);
+                shadow(shadowRay, std::numeric_limits<float>::max(),
+                       throughput * brdf * m_sunColor * cosSurface * misWeight);
+            }
+        }
+
+        // --- NEE: environment map importance sampling ---
+        if (m_enableNEE && m_enableEnvironment && m_hasEnvMap && m_envTotalIntegral > 0.0f)
+        {
+            glm::vec3 envDir;
+            float envPdf;
+            glm::vec3 envRad = sampleEnvMap(rng, envDir, envPdf);
+
+            float cosSurface = glm::dot(hit.normal, envDir);
+
+            if (cosSurface > 0.0f && envPdf > 1e-8f && glm::dot(offsetNormal, envDir) > 0.0f)
+            {
+                Ray shadowRay;
+                shadowRay.origin    = hit.position + offsetNormal * m_rayEps;
+                shadowRay.direction = envDir;
+
+                float bsdfPdf   = scatterPdf(envDir);
+                float misWeight = envPdf / (envPdf + bsdfPdf);
+
+                glm::vec3 brdf = bsdf.evaluate(hit.normal, wo, envDir);
+                shadow(shadowRay, std::numeric_limits<float>::max(),
+                       throughput * brdf * envRad * m_envLightMultiplier * cosSurface / envPdf * misWeight);
+            }
+        }
+
+        // --- BSDF (or guided) sampling for next bounce ---
+        BSDFSample sample;
+        if (guideFraction > 0.0f && rng.next() < guideFraction)
+        {
+            sample.direction = m_pathGuide.sample(guideRegion, rng.next(), rng.next());
+            sample.pdf = scatterPdf(sample.direction);
+            const float cosSurface = glm::dot(hit.normal, sample.direction);
+            if (cosSurface <= 0.0f || sample.pdf < 1e-8f)
+                return false;
+            sample.throughput = bsdf.evaluate(hit.normal, wo, sample.direction) * cosSurface / sample.pdf;
+        }
+        else
+        {
+            sample = bsdf.sample(hit.normal, offsetNormal, wo, rng.next(), rng.next(), rng.next());
+            if (guideFraction > 0.0f && sample.pdf >= 1e-8f)
+            {
+                const float pdf = scatterPdf(sample.direction);
+                sample.throughput *= sample.pdf / pdf;
+                sample.pdf = pdf;
+            }
+        }
+
+        if (sample.pdf < 1e-8f)
+            return false;
+
+        // Don't bounce below the actual geometric surface — prevents self-intersection
+        if (glm::dot(sample.direction, offsetNormal) < 0.0f)
+            return false;
+
+        throughput *= sample.throughput;
+        prevBsdfPdf = sample.pdf;
+        prevWasDelta = false;
+        path.prevPosition = hit.position;
+        path.prevNormal   = hit.normal;
+
+        if (guideRegion != PathGuide::INVALID && path.guideVertexCount < MAX_GUIDE_VERTICES)
+            path.guideVertices[path.guideVertexCount++] = { guideRegion, sample.direction, sample.pdf, throughput, glm::vec3(0.0f) };
+
+        ray.origin    = hit.position + offsetNormal * m_rayEps;
+        ray.direction = sample.direction;
+    }
+
+    return true;
+}
+
+glm::vec3 CPURaytracer::pathTrace(const Ray& initialRay, RNG& rng,
+                                    glm::vec3* outAlbedo, glm::vec3* outNormal,
+                                    const HitRecord* primaryHit, uint64_t* outRays) const
+{
+    PathState path;
+    path.ray = initialRay;
+    uint64_t rays = 0;
+
+    // Light samples are resolved on the spot
+    auto shadow = [&](const Ray& shadowRay, float maxDist, const glm::vec3& contribution)
+    {
+        ++rays;
+        if (!traceShadowRay(shadowRay, maxDist))
+            path.addRadiance(contribution);
+    };
+
+    for (int depth = 0; depth < m_maxDepth; ++depth)
+    {
+        rng.beginBounce(depth);
+        if (!survivesRoulette(path, rng, depth))
+            break;
+
+        ++rays;
+        HitRecord hit = (depth == 0 && primaryHit) ? *primaryHit : traceRay(path.ray);
+        if (!shadeBounce(path, hit, rng, depth, outAlbedo, outNormal, shadow))
+            break;
+    }
+
+    if (path.guideVertexCount > 0)
+        recordGuideVertices(path);
+    if (outRays)
+        *outRays += rays;
+    return path.radiance;
+}
+
+void CPURaytracer::recordGuideVertices(const PathState& path) const
+{
+    // Luminance of the incident radiance over the pdf of its direction
+    for (uint32_t i = 0; i < path.guideVertexCount; ++i)
+    {
+        const GuideVertex& v = path.guideVertices[i];
+        const glm::vec3 incident(v.throughput.r > 0.0f ? v.radiance.r / v.throughput.r : 0.0f,
+                                 v.throughput.g > 0.0f ? v.radiance.g / v.throughput.g : 0.0f,
+                                 v.throughput.b > 0.0f ? v.radiance.b / v.throughput.b : 0.0f);
+        const float lum = 0.2126f * incident.r + 0.7152f * incident.g + 0.0722f * incident.b;
+        m_pathGuide.record(v.region, v.direction, lum / v.pdf);
+    }
+}
+
+// --- Wavefront path tracing ---
+
+struct CPURaytracer::WavefrontPath
+{
+    PathState state;
+    RNG       rng{0};
+    uint32_t  pixel = 0;
+    glm::vec3 albedo{0.0f};
+    glm::vec3 normal{0.0f};
+};
+
+// A light sample waiting for the shadow stage
+struct CPURaytracer::ShadowQuery
+{
+    Ray       ray;
+    float     maxDist;
+    glm::vec3 contribution;
+    uint32_t  path;
+    uint32_t  guideVertices;  // of the path when the sample was taken
+};
+
+// Stable counting sort of 0..count-1 by key(i) < KEYS. offsets[k] is where
+// bucket k starts in order; offsets[KEYS] = count.
+template <uint32_t KEYS, typename KeyFn>
+static void sortByKey(uint32_t count, std::vector<uint32_t>& order, uint32_t (&offsets)[KEYS + 1], KeyFn&& key)
+{
+    std::fill(offsets, offsets + KEYS + 1, 0u);
+    for (uint32_t i = 0; i < count; ++i)
+        ++offsets[key(i) + 1];
+    for (uint32_t k = 0; k < KEYS; ++k)
+        offsets[k + 1] += offsets[k];
+
+    uint32_t cursor[KEYS];
+    std::copy(offsets, offsets + KEYS, cursor);
+    order.resize(count);
+    for (uint32_t i = 0; i < count; ++i)
+        order[cursor[key(i)]++] = i;
+}
+
+static inline uint32_t directionOctant(const glm::vec3& d)
+{
+    return (d.x < 0.0f ? 1u : 0u) | (d.y < 0.0f ? 2u : 0u) | (d.z < 0.0f ? 4u : 0u);
+}
+
+void CPURaytracer::traceTilesWavefront(uint32_t worker)
+{
+    constexpr uint32_t batchTiles = std::max(1u, WAVEFRONT_BATCH_PATHS / (TILE_SIZE * TILE_SIZE));
+    WorkerStats& stats = m_workerStats[worker];
+
+    std::vector<WavefrontPath> paths;
+    std::vector<uint32_t>      extendQueue;         // path ids still tracing
+    std::vector<uint32_t>      order;               // sort scratch
+    std::vector<uint32_t>      streamPaths;         // path of each extend stream slot
+    std::vector<Ray>           streamRays;
+    std::vector<HitRecord>     streamHits;
+    std::vector<uint32_t>      shadeQueue;          // extend stream slots, by material
+    std::vector<ShadowQuery>   shadowQueue;
+    std::vector<Ray>           shadowRays;
+    std::vector<float>         shadowMaxDist;
+    std::vector<uint8_t>       shadowOccluded;
+    std::vector<uint8_t>       queryOccluded;
+    uint32_t octants[9];
+    uint32_t materials[6];
+
+    // Traces order[offsets[o], offsets[o + 1]) for each octant o as one stream
+    auto perOctant = [&](auto&& traceStream)
+    {
+        for (uint32_t o = 0; o < 8; ++o)
+        {
+            if (octants[o + 1] > octants[o])
+                traceStream(octants[o], octants[o + 1] - octants[o]);
+        }
+    };
 
-        // --- Hit emissive surface ---
-        glm::vec3 emission(0.0f);
-        if (m_enableEmissive)
+    uint32_t firstTile, endTile;
+    while (nextTiles(worker, batchTiles, firstTile, endTile))
+    {
+        const auto start = std::chrono::steady_clock::now();
+
+        // Generate: camera rays with the per-pixel seeds of the megakernel
+        paths.clear();
+        extendQueue.clear();
+        for (uint32_t t = firstTile; t < endTile; ++t)
         {
-            emission = hit.emissive;  // already scaled by emissiveStrength (baked at upload)
-            if (hit.emissiveTextureIndex >= 0)
-                emission = glm::vec3(sampleTexture(hit.emissiveTextureIndex, hit.uv)) * hit.emissiveStrength;
+            const Tile& tile = m_tiles[m_activeTiles[t]];
+            for (uint32_t y = tile.y0; y < tile.y1; ++y)
+            {
+                for (uint32_t x = tile.x0; x < tile.x1; ++x)
+                {
+                    WavefrontPath& path = paths.emplace_back();
+                    path.rng = pixelRNG(x, y);
+                    float jx = m_enableAA ? path.rng.next() : 0.5f;
+                    float jy = m_enableAA ? path.rng.next() : 0.5f;
+                    path.state.ray = generateRay(static_cast<int>(x), static_cast<int>(y), jx, jy, path.rng);
+                    path.pixel = y * m_width + x;
+                    extendQueue.push_back(static_cast<uint32_t>(paths.size() - 1));
+                }
+            }
         }
 
-        if (glm::length(emission) > 0.001f)
+        // A cancelled batch is dropped whole, so no pixel gets a cut-off path
+        bool cancelled = false;
+        for (int depth = 0; depth < m_maxDepth && !extendQueue.empty(); ++depth)
         {
-            float cosLight = glm::dot(hit.geometricNormal, -ray.direction);
-            bool isTexturedEmitter = (hit.emissiveTextureIndex >= 0);
-
-            if (depth == 0 || prevWasDelta || isTexturedEmitter)
+            if (m_cancelSample.load(std::memory_order_relaxed))
             {
-                // Direct view, delta bounce, or textured emitter (not in light CDF) — full contribution
-                if (cosLight > 0.0f)
-                    radiance += throughput * emission;
+                m_passCancelled.store(true, std::memory_order_relaxed);
+                cancelled = true;
+                break;
             }
-            else if (m_enableNEE && hasLights && cosLight > 0.0f)
+
+            // Extend: roulette, then one closest-hit stream per direction octant
+            uint32_t survivors = 0;
+            for (uint32_t id : extendQueue)
             {
-                // MIS weight for BSDF path hitting a light
-                float lumFactor = m_useLuminanceCDF
-                    ? (0.2126f * emission.r + 0.7152f * emission.g + 0.0722f * emission.b)
-                    : 1.0f;
-                float pdfLight = (hit.t * hit.t) * lumFactor / (cosLight * m_totalLightArea);
-                float weight = prevBsdfPdf / (prevBsdfPdf + pdfLight);
-                radiance += throughput * emission * weight;
+                paths[id].rng.beginBounce(depth);
+                if (survivesRoulette(paths[id].state, paths[id].rng, depth))
+                    extendQueue[survivors++] = id;
             }
-            else if (!m_enableNEE)
+            extendQueue.resize(survivors);
+            stats.rays += survivors;
+
+            sortByKey<8>(survivors, order, octants,
+                         [&](uint32_t i) { return directionOctant(paths[extendQueue[i]].state.ray.direction); });
+            streamPaths.resize(survivors);
+            streamRays.resize(survivors);
+            streamHits.resize(survivors);
+            for (uint32_t s = 0; s < survivors; ++s)
             {
-                // No NEE — BSDF is the only strategy, weight = 1
-                if (cosLight > 0.0f)
-                    radiance += throughput * emission;
+                streamPaths[s] = extendQueue[order[s]];
+                streamRays[s]  = paths[streamPaths[s]].state.ray;
             }
+            perOctant([&](uint32_t begin, uint32_t count)
+            {
+                traceRayStream(&streamRays[begin], count, &streamHits[begin]);
+            });
 
-        }
+            // Shade: misses first, then one run per material type, so each
+            // branch of shadeBounce() runs over like paths back to back
+            sortByKey<5>(survivors, shadeQueue, materials, [&](uint32_t s)
+            {
+                const HitRecord& hit = streamHits[s];
+                return hit.hit ? 1u + static_cast<uint32_t>(std::clamp(m_triData[hit.triangleIndex].materialType, 0, 3)) : 0u;
+            });
 
-        glm::vec3 albedo = hit.color;
-        if (hit.textureIndex >= 0)
-            albedo *= glm::vec3(sampleTexture(hit.textureIndex, hit.uv));
+            extendQueue.clear();
+            shadowQueue.clear();
+            for (uint32_t s : shadeQueue)
+            {
+                const uint32_t id = streamPaths[s];
+                WavefrontPath& path = paths[id];
+                auto shadow = [&](const Ray& shadowRay, float maxDist, const glm::vec3& contribution)
+                {
+                    shadowQueue.push_back({ shadowRay, maxDist, contribution, id, path.state.guideVertexCount });
+                };
+                if (shadeBounce(path.state, streamHits[s], path.rng, depth, &path.albedo, &path.normal, shadow))
+                    extendQueue.push_back(id);
+            }
 
-        if (depth == 0 && outAlbedo)
-            *outAlbedo = albedo;
+            // Shadow: one occlusion stream per octant. Contributions are added
+            // in queue order, which keeps every path's sum in megakernel order.
+            const uint32_t queries = static_cast<uint32_t>(shadowQueue.size());
+            stats.rays += queries;
+            sortByKey<8>(queries, order, octants,
+                         [&](uint32_t q) { return directionOctant(shadowQueue[q].ray.direction); });
+            shadowRays.resize(queries);
+            shadowMaxDist.resize(queries);
+            shadowOccluded.resize(queries);
+            queryOccluded.resize(queries);
+            for (uint32_t s = 0; s < queries; ++s)
+            {
+                shadowRays[s]    = shadowQueue[order[s]].ray;
+                shadowMaxDist[s] = shadowQueue[order[s]].maxDist;
+            }
+            perOctant([&](uint32_t begin, uint32_t count)
+            {
+                occludedStream(&shadowRays[begin], &shadowMaxDist[begin], count, &shadowOccluded[begin]);
+            });
+            for (uint32_t s = 0; s < queries; ++s)
+                queryOccluded[order[s]] = shadowOccluded[s];
+            for (uint32_t q = 0; q < queries; ++q)
+            {
+                const ShadowQuery& query = shadowQueue[q];
+                if (!queryOccluded[q])
+                    paths[query.path].state.addRadiance(query.contribution, query.guideVertices);
+            }
+        }
 
-        // Normal map perturbation
-        if (m_enableNormalMapping && hit.normalMapTextureIndex >= 0)
+        if (cancelled)
+            break;
+        for (const WavefrontPath& path : paths)
         {
-            glm::vec3 N = hit.normal;
-            glm::vec4 mapSample = sampleTexture(hit.normalMapTextureIndex, hit.uv);
-            glm::vec3 mapN(mapSample.x * 2.0f - 1.0f,
-                           mapSample.y * 2.0f - 1.0f,
-                           mapSample.z * 2.0f - 1.0f);
-            mapN = glm::normalize(mapN);
+            accumulatePixel(path.pixel, path.state.radiance, path.albedo, path.normal);
+            if (path.state.guideVertexCount > 0)
+                recordGuideVertices(path.state);
+        }
+        for (uint32_t t = firstTile; t < endTile; ++t)
+            updateTileConvergence(m_activeTiles[t]);
+
+        stats.busyMs += std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+        stats.tiles  += endTile - firstTile;
+    }
+}
 
-            glm::vec3 T = hit.tangent;
-            T = glm::normalize(T - glm::dot(T, N) * N);  // re-orthogonalize
-            glm::vec3 B = glm::cross(N, T) * hit.bitangentSign;
+// --- Batched queries ---
 
-            hit.normal = glm::normalize(T * mapN.x + B * mapN.y + N * mapN.z);
+void CPURaytracer::runQueryChunks(uint32_t count, const std::function<void(uint32_t, uint32_t)>& chunk)
+{
+    if (count <= QUERY_CHUNK_RAYS)
+    {
+        if (count > 0)
+            chunk(0, count);
+        return;
+    }
 
-            // Re-apply alignment after normal map perturbation.
-            if (glm::dot(hit.normal, offsetNormal) < 0.0f)
-                hit.normal = -hit.normal;
-        }
+    cancelSample();
+    if (m_workers.empty())
+        buildThreadPool();
 
-        if (depth == 0 && outNormal)
-            *outNormal = hit.normal; // world-space, after normal mapping
+    std::atomic<uint32_t> next{0};
+    const std::function<void()> job = [&]()
+    {
+        uint32_t begin;
+        while ((begin = next.fetch_add(QUERY_CHUNK_RAYS, std::memory_order_relaxed)) < count)
+            chunk(begin, std::min(begin + QUERY_CHUNK_RAYS, count));
+    };
+    dispatchPool(job);
+}
 
-        // Sample roughness/metallic textures
-        // G channel = roughness, B channel = metallic (ARM packing).
-        // Safe for OBJ separate grayscale textures too since R=G=B there.
-        // Thin glass (type 3) repurposes metallic as tint strength — skip texture override.
-        float roughness = hit.roughness;
-        float metallic = hit.metallic;
-        if (hit.materialType != 3)
+void CPURaytracer::traceRays(std::span<const Ray> rays, std::span<HitRecord> hits)
+{
+    const uint32_t count = static_cast<uint32_t>(std::min(rays.size(), hits.size()));
+    const bool streams = !isInstanced() && !m_compressedBVH && m_bvhWidth == 2;
+    runQueryChunks(count, [&](uint32_t begin, uint32_t end)
+    {
+        const uint32_t n = end - begin;
+        std::vector<uint32_t> order;
+        uint32_t octants[9];
+        sortByKey<8>(n, order, octants, [&](uint32_t i) { return directionOctant(rays[begin + i].direction); });
+        if (!streams)
         {
-            if (hit.roughnessTextureIndex >= 0)
-                roughness = sampleTexture(hit.roughnessTextureIndex, hit.uv).y;
-            if (hit.metallicTextureIndex >= 0)
-                metallic = sampleTexture(hit.metallicTextureIndex, hit.uv).z;
+            for (uint32_t s = 0; s < n; ++s)
+                hits[begin + order[s]] = traceRay(rays[begin + order[s]]);
+            return;
         }
 
-        // --- Material dispatch ---
-        if (hit.materialType == 3)
+        std::vector<Ray> sorted(n);
+        std::vector<HitRecord> sortedHits(n);
+        for (uint32_t s = 0; s < n; ++s)
+            sorted[s] = rays[begin + order[s]];
+        for (uint32_t o = 0; o < 8; ++o)
         {
-            // Thin glass: Fresnel reflection or tinted passthrough — no refraction.
-            glm::vec3 wo  = -ray.direction;
-            float cosI    = glm::max(glm::dot(hit.normal, wo), 0.0f);
-            float dF0     = (1.0f - hit.ior) / (1.0f + hit.ior); dF0 = dF0 * dF0;
-            float F       = dF0 + (1.0f - dF0) * std::pow(1.0f - cosI, 5.0f);
-
-            prevBsdfPdf  = 1.0f;
-            prevWasDelta = true;
+            if (octants[o + 1] > octants[o])
+                traceRayStream(&sorted[octants[o]], octants[o + 1] - octants[o], &sortedHits[octants[o]]);
+        }
+        for (uint32_t s = 0; s < n; ++s)
+            hits[begin + order[s]] = sortedHits[s];
+    });
+}
 
-            if (rng.next() < F)
-            {
-                ray.origin    = hit.position + offsetNormal * m_rayEps;
-                ray.direction = glm::reflect(-wo, hit.normal);
-            }
-            else
+void CPURaytracer::occluded(std::span<const Ray> rays, std::span<const float> tMax, std::span<uint64_t> occluded)
+{
+    const uint32_t count = static_cast<uint32_t>(std::min({ rays.size(), tMax.size(), occluded.size() * 64 }));
+    const bool streams = !isInstanced() && !m_compressedBVH && m_bvhWidth == 2;
+    runQueryChunks(count, [&](uint32_t begin, uint32_t end)
+    {
+        // Chunks start on a word boundary, so no two of them share a word
+        std::fill(occluded.begin() + begin / 64, occluded.begin() + (end + 63) / 64, uint64_t(0));
+        auto setBit = [&](uint32_t i) { occluded[i / 64] |= uint64_t(1) << (i % 64); };
+
+        const uint32_t n = end - begin;
+        std::vector<uint32_t> order;
+        uint32_t octants[9];
+        sortByKey<8>(n, order, octants, [&](uint32_t i) { return directionOctant(rays[begin + i].direction); });
+        if (!streams)
+        {
+            for (uint32_t s = 0; s < n; ++s)
             {
-                throughput   *= glm::mix(glm::vec3(1.0f), albedo, metallic);
-                ray.origin    = hit.position - offsetNormal * m_rayEps;
-                // ray.direction unchanged
+                const uint32_t i = begin + order[s];
+                if (traceShadowRay(rays[i], tMax[i]))
+                    setBit(i);
             }
+            return;
         }
-        else if (hit.materialType == 2)
-        {
-            // Dielectric: Fresnel reflect/refract
-            DielectricBSDF glassBsdf{ albedo, hit.ior };
-            glm::vec3 wo = -ray.direction;
-            BSDFSample sample = glassBsdf.sample(hit.normal, wo, frontFace, rng.next());
 
-            throughput *= sample.throughput;
-            prevBsdfPdf = sample.pdf;
-            prevWasDelta = true;
-
-            // Offset origin: same side for reflection, opposite for refraction
-            if (glm::dot(sample.direction, offsetNormal) > 0.0f)
-                ray.origin = hit.position + offsetNormal * m_rayEps;
-            else
-                ray.origin = hit.position - offsetNormal * m_rayEps;
-            ray.direction = sample.direction;
+        std::vector<Ray> sorted(n);
+        std::vector<float> sortedMax(n);
+        std::vector<uint8_t> sortedOccluded(n);
+        for (uint32_t s = 0; s < n; ++s)
+        {
+            sorted[s]    = rays[begin + order[s]];
+            sortedMax[s] = tMax[begin + order[s]];
         }
-        else if (hit.materialType == 1 || (metallic > 0.99f && roughness < 0.01f))
+        for (uint32_t o = 0; o < 8; ++o)
         {
-            // Mirror: explicit mirror material, or perfect-metallic PBR params (delta BRDF, no NEE)
-            MirrorBSDF mirrorBsdf{ albedo };
-            glm::vec3 wo = -ray.direction;
-            BSDFSample sample = mirrorBsdf.sample(hit.normal, wo);
-
-            throughput *= sample.throughput;
-            prevBsdfPdf = sample.pdf;
-            prevWasDelta = true;
-
-            ray.origin    = hit.position + offsetNormal * m_rayEps;
-            ray.direction = sample.direction;
+            if (octants[o + 1] > octants[o])
+                occludedStream(&sorted[octants[o]], &sortedMax[octants[o]], octants[o + 1] - octants[o],
+                               &sortedOccluded[octants[o]]);
         }
-        else
+        for (uint32_t s = 0; s < n; ++s)
         {
-            // Cook-Torrance GGX (handles both diffuse and metallic materials)
-            glm::vec3 wo = -ray.direction;
-            CookTorranceBSDF bsdf{ albedo, roughness, metallic, hit.ior };
+            if (sortedOccluded[s])
+                setBit(begin + order[s]);
+        }
+    });
+}
 
-            // --- NEE: emissive triangle sampling ---
-            if (m_enableNEE && m_enableEmissive && hasLights)
-            {
-                uint32_t lightTriIdx;
-                glm::vec3 lightPos = sampleLightPoint(rng, lightTriIdx);
-                const auto& lightData = m_triData[lightTriIdx];
+// --- Tile scheduler ---
 
-                glm::vec3 toLight = lightPos - hit.position;
-                float dist = glm::length(toLight);
-                glm::vec3 lightDir = toLight / dist;
+static uint32_t mortonCode2D(uint32_t x, uint32_t y)
+{
+    auto spread = [](uint32_t v)
+    {
+        v &= 0x0000ffffu;
+        v = (v | (v << 8)) & 0x00ff00ffu;
+        v = (v | (v << 4)) & 0x0f0f0f0fu;
+        v = (v | (v << 2)) & 0x33333333u;
+        v = (v | (v << 1)) & 0x55555555u;
+        return v;
+    };
+    return spread(x) | (spread(y) << 1);
+}
 
-                float cosSurface = glm::dot(hit.normal, lightDir);
-                float cosLight   = glm::dot(lightData.geometricNormal, -lightDir);
+void CPURaytracer::buildTiles()
+{
+    const uint32_t tilesX = (m_width + TILE_SIZE - 1) / TILE_SIZE;
+    const uint32_t tilesY = (m_height + TILE_SIZE - 1) / TILE_SIZE;
+    std::vector<std::pair<uint32_t, Tile>> keyed;
+    keyed.reserve(tilesX * tilesY);
+    for (uint32_t ty = 0; ty < tilesY; ++ty)
+    {
+        for (uint32_t tx = 0; tx < tilesX; ++tx)
+        {
+            const Tile tile{ tx * TILE_SIZE, ty * TILE_SIZE,
+                             std::min((tx + 1) * TILE_SIZE, m_width), std::min((ty + 1) * TILE_SIZE, m_height) };
+            keyed.push_back({ mortonCode2D(tx, ty), tile });
+        }
+    }
 
-                if (cosSurface > 0.0f && cosLight > 0.0f && glm::dot(offsetNormal, lightDir) > 0.0f)
-                {
-                    Ray shadowRay;
-                    shadowRay.origin    = hit.position + offsetNormal * m_rayEps;
-                    shadowRay.direction = lightDir;
+    // Neighbouring tiles stay close in the order, so a worker's run (and the
+    // half a thief takes from it) covers a compact patch of the screen
+    std::sort(keyed.begin(), keyed.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+    m_tiles.resize(keyed.size());
+    for (size_t i = 0; i < keyed.size(); ++i)
+        m_tiles[i] = keyed[i].second;
+}
 
-                    if (!traceShadowRay(shadowRay, dist - 2.0f * m_rayEps))
-                    {
-                        float pdfLight = (dist * dist) / (cosLight * m_totalLightArea);
-                        float pdfBsdf  = bsdf.pdf(hit.normal, wo, lightDir);
-                        float misWeight = pdfLight / (pdfLight + pdfBsdf);
+static inline uint64_t packTileRange(uint32_t begin, uint32_t end)
+{
+    return uint64_t(begin) | (uint64_t(end) << 32);
+}
 
-                        glm::vec3 brdf = bsdf.evaluate(hit.normal, wo, lightDir);
-                        radiance += throughput * brdf * lightData.emissive * cosSurface / pdfLight * misWeight;
-                    }
-                }
+bool CPURaytracer::nextTiles(uint32_t worker, uint32_t maxTiles, uint32_t& begin, uint32_t& end)
+{
+    std::atomic<uint64_t>& own = m_tileQueues[worker].range;
+    const uint32_t workerCount = static_cast<uint32_t>(m_tileQueues.size());
+    for (;;)
+    {
+        if (m_cancelSample.load(std::memory_order_relaxed))
+        {
+            m_passCancelled.store(true, std::memory_order_relaxed);
+            return false;
+        }
+        // Out of budget: what is left stays queued for the next slice. Each
+        // worker still gets one run per slice, so any budget makes progress.
+        if (m_passTimed && m_workerStats[worker].tiles > 0 && std::chrono::steady_clock::now() >= m_passDeadline)
+            return false;
+
+        uint64_t range = own.load(std::memory_order_acquire);
+        const uint32_t first = static_cast<uint32_t>(range), last = static_cast<uint32_t>(range >> 32);
+        if (first < last)
+        {
+            const uint32_t take = std::min(maxTiles, last - first);
+            if (own.compare_exchange_weak(range, packTileRange(first + take, last), std::memory_order_acq_rel))
+            {
+                begin = first;
+                end = first + take;
+                return true;
             }
+            continue;
+        }
 
-            // --- NEE: point light sampling ---
-            if (m_enableNEE && m_pointLightEnabled)
+        // Own queue is empty: move the back half of the next non-empty queue
+        // into it. Nothing is added to the queues during a pass, so once
+        // every one is empty the worker is done.
+        bool stole = false;
+        for (uint32_t k = 1; k < workerCount && !stole; ++k)
+        {
+            std::atomic<uint64_t>& victim = m_tileQueues[(worker + k) % workerCount].range;
+            uint64_t theirs = victim.load(std::memory_order_acquire);
+            for (;;)
             {
-                glm::vec3 toLight = m_pointLightPos - hit.position;
-                float dist = glm::length(toLight);
-                glm::vec3 lightDir = toLight / dist;
-
-                float cosSurface = glm::dot(hit.normal, lightDir);
-
-                if (cosSurface > 0.0f && glm::dot(offsetNormal, lightDir) > 0.0f)
+                const uint32_t vFirst = static_cast<uint32_t>(theirs), vLast = static_cast<uint32_t>(theirs >> 32);
+                if (vFirst >= vLast)
+                    break;
+                const uint32_t split = vLast - (vLast - vFirst + 1) / 2;
+                if (victim.compare_exchange_weak(theirs, packTileRange(vFirst, split), std::memory_order_acq_rel))
                 {
-                    Ray shadowRay;
-                    shadowRay.origin    = hit.position + offsetNormal * m_rayEps;
-                    shadowRay.direction = lightDir;
-
-                    if (!traceShadowRay(shadowRay, dist - 2.0f * m_rayEps))
-                    {
-                        glm::vec3 brdf = bsdf.evaluate(hit.normal, wo, lightDir);
-                        // Point light: no MIS (delta distribution, BSDF can never hit it)
-                        // Inverse-square attenuation
-                        radiance += throughput * brdf * m_pointLightColor * cosSurface / (dist * dist);
-                    }
+                    own.store(packTileRange(split, vLast), std::memory_order_release);
+                    ++m_workerStats[worker].steals;
+                    stole = true;
+                    break;
                 }
             }
+        }
+        if (!stole)
+            return false;
+    }
+}
 
-            // --- NEE: directional (sun) light sampling ---
-            if (m_enableNEE && m_sunEnabled)
-            {
-                // Sample direction uniformly within sun cone
-                float sunSolidAngle = 2.0f * PI * (1.0f - m_sunCosAngle);
-                float u1 = rng.next();
-                float u2 = rng.next();
-
-                float cosTheta = 1.0f - u1 * (1.0f - m_sunCosAngle);
-                float sinTheta = std::sqrt(1.0f - cosTheta * cosTheta);
-                float phi = 2.0f * PI * u2;
+void CPURaytracer::traceTiles(uint32_t worker)
+{
+    if (m_wavefront)
+    {
+        traceTilesWavefront(worker);
+        return;
+    }
 
-                // Build ONB around -sunDir (direction toward sun)
-                glm::vec3 toSun = -m_sunDir;
-                glm::vec3 t, b;
-                buildONB(toSun, t, b);
+    WorkerStats& stats = m_workerStats[worker];
+    uint32_t first, end;
+    while (nextTiles(worker, 1, first, end))
+    {
+        const auto start = std::chrono::steady_clock::now();
+        stats.rays += traceTile(m_tiles[m_activeTiles[first]]);
+        updateTileConvergence(m_activeTiles[first]);
+        stats.busyMs += std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+        ++stats.tiles;
+    }
+}
 
-                glm::vec3 lightDir = t * (std::cos(phi) * sinTheta)
-                                   + b * (std::sin(phi) * sinTheta)
-                                   + toSun * cosTheta;
-                lightDir = glm::normalize(lightDir);
+void CPURaytracer::updateTileConvergence(uint32_t tile)
+{
+    if (!m_adaptiveSampling)
+        return;
+    const Tile& bounds = m_tiles[tile];
+    const uint32_t samples = m_pixelSamples[bounds.y0 * m_width + bounds.x0];
+    if (samples < std::max(2u, m_adaptiveMinSamples))
+        return;
 
-                float cosSurface = glm::dot(hit.normal, lightDir);
+    // The odd-sample average is an estimate from half the samples; its
+    // distance to the full average tracks the remaining noise
+    const float invAll = 1.0f / static_cast<float>(samples);
+    const float invOdd = 1.0f / static_cast<float>(samples / 2);
+    float error = 0.0f;
+    for (uint32_t y = bounds.y0; y < bounds.y1; ++y)
+    {
+        for (uint32_t x = bounds.x0; x < bounds.x1; ++x)
+        {
+            const uint32_t i = y * m_width + x;
+            const glm::vec3 all = m_accumBuffer[i] * invAll;
+            const glm::vec3 diff = glm::abs(all - m_oddAccumBuffer[i] * invOdd);
+            error += (diff.r + diff.g + diff.b) / std::sqrt(std::max(all.r + all.g + all.b, 1e-4f));
+        }
+    }
+    error /= static_cast<float>((bounds.x1 - bounds.x0) * (bounds.y1 - bounds.y0));
+    if (error < m_adaptiveThreshold)
+        m_tileConverged[tile] = 1;
+}
 
-                if (cosSurface > 0.0f && glm::dot(offsetNormal, lightDir) > 0.0f)
+uint64_t CPURaytracer::traceTile(const Tile& tile)
+{
+    uint64_t rayCount = 0;
+    if (m_packetTracing && !isInstanced())
+    {
+        // Primary rays of each packet-sized block are traced as one packet;
+        // every pixel then continues with its own RNG, so the image is unchanged
+        constexpr uint32_t tileHeight = PACKET_SIZE / PACKET_TILE_WIDTH;
+        Ray rays[PACKET_SIZE];
+        HitRecord hits[PACKET_SIZE];
+        uint32_t pixels[PACKET_SIZE];
+        RNG rngs[PACKET_SIZE];
+        for (uint32_t y0 = tile.y0; y0 < tile.y1; y0 += tileHeight)
+        {
+            for (uint32_t x0 = tile.x0; x0 < tile.x1; x0 += PACKET_TILE_WIDTH)
+            {
+                uint32_t n = 0;
+                for (uint32_t y = y0; y < std::min(y0 + tileHeight, tile.y1); ++y)
                 {
-                    Ray shadowRay;
-                    shadowRay.origin    = hit.position + offsetNormal * m_rayEps;
-                    shadowRay.direction = lightDir;
-
-                    if (!traceShadowRay(shadowRay, std::numeric_limits<float>::max()))
+                    for (uint32_t x = x0; x < std::min(x0 + PACKET_TILE_WIDTH, tile.x1); ++x)
                     {
-                        float lightPdf  = 1.0f / sunSolidAngle;
-                        float bsdfPdf   = bsdf.pdf(hit.normal, wo, lightDir);
-                        float misWeight = lightPdf / (lightPdf + bsdfPdf);
-
-                        glm::vec3 brdf = bsdf.evaluate(hit.normal, wo, lightDir);
-                        radiance += throughput * brdf * m_sunColor * cosSurface * misWeight;
+                        RNG& rng = rngs[n];
+                        rng = pixelRNG(x, y);
+                        float jx = m_enableAA ? rng.next() : 0.5f;
+                        float jy = m_enableAA ? rng.next() : 0.5f;
+                        rays[n] = generateRay(static_cast<int>(x), static_cast<int>(y), jx, jy, rng);
+                        pixels[n++] = y * m_width + x;
                     }
                 }
-            }
-
-            // --- NEE: environment map importance sampling ---
-            if (m_enableNEE && m_enableEnvironment && m_hasEnvMap && m_envTotalIntegral > 0.0f)
-            {
-                glm::vec3 envDir;
-                float envPdf;
-                glm::vec3 envRad = sampleEnvMap(rng, envDir, envPdf);
 
-                float cosSurface = glm::dot(hit.normal, envDir);
+                traceRayPacket(rays, n, hits);
 
-                if (cosSurface > 0.0f && envPdf > 1e-8f && glm::dot(offsetNormal, envDir) > 0.0f)
+                for (uint32_t i = 0; i < n; ++i)
                 {
-                    Ray shadowRay;
-                    shadowRay.origin    = hit.position + offsetNormal * m_rayEps;
-                    shadowRay.direction = envDir;
-
-                    if (!traceShadowRay(shadowRay, std::numeric_limits<float>::max()))
-                    {
-                        float bsdfPdf   = bsdf.pdf(hit.normal, wo, envDir);
-                        float misWeight = envPdf / (envPdf + bsdfPdf);
-
-                        glm::vec3 brdf = bsdf.evaluate(hit.normal, wo, envDir);
-                        radiance += throughput * brdf * envRad * m_envLightMultiplier * cosSurface / envPdf * misWeight;
-                    }
+                    glm::vec3 pixAlbedo(0.0f), pixNormal(0.0f);
+                    glm::vec3 color = pathTrace(rays[i], rngs[i], &pixAlbedo, &pixNormal, &hits[i], &rayCount);
+                    accumulatePixel(pixels[i], color, pixAlbedo, pixNormal);
                 }
             }
-
-            // --- BSDF sampling for next bounce ---
-            BSDFSample sample = bsdf.sample(hit.normal, offsetNormal, wo, rng.next(), rng.next(), rng.next());
-
-            if (sample.pdf < 1e-8f)
-                break;
-
-            // Don't bounce below the actual geometric surface — prevents self-intersection
-            if (glm::dot(sample.direction, offsetNormal) < 0.0f)
-                break;
-
-            throughput *= sample.throughput;
-            prevBsdfPdf = sample.pdf;
-            prevWasDelta = false;
-
-            ray.origin    = hit.position + offsetNormal * m_rayEps;
-            ray.direction = sample.direction;
         }
+        return rayCount;
     }
 
-    return radiance;
-}
-
-// --- Thread pool ---
-
-void CPURaytracer::traceRowRange(uint32_t startRow, uint32_t endRow)
-{
-    for (uint32_t y = startRow; y < endRow; ++y)
+    for (uint32_t y = tile.y0; y < tile.y1; ++y)
     {
-        for (uint32_t x = 0; x < m_width; ++x)
+        for (uint32_t x = tile.x0; x < tile.x1; ++x)
         {
-            uint32_t seed = hash(x + y * m_width) ^ hash(m_sampleCount);
-            RNG rng(seed);
+            RNG rng = pixelRNG(x, y);
 
             float jx = m_enableAA ? rng.next() : 0.5f;
             float jy = m_enableAA ? rng.next() : 0.5f;
             Ray ray = generateRay(static_cast<int>(x), static_cast<int>(y), jx, jy, rng);
 
             glm::vec3 pixAlbedo(0.0f), pixNormal(0.0f);
-            glm::vec3 color = pathTrace(ray, rng, &pixAlbedo, &pixNormal);
+            glm::vec3 color = pathTrace(ray, rng, &pixAlbedo, &pixNormal, nullptr, &rayCount);
+            accumulatePixel(y * m_width + x, color, pixAlbedo, pixNormal);
+        }
+    }
+    return rayCount;
+}
 
-            // NaN/Inf guard — protect accumulation buffer
-            if (std::isnan(color.r) || std::isnan(color.g) || std::isnan(color.b) ||
-                std::isinf(color.r) || std::isinf(color.g) || std::isinf(color.b))
-                color = glm::vec3(0.0f);
+// --- Thread pool ---
 
-            if (m_enableFireflyClamping)
-            {
-                float lum = 0.2126f * color.r + 0.7152f * color.g + 0.0722f * color.b;
-                if (lum > m_fireflyClampThreshold)
-                    color *= m_fireflyClampThreshold / lum;
-            }
+void CPURaytracer::accumulatePixel(uint32_t index, glm::vec3 color, const glm::vec3& albedo, const glm::vec3& normal)
+{
+    // NaN/Inf guard — protect accumulation buffer
+    if (std::isnan(color.r) || std::isnan(color.g) || std::isnan(color.b) ||
+        std::isinf(color.r) || std::isinf(color.g) || std::isinf(color.b))
+        color = glm::vec3(0.0f);
 
-            m_accumBuffer[y * m_width + x] += color;
-            m_albedoBuffer[y * m_width + x] = pixAlbedo;
-            m_normalBuffer[y * m_width + x] = pixNormal;
-        }
+    if (m_enableFireflyClamping)
+    {
+        float lum = 0.2126f * color.r + 0.7152f * color.g + 0.0722f * color.b;
+        if (lum > m_fireflyClampThreshold)
+            color *= m_fireflyClampThreshold / lum;
     }
+
+    m_accumBuffer[index] += color;
+    if (m_pixelSamples[index]++ & 1u)
+        m_oddAccumBuffer[index] += color;
+    m_albedoBuffer[index] = albedo;
+    m_normalBuffer[index] = normal;
 }
 
 void CPURaytracer::workerLoop(uint32_t id)
 {
     uint64_t lastEpoch = 0;
+    const std::function<void()>* job = nullptr;
     while (true)
     {
         {
@@ -1229,29 +4324,38 @@ void CPURaytracer::workerLoop(uint32_t id)
             m_cvWork.wait(lock, [&]{ return m_poolEpoch > lastEpoch || m_poolStop; });
             if (m_poolStop) return;
             lastEpoch = m_poolEpoch;
+            job = m_poolJob;
         }
 
-        traceRowRange(m_workerRanges[id].startRow, m_workerRanges[id].endRow);
+        if (job)
+            (*job)();
+        else
+            traceTiles(id);
 
+        std::unique_lock<std::mutex> lock(m_poolMutex);
+        if (--m_poolPending != 0)
+            continue;
+        if (job)
         {
-            std::lock_guard<std::mutex> lock(m_poolMutex);
-            if (--m_poolPending == 0)
-                m_cvDone.notify_one();
+            m_cvDone.notify_all();
+            continue;
         }
-    }
-}
 
-void CPURaytracer::rebuildWorkerRanges()
-{
-    uint32_t threadCount  = static_cast<uint32_t>(m_workerRanges.size());
-    uint32_t rowsPerThread = m_height / threadCount;
-    uint32_t remainder     = m_height % threadCount;
-    uint32_t startRow = 0;
-    for (uint32_t i = 0; i < threadCount; ++i)
-    {
-        uint32_t endRow = startRow + rowsPerThread + (i < remainder ? 1 : 0);
-        m_workerRanges[i] = { startRow, endRow };
-        startRow = endRow;
+        // Last one out of a pass: the others are parked until the next epoch
+        lock.unlock();
+        const bool next = endPass();
+        lock.lock();
+        if (next)
+        {
+            m_poolPending = static_cast<uint32_t>(m_workers.size());
+            ++m_poolEpoch;
+            m_cvWork.notify_all();
+        }
+        else
+        {
+            m_sampling.store(false, std::memory_order_release);
+            m_cvDone.notify_all();
+        }
     }
 }
 
@@ -1259,15 +4363,26 @@ void CPURaytracer::buildThreadPool()
 {
     shutdownPool();
 
-    uint32_t threadCount = std::max(1u, std::thread::hardware_concurrency());
-    m_workerRanges.resize(threadCount);
-    rebuildWorkerRanges();
+    uint32_t threadCount = m_workerCountRequest ? m_workerCountRequest
+                                                : std::max(1u, std::thread::hardware_concurrency());
+    m_tileQueues = std::vector<TileQueue>(threadCount);
+    m_workerStats.assign(threadCount, WorkerStats{});
 
     m_workers.reserve(threadCount);
     for (uint32_t i = 0; i < threadCount; ++i)
         m_workers.emplace_back(&CPURaytracer::workerLoop, this, i);
 }
 
+void CPURaytracer::setWorkerCount(uint32_t count)
+{
+    if (count == m_workerCountRequest)
+        return;
+    cancelSample();
+    m_workerCountRequest = count;
+    if (!m_workers.empty())
+        buildThreadPool();
+}
+
 void CPURaytracer::shutdownPool()
 {
     if (m_workers.empty()) return;
@@ -1282,7 +4397,8 @@ void CPURaytracer::shutdownPool()
     for (auto& t : m_workers)
         t.join();
     m_workers.clear();
-    m_workerRanges.clear();
+    m_tileQueues.clear();
+    m_workerStats.clear();
 
     // Reset so new threads (after rebuild) start cleanly from epoch 0
     m_poolEpoch   = 0;
@@ -1290,8 +4406,27 @@ void CPURaytracer::shutdownPool()
     m_poolStop    = false;
 }
 
+void CPURaytracer::dispatchPool(const std::function<void()>& job)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_poolMutex);
+        m_poolPending = static_cast<uint32_t>(m_workers.size());
+        m_poolJob = &job;
+        ++m_poolEpoch;
+    }
+    m_cvWork.notify_all();
+
+    // Wait for all workers to finish
+    {
+        std::unique_lock<std::mutex> lock(m_poolMutex);
+        m_cvDone.wait(lock, [&]{ return m_poolPending == 0; });
+        m_poolJob = nullptr;
+    }
+}
+
 CPURaytracer::~CPURaytracer()
 {
+    cancelSample();
     shutdownPool();
 }
 
@@ -1299,31 +4434,166 @@ CPURaytracer::~CPURaytracer()
 
 void CPURaytracer::traceSample()
 {
-    if (m_width == 0 || m_height == 0)
+    cancelSample();
+    startSampling(false, 0);
+
+    std::unique_lock<std::mutex> lock(m_poolMutex);
+    m_cvDone.wait(lock, [&]{ return !m_sampling.load(std::memory_order_relaxed); });
+}
+
+void CPURaytracer::traceSampleAsync(uint32_t maxSamples)
+{
+    // A running pass reads the limit only when it ends
+    m_maxSamples.store(maxSamples, std::memory_order_relaxed);
+    if (!isSampling())
+        startSampling(true, maxSamples);
+}
+
+bool CPURaytracer::traceSampleBudget(float budgetMs)
+{
+    if (isSampling())
+        cancelSample();
+
+    const uint32_t before = m_sampleCount.load(std::memory_order_relaxed);
+    m_passTimed = true;
+    m_passDeadline = std::chrono::steady_clock::now()
+                   + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                         std::chrono::duration<float, std::milli>(std::max(0.0f, budgetMs)));
+    startSampling(false, 0);
+    {
+        std::unique_lock<std::mutex> lock(m_poolMutex);
+        m_cvDone.wait(lock, [&]{ return !m_sampling.load(std::memory_order_relaxed); });
+    }
+    m_passTimed = false;
+    return m_sampleCount.load(std::memory_order_relaxed) != before;
+}
+
+void CPURaytracer::cancelSample()
+{
+    // A budgeted pass waiting for its next slice is dropped like a cancelled one
+    if (m_passPaused)
+    {
+        m_passPaused = false;
+        ++m_passIndex;
+    }
+    if (!isSampling())
+        return;
+
+    m_cancelSample.store(true, std::memory_order_relaxed);
+    {
+        std::unique_lock<std::mutex> lock(m_poolMutex);
+        m_cvDone.wait(lock, [&]{ return !m_sampling.load(std::memory_order_relaxed); });
+    }
+    m_cancelSample.store(false, std::memory_order_relaxed);
+}
+
+void CPURaytracer::startSampling(bool continuous, uint32_t maxSamples)
+{
+    m_continuousSampling = continuous;
+    m_maxSamples.store(maxSamples, std::memory_order_relaxed);
+    if (m_passPaused)
+        startPassClock();
+    else if (!beginPass())
         return;
 
-    // Dispatch work to persistent thread pool
     {
         std::lock_guard<std::mutex> lock(m_poolMutex);
+        m_sampling.store(true, std::memory_order_relaxed);
         m_poolPending = static_cast<uint32_t>(m_workers.size());
+        m_poolJob = nullptr;
         ++m_poolEpoch;
     }
     m_cvWork.notify_all();
+}
 
-    // Wait for all workers to finish
+bool CPURaytracer::beginPass()
+{
+    if (m_width == 0 || m_height == 0)
+        return false;
+    const uint32_t maxSamples = m_maxSamples.load(std::memory_order_relaxed);
+    if (maxSamples != 0 && m_sampleCount.load(std::memory_order_relaxed) >= maxSamples)
+        return false;
+
+    m_activeTiles.clear();
+    for (uint32_t t = 0; t < m_tiles.size(); ++t)
     {
-        std::unique_lock<std::mutex> lock(m_poolMutex);
-        m_cvDone.wait(lock, [&]{ return m_poolPending == 0; });
+        if (!m_tileConverged[t])
+            m_activeTiles.push_back(t);
+    }
+    if (m_activeTiles.empty())
+        return false;
+
+    // Even shares of the Morton-ordered tiles; the rest is balanced by stealing
+    const uint32_t workerCount = static_cast<uint32_t>(m_tileQueues.size());
+    const uint32_t tileCount = static_cast<uint32_t>(m_activeTiles.size());
+    for (uint32_t i = 0; i < workerCount; ++i)
+    {
+        m_tileQueues[i].range.store(packTileRange(static_cast<uint32_t>(uint64_t(tileCount) * i / workerCount),
+                                                  static_cast<uint32_t>(uint64_t(tileCount) * (i + 1) / workerCount)),
+                                    std::memory_order_relaxed);
+    }
+    startPassClock();
+    return true;
+}
+
+void CPURaytracer::startPassClock()
+{
+    std::fill(m_workerStats.begin(), m_workerStats.end(), WorkerStats{});
+    m_passCancelled.store(false, std::memory_order_relaxed);
+    m_passStart = std::chrono::steady_clock::now();
+}
+
+bool CPURaytracer::endPass()
+{
+    const float frameMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - m_passStart).count();
+    uint64_t rays = 0;
+    for (WorkerStats& stats : m_workerStats)
+    {
+        stats.idleMs = std::max(0.0f, frameMs - stats.busyMs);
+        rays += stats.rays;
     }
+    m_raysTraced.fetch_add(rays, std::memory_order_relaxed);
+    m_convergedTiles = static_cast<uint32_t>(std::count(m_tileConverged.begin(), m_tileConverged.end(), uint8_t(1)));
 
-    ++m_sampleCount;
+    if (m_passCancelled.load(std::memory_order_relaxed))
+    {
+        ++m_passIndex;
+        return false;
+    }
+
+    m_passPaused = m_passTimed && std::any_of(m_tileQueues.begin(), m_tileQueues.end(), [](const TileQueue& q)
+    {
+        const uint64_t range = q.range.load(std::memory_order_relaxed);
+        return static_cast<uint32_t>(range) < static_cast<uint32_t>(range >> 32);
+    });
+    if (m_passPaused)
+    {
+        resolveFrame(false);
+        return false;
+    }
+
+    ++m_passIndex;
+    if (m_pathGuiding)
+        m_pathGuide.endPass();
+    resolveFrame(true);
+    return m_continuousSampling && !m_cancelSample.load(std::memory_order_relaxed) && beginPass();
+}
+
+void CPURaytracer::resolveFrame(bool completed)
+{
+    // The back frame is never read, so it fills without the lock; only the
+    // swap waits for a reader of the front one
+    Frame& frame = m_frames[m_frontFrame ^ 1u];
+    frame.workerStats = m_workerStats;
+    frame.samples = m_pixelSamples;
 
-    float invSamples = 1.0f / static_cast<float>(m_sampleCount);
     float exposureMul = std::pow(2.0f, m_exposure);
     float invGamma = 1.0f / m_gamma;
     for (uint32_t i = 0; i < m_width * m_height; ++i)
     {
-        glm::vec3 c = m_accumBuffer[i] * invSamples * exposureMul;
+        float inv = m_pixelSamples[i] > 0 ? 1.0f / static_cast<float>(m_pixelSamples[i]) : 0.0f;
+        frame.hdr[i] = m_accumBuffer[i] * inv;
+        glm::vec3 c = frame.hdr[i] * exposureMul;
 
         if (m_enableACES)
         {
@@ -1338,22 +4608,68 @@ void CPURaytracer::traceSample()
 
         c = glm::pow(c, glm::vec3(invGamma));
 
-        m_pixelBuffer[i * 4 + 0] = static_cast<uint8_t>(c.r * 255.0f);
-        m_pixelBuffer[i * 4 + 1] = static_cast<uint8_t>(c.g * 255.0f);
-        m_pixelBuffer[i * 4 + 2] = static_cast<uint8_t>(c.b * 255.0f);
-        m_pixelBuffer[i * 4 + 3] = 255;
+        frame.pixels[i * 4 + 0] = static_cast<uint8_t>(c.r * 255.0f);
+        frame.pixels[i * 4 + 1] = static_cast<uint8_t>(c.g * 255.0f);
+        frame.pixels[i * 4 + 2] = static_cast<uint8_t>(c.b * 255.0f);
+        frame.pixels[i * 4 + 3] = 255;
     }
+
+    std::lock_guard<std::mutex> lock(m_frameMutex);
+    m_frontFrame ^= 1u;
+    if (completed)
+        m_sampleCount.fetch_add(1, std::memory_order_release);
+}
+
+// --- Front frame ---
+
+void CPURaytracer::getPixelBuffer(std::vector<uint8_t>& outRGBA) const
+{
+    std::lock_guard<std::mutex> lock(m_frameMutex);
+    outRGBA = m_frames[m_frontFrame].pixels;
 }
 
 void CPURaytracer::getLinearHDR(std::vector<float>& outRGB) const
 {
-    outRGB.resize(m_width * m_height * 3);
-    float inv = (m_sampleCount > 0) ? 1.0f / static_cast<float>(m_sampleCount) : 0.0f;
-    for (uint32_t i = 0; i < m_width * m_height; ++i)
+    std::lock_guard<std::mutex> lock(m_frameMutex);
+    const Frame& frame = m_frames[m_frontFrame];
+    outRGB.resize(frame.hdr.size() * 3);
+    for (size_t i = 0; i < frame.hdr.size(); ++i)
+    {
+        outRGB[i * 3 + 0] = frame.hdr[i].r;
+        outRGB[i * 3 + 1] = frame.hdr[i].g;
+        outRGB[i * 3 + 2] = frame.hdr[i].b;
+    }
+}
+
+std::vector<CPURaytracer::WorkerStats> CPURaytracer::getWorkerStats() const
+{
+    std::lock_guard<std::mutex> lock(m_frameMutex);
+    return m_frames[m_frontFrame].workerStats;
+}
+
+float CPURaytracer::getConvergedTileFraction() const
+{
+    return m_tiles.empty() ? 0.0f : static_cast<float>(m_convergedTiles) / static_cast<float>(m_tiles.size());
+}
+
+std::vector<uint32_t> CPURaytracer::getPixelSampleCounts() const
+{
+    std::lock_guard<std::mutex> lock(m_frameMutex);
+    return m_frames[m_frontFrame].samples;
+}
+
+void CPURaytracer::getSampleCountHeatmap(std::vector<float>& outRGB) const
+{
+    std::lock_guard<std::mutex> lock(m_frameMutex);
+    const Frame& frame = m_frames[m_frontFrame];
+    outRGB.resize(frame.samples.size() * 3);
+    const float inv = 1.0f / static_cast<float>(std::max(1u, m_sampleCount.load(std::memory_order_relaxed)));
+    for (size_t i = 0; i < frame.samples.size(); ++i)
     {
-        outRGB[i * 3 + 0] = m_accumBuffer[i].r * inv;
-        outRGB[i * 3 + 1] = m_accumBuffer[i].g * inv;
-        outRGB[i * 3 + 2] = m_accumBuffer[i].b * inv;
+        const float t = std::min(1.0f, static_cast<float>(frame.samples[i]) * inv);
+        outRGB[i * 3 + 0] = std::clamp(2.0f * t - 1.0f, 0.0f, 1.0f);
+        outRGB[i * 3 + 1] = 1.0f - std::abs(2.0f * t - 1.0f);
+        outRGB[i * 3 + 2] = std::clamp(1.0f - 2.0f * t, 0.0f, 1.0f);
     }
 }
 
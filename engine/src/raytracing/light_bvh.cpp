@@ -0,0 +1,343 @@
+#include <vex/raytracing/light_bvh.h>
+#include <vex/raytracing/bsdf.h>
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+namespace vex
+{
+
+static constexpr uint32_t SAOH_BINS = 12;
+static constexpr float ONE_MINUS_EPSILON = 0x1.fffffep-1f;
+
+static float safeSqrt(float x)
+{
+    return std::sqrt(std::max(x, 0.0f));
+}
+
+static float safeAcos(float x)
+{
+    return std::acos(std::clamp(x, -1.0f, 1.0f));
+}
+
+// cos(max(0, a - b)) and sin(max(0, a - b)) from the sines and cosines of a and b
+static float cosSubClamped(float sinA, float cosA, float sinB, float cosB)
+{
+    return cosA > cosB ? 1.0f : cosA * cosB + sinA * sinB;
+}
+
+static float sinSubClamped(float sinA, float cosA, float sinB, float cosB)
+{
+    return cosA > cosB ? 0.0f : sinA * cosB - cosA * sinB;
+}
+
+static bool isEmpty(const LightBounds& b)
+{
+    return b.bounds.min.x > b.bounds.max.x;
+}
+
+// Smallest cone around both cones: rotates a's axis towards b's until the
+// two just fit, or gives up on the whole sphere
+static void growCone(glm::vec3& axis, float& cosTheta, const glm::vec3& otherAxis, float otherCos)
+{
+    const float thetaA = safeAcos(cosTheta);
+    const float thetaB = safeAcos(otherCos);
+    const float thetaD = safeAcos(glm::dot(axis, otherAxis));
+    if (std::min(thetaD + thetaB, PI) <= thetaA)
+        return;
+    if (std::min(thetaD + thetaA, PI) <= thetaB)
+    {
+        axis = otherAxis;
+        cosTheta = otherCos;
+        return;
+    }
+
+    const float thetaO = 0.5f * (thetaA + thetaD + thetaB);
+    const glm::vec3 w = glm::cross(axis, otherAxis);
+    const float len = glm::length(w);
+    if (thetaO >= PI || len == 0.0f)
+    {
+        cosTheta = -1.0f;
+        return;
+    }
+    const float thetaR = thetaO - thetaA;
+    axis = glm::normalize(axis * std::cos(thetaR) + glm::cross(w / len, axis) * std::sin(thetaR));
+    cosTheta = std::cos(thetaO);
+}
+
+static void grow(LightBounds& a, const LightBounds& b)
+{
+    if (isEmpty(b))
+        return;
+    if (isEmpty(a))
+    {
+        a = b;
+        return;
+    }
+    a.bounds.grow(b.bounds);
+    a.power += b.power;
+    growCone(a.axis, a.cosThetaO, b.axis, b.cosThetaO);
+    a.cosThetaE = std::min(a.cosThetaE, b.cosThetaE);
+}
+
+// Solid angle measure of the directions the group radiates into
+static float orientationMeasure(const LightBounds& b)
+{
+    const float thetaO = safeAcos(b.cosThetaO);
+    const float thetaW = std::min(thetaO + safeAcos(b.cosThetaE), PI);
+    const float sinThetaO = safeSqrt(1.0f - b.cosThetaO * b.cosThetaO);
+    return 2.0f * PI * (1.0f - b.cosThetaO)
+         + 0.5f * PI * (2.0f * thetaW * sinThetaO - std::cos(thetaO - 2.0f * thetaW)
+                        - 2.0f * thetaO * sinThetaO + b.cosThetaO);
+}
+
+static float saohCost(const LightBounds& b)
+{
+    return isEmpty(b) ? 0.0f : b.power * orientationMeasure(b) * b.bounds.surfaceArea();
+}
+
+void LightBVH::clear()
+{
+    m_nodes.clear();
+    m_nodes.shrink_to_fit();
+    m_leaves.clear();
+    m_leaves.shrink_to_fit();
+}
+
+void LightBVH::build(std::span<const LightBounds> lights)
+{
+    m_nodes.clear();
+    m_leaves.assign(lights.size(), Node::INVALID);
+    if (lights.empty())
+        return;
+
+    std::vector<uint32_t> order(lights.size());
+    std::iota(order.begin(), order.end(), 0u);
+    m_nodes.reserve(2 * lights.size() - 1);
+    buildRecursive(lights, order.data(), static_cast<uint32_t>(order.size()), Node::INVALID);
+}
+
+uint32_t LightBVH::buildRecursive(std::span<const LightBounds> lights, uint32_t* order, uint32_t count,
+                                  uint32_t parent)
+{
+    LightBounds total;
+    AABB centroids;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        grow(total, lights[order[i]]);
+        centroids.grow(lights[order[i]].bounds.centroid());
+    }
+
+    const uint32_t index = static_cast<uint32_t>(m_nodes.size());
+    Node& node = m_nodes.emplace_back();
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        node.boundsMin[axis] = total.bounds.min[axis];
+        node.boundsMax[axis] = total.bounds.max[axis];
+        node.axis[axis]      = total.axis[axis];
+    }
+    node.power        = total.power;
+    node.cosThetaO    = total.cosThetaO;
+    node.cosThetaE    = total.cosThetaE;
+    node.childOrLight = Node::INVALID;
+    node.parent       = parent;
+    node.lightCount   = 0;
+    node.pad          = 0;
+
+    if (count == 1)
+    {
+        node.childOrLight = order[0];
+        node.lightCount = 1;
+        m_leaves[order[0]] = index;
+        return index;
+    }
+
+    // Bucketed SAOH over the centroid extent of every axis. Thin boxes are
+    // penalised for splits along their short sides (the Kr term), which would
+    // otherwise look free to the surface area.
+    const glm::vec3 extent = centroids.max - centroids.min;
+    const glm::vec3 boxExtent = total.bounds.max - total.bounds.min;
+    const float maxExtent = std::max({ boxExtent.x, boxExtent.y, boxExtent.z });
+    auto binOf = [&](uint32_t light, int axis)
+    {
+        const float c = lights[light].bounds.centroid()[axis];
+        const float t = (c - centroids.min[axis]) / extent[axis];
+        return std::min(SAOH_BINS - 1, static_cast<uint32_t>(t * static_cast<float>(SAOH_BINS)));
+    };
+
+    float bestCost = FLT_MAX;
+    int bestAxis = -1;
+    uint32_t bestBin = 0;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        if (extent[axis] <= 0.0f)
+            continue;
+
+        LightBounds bins[SAOH_BINS];
+        uint32_t binCount[SAOH_BINS] = {};
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            const uint32_t b = binOf(order[i], axis);
+            grow(bins[b], lights[order[i]]);
+            ++binCount[b];
+        }
+
+        float aboveCost[SAOH_BINS - 1];
+        LightBounds above;
+        for (uint32_t b = SAOH_BINS - 1; b > 0; --b)
+        {
+            grow(above, bins[b]);
+            aboveCost[b - 1] = saohCost(above);
+        }
+
+        const float axisWeight = maxExtent / boxExtent[axis];
+        LightBounds below;
+        uint32_t belowCount = 0;
+        for (uint32_t b = 0; b < SAOH_BINS - 1; ++b)
+        {
+            grow(below, bins[b]);
+            belowCount += binCount[b];
+            if (belowCount == 0 || belowCount == count)
+                continue;
+            const float cost = (saohCost(below) + aboveCost[b]) * axisWeight;
+            if (cost < bestCost)
+            {
+                bestCost = cost;
+                bestAxis = axis;
+                bestBin = b;
+            }
+        }
+    }
+
+    uint32_t mid = 0;
+    if (bestAxis >= 0)
+    {
+        mid = static_cast<uint32_t>(std::partition(order, order + count, [&](uint32_t light)
+        {
+            return binOf(light, bestAxis) <= bestBin;
+        }) - order);
+    }
+    if (mid == 0 || mid == count)
+    {
+        // Coincident centroids: any halving is as good as another
+        mid = count / 2;
+    }
+
+    buildRecursive(lights, order, mid, index);
+    const uint32_t second = buildRecursive(lights, order + mid, count - mid, index);
+    m_nodes[index].childOrLight = second;
+    return index;
+}
+
+float LightBVH::importance(const Node& node, const glm::vec3& p, const glm::vec3& n)
+{
+    const glm::vec3 lo(node.boundsMin[0], node.boundsMin[1], node.boundsMin[2]);
+    const glm::vec3 hi(node.boundsMax[0], node.boundsMax[1], node.boundsMax[2]);
+    const glm::vec3 center = 0.5f * (lo + hi);
+    const float radius2 = 0.25f * glm::dot(hi - lo, hi - lo);
+    const glm::vec3 d = p - center;
+    const float dist2 = glm::dot(d, d);
+    const glm::vec3 wi = dist2 > 0.0f ? d / std::sqrt(dist2) : glm::vec3(0.0f, 0.0f, 1.0f);
+
+    // Half-angle of the bounding sphere seen from p (everything from inside)
+    float cosThetaB = -1.0f, sinThetaB = 0.0f;
+    if (dist2 > radius2)
+    {
+        const float sin2ThetaB = radius2 / dist2;
+        cosThetaB = safeSqrt(1.0f - sin2ThetaB);
+        sinThetaB = std::sqrt(sin2ThetaB);
+    }
+
+    // Smallest angle between an emitter normal and the direction to p: the
+    // angle to the cone axis less the normal spread and the bounds' extent
+    const glm::vec3 axis(node.axis[0], node.axis[1], node.axis[2]);
+    const float cosThetaW = glm::dot(axis, wi);
+    const float sinThetaW = safeSqrt(1.0f - cosThetaW * cosThetaW);
+    const float sinThetaO = safeSqrt(1.0f - node.cosThetaO * node.cosThetaO);
+    const float cosThetaX = cosSubClamped(sinThetaW, cosThetaW, sinThetaO, node.cosThetaO);
+    const float sinThetaX = sinSubClamped(sinThetaW, cosThetaW, sinThetaO, node.cosThetaO);
+    const float cosThetaP = cosSubClamped(sinThetaX, cosThetaX, sinThetaB, cosThetaB);
+    if (cosThetaP <= node.cosThetaE)
+        return 0.0f;
+
+    // Distance clamped to the bounding sphere, so a cluster around p does
+    // not swamp its siblings
+    float result = node.power * cosThetaP / std::max(dist2, std::max(radius2, 1e-12f));
+
+    // Receiver: the light must be able to reach the upper hemisphere of n
+    if (glm::dot(n, n) > 0.0f)
+    {
+        const float cosThetaI = -glm::dot(wi, n);
+        const float sinThetaI = safeSqrt(1.0f - cosThetaI * cosThetaI);
+        result *= std::max(cosSubClamped(sinThetaI, cosThetaI, sinThetaB, cosThetaB), 0.0f);
+    }
+    return result;
+}
+
+bool LightBVH::sample(const glm::vec3& p, const glm::vec3& n, float u, uint32_t& outLight, float& outPmf) const
+{
+    if (m_nodes.empty())
+        return false;
+    if (m_nodes[0].isLeaf() && importance(m_nodes[0], p, n) <= 0.0f)
+        return false;
+
+    // A child with zero importance is never taken, so only the root can be
+    // unreachable
+    uint32_t index = 0;
+    float pmf = 1.0f;
+    while (!m_nodes[index].isLeaf())
+    {
+        const uint32_t first = index + 1;
+        const uint32_t second = m_nodes[index].childOrLight;
+        const float i0 = importance(m_nodes[first], p, n);
+        const float i1 = importance(m_nodes[second], p, n);
+        if (i0 <= 0.0f && i1 <= 0.0f)
+            return false;
+
+        const float p0 = i0 / (i0 + i1);
+        if (u < p0)
+        {
+            index = first;
+            pmf *= p0;
+            u = std::min(u / p0, ONE_MINUS_EPSILON);
+        }
+        else
+        {
+            index = second;
+            pmf *= 1.0f - p0;
+            u = std::min((u - p0) / (1.0f - p0), ONE_MINUS_EPSILON);
+        }
+    }
+
+    outLight = m_nodes[index].childOrLight;
+    outPmf = pmf;
+    return true;
+}
+
+float LightBVH::pmf(const glm::vec3& p, const glm::vec3& n, uint32_t light) const
+{
+    if (light >= m_leaves.size())
+        return 0.0f;
+
+    // Walk up from the leaf, taking the branch probability at every parent
+    uint32_t index = m_leaves[light];
+    if (index == 0)
+        return importance(m_nodes[0], p, n) > 0.0f ? 1.0f : 0.0f;
+
+    float pmf = 1.0f;
+    for (uint32_t parent = m_nodes[index].parent; parent != Node::INVALID; parent = m_nodes[index].parent)
+    {
+        const uint32_t first = parent + 1;
+        const float i0 = importance(m_nodes[first], p, n);
+        const float i1 = importance(m_nodes[m_nodes[parent].childOrLight], p, n);
+        const float self = index == first ? i0 : i1;
+        if (self <= 0.0f)
+            return 0.0f;
+        pmf *= self / (i0 + i1);
+        index = parent;
+    }
+    return pmf;
+}
+
+} // namespace vex
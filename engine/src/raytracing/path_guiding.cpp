@@ -0,0 +1,338 @@
+#include <vex/raytracing/path_guiding.h>
+#include <vex/raytracing/bsdf.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+namespace vex
+{
+
+// Iteration k splits a region that saw more than SPATIAL_SPLIT_SAMPLES *
+// sqrt(2^k) records; a quadrant subdivides while it holds more than
+// DTREE_SPLIT_FLUX of its tree's flux. Values from the paper.
+static constexpr float    SPATIAL_SPLIT_SAMPLES = 12000.0f;
+static constexpr float    DTREE_SPLIT_FLUX      = 0.01f;
+static constexpr uint32_t DTREE_MAX_DEPTH       = 20;
+static constexpr float    ONE_MINUS_EPSILON     = 0x1.fffffep-1f;
+
+static glm::vec2 directionToSquare(const glm::vec3& d)
+{
+    const float cosTheta = std::clamp(d.z, -1.0f, 1.0f);
+    float phi = std::atan2(d.y, d.x);
+    if (phi < 0.0f)
+        phi += 2.0f * PI;
+    return { std::clamp(0.5f * (cosTheta + 1.0f), 0.0f, ONE_MINUS_EPSILON),
+             std::clamp(phi / (2.0f * PI), 0.0f, ONE_MINUS_EPSILON) };
+}
+
+static glm::vec3 squareToDirection(const glm::vec2& p)
+{
+    const float cosTheta = 2.0f * p.x - 1.0f;
+    const float sinTheta = std::sqrt(std::max(0.0f, 1.0f - cosTheta * cosTheta));
+    const float phi = 2.0f * PI * p.y;
+    return { std::cos(phi) * sinTheta, std::sin(phi) * sinTheta, cosTheta };
+}
+
+// Quadrant of p and p rescaled to that quadrant
+static uint32_t descend(glm::vec2& p)
+{
+    const uint32_t qx = p.x >= 0.5f ? 1u : 0u;
+    const uint32_t qy = p.y >= 0.5f ? 1u : 0u;
+    p = p * 2.0f - glm::vec2(static_cast<float>(qx), static_cast<float>(qy));
+    return qx | (qy << 1);
+}
+
+// --- D-tree ---
+
+void PathGuide::DTree::reset()
+{
+    nodes.assign(1, QuadNode{});
+    total = 0.0f;
+}
+
+void PathGuide::DTree::build()
+{
+    // Children always come after their parent
+    for (size_t i = nodes.size(); i-- > 0;)
+    {
+        QuadNode& node = nodes[i];
+        for (uint32_t q = 0; q < 4; ++q)
+        {
+            if (node.child[q] == 0)
+                continue;
+            const QuadNode& child = nodes[node.child[q]];
+            node.sum[q] = child.sum[0] + child.sum[1] + child.sum[2] + child.sum[3];
+        }
+    }
+    total = nodes.empty() ? 0.0f : nodes[0].sum[0] + nodes[0].sum[1] + nodes[0].sum[2] + nodes[0].sum[3];
+}
+
+void PathGuide::DTree::record(glm::vec2 p, float value)
+{
+    uint32_t n = 0;
+    while (true)
+    {
+        QuadNode& node = nodes[n];
+        const uint32_t q = descend(p);
+        if (node.child[q] == 0)
+        {
+            std::atomic_ref<float>(node.sum[q]).fetch_add(value, std::memory_order_relaxed);
+            return;
+        }
+        n = node.child[q];
+    }
+}
+
+glm::vec2 PathGuide::DTree::sample(glm::vec2 u) const
+{
+    // Picks a column by its flux, then a quadrant in it, reusing what is left
+    // of each number below
+    glm::vec2 origin(0.0f);
+    float size = 1.0f;
+    uint32_t n = 0;
+    while (true)
+    {
+        u = glm::min(u, glm::vec2(ONE_MINUS_EPSILON));
+        const QuadNode& node = nodes[n];
+        const float left  = node.sum[0] + node.sum[2];
+        const float right = node.sum[1] + node.sum[3];
+
+        uint32_t qx = 0;
+        float x = u.x * (left + right);
+        if (x < left || right <= 0.0f)
+        {
+            u.x = x / left;
+        }
+        else
+        {
+            qx = 1;
+            u.x = (x - left) / right;
+        }
+
+        uint32_t qy = 0;
+        const float lower = node.sum[qx], upper = node.sum[qx + 2];
+        float y = u.y * (lower + upper);
+        if (y < lower || upper <= 0.0f)
+        {
+            u.y = y / lower;
+        }
+        else
+        {
+            qy = 1;
+            u.y = (y - lower) / upper;
+        }
+
+        size *= 0.5f;
+        origin += glm::vec2(static_cast<float>(qx), static_cast<float>(qy)) * size;
+        const uint32_t child = node.child[qx | (qy << 1)];
+        if (child == 0)
+            return origin + u * size;
+        n = child;
+    }
+}
+
+float PathGuide::DTree::pdf(glm::vec2 p) const
+{
+    float density = 1.0f;
+    uint32_t n = 0;
+    while (true)
+    {
+        const QuadNode& node = nodes[n];
+        const float sum = node.sum[0] + node.sum[1] + node.sum[2] + node.sum[3];
+        if (sum <= 0.0f)
+            return 0.0f;
+        const uint32_t q = descend(p);
+        density *= 4.0f * node.sum[q] / sum;
+        if (node.child[q] == 0)
+            return density;
+        n = node.child[q];
+    }
+}
+
+void PathGuide::DTree::refineFrom(const DTree& source, float threshold, uint32_t maxNodes)
+{
+    reset();
+    if (source.total <= 0.0f)
+        return;
+
+    // Breadth first, so a full node budget cuts off the finest levels. A
+    // quadrant that is a leaf in source spreads its flux evenly below it.
+    struct Item
+    {
+        uint32_t node;
+        uint32_t source;   // INVALID below source's leaves
+        float    flux;
+        uint32_t depth;
+    };
+    std::vector<Item> queue{ { 0, 0, source.total, 1 } };
+    const float minFlux = threshold * source.total;
+    for (size_t i = 0; i < queue.size(); ++i)
+    {
+        const Item item = queue[i];
+        for (uint32_t q = 0; q < 4; ++q)
+        {
+            const float flux = item.source != INVALID ? source.nodes[item.source].sum[q] : 0.25f * item.flux;
+            if (flux <= minFlux || item.depth >= DTREE_MAX_DEPTH || nodes.size() >= maxNodes)
+                continue;
+
+            const uint32_t child = static_cast<uint32_t>(nodes.size());
+            nodes.push_back(QuadNode{});
+            nodes[item.node].child[q] = child;
+            const uint32_t next = item.source != INVALID ? source.nodes[item.source].child[q] : 0;
+            queue.push_back({ child, next != 0 ? next : INVALID, flux, item.depth + 1 });
+        }
+    }
+    nodes.shrink_to_fit();
+}
+
+// --- Spatial tree ---
+
+void PathGuide::clear()
+{
+    std::vector<SpatialNode>().swap(m_nodes);
+    std::vector<Region>().swap(m_regions);
+    m_iteration = 0;
+    m_passesInIteration = 0;
+}
+
+void PathGuide::reset(const AABB& bounds)
+{
+    clear();
+    if (bounds.min.x > bounds.max.x)
+        return;
+
+    // A cube, so that cycling the split axis keeps the regions compact
+    const glm::vec3 extent = bounds.max - bounds.min;
+    const float half = 0.5f * std::max({ extent.x, extent.y, extent.z }) * 1.01f + 1e-4f;
+    const glm::vec3 center = bounds.centroid();
+    m_bounds.min = center - glm::vec3(half);
+    m_bounds.max = center + glm::vec3(half);
+
+    m_nodes.push_back({ 0, 0 });
+    m_regions.emplace_back().building.reset();
+}
+
+uint32_t PathGuide::regionAt(const glm::vec3& p) const
+{
+    glm::vec3 lo = m_bounds.min, hi = m_bounds.max;
+    uint32_t n = 0, axis = 0;
+    while (m_nodes[n].child != 0)
+    {
+        const float mid = 0.5f * (lo[axis] + hi[axis]);
+        if (p[axis] < mid)
+        {
+            hi[axis] = mid;
+            n = m_nodes[n].child;
+        }
+        else
+        {
+            lo[axis] = mid;
+            n = m_nodes[n].child + 1;
+        }
+        axis = axis == 2 ? 0 : axis + 1;
+    }
+    return m_nodes[n].region;
+}
+
+glm::vec3 PathGuide::sample(uint32_t region, float u1, float u2) const
+{
+    return squareToDirection(m_regions[region].sampling.sample({ u1, u2 }));
+}
+
+float PathGuide::pdf(uint32_t region, const glm::vec3& direction) const
+{
+    // The square maps to the 4 pi sphere with a constant Jacobian
+    const DTree& tree = m_regions[region].sampling;
+    if (tree.total <= 0.0f)
+        return 0.0f;
+    return tree.pdf(directionToSquare(direction)) / (4.0f * PI);
+}
+
+void PathGuide::record(uint32_t region, const glm::vec3& direction, float value)
+{
+    if (!std::isfinite(value) || value < 0.0f)
+        return;
+    Region& r = m_regions[region];
+    std::atomic_ref<uint32_t>(r.samples).fetch_add(1, std::memory_order_relaxed);
+    if (value > 0.0f)
+        r.building.record(directionToSquare(direction), value);
+}
+
+void PathGuide::endPass()
+{
+    if (empty())
+        return;
+    if (++m_passesInIteration < (1u << std::min(m_iteration, 31u)))
+        return;
+    refine();
+    ++m_iteration;
+    m_passesInIteration = 0;
+}
+
+void PathGuide::refine()
+{
+    // What this iteration recorded is what the next one samples
+    for (Region& region : m_regions)
+    {
+        region.building.build();
+        std::swap(region.sampling, region.building);
+    }
+
+    size_t used = m_nodes.size() * sizeof(SpatialNode) + m_regions.size() * sizeof(Region);
+    for (const Region& region : m_regions)
+        used += region.sampling.nodes.size() * sizeof(QuadNode);
+
+    // Busy regions split in two; both halves start from the parent's
+    // distribution and split again while they are still over the threshold
+    const float splitSamples = SPATIAL_SPLIT_SAMPLES * std::sqrt(std::ldexp(1.0f, static_cast<int>(m_iteration)));
+    for (uint32_t n = 0; n < m_nodes.size(); ++n)
+    {
+        if (m_nodes[n].child != 0)
+            continue;
+        const uint32_t r = m_nodes[n].region;
+        if (static_cast<float>(m_regions[r].samples) <= splitSamples)
+            continue;
+
+        // The new region's sampling tree, plus one building node per region
+        const size_t cost = 2 * sizeof(SpatialNode) + sizeof(Region)
+                          + (m_regions[r].sampling.nodes.size() + 1) * sizeof(QuadNode);
+        if (used + cost + m_regions.size() * sizeof(QuadNode) > m_memoryLimit)
+            break;
+        used += cost;
+
+        m_regions[r].samples /= 2;
+        Region half;
+        half.sampling = m_regions[r].sampling;
+        half.samples = m_regions[r].samples;
+        m_regions.push_back(std::move(half));
+
+        const uint32_t child = static_cast<uint32_t>(m_nodes.size());
+        m_nodes[n].child = child;
+        m_nodes.push_back({ 0, r });
+        m_nodes.push_back({ 0, static_cast<uint32_t>(m_regions.size() - 1) });
+    }
+    // The budget counted elements, not the slack growth left behind
+    m_nodes.shrink_to_fit();
+    m_regions.shrink_to_fit();
+
+    // The building trees share what the memory limit leaves
+    const size_t spare = m_memoryLimit > used ? m_memoryLimit - used : 0;
+    const uint32_t maxNodes = static_cast<uint32_t>(std::clamp<size_t>(spare / sizeof(QuadNode) / m_regions.size(),
+                                                                       1, UINT32_MAX));
+    for (Region& region : m_regions)
+    {
+        region.building.refineFrom(region.sampling, DTREE_SPLIT_FLUX, maxNodes);
+        region.samples = 0;
+    }
+}
+
+size_t PathGuide::memoryBytes() const
+{
+    size_t bytes = m_nodes.capacity() * sizeof(SpatialNode) + m_regions.capacity() * sizeof(Region);
+    for (const Region& region : m_regions)
+        bytes += (region.sampling.nodes.capacity() + region.building.nodes.capacity()) * sizeof(QuadNode);
+    return bytes;
+}
+
+} // namespace vex
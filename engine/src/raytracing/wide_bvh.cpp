@@ -0,0 +1,151 @@
+#include <vex/raytracing/wide_bvh.h>
+
+#include <limits>
+
+#if defined(VEX_BVH_SIMD_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace vex
+{
+
+uint32_t detectBVHWidth()
+{
+#if defined(VEX_BVH_SIMD_X86)
+#if defined(_MSC_VER)
+    // AVX2 needs the CPU feature bit and OS support for saving YMM state
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] >= 7)
+    {
+        __cpuid(info, 1);
+        const bool osxsave = (info[2] & (1 << 27)) != 0;
+        const bool avx     = (info[2] & (1 << 28)) != 0;
+        if (osxsave && avx && (_xgetbv(0) & 0x6) == 0x6)
+        {
+            __cpuidex(info, 7, 0);
+            if (info[1] & (1 << 5))
+                return 8;
+        }
+    }
+#else
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return 8;
+#endif
+    return 4;
+#else
+    return 2;
+#endif
+}
+
+template <uint32_t N>
+void WideBVH<N>::clear()
+{
+    m_nodes.clear();
+    m_nodes.shrink_to_fit();
+}
+
+template <uint32_t N>
+void WideBVH<N>::build(const BVH& bvh)
+{
+    m_nodes.clear();
+    if (bvh.empty())
+    {
+        m_nodes.shrink_to_fit();
+        return;
+    }
+
+    // Roughly (binary nodes) / (N - 1) wide nodes in a full tree
+    m_nodes.reserve(bvh.nodeCount() / (N - 1) + 1);
+    collapse(bvh, 0);
+    m_nodes.shrink_to_fit();
+}
+
+template <uint32_t N>
+uint32_t WideBVH<N>::collapse(const BVH& bvh, uint32_t binaryIdx)
+{
+    const auto& bin = bvh.nodes();
+
+    // Gather up to N descendants of binaryIdx. A binary leaf root becomes a
+    // wide node with a single leaf child.
+    uint32_t children[N];
+    uint32_t childCount = 0;
+    if (bin[binaryIdx].isLeaf())
+    {
+        children[childCount++] = binaryIdx;
+    }
+    else
+    {
+        children[childCount++] = bin[binaryIdx].leftFirst;
+        children[childCount++] = bin[binaryIdx].leftFirst + 1;
+    }
+
+    while (childCount < N)
+    {
+        int best = -1;
+        float bestArea = -1.0f;
+        for (uint32_t i = 0; i < childCount; ++i)
+        {
+            const auto& c = bin[children[i]];
+            if (c.isLeaf())
+                continue;
+            float area = c.bounds.surfaceArea();
+            if (area > bestArea)
+            {
+                bestArea = area;
+                best = static_cast<int>(i);
+            }
+        }
+        if (best < 0)
+            break; // only leaves left
+
+        uint32_t opened = children[best];
+        children[best] = bin[opened].leftFirst;
+        children[childCount++] = bin[opened].leftFirst + 1;
+    }
+
+    const uint32_t wideIdx = static_cast<uint32_t>(m_nodes.size());
+    m_nodes.emplace_back();
+
+    // Unused slots get +inf bounds on both sides: the slab test then yields an
+    // entry distance of +inf (or an exit of -inf) and never reports a hit.
+    const float inf = std::numeric_limits<float>::infinity();
+    Node node;
+    for (uint32_t i = 0; i < N; ++i)
+    {
+        node.minX[i] = node.minY[i] = node.minZ[i] = inf;
+        node.maxX[i] = node.maxY[i] = node.maxZ[i] = inf;
+        node.child[i]    = Node::EMPTY;
+        node.triCount[i] = 0;
+    }
+
+    for (uint32_t i = 0; i < childCount; ++i)
+    {
+        const auto& c = bin[children[i]];
+        node.minX[i] = c.bounds.min.x;
+        node.minY[i] = c.bounds.min.y;
+        node.minZ[i] = c.bounds.min.z;
+        node.maxX[i] = c.bounds.max.x;
+        node.maxY[i] = c.bounds.max.y;
+        node.maxZ[i] = c.bounds.max.z;
+        if (c.isLeaf())
+        {
+            node.child[i]    = c.leftFirst;
+            node.triCount[i] = c.triCount;
+        }
+        else
+        {
+            // Recursion may reallocate m_nodes; fill the local copy and store once
+            node.child[i] = collapse(bvh, children[i]);
+        }
+    }
+
+    m_nodes[wideIdx] = node;
+    return wideIdx;
+}
+
+template class WideBVH<4>;
+template class WideBVH<8>;
+
+} // namespace vex
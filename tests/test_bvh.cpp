@@ -1,7 +1,12 @@
 #include <doctest/doctest.h>
 #include <vex/raytracing/bvh.h>
+#include <vex/raytracing/compressed_bvh.h>
+#include <vex/raytracing/light_bvh.h>
+#include <vex/raytracing/wide_bvh.h>
 
+#include <algorithm>
 #include <cfloat>
+#include <cmath>
 #include <vector>
 
 using namespace vex;
@@ -14,6 +19,24 @@ static AABB makeBox(glm::vec3 mn, glm::vec3 mx)
     return b;
 }
 
+// Deterministic scatter of small boxes (LCG, no <random> so the output is
+// identical across standard libraries).
+static std::vector<AABB> makeRandomBoxes(int n, uint32_t seed = 12345u)
+{
+    auto next = [&]() {
+        seed = seed * 1664525u + 1013904223u;
+        return static_cast<float>(seed >> 8) / 16777216.0f;
+    };
+    std::vector<AABB> boxes(n);
+    for (int i = 0; i < n; ++i)
+    {
+        glm::vec3 p(next() * 100.0f, next() * 100.0f, next() * 100.0f);
+        glm::vec3 e(next() * 2.0f, next() * 2.0f, next() * 2.0f);
+        boxes[i] = makeBox(p, p + e);
+    }
+    return boxes;
+}
+
 // ── AABB ─────────────────────────────────────────────────────────────────────
 
 TEST_SUITE("AABB")
@@ -348,4 +371,661 @@ TEST_CASE("node bounds enclose all triangles assigned to that node")
     }
 }
 
+TEST_CASE("parallel build matches the single-threaded build exactly")
+{
+    // Large enough to exercise both parallel binning and subtree tasks.
+    const auto bounds = makeRandomBoxes(100000);
+
+    BVH serial;
+    serial.build(bounds, {1});
+
+    for (uint32_t threads : {2u, 3u, 8u})
+    {
+        BVH parallel;
+        parallel.build(bounds, {threads});
+
+        REQUIRE(parallel.nodeCount() == serial.nodeCount());
+        CHECK(parallel.indices() == serial.indices());
+        CHECK(parallel.sahCost() == serial.sahCost());
+
+        bool nodesEqual = true;
+        for (uint32_t i = 0; i < serial.nodeCount() && nodesEqual; ++i)
+        {
+            const auto& a = serial.nodes()[i];
+            const auto& b = parallel.nodes()[i];
+            nodesEqual = a.leftFirst == b.leftFirst && a.triCount == b.triCount &&
+                         a.bounds.min == b.bounds.min && a.bounds.max == b.bounds.max;
+        }
+        CHECK(nodesEqual);
+    }
+}
+
+// Every reference covered exactly once by a leaf, every node enclosing its
+// contents, children adjacent and after their parent
+static bool isValidTree(const BVH& bvh, const std::vector<AABB>& bounds)
+{
+    std::vector<uint32_t> sorted = bvh.indices();
+    std::sort(sorted.begin(), sorted.end());
+    bool ok = sorted.size() == bounds.size();
+    for (uint32_t i = 0; ok && i < sorted.size(); ++i)
+        ok = sorted[i] == i;
+
+    auto encloses = [](const AABB& outer, const AABB& inner)
+    {
+        return outer.min.x <= inner.min.x && outer.min.y <= inner.min.y && outer.min.z <= inner.min.z &&
+               outer.max.x >= inner.max.x && outer.max.y >= inner.max.y && outer.max.z >= inner.max.z;
+    };
+    uint32_t leafTris = 0;
+    for (uint32_t i = 0; i < bvh.nodeCount() && ok; ++i)
+    {
+        const auto& node = bvh.nodes()[i];
+        if (node.isLeaf())
+        {
+            leafTris += node.triCount;
+            for (uint32_t j = 0; j < node.triCount; ++j)
+                ok = ok && encloses(node.bounds, bounds[bvh.indices()[node.leftFirst + j]]);
+        }
+        else
+        {
+            // Refit and the wide collapse rely on children following their parent
+            ok = node.leftFirst > i && node.leftFirst + 1 < bvh.nodeCount() &&
+                 encloses(node.bounds, bvh.nodes()[node.leftFirst].bounds) &&
+                 encloses(node.bounds, bvh.nodes()[node.leftFirst + 1].bounds);
+        }
+    }
+    return ok && leafTris == bounds.size();
+}
+
+TEST_CASE("LBVH build covers every triangle once with enclosing, parent-first nodes")
+{
+    const auto bounds = makeRandomBoxes(50000);
+    BVHBuildOptions opts;
+    opts.builder = BVHBuilder::LBVH;
+    BVH bvh;
+    bvh.build(bounds, opts);
+
+    CHECK(bvh.nodeCount() <= 2 * bounds.size() - 1);
+    CHECK(bvh.sahCost() > 0.0f);
+    CHECK(isValidTree(bvh, bounds));
+}
+
+TEST_CASE("LBVH build is identical for every thread count")
+{
+    const auto bounds = makeRandomBoxes(100000, 99u);
+    BVHBuildOptions opts;
+    opts.builder     = BVHBuilder::LBVH;
+    opts.threadCount = 1;
+    BVH serial;
+    serial.build(bounds, opts);
+
+    opts.threadCount = 6;
+    BVH parallel;
+    parallel.build(bounds, opts);
+
+    REQUIRE(parallel.nodeCount() == serial.nodeCount());
+    CHECK(parallel.indices() == serial.indices());
+    CHECK(parallel.sahCost() == serial.sahCost());
+}
+
+TEST_CASE("reinsertion lowers the SAH cost and keeps a valid tree")
+{
+    const auto bounds = makeRandomBoxes(20000, 5u);
+    BVHBuildOptions opts;
+    opts.builder = BVHBuilder::LBVH;
+    BVH bvh;
+    bvh.build(bounds, opts);
+    const float before    = bvh.sahCost();
+    const uint32_t nodes  = bvh.nodeCount();
+
+    CHECK(bvh.optimize(64, 4) > 0);
+    CHECK_FALSE(bvh.optimizeStoppedEarly());
+    CHECK(bvh.sahCost() < before);
+    CHECK(bvh.buildSAHCost() == bvh.sahCost());
+    CHECK(bvh.nodeCount() == nodes);
+    CHECK(isValidTree(bvh, bounds));
+}
+
+TEST_CASE("optimizePasses runs reinsertion as part of the build")
+{
+    const auto bounds = makeRandomBoxes(5000, 17u);
+    BVH plain;
+    plain.build(bounds);
+
+    BVHBuildOptions opts;
+    opts.optimizePasses = 8;
+    BVH optimized;
+    optimized.build(bounds, opts);
+
+    CHECK(optimized.sahCost() <= plain.sahCost());
+    CHECK(isValidTree(optimized, bounds));
+}
+
+TEST_CASE("an optimize deadline stops reinsertion early with a valid tree")
+{
+    const auto bounds = makeRandomBoxes(50000, 31u);
+    BVHBuildOptions opts;
+    opts.builder = BVHBuilder::LBVH;
+    BVH bvh;
+    bvh.build(bounds, opts);
+    const float before = bvh.sahCost();
+
+    // A full pass over 100k nodes takes far longer than a millisecond
+    bvh.optimize(64, 2, 1.0f);
+    CHECK(bvh.optimizeStoppedEarly());
+    CHECK(bvh.sahCost() <= before);
+    CHECK(isValidTree(bvh, bounds));
+
+    // A rebuild starts over
+    bvh.build(bounds, opts);
+    CHECK_FALSE(bvh.optimizeStoppedEarly());
+}
+
+TEST_CASE("reinsertion is identical for every thread count")
+{
+    const auto bounds = makeRandomBoxes(20000, 23u);
+    BVHBuildOptions opts;
+    opts.builder        = BVHBuilder::LBVH;
+    opts.optimizePasses = 3;
+    opts.threadCount    = 1;
+    BVH serial;
+    serial.build(bounds, opts);
+
+    opts.threadCount = 6;
+    BVH parallel;
+    parallel.build(bounds, opts);
+
+    REQUIRE(parallel.nodeCount() == serial.nodeCount());
+    CHECK(parallel.indices() == serial.indices());
+    CHECK(parallel.sahCost() == serial.sahCost());
+}
+
+TEST_CASE("leafSize stops splitting small ranges")
+{
+    const auto bounds = makeRandomBoxes(5000, 23u);
+    BVH small;
+    small.build(bounds);
+
+    BVHBuildOptions opts;
+    opts.leafSize = 4;
+    BVH large;
+    large.build(bounds, opts);
+
+    CHECK(isValidTree(large, bounds));
+    CHECK(large.nodeCount() < small.nodeCount());
+    uint32_t fullLeaves = 0;
+    for (const auto& node : large.nodes())
+        fullLeaves += node.triCount >= 3 && node.triCount <= 4;
+    CHECK(fullLeaves > 0);
+}
+
+TEST_CASE("LBVH leaves follow leafSize")
+{
+    const auto bounds = makeRandomBoxes(5000, 23u);
+    BVHBuildOptions opts;
+    opts.builder = BVHBuilder::LBVH;
+
+    uint32_t previousNodes = 0xFFFFFFFFu;
+    for (uint32_t leafSize : {1u, 0u, 8u}) // 0 = LBVH default of four
+    {
+        opts.leafSize = leafSize;
+        BVH bvh;
+        bvh.build(bounds, opts);
+        CHECK(isValidTree(bvh, bounds));
+        CHECK(bvh.nodeCount() < previousNodes);
+        previousNodes = bvh.nodeCount();
+
+        uint32_t largest = 0;
+        for (uint32_t i = 0; i < bvh.nodeCount(); ++i)
+            largest = std::max(largest, bvh.nodes()[i].triCount);
+        CHECK(largest == (leafSize > 0 ? leafSize : 4u));
+    }
+}
+
+// Long thin triangles along the x=y diagonal (the worst case for object splits):
+// three vertices per triangle, packed for BVH::buildFromTriangles.
+static std::vector<glm::vec3> makeDiagonalSlivers(int n, uint32_t seed = 777u)
+{
+    uint32_t state = seed;
+    auto next = [&]()
+    {
+        state = state * 1664525u + 1013904223u;
+        return static_cast<float>(state >> 8) / 16777216.0f;
+    };
+
+    std::vector<glm::vec3> verts;
+    verts.reserve(static_cast<size_t>(n) * 3);
+    for (int i = 0; i < n; ++i)
+    {
+        glm::vec3 offset(next() * 4.0f, next() * 4.0f, next() * 100.0f);
+        verts.push_back(offset);
+        verts.push_back(offset + glm::vec3(50.0f, 50.0f, 0.0f));
+        verts.push_back(offset + glm::vec3(50.2f, 50.0f, 0.1f));
+    }
+    return verts;
+}
+
+TEST_CASE("spatial splits lower the SAH cost of long diagonal triangles")
+{
+    const auto verts = makeDiagonalSlivers(2000);
+
+    BVH objectOnly;
+    objectOnly.buildFromTriangles(verts);
+    CHECK(objectOnly.duplicationRatio() == 1.0f);
+
+    BVHBuildOptions opts;
+    opts.spatialSplits      = true;
+    opts.spatialSplitBudget = 0.5f;
+    BVH spatial;
+    spatial.buildFromTriangles(verts, opts);
+
+    CHECK(spatial.primitiveCount() == 2000u);
+    CHECK(spatial.sahCost() < objectOnly.sahCost());
+    CHECK(spatial.duplicationRatio() > 1.0f);
+    CHECK(spatial.duplicationRatio() <= 1.5f);
+}
+
+TEST_CASE("spatial split build references every triangle and respects the budget")
+{
+    const auto verts = makeDiagonalSlivers(500);
+
+    for (float budget : {0.0f, 0.1f, 1.0f})
+    {
+        BVHBuildOptions opts;
+        opts.spatialSplits      = true;
+        opts.spatialSplitBudget = budget;
+        BVH bvh;
+        bvh.buildFromTriangles(verts, opts);
+
+        const auto& idx = bvh.indices();
+        CHECK(idx.size() <= static_cast<size_t>(500 * (1.0f + budget)));
+
+        // Every triangle referenced; firstReferenceMask picks exactly one copy each
+        std::vector<int> refs(500, 0);
+        for (uint32_t i : idx)
+        {
+            REQUIRE(i < 500u);
+            refs[i]++;
+        }
+        CHECK(std::count(refs.begin(), refs.end(), 0) == 0);
+        const auto first = bvh.firstReferenceMask();
+        CHECK(std::count(first.begin(), first.end(), true) == 500);
+
+        // Leaf ranges are in bounds and sum to the reference count
+        size_t leafRefs = 0;
+        for (const auto& node : bvh.nodes())
+        {
+            if (!node.isLeaf()) continue;
+            CHECK(node.leftFirst + node.triCount <= idx.size());
+            leafRefs += node.triCount;
+        }
+        CHECK(leafRefs == idx.size());
+    }
+}
+
+TEST_CASE("refit after moving boxes matches the moved geometry exactly")
+{
+    auto boxes = makeRandomBoxes(5000);
+    BVH bvh;
+    bvh.build(boxes);
+    const float builtSAH = bvh.sahCost();
+    CHECK(bvh.buildSAHCost() == builtSAH);
+    CHECK(bvh.refitDegradation() == 1.0f);
+
+    // Move every 7th box; the refs that point at them are the dirty set
+    const glm::vec3 offset(30.0f, -12.0f, 5.0f);
+    for (size_t i = 0; i < boxes.size(); i += 7)
+    {
+        boxes[i].min += offset;
+        boxes[i].max += offset;
+    }
+    const auto& idx = bvh.indices();
+    std::vector<bool> dirty(idx.size(), false);
+    for (size_t r = 0; r < idx.size(); ++r)
+        dirty[r] = (idx[r] % 7) == 0;
+
+    BVH partial = bvh;
+    auto refBounds = [&](uint32_t r) { return boxes[idx[r]]; };
+    CHECK(partial.refit(refBounds, dirty) > 0u);
+    CHECK(bvh.refit(refBounds) == bvh.nodeCount());
+
+    // Every node is the exact union of its subtree, and the dirty-only refit
+    // lands on the same boxes as a full refit
+    const auto& nodes = bvh.nodes();
+    for (size_t n = 0; n < nodes.size(); ++n)
+    {
+        AABB expected;
+        if (nodes[n].isLeaf())
+        {
+            for (uint32_t j = 0; j < nodes[n].triCount; ++j)
+                expected.grow(boxes[idx[nodes[n].leftFirst + j]]);
+        }
+        else
+        {
+            expected.grow(nodes[nodes[n].leftFirst].bounds);
+            expected.grow(nodes[nodes[n].leftFirst + 1].bounds);
+        }
+        CHECK(nodes[n].bounds.min == expected.min);
+        CHECK(nodes[n].bounds.max == expected.max);
+        CHECK(partial.nodes()[n].bounds.min == expected.min);
+        CHECK(partial.nodes()[n].bounds.max == expected.max);
+    }
+
+    // Topology is untouched; the stretched boxes show up as SAH growth
+    CHECK(partial.indices() == bvh.indices());
+    CHECK(bvh.buildSAHCost() == builtSAH);
+    CHECK(bvh.refitDegradation() > 1.0f);
+}
+
+TEST_CASE("refit with no dirty references leaves the tree unchanged")
+{
+    const auto boxes = makeRandomBoxes(1000);
+    BVH bvh;
+    bvh.build(boxes);
+    const auto before = bvh.nodes();
+
+    std::vector<bool> dirty(bvh.indices().size(), false);
+    CHECK(bvh.refit([&](uint32_t r) { return boxes[bvh.indices()[r]]; }, dirty) == 0u);
+    CHECK(bvh.sahCost() == bvh.buildSAHCost());
+    for (size_t n = 0; n < before.size(); ++n)
+    {
+        CHECK(bvh.nodes()[n].bounds.min == before[n].bounds.min);
+        CHECK(bvh.nodes()[n].bounds.max == before[n].bounds.max);
+    }
+}
+
 } // TEST_SUITE("BVH")
+
+// ── WideBVH ───────────────────────────────────────────────────────────────────
+
+TEST_SUITE("WideBVH")
+{
+
+template <uint32_t N>
+static void checkCollapse(const BVH& bvh)
+{
+    WideBVH<N> wide;
+    wide.build(bvh);
+    REQUIRE_FALSE(wide.empty());
+    CHECK(wide.nodeCount() < bvh.nodeCount());
+
+    // Every binary leaf range appears exactly once, so each reference is covered once
+    std::vector<int> covered(bvh.indices().size(), 0);
+    for (const auto& node : wide.nodes())
+    {
+        for (uint32_t i = 0; i < N; ++i)
+        {
+            if (node.child[i] == WideBVHNode<N>::EMPTY)
+                continue;
+            if (node.triCount[i] == 0)
+            {
+                CHECK(node.child[i] < wide.nodeCount());
+                continue;
+            }
+            for (uint32_t t = node.child[i]; t < node.child[i] + node.triCount[i]; ++t)
+                covered[t]++;
+        }
+    }
+    CHECK(std::count(covered.begin(), covered.end(), 1) == static_cast<long>(covered.size()));
+}
+
+TEST_CASE("collapse covers every leaf range exactly once")
+{
+    BVH bvh;
+    bvh.build(makeRandomBoxes(5000));
+    checkCollapse<4>(bvh);
+    checkCollapse<8>(bvh);
+}
+
+TEST_CASE("single-leaf binary BVH collapses to one node with one child")
+{
+    BVH bvh;
+    bvh.build({ makeBox({0, 0, 0}, {1, 1, 1}) });
+
+    WideBVH<4> wide;
+    wide.build(bvh);
+    REQUIRE(wide.nodeCount() == 1);
+    const auto& root = wide.nodes()[0];
+    CHECK(root.triCount[0] == 1);
+    CHECK(root.child[1] == WideBVHNode<4>::EMPTY);
+}
+
+TEST_CASE("detected width is 2, 4 or 8")
+{
+    uint32_t w = detectBVHWidth();
+    CHECK((w == 2 || w == 4 || w == 8));
+}
+
+} // TEST_SUITE("WideBVH")
+
+TEST_SUITE("CompressedBVH")
+{
+
+TEST_CASE("quantized child boxes enclose the exact ones")
+{
+    BVH bvh;
+    bvh.build(makeRandomBoxes(5000));
+    WideBVH<4> wide;
+    wide.build(bvh);
+    CompressedBVH cbvh;
+    cbvh.build(bvh);
+    REQUIRE(cbvh.nodeCount() == wide.nodeCount());
+
+    int loose = 0;
+    for (uint32_t n = 0; n < cbvh.nodeCount(); ++n)
+    {
+        const auto& c = cbvh.nodes()[n];
+        const auto& w = wide.nodes()[n];
+        for (uint32_t i = 0; i < 4; ++i)
+        {
+            const bool used = (c.childMask & (1u << i)) != 0;
+            REQUIRE(used == (w.child[i] != WideBVHNode<4>::EMPTY));
+            if (!used)
+                continue;
+            CHECK(c.child[i] == w.child[i]);
+            CHECK(c.triCount[i] == w.triCount[i]);
+
+            AABB q = c.childBounds(i);
+            CHECK(q.min.x <= w.minX[i]);
+            CHECK(q.min.y <= w.minY[i]);
+            CHECK(q.min.z <= w.minZ[i]);
+            CHECK(q.max.x >= w.maxX[i]);
+            CHECK(q.max.y >= w.maxY[i]);
+            CHECK(q.max.z >= w.maxZ[i]);
+
+            // Outward rounding should cost at most a step or two per plane
+            AABB exact;
+            exact.min = { w.minX[i], w.minY[i], w.minZ[i] };
+            exact.max = { w.maxX[i], w.maxY[i], w.maxZ[i] };
+            AABB parent = c.childBounds(0);
+            for (uint32_t j = 1; j < 4; ++j)
+                if (c.childMask & (1u << j))
+                    parent.grow(c.childBounds(j));
+            glm::vec3 slack = (exact.min - q.min) + (q.max - exact.max);
+            glm::vec3 extent = parent.max - parent.min;
+            if (slack.x > extent.x * 0.05f || slack.y > extent.y * 0.05f || slack.z > extent.z * 0.05f)
+                ++loose;
+        }
+    }
+    CHECK(loose == 0);
+}
+
+TEST_CASE("compressed nodes take half the memory of full-precision BVH4 nodes")
+{
+    BVH bvh;
+    bvh.build(makeRandomBoxes(5000));
+    WideBVH<4> wide;
+    wide.build(bvh);
+    CompressedBVH cbvh;
+    cbvh.build(bvh);
+    CHECK(sizeof(CompressedBVHNode) * 2 == sizeof(WideBVHNode<4>));
+    CHECK(cbvh.memoryBytes() * 2 == wide.memoryBytes());
+    CHECK(cbvh.memoryBytes() < bvh.memoryBytes() / 2);
+}
+
+TEST_CASE("flat geometry quantizes without a zero-extent axis breaking")
+{
+    std::vector<AABB> boxes;
+    for (int i = 0; i < 64; ++i)
+        boxes.push_back(makeBox({ float(i), 0.0f, 3.0f }, { float(i) + 0.5f, 1.0f, 3.0f }));
+    BVH bvh;
+    bvh.build(boxes);
+    CompressedBVH cbvh;
+    cbvh.build(bvh);
+    REQUIRE_FALSE(cbvh.empty());
+    for (const auto& node : cbvh.nodes())
+        for (uint32_t i = 0; i < 4; ++i)
+            if (node.childMask & (1u << i))
+            {
+                AABB q = node.childBounds(i);
+                CHECK(q.min.z <= 3.0f);
+                CHECK(q.max.z >= 3.0f);
+            }
+}
+
+} // TEST_SUITE("CompressedBVH")
+
+TEST_SUITE("LightBVH")
+{
+
+// Small emitters scattered through a box, facing random directions, with
+// powers spread over two orders of magnitude
+static std::vector<LightBounds> makeRandomLights(int n, uint32_t seed = 4242u)
+{
+    auto next = [&]() {
+        seed = seed * 1664525u + 1013904223u;
+        return static_cast<float>(seed >> 8) / 16777216.0f;
+    };
+    std::vector<LightBounds> lights(n);
+    for (int i = 0; i < n; ++i)
+    {
+        glm::vec3 p(next() * 20.0f, next() * 5.0f, next() * 20.0f);
+        lights[i].bounds = makeBox(p, p + glm::vec3(0.2f, 0.2f, 0.2f));
+        lights[i].power = std::pow(10.0f, next() * 2.0f);
+        lights[i].axis = glm::normalize(glm::vec3(next() - 0.5f, next() - 0.5f, next() - 0.5f));
+    }
+    return lights;
+}
+
+TEST_CASE("every light gets one leaf and internal nodes bound their children")
+{
+    const auto lights = makeRandomLights(500);
+    LightBVH tree;
+    tree.build(lights);
+    REQUIRE(tree.nodes().size() == 2 * lights.size() - 1);
+    REQUIRE(tree.leaves().size() == lights.size());
+
+    for (uint32_t i = 0; i < lights.size(); ++i)
+    {
+        const auto& leaf = tree.nodes()[tree.leaves()[i]];
+        CHECK(leaf.isLeaf());
+        CHECK(leaf.childOrLight == i);
+    }
+
+    float totalPower = 0.0f;
+    for (const auto& light : lights)
+        totalPower += light.power;
+    CHECK(tree.nodes()[0].power == doctest::Approx(totalPower).epsilon(1e-4));
+    CHECK(tree.nodes()[0].parent == LightBVHNode::INVALID);
+
+    for (uint32_t n = 0; n < tree.nodes().size(); ++n)
+    {
+        const auto& node = tree.nodes()[n];
+        if (node.isLeaf())
+            continue;
+        for (uint32_t child : { n + 1, node.childOrLight })
+        {
+            const auto& c = tree.nodes()[child];
+            CHECK(c.parent == n);
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                CHECK(c.boundsMin[axis] >= node.boundsMin[axis]);
+                CHECK(c.boundsMax[axis] <= node.boundsMax[axis]);
+            }
+        }
+    }
+
+    // Every node's normal cone holds the normals of all lights below it
+    for (uint32_t i = 0; i < lights.size(); ++i)
+    {
+        for (uint32_t n = tree.leaves()[i]; n != LightBVHNode::INVALID; n = tree.nodes()[n].parent)
+        {
+            const auto& node = tree.nodes()[n];
+            const glm::vec3 axis(node.axis[0], node.axis[1], node.axis[2]);
+            CHECK(glm::dot(axis, lights[i].axis) >= node.cosThetaO - 1e-4f);
+        }
+    }
+}
+
+TEST_CASE("sample() picks lights with the probability pmf() reports")
+{
+    const auto lights = makeRandomLights(64);
+    LightBVH tree;
+    tree.build(lights);
+
+    const glm::vec3 p(10.0f, 2.5f, 10.0f);
+    const glm::vec3 n(0.0f, 1.0f, 0.0f);
+    double sum = 0.0;
+    std::vector<float> pmf(lights.size());
+    for (uint32_t i = 0; i < lights.size(); ++i)
+    {
+        pmf[i] = tree.pmf(p, n, i);
+        sum += pmf[i];
+    }
+    // Subtrees whose children all turn out unreachable lose their share, and
+    // sample() fails just as often
+    CHECK(sum <= 1.0 + 1e-4);
+    CHECK(sum > 0.5);
+
+    const int samples = 200000;
+    int failed = 0;
+    std::vector<int> picked(lights.size(), 0);
+    for (int s = 0; s < samples; ++s)
+    {
+        uint32_t light;
+        float samplePmf;
+        if (!tree.sample(p, n, (static_cast<float>(s) + 0.5f) / samples, light, samplePmf))
+        {
+            ++failed;
+            continue;
+        }
+        CHECK(samplePmf == doctest::Approx(pmf[light]).epsilon(1e-3));
+        ++picked[light];
+    }
+    CHECK(static_cast<double>(failed) / samples == doctest::Approx(1.0 - sum).epsilon(1e-4).scale(1.0));
+    for (uint32_t i = 0; i < lights.size(); ++i)
+        CHECK(static_cast<double>(picked[i]) / samples == doctest::Approx(pmf[i]).epsilon(1e-4).scale(1.0));
+}
+
+TEST_CASE("lights facing away or below the receiver's horizon are never picked")
+{
+    std::vector<LightBounds> lights(3);
+    lights[0].bounds = makeBox({ -0.1f, 2.0f, -0.1f }, { 0.1f, 2.0f, 0.1f });   // overhead, facing down
+    lights[0].axis = { 0.0f, -1.0f, 0.0f };
+    lights[1].bounds = makeBox({ 3.0f, 2.0f, -0.1f }, { 3.2f, 2.0f, 0.1f });    // overhead, facing up
+    lights[1].axis = { 0.0f, 1.0f, 0.0f };
+    lights[2].bounds = makeBox({ -3.2f, -2.0f, -0.1f }, { -3.0f, -2.0f, 0.1f }); // below the floor
+    lights[2].axis = { 0.0f, 1.0f, 0.0f };
+    for (auto& light : lights)
+        light.power = 1.0f;
+
+    LightBVH tree;
+    tree.build(lights);
+    const glm::vec3 p(0.0f), n(0.0f, 1.0f, 0.0f);
+    CHECK(tree.pmf(p, n, 0) == doctest::Approx(1.0f));
+    CHECK(tree.pmf(p, n, 1) == 0.0f);
+    CHECK(tree.pmf(p, n, 2) == 0.0f);
+    for (float u : { 0.0f, 0.3f, 0.7f, 0.999f })
+    {
+        uint32_t light;
+        float pmf;
+        REQUIRE(tree.sample(p, n, u, light, pmf));
+        CHECK(light == 0);
+    }
+
+    // Nothing reaches a point under the floor facing down
+    uint32_t light;
+    float pmf;
+    CHECK_FALSE(tree.sample({ 0.0f, -5.0f, 0.0f }, { 0.0f, -1.0f, 0.0f }, 0.5f, light, pmf));
+}
+
+} // TEST_SUITE("LightBVH")
@@ -5,7 +5,10 @@
 
 #include <glm/glm.hpp>
 #include <algorithm>
+#include <chrono>
 #include <cmath>
+#include <filesystem>
+#include <thread>
 
 using namespace vex;
 
@@ -24,6 +27,114 @@ static CPURaytracer::Triangle makeTri(glm::vec3 v0, glm::vec3 v1, glm::vec3 v2,
     return t;
 }
 
+// Deterministic LCG in [0, 1) (no <random>, so the scenes below are identical
+// across standard libraries)
+static float nextRandom(uint32_t& state)
+{
+    state = state * 1664525u + 1013904223u;
+    return static_cast<float>(state >> 8) / 16777216.0f;
+}
+
+// Soup of small triangles: centres over [-spread/2, spread/2]^2 x [0, spread],
+// edges up to `edge` long in random directions
+static std::vector<CPURaytracer::Triangle> makeRandomTriangles(int count, uint32_t seed, float spread = 20.0f,
+                                                               float edge = 3.0f)
+{
+    uint32_t state = seed;
+    std::vector<CPURaytracer::Triangle> tris;
+    tris.reserve(static_cast<size_t>(count));
+    for (int i = 0; i < count; ++i)
+    {
+        const float x = nextRandom(state) * spread - 0.5f * spread;
+        const float y = nextRandom(state) * spread - 0.5f * spread;
+        const glm::vec3 c(x, y, nextRandom(state) * spread);
+        const glm::vec3 a(nextRandom(state) - 0.5f, nextRandom(state) - 0.5f, nextRandom(state) - 0.5f);
+        const glm::vec3 b(nextRandom(state) - 0.5f, nextRandom(state) - 0.5f, nextRandom(state) - 0.5f);
+        tris.push_back(makeTri(c, c + a * edge, c + b * edge));
+    }
+    return tris;
+}
+
+// Rays from origins spread over the box [originMin, originMax]. Forward rays
+// head into +z, at the scene in front of them; the rest go every way.
+static std::vector<Ray> makeRandomRays(int count, uint32_t seed, glm::vec3 originMin, glm::vec3 originMax,
+                                       bool forward = false)
+{
+    uint32_t state = seed;
+    std::vector<Ray> rays;
+    rays.reserve(static_cast<size_t>(count));
+    for (int i = 0; i < count; ++i)
+    {
+        const float dx = nextRandom(state) - 0.5f;
+        const float dy = nextRandom(state) - 0.5f;
+        const float dz = forward ? nextRandom(state) * 0.5f + 0.25f : nextRandom(state) - 0.5f;
+        const float ox = nextRandom(state), oy = nextRandom(state), oz = nextRandom(state);
+        const glm::vec3 origin = originMin + (originMax - originMin) * glm::vec3(ox, oy, oz);
+        rays.push_back({ origin, glm::normalize(glm::vec3(dx, dy, dz)) });
+    }
+    return rays;
+}
+
+static std::vector<HitRecord> traceAll(const CPURaytracer& tracer, const std::vector<Ray>& rays)
+{
+    std::vector<HitRecord> hits;
+    hits.reserve(rays.size());
+    for (const auto& ray : rays)
+        hits.push_back(tracer.traceRay(ray));
+    return hits;
+}
+
+static int countHits(const std::vector<HitRecord>& results)
+{
+    return static_cast<int>(std::count_if(results.begin(), results.end(), [](const HitRecord& h) { return h.hit; }));
+}
+
+// Results that differ from tracer.traceRay() of the same rays in hit and
+// distance, and in triangle unless they come from a tracer whose BVH orders
+// the triangles differently
+static int countHitMismatches(const CPURaytracer& tracer, const std::vector<Ray>& rays,
+                              const std::vector<HitRecord>& results, bool compareTriangles = true)
+{
+    int mismatches = 0;
+    for (size_t i = 0; i < rays.size(); ++i)
+    {
+        const HitRecord h = tracer.traceRay(rays[i]);
+        if (h.hit != results[i].hit
+            || (h.hit && (h.t != results[i].t || (compareTriangles && h.triangleIndex != results[i].triangleIndex))))
+            ++mismatches;
+    }
+    return mismatches;
+}
+
+// Inverse view-projection of a pinhole camera looking along (0, -0.2, 1),
+// the view most rendering tests use
+static glm::mat4 testCameraInverseVP()
+{
+    glm::mat4 inverseVP(0.0f);
+    inverseVP[0] = glm::vec4(1.0f, 0.0f, 0.0f, 0.0f);
+    inverseVP[1] = glm::vec4(0.0f, 0.5f, 0.0f, 0.0f);
+    inverseVP[2] = glm::vec4(0.0f, -0.5f, 2.0f, -0.25f);
+    inverseVP[3] = glm::vec4(0.0f, 1.3f, -5.0f, 0.75f);
+    return inverseVP;
+}
+
+// Per-channel error and mean of linear HDR images, for convergence tests
+static double meanSquaredError(const std::vector<float>& a, const std::vector<float>& b)
+{
+    double sum = 0.0;
+    for (size_t i = 0; i < a.size(); ++i)
+        sum += (static_cast<double>(a[i]) - b[i]) * (a[i] - b[i]);
+    return sum / static_cast<double>(a.size());
+}
+
+static double imageMean(const std::vector<float>& a)
+{
+    double sum = 0.0;
+    for (float v : a)
+        sum += v;
+    return sum / static_cast<double>(a.size());
+}
+
 TEST_SUITE("CPURaytracer")
 {
 
@@ -127,6 +238,1231 @@ TEST_CASE("SAH cost is finite and positive after a valid geometry upload")
     CHECK(cost > 0.0f);
 }
 
+TEST_CASE("spatial-split BVH returns the same closest hits")
+{
+    // A fan of long overlapping triangles, plus small ones, crossed by a grid of rays
+    std::vector<CPURaytracer::Triangle> tris;
+    for (int i = 0; i < 40; ++i)
+    {
+        float z = 2.0f + 0.25f * static_cast<float>(i);
+        float s = static_cast<float>(i % 7) * 0.3f;
+        tris.push_back(makeTri({-10 + s, -10, z}, {10, 10 - s, z + 1.0f}, {10, 9 - s, z}));
+        tris.push_back(makeTri({s - 1, s - 1, z}, {s, s - 1, z}, {s - 1, s, z}));
+    }
+
+    CPURaytracer reference;
+    reference.setGeometry(tris);
+
+    CPURaytracer spatial;
+    BVHBuildOptions opts;
+    opts.spatialSplits = true;
+    spatial.setBVHBuildOptions(opts);
+    spatial.setGeometry(tris);
+
+    int hits = 0;
+    for (int y = -8; y <= 8; ++y)
+    {
+        for (int x = -8; x <= 8; ++x)
+        {
+            Ray ray{ glm::vec3(x * 0.9f, y * 0.9f, -1.0f), glm::vec3(0, 0, 1) };
+            HitRecord a = reference.traceRay(ray);
+            HitRecord b = spatial.traceRay(ray);
+            REQUIRE(a.hit == b.hit);
+            if (a.hit)
+            {
+                CHECK(b.t == doctest::Approx(a.t));
+                ++hits;
+            }
+        }
+    }
+    CHECK(hits > 0);
+}
+
+TEST_CASE("binary, 4-wide, 8-wide and compressed traversal return the same closest hits")
+{
+    CPURaytracer rt;
+    rt.setGeometry(makeRandomTriangles(300, 99u));
+    rt.setBVHWidth(2);
+    REQUIRE(rt.getBVHWidth() == 2);
+
+    const std::vector<Ray> rays = makeRandomRays(500, 99u, {-2, -2, -15}, {2, 2, -15}, true);
+    const std::vector<HitRecord> expected = traceAll(rt, rays);
+    CHECK(countHits(expected) > 0);
+
+    for (uint32_t width : {4u, 8u})
+    {
+        rt.setBVHWidth(width);
+        CHECK(rt.getBVHWidth() <= width);
+        CHECK(countHitMismatches(rt, rays, expected) == 0);
+    }
+
+    const size_t fullBytes = rt.getTraversalBVHMemoryBytes();
+    rt.setCompressedBVH(true);
+    CHECK(rt.getTraversalBVHMemoryBytes() < fullBytes);
+    CHECK(countHitMismatches(rt, rays, expected) == 0);
+}
+
+TEST_CASE("leaf triangle blocks return the same closest hits for every leaf size")
+{
+    // Leaf sizes that fill a block partly, exactly, and across two blocks
+    const std::vector<CPURaytracer::Triangle> tris = makeRandomTriangles(400, 7u, 16.0f, 2.0f);
+    const std::vector<Ray> rays = makeRandomRays(600, 7u, {-2, -2, -12}, {2, 2, -12}, true);
+
+    BVHBuildOptions opts;
+    opts.leafSize = 1;
+    CPURaytracer reference;
+    reference.setBVHBuildOptions(opts);
+    reference.setGeometry(tris);
+    reference.setBVHWidth(2);
+    const std::vector<HitRecord> expected = traceAll(reference, rays);
+    CHECK(countHits(expected) > 0);
+
+    for (uint32_t leafSize : {2u, 3u, 4u, 5u, 8u})
+    {
+        opts.leafSize = leafSize;
+        CPURaytracer rt;
+        rt.setBVHBuildOptions(opts);
+        rt.setGeometry(tris);
+        CHECK(rt.getBVHNodeCount() < reference.getBVHNodeCount());
+        CHECK(countHitMismatches(rt, rays, expected, false) == 0);
+    }
+}
+
+TEST_CASE("front-to-back binary traversal visits fewer nodes for the same hits")
+{
+    // Stacked grids of small quads facing the camera: most of the tree lies
+    // behind the first layer a ray hits
+    std::vector<CPURaytracer::Triangle> tris;
+    for (int layer = 0; layer < 8; ++layer)
+    {
+        const float z = static_cast<float>(layer) * 2.0f;
+        for (int y = 0; y < 16; ++y)
+        {
+            for (int x = 0; x < 16; ++x)
+            {
+                const glm::vec3 p(static_cast<float>(x) - 8.0f, static_cast<float>(y) - 8.0f, z);
+                tris.push_back(makeTri(p, p + glm::vec3(0, 0.9f, 0), p + glm::vec3(0.9f, 0, 0)));
+                tris.push_back(makeTri(p + glm::vec3(0.9f, 0, 0), p + glm::vec3(0, 0.9f, 0), p + glm::vec3(0.9f, 0.9f, 0)));
+            }
+        }
+    }
+
+    CPURaytracer rt;
+    rt.setGeometry(tris);
+
+    uint32_t state = 7u;
+    CPURaytracer::TraversalStats ordered, unordered;
+    int hits = 0;
+    for (int i = 0; i < 1000; ++i)
+    {
+        const float tx = nextRandom(state) * 16.0f - 8.0f, ty = nextRandom(state) * 16.0f - 8.0f;
+        const float ox = nextRandom(state) * 4.0f - 2.0f, oy = nextRandom(state) * 4.0f - 2.0f;
+        const glm::vec3 target(tx, ty, 14.0f);
+        const glm::vec3 origin(ox, oy, -10.0f);
+        const Ray r{ origin, glm::normalize(target - origin) };
+
+        HitRecord a = rt.traceRayStats(r, ordered, true);
+        HitRecord b = rt.traceRayStats(r, unordered, false);
+        REQUIRE(a.hit == b.hit);
+        if (a.hit)
+        {
+            CHECK(a.t == b.t);
+            CHECK(a.triangleIndex == b.triangleIndex);
+            ++hits;
+        }
+    }
+
+    CHECK(hits > 500);
+    CHECK(ordered.nodesVisited < unordered.nodesVisited);
+    CHECK(ordered.trianglesTested < unordered.trianglesTested);
+}
+
+TEST_CASE("packet traversal returns the same closest hits as single rays")
+{
+    CPURaytracer rt;
+    rt.setGeometry(makeRandomTriangles(400, 31u));
+
+    // Coherent camera rays over a 29x13 grid (rows straddle the z axis and the
+    // count is not a multiple of the packet size), then incoherent ones
+    std::vector<Ray> rays;
+    for (int y = 0; y < 13; ++y)
+    {
+        for (int x = 0; x < 29; ++x)
+        {
+            glm::vec3 dir(static_cast<float>(x) / 28.0f - 0.5f, static_cast<float>(y) / 12.0f - 0.5f, 1.0f);
+            rays.push_back({ glm::vec3(0.0f, 0.0f, -15.0f), glm::normalize(dir) });
+        }
+    }
+    const std::vector<Ray> incoherent = makeRandomRays(300, 31u, {-2, -2, 0}, {2, 2, 10});
+    rays.insert(rays.end(), incoherent.begin(), incoherent.end());
+
+    std::vector<HitRecord> packed(rays.size());
+    rt.traceRayPacket(rays.data(), static_cast<uint32_t>(rays.size()), packed.data());
+    CHECK(countHits(packed) > 50);
+    CHECK(countHitMismatches(rt, rays, packed) == 0);
+}
+
+TEST_CASE("stream traversal returns the same closest hits as single rays")
+{
+    CPURaytracer rt;
+    rt.setGeometry(makeRandomTriangles(400, 57u));
+
+    // One stream mixing every direction octant, with a count that is not a
+    // multiple of the four-ray filter step
+    const std::vector<Ray> rays = makeRandomRays(1001, 57u, {-2, -2, 0}, {2, 2, 10});
+
+    std::vector<HitRecord> streamed(rays.size());
+    rt.traceRayStream(rays.data(), static_cast<uint32_t>(rays.size()), streamed.data());
+    CHECK(countHits(streamed) > 50);
+    CHECK(countHitMismatches(rt, rays, streamed) == 0);
+}
+
+TEST_CASE("batched traceRays and occluded match single-ray queries")
+{
+    CPURaytracer rt;
+    rt.setGeometry(makeRandomTriangles(400, 91u));
+
+    // Several chunks (run on the worker pool) and a partial last word
+    const uint32_t count = CPURaytracer::QUERY_CHUNK_RAYS * 3 + 37;
+    const std::vector<Ray> rays = makeRandomRays(static_cast<int>(count), 91u, {-2, -2, 0}, {2, 2, 10});
+
+    // Streams over the binary BVH, then single rays over the widest one
+    for (uint32_t width : {2u, 0u})
+    {
+        rt.setBVHWidth(width);
+
+        std::vector<HitRecord> batched(count);
+        rt.traceRays(rays, batched);
+        CHECK(countHits(batched) > 500);
+        CHECK(countHitMismatches(rt, rays, batched) == 0);
+
+        // Limits just short of and just past each closest hit
+        std::vector<float> tMax(count);
+        std::vector<HitRecord> single(count);
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            single[i] = rt.traceRay(rays[i]);
+            tMax[i] = single[i].hit ? single[i].t * (i % 2 ? 1.01f : 0.99f) : 100.0f;
+        }
+        std::vector<uint64_t> bits((count + 63) / 64, ~uint64_t(0));
+        rt.occluded(rays, tMax, bits);
+
+        int occlusionMismatches = 0;
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            const bool expected = single[i].hit && i % 2;
+            if (expected != (((bits[i / 64] >> (i % 64)) & 1) != 0))
+                ++occlusionMismatches;
+        }
+        CHECK(occlusionMismatches == 0);
+        // Bits past the last ray are cleared along with the rest of its word
+        CHECK((bits.back() >> (count % 64)) == 0);
+    }
+}
+
+TEST_CASE("wavefront mode renders the same image as the per-path tracer")
+{
+    // Floor, a mirror and a glass panel under an emissive quad, a point light
+    // and the sun, so every shading branch and light sample type is exercised
+    std::vector<CPURaytracer::Triangle> tris;
+    tris.push_back(makeTri({-5, 0, -5}, {-5, 0, 5}, {5, 0, -5}));
+    tris.push_back(makeTri({5, 0, -5}, {-5, 0, 5}, {5, 0, 5}));
+    auto mirror = makeTri({-3, 0, 3}, {3, 0, 3}, {0, 4, 3});
+    mirror.materialType = 1;
+    auto glass = makeTri({-1, 0, 0}, {0, 2, 0}, {1, 0, 0});
+    glass.materialType = 2;
+    auto light0 = makeTri({-1, 4, -1}, {1, 4, -1}, {-1, 4, 1});
+    auto light1 = makeTri({1, 4, -1}, {1, 4, 1}, {-1, 4, 1});
+    light0.emissive = light1.emissive = glm::vec3(5.0f);
+    tris.insert(tris.end(), { mirror, glass, light0, light1 });
+
+    CPURaytracer rt;
+    rt.setGeometry(tris);
+    rt.resize(48, 24);
+    const glm::mat4 inverseVP = testCameraInverseVP();
+    rt.setCamera({0.0f, 2.0f, -8.0f}, inverseVP);
+    rt.setPointLight({2.0f, 3.0f, -2.0f}, glm::vec3(10.0f), true);
+    rt.setDirectionalLight(glm::normalize(glm::vec3(0.3f, -1.0f, 0.2f)), glm::vec3(2.0f), 0.01f, true);
+    rt.setEnvironmentColor({0.2f, 0.3f, 0.5f});
+
+    std::vector<float> image[2];
+    for (int wavefront = 0; wavefront < 2; ++wavefront)
+    {
+        rt.setWavefront(wavefront == 1);
+        rt.reset();
+        for (int s = 0; s < 4; ++s)
+            rt.traceSample();
+        rt.getLinearHDR(image[wavefront]);
+    }
+
+    // Both modes draw the same random numbers per path, so only hits on a
+    // shared edge (where traversal order picks the triangle) may differ
+    size_t differing = 0;
+    double sum[2] = { 0.0, 0.0 };
+    for (size_t i = 0; i < image[0].size(); ++i)
+    {
+        differing += image[0][i] != image[1][i] ? 1 : 0;
+        sum[0] += image[0][i];
+        sum[1] += image[1][i];
+    }
+    CHECK(sum[0] > 0.0);
+    CHECK(differing <= image[0].size() / 100);
+    CHECK(sum[1] == doctest::Approx(sum[0]).epsilon(0.01));
+}
+
+TEST_CASE("tile scheduler renders the same image for any worker count")
+{
+    std::vector<CPURaytracer::Triangle> tris;
+    tris.push_back(makeTri({-5, 0, -5}, {-5, 0, 5}, {5, 0, -5}));
+    tris.push_back(makeTri({5, 0, -5}, {-5, 0, 5}, {5, 0, 5}));
+    auto glass = makeTri({-1, 0, 0}, {0, 2, 0}, {1, 0, 0});
+    glass.materialType = 2;
+    tris.push_back(glass);
+
+    CPURaytracer rt;
+    rt.setGeometry(tris);
+    // Partial tiles along the right and bottom edges: 7 x 5 tiles
+    rt.resize(100, 70);
+    const glm::mat4 inverseVP = testCameraInverseVP();
+    rt.setCamera({0.0f, 2.0f, -8.0f}, inverseVP);
+    rt.setPointLight({2.0f, 3.0f, -2.0f}, glm::vec3(10.0f), true);
+    rt.setEnvironmentColor({0.2f, 0.3f, 0.5f});
+
+    for (bool wavefront : { false, true })
+    {
+        rt.setWavefront(wavefront);
+        std::vector<float> reference;
+        for (uint32_t workers : { 1u, 3u, 8u })
+        {
+            rt.setWorkerCount(workers);
+            REQUIRE(rt.getWorkerCount() == workers);
+            rt.reset();
+            rt.traceSample();
+            rt.traceSample();
+
+            // Per-pixel seeds do not depend on which worker traces a tile
+            std::vector<float> image;
+            rt.getLinearHDR(image);
+            if (reference.empty())
+                reference = image;
+            CHECK(image == reference);
+
+            const auto& stats = rt.getWorkerStats();
+            REQUIRE(stats.size() == workers);
+            uint32_t tiles = 0;
+            for (const auto& worker : stats)
+            {
+                tiles += worker.tiles;
+                CHECK(worker.busyMs >= 0.0f);
+                CHECK(worker.idleMs >= 0.0f);
+            }
+            CHECK(tiles == 35);
+        }
+    }
+}
+
+TEST_CASE("adaptive sampling stops converged tiles and keeps sampling noisy ones")
+{
+    // Sky over the top half of the image (constant, converges at once) and a
+    // floor lit by a point light below (noisy)
+    std::vector<CPURaytracer::Triangle> tris;
+    tris.push_back(makeTri({-5, 0, -5}, {-5, 0, 5}, {5, 0, -5}));
+    tris.push_back(makeTri({5, 0, -5}, {-5, 0, 5}, {5, 0, 5}));
+
+    const glm::mat4 inverseVP = testCameraInverseVP();
+    auto setup = [&](CPURaytracer& rt)
+    {
+        rt.setGeometry(tris);
+        rt.resize(64, 64);
+        rt.setCamera({0.0f, 2.0f, -8.0f}, inverseVP);
+        rt.setPointLight({2.0f, 3.0f, -2.0f}, glm::vec3(10.0f), true);
+        rt.setEnvironmentColor({0.2f, 0.3f, 0.5f});
+    };
+
+    CPURaytracer reference;
+    setup(reference);
+    CPURaytracer adaptive;
+    setup(adaptive);
+    adaptive.setAdaptiveSampling(true);
+    adaptive.setAdaptiveThreshold(0.01f);
+    adaptive.setAdaptiveMinSamples(8);
+
+    for (int s = 0; s < 8; ++s)
+        adaptive.traceSample();
+    CHECK(adaptive.getConvergedTileFraction() > 0.25f);
+    CHECK_FALSE(adaptive.isConverged());
+
+    for (int s = 8; s < 64; ++s)
+        adaptive.traceSample();
+    for (int s = 0; s < 64; ++s)
+        reference.traceSample();
+    CHECK(adaptive.getSampleCount() == 64);
+
+    // Pass count vs per-pixel counts: sky pixels stopped at the minimum
+    const auto& counts = adaptive.getPixelSampleCounts();
+    CHECK(counts[0] == 8);
+    CHECK(*std::max_element(counts.begin(), counts.end()) == 64);
+    CHECK(reference.getPixelSampleCounts()[0] == 64);
+
+    // Each pixel is averaged over its own sample count
+    std::vector<float> a, b;
+    adaptive.getLinearHDR(a);
+    reference.getLinearHDR(b);
+    CHECK(a[0] == doctest::Approx(b[0]));
+    CHECK(a[2] == doctest::Approx(b[2]));
+    double sumA = 0.0, sumB = 0.0;
+    for (size_t i = 0; i < a.size(); ++i)
+    {
+        sumA += a[i];
+        sumB += b[i];
+    }
+    CHECK(sumA == doctest::Approx(sumB).epsilon(0.02));
+
+    std::vector<float> heat;
+    adaptive.getSampleCountHeatmap(heat);
+    CHECK(heat[2] > heat[0]); // few samples: blue
+}
+
+TEST_CASE("low-discrepancy samplers converge faster than PCG without bias")
+{
+    // Floor under a sky, half shadowed by a hovering quad: the soft shadow
+    // and the antialiased edges are the noise every sampler has to integrate
+    std::vector<CPURaytracer::Triangle> tris;
+    tris.push_back(makeTri({-5, 0, -5}, {-5, 0, 5}, {5, 0, -5}));
+    tris.push_back(makeTri({5, 0, -5}, {-5, 0, 5}, {5, 0, 5}));
+    tris.push_back(makeTri({-1, 0.6f, -1}, {-1, 0.6f, 1}, {1, 0.6f, -1}));
+    tris.push_back(makeTri({1, 0.6f, -1}, {-1, 0.6f, 1}, {1, 0.6f, 1}));
+
+    const glm::mat4 inverseVP = testCameraInverseVP();
+    auto render = [&](CPURaytracer::Sampler sampler, int samples, bool wavefront = false)
+    {
+        CPURaytracer rt;
+        rt.setWavefront(wavefront);
+        rt.setGeometry(tris);
+        rt.resize(32, 32);
+        rt.setCamera({0.0f, 2.0f, -5.0f}, inverseVP);
+        rt.setEnvironmentColor({0.6f, 0.7f, 0.9f});
+        rt.setMaxDepth(3);
+        rt.setSampler(sampler);
+        for (int s = 0; s < samples; ++s)
+            rt.traceSample();
+        std::vector<float> hdr;
+        rt.getLinearHDR(hdr);
+        return hdr;
+    };
+
+    const std::vector<float> reference = render(CPURaytracer::Sampler::PCG, 1024);
+    const std::vector<float> pcg       = render(CPURaytracer::Sampler::PCG, 16);
+    const std::vector<float> sobol     = render(CPURaytracer::Sampler::Sobol, 16);
+    const std::vector<float> blueNoise = render(CPURaytracer::Sampler::BlueNoise, 16);
+
+    // Same integral, a fraction of the error at equal samples per pixel
+    CHECK(meanSquaredError(sobol, reference) < 0.6 * meanSquaredError(pcg, reference));
+    CHECK(meanSquaredError(blueNoise, reference) < 0.75 * meanSquaredError(pcg, reference));
+    CHECK(imageMean(sobol) == doctest::Approx(imageMean(reference)).epsilon(0.005));
+    CHECK(imageMean(blueNoise) == doctest::Approx(imageMean(reference)).epsilon(0.005));
+
+    // Each bounce draws from the same dimensions in both integrators
+    CHECK(render(CPURaytracer::Sampler::Sobol, 4, true) == render(CPURaytracer::Sampler::Sobol, 4));
+}
+
+TEST_CASE("light BVH sampling is unbiased and beats the power CDF on many small emitters")
+{
+    // A floor under a 24x24 grid of small down-facing emitters spread far
+    // beyond the view: from any floor point only the few lights overhead matter
+    std::vector<CPURaytracer::Triangle> tris;
+    tris.push_back(makeTri({-30, 0, -30}, {-30, 0, 30}, {30, 0, -30}));
+    tris.push_back(makeTri({30, 0, -30}, {-30, 0, 30}, {30, 0, 30}));
+    for (int j = 0; j < 24; ++j)
+    {
+        for (int i = 0; i < 24; ++i)
+        {
+            const float x = -30.0f + 2.5f * (static_cast<float>(i) + 0.5f);
+            const float z = -30.0f + 2.5f * (static_cast<float>(j) + 0.5f);
+            auto a = makeTri({x, 1.5f, z}, {x + 0.3f, 1.5f, z}, {x, 1.5f, z + 0.3f});
+            auto b = makeTri({x + 0.3f, 1.5f, z}, {x + 0.3f, 1.5f, z + 0.3f}, {x, 1.5f, z + 0.3f});
+            a.emissive = b.emissive = glm::vec3(20.0f);
+            tris.push_back(a);
+            tris.push_back(b);
+        }
+    }
+
+    const glm::mat4 inverseVP = testCameraInverseVP();
+    CPURaytracer rt;
+    rt.setGeometry(tris);
+    rt.resize(32, 32);
+    rt.setCamera({0.0f, 2.0f, -5.0f}, inverseVP);
+    rt.setEnvironmentColor(glm::vec3(0.0f));
+    rt.setMaxDepth(2);
+    auto render = [&](bool lightBVH, int samples)
+    {
+        rt.setUseLightBVH(lightBVH);
+        rt.reset();
+        for (int s = 0; s < samples; ++s)
+            rt.traceSample();
+        std::vector<float> hdr;
+        rt.getLinearHDR(hdr);
+        return hdr;
+    };
+
+    const std::vector<float> reference = render(true, 256);
+    const std::vector<float> cdf       = render(false, 16);
+    const std::vector<float> tree      = render(true, 16);
+    CHECK(meanSquaredError(tree, reference) < 0.25 * meanSquaredError(cdf, reference));
+    CHECK(std::abs(imageMean(render(false, 256)) - imageMean(reference)) < 0.02 * imageMean(reference));
+
+    // The GPU export points every leaf at an emissive triangle
+    std::vector<CPURaytracer::Triangle> reordered;
+    rt.getReorderedTriangles(reordered);
+    const std::vector<LightBVHNode> nodes = rt.exportLightBVH();
+    CHECK(nodes.size() == 2 * 24 * 24 * 2 - 1);
+    uint32_t leaves = 0;
+    for (const auto& node : nodes)
+    {
+        if (!node.isLeaf())
+            continue;
+        ++leaves;
+        REQUIRE(node.childOrLight < reordered.size());
+        CHECK(reordered[node.childOrLight].emissive.x == 20.0f);
+    }
+    CHECK(leaves == 24 * 24 * 2);
+}
+
+TEST_CASE("spherical triangle sampling converges faster under a large close emitter")
+{
+    // A floor lit by a wide emitter just above it: area sampling spends most
+    // samples on far parts seen at grazing angles. The floor is only slightly
+    // rough so both strategies' MIS weights use exact BSDF pdfs.
+    std::vector<CPURaytracer::Triangle> tris;
+    tris.push_back(makeTri({-10, 0, -10}, {-10, 0, 10}, {10, 0, -10}));
+    tris.push_back(makeTri({10, 0, -10}, {-10, 0, 10}, {10, 0, 10}));
+    tris[0].roughness = tris[1].roughness = 0.2f;
+    auto panel = makeTri({-3, 0.3f, -3}, {5, 0.3f, -3}, {-3, 0.3f, 5});
+    panel.emissive = glm::vec3(4.0f);
+    tris.push_back(panel);
+
+    const glm::mat4 inverseVP = testCameraInverseVP();
+    CPURaytracer rt;
+    rt.setGeometry(tris);
+    rt.resize(32, 32);
+    rt.setCamera({0.0f, 2.0f, -5.0f}, inverseVP);
+    rt.setEnvironmentColor(glm::vec3(0.0f));
+    rt.setMaxDepth(2);
+    rt.setEnableAA(false);
+    auto render = [&](bool spherical, int samples)
+    {
+        rt.setSphericalLightSampling(spherical);
+        rt.reset();
+        for (int s = 0; s < samples; ++s)
+            rt.traceSample();
+        std::vector<float> hdr;
+        rt.getLinearHDR(hdr);
+        return hdr;
+    };
+
+    const std::vector<float> reference = render(true, 512);
+    const std::vector<float> area      = render(false, 16);
+    const std::vector<float> spherical = render(true, 16);
+    CHECK(meanSquaredError(spherical, reference) < 0.25 * meanSquaredError(area, reference));
+    CHECK(std::abs(imageMean(render(false, 512)) - imageMean(reference)) < 0.005 * imageMean(reference));
+}
+
+TEST_CASE("path guide samples the distribution its pdf describes")
+{
+    AABB bounds;
+    bounds.grow(glm::vec3(-1.0f));
+    bounds.grow(glm::vec3(1.0f));
+    PathGuide guide;
+    guide.reset(bounds);
+    CHECK_FALSE(guide.canSample(guide.regionAt(glm::vec3(0.0f))));
+
+    uint32_t state = 1u;
+    auto uniform = [&] { return nextRandom(state); };
+    auto sphere = [](float u1, float u2)
+    {
+        const float z = 1.0f - 2.0f * u1;
+        const float r = std::sqrt(std::max(0.0f, 1.0f - z * z));
+        return glm::vec3(r * std::cos(6.2831853f * u2), r * std::sin(6.2831853f * u2), z);
+    };
+
+    // Most of the light comes from a cone covering 5% of the sphere. A few
+    // iterations of 1, 2, 4, 8 passes refine the directional tree around it.
+    const glm::vec3 lobe = glm::normalize(glm::vec3(0.3f, 1.0f, 0.2f));
+    for (uint32_t iteration = 0; iteration < 4; ++iteration)
+    {
+        const uint32_t region = guide.regionAt(glm::vec3(0.0f));
+        for (int i = 0; i < 100000; ++i)
+        {
+            const glm::vec3 d = sphere(uniform(), uniform());
+            guide.record(region, d, glm::dot(d, lobe) > 0.9f ? 50.0f : 1.0f);
+        }
+        for (uint32_t pass = 0; pass < (1u << iteration); ++pass)
+            guide.endPass();
+    }
+    CHECK(guide.iteration() == 4);
+    CHECK(guide.regionCount() > 1);
+    const uint32_t region = guide.regionAt(glm::vec3(0.0f));
+    REQUIRE(guide.canSample(region));
+
+    // The pdf integrates to one over the sphere and puts most mass in the cone
+    const uint32_t grid = 512;
+    double integral = 0.0, lobeMass = 0.0;
+    for (uint32_t y = 0; y < grid; ++y)
+    {
+        for (uint32_t x = 0; x < grid; ++x)
+        {
+            const glm::vec3 d = sphere((x + 0.5f) / grid, (y + 0.5f) / grid);
+            const double pdf = guide.pdf(region, d);
+            integral += pdf;
+            if (glm::dot(d, lobe) > 0.9f)
+                lobeMass += pdf;
+        }
+    }
+    integral *= 4.0 * 3.14159265358979 / (grid * grid);
+    lobeMass *= 4.0 * 3.14159265358979 / (grid * grid);
+    CHECK(integral == doctest::Approx(1.0).epsilon(0.01));
+    CHECK(lobeMass > 0.6);
+
+    // Sampling lands in the cone as often as the pdf says
+    const uint32_t samples = 200000;
+    uint32_t inLobe = 0;
+    for (uint32_t s = 0; s < samples; ++s)
+    {
+        const glm::vec3 d = guide.sample(region, uniform(), uniform());
+        inLobe += glm::dot(d, lobe) > 0.9f ? 1u : 0u;
+    }
+    CHECK(std::abs(static_cast<double>(inLobe) / samples - lobeMass) < 0.01);
+
+    guide.reset(AABB{});
+    CHECK(guide.empty());
+    CHECK(guide.memoryBytes() == 0);
+}
+
+TEST_CASE("path guide memory limit stops the spatial tree growing")
+{
+    AABB bounds;
+    bounds.grow(glm::vec3(-1.0f));
+    bounds.grow(glm::vec3(1.0f));
+
+    uint32_t state = 7u;
+    auto uniform = [&] { return nextRandom(state); };
+
+    // Records spread over the whole box, enough to split the root several
+    // times per iteration; returns the region count after each iteration
+    auto grow = [&](PathGuide& guide)
+    {
+        guide.reset(bounds);
+        std::vector<uint32_t> regions;
+        for (uint32_t iteration = 0; iteration < 5; ++iteration)
+        {
+            for (int i = 0; i < 200000; ++i)
+            {
+                const glm::vec3 p(uniform() * 2.0f - 1.0f, uniform() * 2.0f - 1.0f, uniform() * 2.0f - 1.0f);
+                const glm::vec3 d(uniform() - 0.5f, uniform() - 0.5f, uniform() + 0.01f);
+                guide.record(guide.regionAt(p), glm::normalize(d), 1.0f + uniform());
+            }
+            for (uint32_t pass = 0; pass < (1u << iteration); ++pass)
+                guide.endPass();
+            CHECK(guide.memoryBytes() <= guide.getMemoryLimit());
+            regions.push_back(guide.regionCount());
+        }
+        return regions;
+    };
+
+    PathGuide unlimited;
+    const std::vector<uint32_t> unlimitedRegions = grow(unlimited);
+    PathGuide limited;
+    limited.setMemoryLimit(4096);
+    const std::vector<uint32_t> limitedRegions = grow(limited);
+
+    CHECK(limitedRegions.front() > 1);
+    CHECK(limitedRegions.back() < unlimitedRegions.back());
+    // Growth stops at the limit, short of what the records ask for
+    CHECK(limitedRegions[limitedRegions.size() - 2] == limitedRegions.back());
+}
+
+TEST_CASE("path guiding converges faster on light arriving through a bounce")
+{
+    // A floor under a ceiling with a small up-facing emitter just below it:
+    // the floor only sees the hot spot the emitter throws on the ceiling, a
+    // small target for BSDF sampling that NEE cannot reach.
+    std::vector<CPURaytracer::Triangle> tris;
+    tris.push_back(makeTri({-10, 0, -10}, {-10, 0, 10}, {10, 0, -10}, glm::vec3(0.8f)));
+    tris.push_back(makeTri({10, 0, -10}, {-10, 0, 10}, {10, 0, 10}, glm::vec3(0.8f)));
+    tris.push_back(makeTri({-10, 2, -10}, {10, 2, -10}, {-10, 2, 10}, glm::vec3(0.8f)));
+    tris.push_back(makeTri({10, 2, -10}, {10, 2, 10}, {-10, 2, 10}, glm::vec3(0.8f)));
+    for (auto& tri : tris)
+        tri.roughness = 0.2f;
+    auto emitter0 = makeTri({1.3f, 1.9f, -0.2f}, {1.3f, 1.9f, 0.2f}, {1.7f, 1.9f, -0.2f});
+    auto emitter1 = makeTri({1.7f, 1.9f, -0.2f}, {1.3f, 1.9f, 0.2f}, {1.7f, 1.9f, 0.2f});
+    emitter0.emissive = emitter1.emissive = glm::vec3(300.0f);
+    tris.push_back(emitter0);
+    tris.push_back(emitter1);
+
+    // Looking straight down at a 20 cm patch of the floor
+    glm::mat4 inverseVP(0.0f);
+    inverseVP[0] = glm::vec4(0.1f, 0.0f, 0.0f, 0.0f);
+    inverseVP[1] = glm::vec4(0.0f, 0.0f, 0.1f, 0.0f);
+    inverseVP[2] = glm::vec4(0.0f, -1.0f / 3.0f, 0.0f, -0.25f);
+    inverseVP[3] = glm::vec4(0.0f, 0.0f, 0.0f, 0.75f);
+    CPURaytracer rt;
+    rt.setGeometry(tris);
+    rt.resize(32, 32);
+    rt.setCamera({0.0f, 1.0f, 0.0f}, inverseVP);
+    rt.setEnvironmentColor(glm::vec3(0.0f));
+    rt.setMaxDepth(3);
+    rt.setEnableAA(false);
+    auto render = [&](bool guided, int samples)
+    {
+        rt.setPathGuiding(guided);
+        rt.reset();
+        for (int s = 0; s < samples; ++s)
+            rt.traceSample();
+        std::vector<float> hdr;
+        rt.getLinearHDR(hdr);
+        return hdr;
+    };
+
+    // Guiding only changes which directions are sampled, not the integral
+    const std::vector<float> reference = render(false, 1024);
+    CHECK(rt.getPathGuideMemoryBytes() == 0);
+    CHECK(std::abs(imageMean(render(true, 512)) - imageMean(reference)) < 0.02 * imageMean(reference));
+    CHECK(rt.getPathGuideRegionCount() > 1);
+
+    const std::vector<float> unguided = render(false, 32);
+    const std::vector<float> guided   = render(true, 32);
+    CHECK(meanSquaredError(guided, reference) < 0.7 * meanSquaredError(unguided, reference));
+
+    rt.setPathGuideMemoryLimit(4096);
+    render(true, 512);
+    CHECK(rt.getPathGuideRegionCount() > 0);
+    CHECK(rt.getPathGuideMemoryBytes() <= 4096);
+}
+
+TEST_CASE("alias tables reproduce their weights exactly")
+{
+    // Probability of each slot implied by a table: its own share plus what
+    // every other slot hands over to it
+    auto impliedPmf = [](const AliasTable::Entry* entries, size_t n)
+    {
+        std::vector<double> pmf(n, 0.0);
+        for (size_t i = 0; i < n; ++i)
+        {
+            pmf[i] += entries[i].threshold / static_cast<double>(n);
+            if (entries[i].threshold < 1.0f)
+                pmf[entries[i].alias] += (1.0 - entries[i].threshold) / static_cast<double>(n);
+        }
+        return pmf;
+    };
+
+    const std::vector<float> weights = { 0.0f, 3.0f, 0.5f, 0.0f, 9.0f, 1.0f, 1.0f, 0.25f, 5.0f };
+    AliasTable table;
+    table.build(weights);
+    const std::vector<double> pmf = impliedPmf(table.entries().data(), table.size());
+    for (size_t i = 0; i < weights.size(); ++i)
+        CHECK(std::abs(pmf[i] - weights[i] / 19.75) < 1e-6);
+
+    // Sampling matches, and the remapped side number stays uniform
+    std::vector<uint32_t> counts(weights.size(), 0);
+    uint32_t lowerHalf = 0;
+    const uint32_t samples = 200000;
+    for (uint32_t s = 0; s < samples; ++s)
+    {
+        float remapped;
+        const uint32_t i = table.sample((s + 0.5f) / samples, static_cast<float>((s * 7919u) % samples) / samples, &remapped);
+        ++counts[i];
+        lowerHalf += remapped < 0.5f ? 1u : 0u;
+    }
+    for (size_t i = 0; i < weights.size(); ++i)
+        CHECK(std::abs(counts[i] / static_cast<double>(samples) - pmf[i]) < 2e-3);
+    CHECK(std::abs(lowerHalf / static_cast<double>(samples) - 0.5) < 5e-3);
+
+    // Environment export: the marginal times each row's conditional gives
+    // luminance x sin(theta) per pixel, including a black row
+    const int W = 8, H = 4;
+    std::vector<float> env(W * H * 3, 0.0f);
+    for (int y = 0; y < H; ++y)
+        for (int x = 0; x < W; ++x)
+            for (int c = 0; c < 3; ++c)
+                env[(y * W + x) * 3 + c] = y == 2 ? 0.0f : 0.1f + static_cast<float>((x * 5 + y * 3 + c) % 7);
+    CPURaytracer rt;
+    rt.setEnvironmentMap(env.data(), W, H);
+    const std::vector<AliasTable::Entry> exported = rt.exportEnvAliasTables();
+    REQUIRE(exported.size() == static_cast<size_t>(H + W * H));
+
+    double total = 0.0;
+    std::vector<double> expected(W * H);
+    for (int y = 0; y < H; ++y)
+    {
+        const double sinTheta = std::sin(3.14159265358979 * (y + 0.5) / H);
+        for (int x = 0; x < W; ++x)
+        {
+            const float* p = &env[(y * W + x) * 3];
+            expected[y * W + x] = (0.2126 * p[0] + 0.7152 * p[1] + 0.0722 * p[2]) * sinTheta;
+            total += expected[y * W + x];
+        }
+    }
+    const std::vector<double> rows = impliedPmf(exported.data(), H);
+    for (int y = 0; y < H; ++y)
+    {
+        const std::vector<double> cols = impliedPmf(exported.data() + H + y * W, W);
+        for (int x = 0; x < W; ++x)
+            CHECK(std::abs(rows[y] * cols[x] - expected[y * W + x] / total) < 1e-6);
+    }
+}
+
+TEST_CASE("asynchronous sampling matches synchronous passes and cancels on changes")
+{
+    std::vector<CPURaytracer::Triangle> tris;
+    tris.push_back(makeTri({-5, 0, -5}, {-5, 0, 5}, {5, 0, -5}));
+    tris.push_back(makeTri({5, 0, -5}, {-5, 0, 5}, {5, 0, 5}));
+
+    glm::mat4 inverseVP = testCameraInverseVP();
+    auto setup = [&](CPURaytracer& rt)
+    {
+        rt.setGeometry(tris);
+        rt.resize(64, 48);
+        rt.setWorkerCount(3);
+        rt.setCamera({0.0f, 2.0f, -8.0f}, inverseVP);
+        rt.setPointLight({2.0f, 3.0f, -2.0f}, glm::vec3(10.0f), true);
+        rt.setEnvironmentColor({0.2f, 0.3f, 0.5f});
+    };
+    auto waitIdle = [](const CPURaytracer& rt)
+    {
+        while (rt.isSampling())
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    };
+
+    CPURaytracer sync;
+    setup(sync);
+    for (int s = 0; s < 6; ++s)
+        sync.traceSample();
+
+    CPURaytracer async;
+    setup(async);
+    async.traceSampleAsync(6);
+    waitIdle(async);
+    CHECK(async.getSampleCount() == 6);
+    std::vector<float> a, b;
+    async.getLinearHDR(a);
+    sync.getLinearHDR(b);
+    CHECK(a == b);
+
+    // Reached its limit: starting again does nothing until the limit moves
+    async.traceSampleAsync(6);
+    CHECK_FALSE(async.isSampling());
+    async.traceSampleAsync(8);
+    waitIdle(async);
+    CHECK(async.getSampleCount() == 8);
+
+    // Unlimited sampling runs until a change cancels it; the front frame
+    // only ever holds whole passes
+    async.reset();
+    async.traceSampleAsync();
+    while (async.getSampleCount() < 3)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    async.getLinearHDR(a);
+    CHECK(a.size() == 64 * 48 * 3);
+    inverseVP[3].x = 0.5f;
+    async.setCamera({0.5f, 2.0f, -8.0f}, inverseVP);
+    CHECK_FALSE(async.isSampling());
+    const uint32_t published = async.getSampleCount();
+    CHECK(published >= 3);
+    for (uint32_t count : async.getPixelSampleCounts())
+        CHECK(count == published);
+
+    async.reset();
+    CHECK(async.getSampleCount() == 0);
+    async.getLinearHDR(a);
+    CHECK(std::all_of(a.begin(), a.end(), [](float v) { return v == 0.0f; }));
+}
+
+TEST_CASE("time-budgeted sampling spreads passes over calls without changing the image")
+{
+    std::vector<CPURaytracer::Triangle> tris;
+    tris.push_back(makeTri({-5, 0, -5}, {-5, 0, 5}, {5, 0, -5}));
+    tris.push_back(makeTri({5, 0, -5}, {-5, 0, 5}, {5, 0, 5}));
+
+    const glm::mat4 inverseVP = testCameraInverseVP();
+    auto setup = [&](CPURaytracer& rt)
+    {
+        rt.setGeometry(tris);
+        rt.resize(64, 48); // 12 tiles
+        rt.setWorkerCount(2);
+        rt.setCamera({0.0f, 2.0f, -8.0f}, inverseVP);
+        rt.setPointLight({2.0f, 3.0f, -2.0f}, glm::vec3(10.0f), true);
+        rt.setEnvironmentColor({0.2f, 0.3f, 0.5f});
+    };
+
+    CPURaytracer sync;
+    setup(sync);
+    sync.traceSample();
+    sync.traceSample();
+
+    // A zero budget still traces one tile per worker and call
+    CPURaytracer budget;
+    setup(budget);
+    CHECK_FALSE(budget.traceSampleBudget(0.0f));
+    CHECK(budget.getSampleCount() == 0);
+    const auto partial = budget.getPixelSampleCounts();
+    const auto traced = std::count(partial.begin(), partial.end(), 1u);
+    CHECK(traced >= 2 * 16 * 16);
+    CHECK(traced < 64 * 48);
+    CHECK(budget.getRaysTraced() > 0);
+
+    int calls = 1;
+    while (budget.getSampleCount() < 2 && calls < 100)
+    {
+        budget.traceSampleBudget(0.0f);
+        ++calls;
+    }
+    CHECK(calls >= 6);
+    CHECK(budget.getSampleCount() == 2);
+    for (uint32_t count : budget.getPixelSampleCounts())
+        CHECK(count == 2);
+    std::vector<float> a, b;
+    budget.getLinearHDR(a);
+    sync.getLinearHDR(b);
+    CHECK(a == b);
+    CHECK(budget.getRaysTraced() == sync.getRaysTraced());
+
+    // A generous budget finishes a pass in one call
+    CHECK(budget.traceSampleBudget(1000.0f));
+    CHECK(budget.getSampleCount() == 3);
+
+    // A reset drops the paused pass
+    budget.traceSampleBudget(0.0f);
+    budget.reset();
+    CHECK(budget.getSampleCount() == 0);
+    CHECK(budget.getRaysTraced() == 0);
+    budget.traceSampleBudget(1000.0f);
+    budget.getLinearHDR(a);
+    CPURaytracer fresh;
+    setup(fresh);
+    fresh.traceSample();
+    fresh.getLinearHDR(b);
+    CHECK(a == b);
+}
+
+TEST_CASE("LBVH-built geometry returns the same closest hits as SAH")
+{
+    const std::vector<CPURaytracer::Triangle> tris = makeRandomTriangles(400, 31337u);
+    CPURaytracer sah;
+    sah.setGeometry(tris);
+    CPURaytracer lbvh;
+    BVHBuildOptions opts;
+    opts.builder = BVHBuilder::LBVH;
+    lbvh.setBVHBuildOptions(opts);
+    lbvh.setGeometry(tris);
+
+    const std::vector<Ray> rays = makeRandomRays(500, 31337u, {-2, -2, -15}, {2, 2, -15}, true);
+    const std::vector<HitRecord> expected = traceAll(sah, rays);
+    CHECK(countHits(expected) > 0);
+    CHECK(countHitMismatches(lbvh, rays, expected, false) == 0);
+}
+
+TEST_CASE("adoptBVH swaps a SAH tree in over an LBVH build")
+{
+    std::vector<CPURaytracer::Triangle> tris;
+    for (int i = 0; i < 300; ++i)
+    {
+        const float x = static_cast<float>(i % 20), y = static_cast<float>(i / 20);
+        tris.push_back(makeTri({x, y, 5.0f + 0.1f * x}, {x, y + 0.9f, 5.0f}, {x + 0.9f, y, 5.0f}));
+    }
+
+    CPURaytracer rt;
+    BVHBuildOptions opts;
+    opts.builder = BVHBuilder::LBVH;
+    rt.setBVHBuildOptions(opts);
+    rt.setGeometry(tris);
+    const Ray ray{ glm::vec3(3.2f, 4.2f, 0.0f), glm::vec3(0, 0, 1) };
+    const HitRecord before = rt.traceRay(ray);
+    REQUIRE(before.hit);
+
+    // What the scene cache does once edits pause: SAH over the current order
+    std::vector<CPURaytracer::Triangle> ordered;
+    rt.getReorderedTriangles(ordered);
+    std::vector<AABB> bounds(ordered.size());
+    for (size_t i = 0; i < ordered.size(); ++i)
+    {
+        bounds[i].grow(ordered[i].v0);
+        bounds[i].grow(ordered[i].v1);
+        bounds[i].grow(ordered[i].v2);
+    }
+    BVH sah;
+    sah.build(bounds);
+    const float sahCost = sah.sahCost();
+    rt.adoptBVH(std::move(sah));
+
+    CHECK(rt.getBVHSAHCost() == sahCost);
+    const HitRecord after = rt.traceRay(ray);
+    REQUIRE(after.hit);
+    CHECK(after.t == before.t);
+}
+
+TEST_CASE("geometry cache file round-trips and rejects another key")
+{
+    std::vector<CPURaytracer::Triangle> tris;
+    for (int i = 0; i < 200; ++i)
+    {
+        const float x = static_cast<float>(i % 20), y = static_cast<float>(i / 20);
+        tris.push_back(makeTri({x, y, 5.0f + 0.1f * y}, {x, y + 0.9f, 5.0f}, {x + 0.9f, y, 5.0f}));
+    }
+    tris[7].emissive = glm::vec3(4.0f);
+
+    CPURaytracer built;
+    built.setGeometry(tris);
+    const std::string path = (std::filesystem::temp_directory_path() / "vex_test_geometry.vgc").string();
+    REQUIRE(built.saveGeometryCache(path, 0x1234u));
+
+    CPURaytracer other;
+    CHECK_FALSE(other.loadGeometryCache(path, 0x4321u));
+    CHECK(other.getBVHNodeCount() == 0);
+    CHECK_FALSE(other.loadGeometryCache(path + ".missing", 0x1234u));
+
+    CPURaytracer loaded;
+    REQUIRE(loaded.loadGeometryCache(path, 0x1234u));
+    CHECK(loaded.getBVHNodeCount() == built.getBVHNodeCount());
+    CHECK(loaded.getBVHSAHCost() == built.getBVHSAHCost());
+    CHECK(loaded.getBVH().indices() == built.getBVH().indices());
+
+    std::vector<CPURaytracer::Triangle> a, b;
+    built.getReorderedTriangles(a);
+    loaded.getReorderedTriangles(b);
+    REQUIRE(a.size() == b.size());
+    bool same = true;
+    for (size_t i = 0; i < a.size(); ++i)
+        same = same && a[i].v0 == b[i].v0 && a[i].v2 == b[i].v2 && a[i].emissive == b[i].emissive;
+    CHECK(same);
+
+    for (float x : {0.3f, 4.5f, 11.2f, 19.6f})
+    {
+        const Ray ray{ glm::vec3(x, 3.3f, 0.0f), glm::vec3(0, 0, 1) };
+        const HitRecord ha = built.traceRay(ray);
+        const HitRecord hb = loaded.traceRay(ray);
+        REQUIRE(ha.hit == hb.hit);
+        CHECK(hb.t == ha.t);
+    }
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("refitGeometry traces moved triangles like a fresh build")
+{
+    CPURaytracer rt;
+    rt.setGeometry(makeRandomTriangles(200, 4242u));
+    const uint32_t nodeCount = rt.getBVHNodeCount();
+
+    // Shift every third triangle (in BVH order, as the scene cache stores them)
+    std::vector<CPURaytracer::Triangle> ordered;
+    rt.getReorderedTriangles(ordered);
+    std::vector<uint32_t> changed;
+    for (uint32_t i = 0; i < ordered.size(); i += 3)
+    {
+        const glm::vec3 offset(4.0f, -2.0f, 3.0f);
+        ordered[i].v0 += offset;
+        ordered[i].v1 += offset;
+        ordered[i].v2 += offset;
+        changed.push_back(i);
+    }
+
+    const float degradation = rt.refitGeometry(ordered, changed);
+    CHECK(degradation >= 1.0f);
+    CHECK(rt.getBVHNodeCount() == nodeCount);
+
+    CPURaytracer fresh;
+    fresh.setGeometry(ordered);
+
+    const std::vector<Ray> rays = makeRandomRays(500, 4242u, {-2, -2, -15}, {2, 2, -15}, true);
+    const std::vector<HitRecord> expected = traceAll(fresh, rays);
+    CHECK(countHits(expected) > 0);
+    CHECK(countHitMismatches(rt, rays, expected, false) == 0);
+}
+
+TEST_CASE("opacity micromaps keep the alpha test of the filtered texture")
+{
+    // 32x32 diffuse alpha: opaque columns, transparent columns and noise in
+    // between. The quad's UVs run over [0.2, 1.7] so the texture wraps once.
+    CPURaytracer::TextureData tex;
+    tex.width = tex.height = 32;
+    tex.pixels.assign(32 * 32 * 4, 255);
+    uint32_t state = 3u;
+    for (int y = 0; y < 32; ++y)
+    {
+        for (int x = 0; x < 32; ++x)
+        {
+            state = state * 1664525u + 1013904223u;
+            uint8_t alpha = x < 14 ? 255 : (x >= 18 ? 0 : static_cast<uint8_t>(state >> 24));
+            tex.pixels[(y * 32 + x) * 4 + 3] = alpha;
+        }
+    }
+
+    // Same filtering as CPURaytracer::sampleTexture, alpha channel only
+    auto referenceAlpha = [&](glm::vec2 uv)
+    {
+        float u = uv.x - std::floor(uv.x);
+        float v = 1.0f - (uv.y - std::floor(uv.y));
+        float fx = u * 32.0f, fy = v * 32.0f;
+        float wx = fx - std::floor(fx), wy = fy - std::floor(fy);
+        int x0 = std::clamp(static_cast<int>(fx), 0, 31), x1 = std::clamp(static_cast<int>(fx) + 1, 0, 31);
+        int y0 = std::clamp(static_cast<int>(fy), 0, 31), y1 = std::clamp(static_cast<int>(fy) + 1, 0, 31);
+        auto a = [&](int x, int y) { return tex.pixels[(y * 32 + x) * 4 + 3] / 255.0f; };
+        float top = a(x0, y0) + (a(x1, y0) - a(x0, y0)) * wx;
+        float bottom = a(x0, y1) + (a(x1, y1) - a(x0, y1)) * wx;
+        return top + (bottom - top) * wy;
+    };
+
+    auto quadTri = [](glm::vec3 a, glm::vec3 b, glm::vec3 c)
+    {
+        auto t = makeTri(a, b, c);
+        t.uv0 = { (a.x + 1.0f) * 0.75f + 0.2f, (a.y + 1.0f) * 0.75f + 0.2f };
+        t.uv1 = { (b.x + 1.0f) * 0.75f + 0.2f, (b.y + 1.0f) * 0.75f + 0.2f };
+        t.uv2 = { (c.x + 1.0f) * 0.75f + 0.2f, (c.y + 1.0f) * 0.75f + 0.2f };
+        t.textureIndex = 0;
+        t.alphaClip = true;
+        return t;
+    };
+    CPURaytracer rt;
+    rt.setGeometry({ quadTri({-1, -1, 5}, {-1, 1, 5}, {1, -1, 5}),
+                     quadTri({1, 1, 5}, {1, -1, 5}, {-1, 1, 5}) }, { tex });
+
+    const auto stats = rt.getOpacityMicromapStats();
+    CHECK(stats.triangles == 2);
+    CHECK(stats.opaque > 0);
+    CHECK(stats.transparent > 0);
+    CHECK(stats.mixed > 0);
+    CHECK(stats.opaque + stats.transparent + stats.mixed == 2 * 64);
+
+    int mismatches = 0, hits = 0, misses = 0;
+    for (int y = 0; y < 80; ++y)
+    {
+        for (int x = 0; x < 80; ++x)
+        {
+            const glm::vec2 p(-0.99f + 1.98f * (x + 0.5f) / 80.0f, -0.99f + 1.98f * (y + 0.5f) / 80.0f);
+            const float alpha = referenceAlpha((p + 1.0f) * 0.75f + 0.2f);
+            if (std::abs(alpha - 0.5f) < 0.01f)
+                continue; // too close to call across rounding differences
+            HitRecord h = rt.traceRay({ glm::vec3(p.x, p.y, 0.0f), glm::vec3(0, 0, 1) });
+            mismatches += h.hit != (alpha >= 0.5f);
+            (h.hit ? hits : misses)++;
+        }
+    }
+    CHECK(mismatches == 0);
+    CHECK(hits > 0);
+    CHECK(misses > 0);
+}
+
+TEST_CASE("instanced geometry traces like the flattened transformed triangles")
+{
+    const std::vector<CPURaytracer::Triangle> mesh = makeRandomTriangles(60, 777u, 4.0f, 2.0f);
+
+    // Translated, rotated + scaled, and mirrored placements of the same mesh
+    std::vector<glm::mat4> transforms(3, glm::mat4(1.0f));
+    transforms[0][3] = glm::vec4(-5.0f, 0.0f, 10.0f, 1.0f);
+    transforms[1][0] = glm::vec4(0.0f, 1.5f, 0.0f, 0.0f);
+    transforms[1][1] = glm::vec4(-1.5f, 0.0f, 0.0f, 0.0f);
+    transforms[1][2] = glm::vec4(0.0f, 0.0f, 1.5f, 0.0f);
+    transforms[1][3] = glm::vec4(1.0f, 2.0f, 12.0f, 1.0f);
+    transforms[2][0] = glm::vec4(-1.0f, 0.0f, 0.0f, 0.0f);
+    transforms[2][3] = glm::vec4(5.0f, -1.0f, 9.0f, 1.0f);
+
+    std::vector<CPURaytracer::Triangle> flat;
+    std::vector<CPURaytracer::Instance> instances;
+    for (const auto& m : transforms)
+    {
+        for (const auto& t : mesh)
+        {
+            flat.push_back(makeTri(glm::vec3(m * glm::vec4(t.v0, 1.0f)),
+                                   glm::vec3(m * glm::vec4(t.v1, 1.0f)),
+                                   glm::vec3(m * glm::vec4(t.v2, 1.0f))));
+        }
+        instances.push_back({ 0, m });
+    }
+
+    CPURaytracer reference;
+    reference.setGeometry(flat);
+    CPURaytracer rt;
+    rt.setInstancedGeometry({ mesh }, instances);
+    REQUIRE(rt.isInstanced());
+    CHECK(rt.getInstanceCount() == 3);
+    CHECK(rt.getMeshCount() == 1);
+    // Three placements share one copy of the triangles
+    CHECK(rt.getTriangleMemoryBytes() * 2 < reference.getTriangleMemoryBytes());
+
+    int hits = 0;
+    for (const Ray& ray : makeRandomRays(500, 777u, {-5, -3, -5}, {5, 3, -5}, true))
+    {
+        HitRecord a = reference.traceRay(ray);
+        HitRecord b = rt.traceRay(ray);
+        REQUIRE(a.hit == b.hit);
+        if (a.hit)
+        {
+            CHECK(b.t == doctest::Approx(a.t).epsilon(1e-4));
+            CHECK(glm::dot(a.geometricNormal, b.geometricNormal) > 0.999f);
+            CHECK(glm::length(b.position - a.position) < 1e-3f);
+            ++hits;
+        }
+    }
+    CHECK(hits > 0);
+}
+
+TEST_CASE("setInstanceTransforms moves instances without touching the meshes")
+{
+    // Facing -z, centred on the z axis
+    std::vector<CPURaytracer::Triangle> mesh = {
+        makeTri({-1, -1, 0}, {0, 1, 0}, {1, -1, 0})
+    };
+    glm::mat4 atFive(1.0f);
+    atFive[3] = glm::vec4(0.0f, 0.0f, 5.0f, 1.0f);
+
+    CPURaytracer rt;
+    rt.setInstancedGeometry({ mesh }, { { 0, atFive } });
+    const size_t triBytes = rt.getTriangleMemoryBytes();
+
+    Ray ray{ glm::vec3(0.0f), glm::vec3(0, 0, 1) };
+    HitRecord hit = rt.traceRay(ray);
+    REQUIRE(hit.hit);
+    CHECK(hit.t == doctest::Approx(5.0f));
+
+    glm::mat4 aside(1.0f);
+    aside[3] = glm::vec4(10.0f, 0.0f, 5.0f, 1.0f);
+    rt.setInstanceTransforms({ aside });
+    CHECK_FALSE(rt.traceRay(ray).hit);
+
+    glm::mat4 further(1.0f);
+    further[3] = glm::vec4(0.0f, 0.0f, 8.0f, 1.0f);
+    rt.setInstanceTransforms({ further });
+    hit = rt.traceRay(ray);
+    REQUIRE(hit.hit);
+    CHECK(hit.t == doctest::Approx(8.0f));
+    CHECK(rt.getTriangleMemoryBytes() == triBytes);
+}
+
+TEST_CASE("instanced hits report the placement they landed on")
+{
+    std::vector<CPURaytracer::Triangle> mesh = {
+        makeTri({-1, -1, 0}, {0, 1, 0}, {1, -1, 0})
+    };
+    std::vector<CPURaytracer::Instance> instances(3);
+    for (int i = 0; i < 3; ++i)
+        instances[i].transform[3] = glm::vec4(4.0f * static_cast<float>(i - 1), 0.0f, 5.0f, 1.0f);
+
+    CPURaytracer rt;
+    rt.setInstancedGeometry({ mesh }, instances);
+    for (uint32_t i = 0; i < 3; ++i)
+    {
+        Ray ray{ glm::vec3(4.0f * static_cast<float>(i) - 4.0f, 0.0f, 0.0f), glm::vec3(0, 0, 1) };
+        HitRecord hit = rt.traceRay(ray);
+        REQUIRE(hit.hit);
+        CHECK(hit.instanceIndex == i);
+    }
+
+    CPURaytracer flat;
+    flat.setGeometry(mesh);
+    HitRecord hit = flat.traceRay({ glm::vec3(0.0f, 0.0f, -5.0f), glm::vec3(0, 0, 1) });
+    REQUIRE(hit.hit);
+    CHECK(hit.instanceIndex == UINT32_MAX);
+}
+
 } // TEST_SUITE("CPURaytracer")
 
 // ── intersectTriangle (via traceRay) ─────────────────────────────────────────
@@ -229,4 +1565,22 @@ TEST_CASE("two overlapping triangles: nearest hit returned")
     CHECK(h.t == doctest::Approx(5.0f).epsilon(1e-4f));
 }
 
+TEST_CASE("surface attributes are interpolated from the nearest triangle")
+{
+    // The far triangle is listed first, so it is a candidate before the near one
+    auto far  = makeTri({0,0,10}, {0,1,10}, {1,0,10});
+    far.uv0 = far.uv1 = far.uv2 = {9.0f, 9.0f};
+    far.n0 = far.n1 = far.n2 = {1, 0, 0};
+    auto near = frontTri();
+    near.uv0 = {0, 0}; near.uv1 = {0, 1}; near.uv2 = {1, 0};
+    CPURaytracer rt;
+    rt.setGeometry({far, near});
+    vex::HitRecord h = rt.traceRay({{0.3f, 0.2f, 0.0f}, {0,0,1}});
+    REQUIRE(h.hit);
+    CHECK(h.t == doctest::Approx(5.0f).epsilon(1e-4f));
+    CHECK(h.uv.x == doctest::Approx(0.3f).epsilon(1e-4f));
+    CHECK(h.uv.y == doctest::Approx(0.2f).epsilon(1e-4f));
+    CHECK(h.normal.z == doctest::Approx(-1.0f).epsilon(1e-4f));
+}
+
 } // TEST_SUITE("intersectTriangle")